@@ -34,162 +34,490 @@ namespace FallbackLayer
         return fabs(a - b) < TEST_EPSILON;
     }
 
-    bool BvhValidator::IsVertexEqual(const BvhValidator::Vertex &vertex1, const BvhValidator::Vertex &vertex2)
-    {
-        return IsFloatEqual(vertex1.x, vertex2.x) &&
-            IsFloatEqual(vertex1.y, vertex2.y) &&
-            IsFloatEqual(vertex1.z, vertex2.z);
-    }
-
-    bool BvhValidator::IsVertexContainedByAABB(const AABB &aabb, const BvhValidator::Vertex &v)
-    {
-        return v.x + TEST_EPSILON >= aabb.min.x &&
-            v.y + TEST_EPSILON >= aabb.min.y &&
-            v.z + TEST_EPSILON >= aabb.min.z &&
-            v.x - TEST_EPSILON <= aabb.max.x &&
-            v.y - TEST_EPSILON <= aabb.max.y &&
-            v.z - TEST_EPSILON <= aabb.max.z;
-    }
-
     bool IsChildNodeIndexValid(UINT nodeIndex)
     {
         return nodeIndex != 0;
     }
 
-    bool BvhValidator::VerifyBVHOutput(
-        std::vector<LeafNodePtr> &pExpectedLeafNodes,
-        const BYTE *pOutputCpuData,
-        std::wstring &errorMessage)
+    namespace
     {
-#define ThrowError(msg) errorMessage = msg; throw false;
-#define ThrowErrorIfFalse(exp, msg) if(!(exp)) {ThrowError(msg);}
+        struct Vertex
+        {
+            float x, y, z;
+        };
 
-        try
+        struct TriangleLeafNode
+        {
+            Vertex v0, v1, v2;
+        };
+
+        bool IsVertexEqual(const Vertex &vertex1, const float3 &vertex2)
+        {
+            return IsFloatEqual(vertex1.x, vertex2.x) &&
+                IsFloatEqual(vertex1.y, vertex2.y) &&
+                IsFloatEqual(vertex1.z, vertex2.z);
+        }
+
+        bool IsVertexContainedByAABB(const AABB &aabb, const Vertex &v)
+        {
+            return v.x + TEST_EPSILON >= aabb.min.x &&
+                v.y + TEST_EPSILON >= aabb.min.y &&
+                v.z + TEST_EPSILON >= aabb.min.z &&
+                v.x - TEST_EPSILON <= aabb.max.x &&
+                v.y - TEST_EPSILON <= aabb.max.y &&
+                v.z - TEST_EPSILON <= aabb.max.z;
+        }
+
+        bool IsTriangleEqual(const TriangleLeafNode &triangle, const Triangle &outputTriangle)
+        {
+            return IsVertexEqual(triangle.v0, outputTriangle.v0) &&
+                IsVertexEqual(triangle.v1, outputTriangle.v1) &&
+                IsVertexEqual(triangle.v2, outputTriangle.v2);
+        }
+
+        bool IsTriangleContainedByBox(const TriangleLeafNode &triangle, const AABB &box)
         {
-            // Given the list of triangles used to construct the BVH,
-            // go through the tree layer by layer (breadth-first) ensuring that:
-            // 1. The child nodes are contained in the parent node
-            // 2. All leaves must be able to fit within at least one of the AABBs at that level 
-            //    (unless that leaf's node has already been found)
-
-            const UINT verticesPerTriangle = 3;
-            const UINT floatsPerVertex = 3;
-            for (auto &pLeaf : pExpectedLeafNodes)
+            return IsVertexContainedByAABB(box, triangle.v0) &&
+                IsVertexContainedByAABB(box, triangle.v1) &&
+                IsVertexContainedByAABB(box, triangle.v2);
+        }
+
+        AABB IntersectAABB(const AABB &a, const AABB &b)
+        {
+            AABB intersection;
+            intersection.min = max(a.min, b.min);
+            intersection.max = min(a.max, b.max);
+            return intersection;
+        }
+
+        float ComputeBoxSurfaceArea(const AABB &box)
+        {
+            const float3 extents = box.max - box.min;
+            return 2.0f * (extents.x * extents.y + extents.x * extents.z + extents.y * extents.z);
+        }
+
+        float ComputeBoxVolume(const AABB &box)
+        {
+            const float3 extents = box.max - box.min;
+            if (extents.x <= 0.0f || extents.y <= 0.0f || extents.z <= 0.0f)
             {
-                pLeaf->LeafFound = false;
+                return 0.0f;
             }
+            return extents.x * extents.y * extents.z;
+        }
 
-            BVHOffsets offsets = *(BVHOffsets*)pOutputCpuData;
-            AABBNode *pNodeArray = (AABBNode*)((BYTE *)pOutputCpuData + offsets.offsetToBoxes);
-            Primitive *pPrimitiveArray = (Primitive*)((BYTE *)pOutputCpuData + offsets.offsetToVertices);
+        float ComputeOverlapSurfaceArea(const AABB &a, const AABB &b)
+        {
+            const AABB intersection = IntersectAABB(a, b);
+            if (intersection.min.x > intersection.max.x ||
+                intersection.min.y > intersection.max.y ||
+                intersection.min.z > intersection.max.z)
+            {
+                return 0.0f;
+            }
+            return ComputeBoxSurfaceArea(intersection);
+        }
+
+        // Thrown from any of the subtree tasks, Concurrency::parallel_invoke
+        // cancels the remaining ones and rethrows it to the caller
+        struct BvhValidationError
+        {
+            const wchar_t *pMessage;
+        };
 
-            std::deque<AABBNode*> nodeQueue;
+#define ThrowErrorIfFalse(exp, msg) if(!(exp)) {throw BvhValidationError{msg};}
 
-            nodeQueue.push_back(&pNodeArray[0]);
-            UINT nodesInLevel = 1;
-            while (nodeQueue.size())
+        // Accumulated separately by each subtree walked in parallel and merged
+        // once the subtree is done
+        struct BvhWalkStatistics
+        {
+            struct Level
             {
-                AABBNode *pCompressedNode = nodeQueue.front();
-                nodeQueue.pop_front();
-                nodesInLevel--;
-                bool bProcessedLastNodeInCurrentLevel = nodesInLevel == 0;
+                UINT NumInternalNodes = 0;
+                UINT NumLeaves = 0;
+                double SiblingOverlapSum = 0.0;
+                UINT NumNodesWithArea = 0;
+                double EmptySpaceSum = 0.0;
+                UINT NumNodesWithVolume = 0;
+            };
+
+            std::vector<Level> Levels;
+            std::vector<UINT> LeafSizeHistogram;
+            double SahCost = 0.0;
+            UINT NumPrimitives = 0;
+
+            Level &GetLevel(UINT depth)
+            {
+                if (depth >= Levels.size())
+                {
+                    Levels.resize(depth + 1);
+                }
+                return Levels[depth];
+            }
 
-                AABB parentAABB;
-                FallbackLayer::DecompressAABB(parentAABB, *pCompressedNode);
+            void AddInternalNode(UINT depth, const AABB &box, const AABB &leftBox, const AABB &rightBox)
+            {
+                Level &level = GetLevel(depth);
+                level.NumInternalNodes++;
 
-                const bool bIsLeaf = pCompressedNode->leaf;
+                const float area = ComputeBoxSurfaceArea(box);
+                SahCost += area;
+                if (area > 0.0f)
+                {
+                    level.SiblingOverlapSum += ComputeOverlapSurfaceArea(leftBox, rightBox) / area;
+                    level.NumNodesWithArea++;
+                }
 
-                for (auto &pLeaf : pExpectedLeafNodes)
+                const float volume = ComputeBoxVolume(box);
+                if (volume > 0.0f)
                 {
-                    if (pLeaf->IsContainedByBox(parentAABB))
-                    {
-                        pLeaf->LeafFound = true;
-                    }
+                    const float coveredVolume = ComputeBoxVolume(leftBox) + ComputeBoxVolume(rightBox) -
+                        ComputeBoxVolume(IntersectAABB(leftBox, rightBox));
+                    level.EmptySpaceSum += std::max(0.0f, 1.0f - coveredVolume / volume);
+                    level.NumNodesWithVolume++;
                 }
+            }
 
-                if (!bIsLeaf)
+            void AddLeaf(UINT depth, const AABB &box, UINT numPrimitives)
+            {
+                GetLevel(depth).NumLeaves++;
+                if (numPrimitives >= LeafSizeHistogram.size())
                 {
-                    {
-                        ThrowErrorIfFalse(IsChildNodeIndexValid(pCompressedNode->internalNode.leftNodeIndex), L"Circular referance to root node");
-                        AABBNode *pLeftNode = &pNodeArray[pCompressedNode->internalNode.leftNodeIndex];
-                        AABB leftAABB;
-                        FallbackLayer::DecompressAABB(leftAABB, *pLeftNode);
-                        ThrowErrorIfFalse(IsChildContainedByParent(parentAABB, leftAABB), L"AABB not contained by parent");
+                    LeafSizeHistogram.resize(numPrimitives + 1);
+                }
+                LeafSizeHistogram[numPrimitives]++;
+                SahCost += ComputeBoxSurfaceArea(box) * numPrimitives;
+                NumPrimitives += numPrimitives;
+            }
 
-                        nodeQueue.push_back(pLeftNode);
-                    }
+            void Merge(const BvhWalkStatistics &other)
+            {
+                for (UINT depth = 0; depth < other.Levels.size(); depth++)
+                {
+                    Level &level = GetLevel(depth);
+                    const Level &otherLevel = other.Levels[depth];
+                    level.NumInternalNodes += otherLevel.NumInternalNodes;
+                    level.NumLeaves += otherLevel.NumLeaves;
+                    level.SiblingOverlapSum += otherLevel.SiblingOverlapSum;
+                    level.NumNodesWithArea += otherLevel.NumNodesWithArea;
+                    level.EmptySpaceSum += otherLevel.EmptySpaceSum;
+                    level.NumNodesWithVolume += otherLevel.NumNodesWithVolume;
+                }
 
-                    {
-                        UINT rightNodeIndex = pCompressedNode->rightNodeIndex;
-      
-                        ThrowErrorIfFalse(IsChildNodeIndexValid(rightNodeIndex), L"Circular referance to root node");
-                        AABBNode *pRightNode = &pNodeArray[rightNodeIndex];
-                        AABB rightAABB;
-                        FallbackLayer::DecompressAABB(rightAABB, *pRightNode);
-                        ThrowErrorIfFalse(IsChildContainedByParent(parentAABB, rightAABB), L"AABB not contained by parent");
-
-                        nodeQueue.push_back(pRightNode);
-                    }
+                if (other.LeafSizeHistogram.size() > LeafSizeHistogram.size())
+                {
+                    LeafSizeHistogram.resize(other.LeafSizeHistogram.size());
                 }
-                else
+                for (UINT i = 0; i < other.LeafSizeHistogram.size(); i++)
                 {
-                    // TODO: Hacky way to use the same code path for both bottom and top level
-                    // BVHs. Doing the triangle calculations for both paths, should 
-                    UINT firstTriangleId = pCompressedNode->leafNode.firstTriangleId;
-                    UINT numTriangles = 1; // pCompressedNode->numTriangles;
-                    ThrowErrorIfFalse(numTriangles > 0, L"Invalid value for numTriangles");
+                    LeafSizeHistogram[i] += other.LeafSizeHistogram[i];
+                }
 
-                    for (UINT triangleId = firstTriangleId; triangleId < firstTriangleId + numTriangles; triangleId++)
+                SahCost += other.SahCost;
+                NumPrimitives += other.NumPrimitives;
+            }
+
+            void FillReport(float rootArea, BvhQualityReport &report) const
+            {
+                report = BvhQualityReport();
+                report.SahCost = rootArea > 0.0f ? (float)(SahCost / rootArea) : 0.0f;
+                report.NumPrimitives = NumPrimitives;
+                report.MaxDepth = Levels.size() ? (UINT)Levels.size() - 1 : 0;
+                report.LeafSizeHistogram = LeafSizeHistogram;
+
+                double siblingOverlapSum = 0.0, emptySpaceSum = 0.0;
+                UINT numNodesWithArea = 0, numNodesWithVolume = 0;
+                for (const Level &level : Levels)
+                {
+                    BvhLevelStatistics levelStatistics;
+                    levelStatistics.NumInternalNodes = level.NumInternalNodes;
+                    levelStatistics.NumLeaves = level.NumLeaves;
+                    if (level.NumNodesWithArea)
                     {
-                        Primitive *pTriangle = &pPrimitiveArray[triangleId];
-                        for (int j = (int)pExpectedLeafNodes.size() - 1; j >= 0; j--)
-                        {
-                            if (pExpectedLeafNodes[j]->IsLeafEqual((void *)pTriangle, parentAABB))
-                            {
-                                pExpectedLeafNodes.erase(pExpectedLeafNodes.begin() + j);
-                            }
-                        }
+                        levelStatistics.SiblingOverlapRatio = (float)(level.SiblingOverlapSum / level.NumNodesWithArea);
                     }
+                    if (level.NumNodesWithVolume)
+                    {
+                        levelStatistics.EmptySpaceRatio = (float)(level.EmptySpaceSum / level.NumNodesWithVolume);
+                    }
+                    report.Levels.push_back(levelStatistics);
+
+                    report.NumNodes += level.NumInternalNodes + level.NumLeaves;
+                    report.NumLeaves += level.NumLeaves;
+                    siblingOverlapSum += level.SiblingOverlapSum;
+                    numNodesWithArea += level.NumNodesWithArea;
+                    emptySpaceSum += level.EmptySpaceSum;
+                    numNodesWithVolume += level.NumNodesWithVolume;
+                }
 
+                if (numNodesWithArea)
+                {
+                    report.SiblingOverlapRatio = (float)(siblingOverlapSum / numNodesWithArea);
+                }
+                if (numNodesWithVolume)
+                {
+                    report.EmptySpaceRatio = (float)(emptySpaceSum / numNodesWithVolume);
                 }
+            }
+        };
+
+        // Walks the tree once depth-first, forking the two children of every
+        // node in the top levels into parallel tasks. Each node is only
+        // checked against its parent and each primitive against the
+        // intersection of its ancestors' boxes, and LeafVerifier matches a
+        // primitive to the expected input in O(1), so the whole walk is linear
+        // in the size of the tree.
+        template<typename LeafVerifier>
+        class BvhWalker
+        {
+        public:
+            BvhWalker(const BYTE *pBvhData, bool bIsTopLevel, LeafVerifier &leafVerifier) :
+                m_bIsTopLevel(bIsTopLevel), m_leafVerifier(leafVerifier)
+            {
+                const BVHOffsets &offsets = *(const BVHOffsets *)pBvhData;
+                m_pNodes = (const AABBNode *)(pBvhData + offsets.offsetToBoxes);
+                m_numNodes = (offsets.offsetToVertices - offsets.offsetToBoxes) / sizeof(AABBNode);
+            }
 
-                // If a whole level has been traversed, verify
-                // that all triangles have been accounted for
-                if (bProcessedLastNodeInCurrentLevel)
+            void Walk(BvhQualityReport &report)
+            {
+                ThrowErrorIfFalse(m_numNodes > 0, L"BVH doesn't have a root node");
+
+                const AABBNode &root = m_pNodes[0];
+                AABB rootBox;
+                DecompressAABB(rootBox, root);
+
+                // Top levels without instances are a single node with no children
+                const bool bIsEmptyTopLevel = m_bIsTopLevel && !root.leaf &&
+                    root.internalNode.leftNodeIndex == 0 && root.rightNodeIndex == 0;
+                if (!bIsEmptyTopLevel)
                 {
-                    for (auto &pLeaf : pExpectedLeafNodes)
+                    m_nodeVisited.resize(m_numNodes, 0);
+                    m_nodeVisited[0] = 1;
+                    WalkSubtree(0, rootBox, 0);
+                }
+
+                m_statistics.FillReport(ComputeBoxSurfaceArea(rootBox), report);
+            }
+
+        private:
+            // Subtrees below this depth are walked serially, up to 2^10 tasks
+            // is plenty to keep every core busy
+            static const UINT ParallelDepth = 10;
+
+            struct StackEntry
+            {
+                UINT NodeIndex;
+                UINT Depth;
+
+                // Intersection of the node's box and all of its ancestors' boxes
+                AABB Bounds;
+            };
+
+            void VisitChild(UINT nodeIndex, const AABB &parentBox, AABB &childBox)
+            {
+                ThrowErrorIfFalse(IsChildNodeIndexValid(nodeIndex), L"Circular referance to root node");
+                ThrowErrorIfFalse(nodeIndex < m_numNodes, L"Child node index is past the end of the node array");
+                ThrowErrorIfFalse(InterlockedExchange(&m_nodeVisited[nodeIndex], 1) == 0, L"Node is referenced by more than one parent");
+
+                DecompressAABB(childBox, m_pNodes[nodeIndex]);
+                ThrowErrorIfFalse(IsChildContainedByParent(parentBox, childBox), L"AABB not contained by parent");
+            }
+
+            void WalkSubtree(UINT subtreeRootIndex, const AABB &subtreeBounds, UINT subtreeDepth)
+            {
+                BvhWalkStatistics statistics;
+                std::vector<StackEntry> stack;
+                stack.push_back({ subtreeRootIndex, subtreeDepth, subtreeBounds });
+                while (stack.size())
+                {
+                    const StackEntry entry = stack.back();
+                    stack.pop_back();
+
+                    const AABBNode &node = m_pNodes[entry.NodeIndex];
+                    AABB box;
+                    DecompressAABB(box, node);
+
+                    if (node.leaf)
                     {
-                        if (!pLeaf->LeafFound)
+                        // Top level leaves always reference a single instance.
+                        // An empty bottom level is a root leaf with no primitives.
+                        const UINT numPrimitives = m_bIsTopLevel ? 1 : node.numTriangles;
+                        ThrowErrorIfFalse(numPrimitives > 0 || entry.NodeIndex == 0, L"Invalid value for numTriangles");
+
+                        const UINT firstPrimitive = node.leafNode.firstTriangleId;
+                        for (UINT i = 0; i < numPrimitives; i++)
                         {
-                            ThrowError(L"One of the BVH levels has AABBs that can't contain one of the leaf nodes");
+                            m_leafVerifier.VerifyPrimitive(firstPrimitive + i, box, entry.Bounds);
                         }
-
-                        // Reset the flags after verification
-                        pLeaf->LeafFound = false;
+                        statistics.AddLeaf(entry.Depth, box, numPrimitives);
                     }
-                    nodesInLevel = static_cast<UINT>(nodeQueue.size());
+                    else
+                    {
+                        const UINT leftNodeIndex = node.internalNode.leftNodeIndex;
+                        const UINT rightNodeIndex = node.rightNodeIndex;
+                        AABB leftBox, rightBox;
+                        VisitChild(leftNodeIndex, box, leftBox);
+                        VisitChild(rightNodeIndex, box, rightBox);
+                        statistics.AddInternalNode(entry.Depth, box, leftBox, rightBox);
+
+                        const StackEntry left = { leftNodeIndex, entry.Depth + 1, IntersectAABB(entry.Bounds, leftBox) };
+                        const StackEntry right = { rightNodeIndex, entry.Depth + 1, IntersectAABB(entry.Bounds, rightBox) };
+                        if (entry.Depth < ParallelDepth)
+                        {
+                            Concurrency::parallel_invoke(
+                                [&] { WalkSubtree(left.NodeIndex, left.Bounds, left.Depth); },
+                                [&] { WalkSubtree(right.NodeIndex, right.Bounds, right.Depth); });
+                        }
+                        else
+                        {
+                            stack.push_back(left);
+                            stack.push_back(right);
+                        }
+                    }
+                }
+
+                std::lock_guard<std::mutex> lock(m_statisticsMutex);
+                m_statistics.Merge(statistics);
+            }
+
+            const bool m_bIsTopLevel;
+            LeafVerifier &m_leafVerifier;
+            const AABBNode *m_pNodes;
+            UINT m_numNodes;
+            std::vector<LONG> m_nodeVisited;
+
+            std::mutex m_statisticsMutex;
+            BvhWalkStatistics m_statistics;
+        };
+
+        class NullLeafVerifier
+        {
+        public:
+            void VerifyPrimitive(UINT, const AABB &, const AABB &) {}
+        };
+
+        // Flags expected leaves as they're found so that both missing leaves
+        // and leaves referenced twice are reported
+        class ExpectedLeafTracker
+        {
+        public:
+            ExpectedLeafTracker(UINT numExpectedLeaves) : m_leafFound(numExpectedLeaves, 0) {}
+
+            void MarkFound(UINT expectedLeafIndex)
+            {
+                ThrowErrorIfFalse(InterlockedExchange(&m_leafFound[expectedLeafIndex], 1) == 0, L"One of the expected leaves is referenced by more than one leaf node");
+            }
+
+            void VerifyAllLeavesFound() const
+            {
+                for (LONG bLeafFound : m_leafFound)
+                {
+                    ThrowErrorIfFalse(bLeafFound, L"Didn't find a leaf node for one or more of the expected leaves");
                 }
             }
-            ThrowErrorIfFalse(pExpectedLeafNodes.size() == 0, L"Didn't find a leaf node for one or more of the expected leaves");
+
+        private:
+            std::vector<LONG> m_leafFound;
+        };
+
+        // Bottom level primitives are matched to the input through their
+        // PrimitiveMetaData. Expected triangles are laid out geometry after
+        // geometry, geometryOffsets[i] being the first triangle of geometry i
+        // and geometryOffsets.back() the total triangle count.
+        class TriangleLeafVerifier : public ExpectedLeafTracker
+        {
+        public:
+            TriangleLeafVerifier(
+                const BYTE *pBvhData,
+                const std::vector<TriangleLeafNode> &expectedTriangles,
+                const std::vector<UINT> &geometryOffsets) :
+                ExpectedLeafTracker((UINT)expectedTriangles.size()),
+                m_expectedTriangles(expectedTriangles),
+                m_geometryOffsets(geometryOffsets)
+            {
+                const BVHOffsets &offsets = *(const BVHOffsets *)pBvhData;
+                m_pPrimitives = (const Primitive *)(pBvhData + offsets.offsetToVertices);
+                m_pMetadata = (const PrimitiveMetaData *)(pBvhData + offsets.offsetToPrimitiveMetaData);
+                m_numPrimitives = (offsets.offsetToPrimitiveMetaData - offsets.offsetToVertices) / sizeof(Primitive);
+            }
+
+            void VerifyPrimitive(UINT primitiveIndex, const AABB &leafBox, const AABB &ancestorBounds)
+            {
+                UNREFERENCED_PARAMETER(leafBox);
+                ThrowErrorIfFalse(primitiveIndex < m_numPrimitives, L"Leaf references a primitive past the end of the primitive array");
+
+                const PrimitiveMetaData &metadata = m_pMetadata[primitiveIndex];
+                const UINT geometryIndex = metadata.GeometryContributionToHitGroupIndex;
+                ThrowErrorIfFalse(geometryIndex + 1 < m_geometryOffsets.size(), L"Invalid geometry index in the primitive metadata");
+                const UINT expectedLeafIndex = m_geometryOffsets[geometryIndex] + metadata.PrimitiveIndex;
+                ThrowErrorIfFalse(expectedLeafIndex < m_geometryOffsets[geometryIndex + 1], L"Invalid primitive index in the primitive metadata");
+
+                const TriangleLeafNode &expectedTriangle = m_expectedTriangles[expectedLeafIndex];
+                ThrowErrorIfFalse(IsTriangleEqual(expectedTriangle, m_pPrimitives[primitiveIndex].triangle), L"Leaf triangle doesn't match the input triangle referenced by its metadata");
+                ThrowErrorIfFalse(IsTriangleContainedByBox(expectedTriangle, ancestorBounds), L"One of the BVH levels has AABBs that can't contain one of the leaf nodes");
+                MarkFound(expectedLeafIndex);
+            }
+
+        private:
+            const std::vector<TriangleLeafNode> &m_expectedTriangles;
+            const std::vector<UINT> &m_geometryOffsets;
+            const Primitive *m_pPrimitives;
+            const PrimitiveMetaData *m_pMetadata;
+            UINT m_numPrimitives;
+        };
+
+        // Top level leaves are matched to the input through BVHMetadata::InstanceIndex
+        class InstanceLeafVerifier : public ExpectedLeafTracker
+        {
+        public:
+            InstanceLeafVerifier(const BYTE *pBvhData, const std::vector<AABB> &expectedBoxes) :
+                ExpectedLeafTracker((UINT)expectedBoxes.size()),
+                m_expectedBoxes(expectedBoxes)
+            {
+                const BVHOffsets &offsets = *(const BVHOffsets *)pBvhData;
+                m_pMetadata = (const BVHMetadata *)(pBvhData + offsets.offsetToVertices);
+            }
+
+            void VerifyPrimitive(UINT leafIndex, const AABB &leafBox, const AABB &ancestorBounds)
+            {
+                ThrowErrorIfFalse(leafIndex < m_expectedBoxes.size(), L"Leaf references an instance past the end of the instance array");
+
+                const UINT instanceIndex = m_pMetadata[leafIndex].InstanceIndex;
+                ThrowErrorIfFalse(instanceIndex < m_expectedBoxes.size(), L"Invalid instance index in the BVH metadata");
+
+                const AABB &expectedBox = m_expectedBoxes[instanceIndex];
+                ThrowErrorIfFalse(IsChildContainedByParent(leafBox, expectedBox), L"Leaf AABB doesn't contain the instance referenced by its metadata");
+                ThrowErrorIfFalse(IsChildContainedByParent(ancestorBounds, expectedBox), L"One of the BVH levels has AABBs that can't contain one of the leaf nodes");
+                MarkFound(instanceIndex);
+            }
+
+        private:
+            const std::vector<AABB> &m_expectedBoxes;
+            const BVHMetadata *m_pMetadata;
+        };
+    }
+
+    bool ComputeBvhQualityReport(
+        _In_ const BYTE *pBvhData,
+        _In_ D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE type,
+        _Out_ BvhQualityReport &report,
+        _Out_ std::wstring &errorMessage)
+    {
+        try
+        {
+            NullLeafVerifier leafVerifier;
+            BvhWalker<NullLeafVerifier> walker(pBvhData, type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL, leafVerifier);
+            walker.Walk(report);
         }
-        catch (bool)
+        catch (BvhValidationError &error)
         {
+            errorMessage = error.pMessage;
             return false;
         }
         return true;
     }
 
-    bool BvhValidator::AABBLeafNode::IsContainedByBox(const AABB &parentBox)
-    {
-        return IsChildContainedByParent(parentBox, box);
-    };
-
-    bool BvhValidator::AABBLeafNode::IsLeafEqual(void *pLeafData, const AABB &leafAABB)
-    {
-        UNREFERENCED_PARAMETER(pLeafData);
-        return IsChildContainedByParent(leafAABB, box);
-    }
-
     template<typename V>
     V Transform(V &v, _In_reads_(12) const float* transform)
     {
@@ -211,13 +539,13 @@ namespace FallbackLayer
         vertices[5] = { box.max.x, box.min.y, box.min.z };
         vertices[6] = { box.max.x, box.min.y, box.max.z };
         vertices[7] = box.max;
-        
+
         AABB transformedBox;
         transformedBox.min = { FLT_MAX,FLT_MAX, FLT_MAX };
         transformedBox.max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
         for (UINT i = 0; i < ARRAYSIZE(vertices); i++)
         {
-            float3 v = Transform(vertices[0], transform);
+            float3 v = Transform(vertices[i], transform);
             transformedBox.min = min(v, transformedBox.min);
             transformedBox.max = max(v, transformedBox.max);
         }
@@ -232,33 +560,31 @@ namespace FallbackLayer
         const BYTE *pOutputCpuData,
         std::wstring &errorMessage)
     {
-        std::vector<LeafNodePtr> pLeafNodes;
+        std::vector<AABB> expectedBoxes(numBoxes);
         for (UINT i = 0; i < numBoxes; i ++)
         {
-            AABB aabb = pReferenceBoxes[i];
+            expectedBoxes[i] = pReferenceBoxes[i];
             if (ppInstanceTransforms)
             {
-                aabb = TransformAABB(aabb, ppInstanceTransforms[i]);
+                expectedBoxes[i] = TransformAABB(expectedBoxes[i], ppInstanceTransforms[i]);
             }
-            pLeafNodes.push_back(std::unique_ptr<LeafNode>(new AABBLeafNode(aabb)));
         }
 
-        return VerifyBVHOutput(pLeafNodes, pOutputCpuData, errorMessage);
-    }
-
-    bool BvhValidator::TriangleLeafNode::IsContainedByBox(const AABB &box)
-    {
-        return IsVertexContainedByAABB(box, v0) &&
-            IsVertexContainedByAABB(box, v1) &&
-            IsVertexContainedByAABB(box, v2);
-    }
-
-    bool BvhValidator::TriangleLeafNode::IsLeafEqual(void *pLeafData, const AABB &leafAABB)
-    {
-        UNREFERENCED_PARAMETER(leafAABB);
-        Primitive *pPrimitive = (Primitive *)pLeafData;
-        Triangle *pTriangle = &pPrimitive->triangle;
-        return IsTriangleEqual(*this, pTriangle);
+        try
+        {
+            InstanceLeafVerifier leafVerifier(pOutputCpuData, expectedBoxes);
+            BvhWalker<InstanceLeafVerifier> walker(pOutputCpuData, true, leafVerifier);
+            BvhQualityReport report;
+            walker.Walk(report);
+            leafVerifier.VerifyAllLeavesFound();
+            m_qualityReport = std::move(report);
+        }
+        catch (BvhValidationError &error)
+        {
+            errorMessage = error.pMessage;
+            return false;
+        }
+        return true;
     }
 
     UINT CalculateBaseIndex(UINT triangleIndex)
@@ -266,18 +592,18 @@ namespace FallbackLayer
         return triangleIndex * 3;
     }
 
-    UINT GetIndex(void *pIndexBufferData, UINT readIndex, DXGI_FORMAT format)
+    UINT GetIndex(const void *pIndexBufferData, UINT readIndex, DXGI_FORMAT format)
     {
         switch (format)
         {
         case DXGI_FORMAT_R32_UINT:
         {
-            auto pIndexBuffer = (UINT32 *)pIndexBufferData;
+            auto pIndexBuffer = (const UINT32 *)pIndexBufferData;
             return pIndexBuffer[readIndex];
         }
         case DXGI_FORMAT_R16_UINT:
         {
-            auto pIndexBuffer = (UINT16 *)pIndexBufferData;
+            auto pIndexBuffer = (const UINT16 *)pIndexBufferData;
             return pIndexBuffer[readIndex];
         }
         case DXGI_FORMAT_UNKNOWN:
@@ -293,38 +619,56 @@ namespace FallbackLayer
         UINT geometryCount,
         const BYTE *pBVHData, std::wstring &errorMessage)
     {
-        std::vector<std::unique_ptr<LeafNode>> pLeafNodes;
+        std::vector<UINT> geometryOffsets(geometryCount + 1, 0);
+        for (UINT geometryIndex = 0; geometryIndex < geometryCount; geometryIndex++)
+        {
+            const CpuGeometryDescriptor &geometryDescriptor = pCpuGeometryDescriptors[geometryIndex];
+            const UINT vertexCount = geometryDescriptor.m_pIndexBuffer ? geometryDescriptor.m_numIndicies : geometryDescriptor.m_numVerticies;
+            geometryOffsets[geometryIndex + 1] = geometryOffsets[geometryIndex] + vertexCount / 3;
+        }
 
+        std::vector<TriangleLeafNode> expectedTriangles(geometryOffsets.back());
         for (UINT geometryIndex = 0; geometryIndex < geometryCount; geometryIndex++)
         {
-            CpuGeometryDescriptor &geometryDescriptor = pCpuGeometryDescriptors[geometryIndex];
+            const CpuGeometryDescriptor &geometryDescriptor = pCpuGeometryDescriptors[geometryIndex];
             const UINT vertexStrideInBytes = sizeof(float) * 3;
-            const float *pVerticies = geometryDescriptor.m_pVertexData;
-            void *pIndicies = (UINT16*)geometryDescriptor.m_pIndexBuffer;
-
-            const UINT vertexCount = pIndicies ? geometryDescriptor.m_numIndicies : geometryDescriptor.m_numVerticies;
-            const UINT triangleCount = vertexCount / 3;
+            const BYTE *pVertexByteBuffer = (const BYTE *)geometryDescriptor.m_pVertexData;
+            const void *pIndicies = geometryDescriptor.m_pIndexBuffer;
+            const UINT firstTriangle = geometryOffsets[geometryIndex];
+            const UINT triangleCount = geometryOffsets[geometryIndex + 1] - firstTriangle;
 
-            const UINT verticesPerTriangle = 3;
-            const UINT floatsPerVertex = 3;
-            BYTE *pVertexByteBuffer = (BYTE *)pVerticies;
-            for (UINT i = 0; i < triangleCount; i ++)
+            Concurrency::parallel_for(0u, triangleCount, [&](UINT i)
             {
+                const UINT verticesPerTriangle = 3;
                 Vertex v[verticesPerTriangle];
                 UINT baseIndex = CalculateBaseIndex(i);
                 for (UINT vertexIndex = 0; vertexIndex < verticesPerTriangle; vertexIndex++)
                 {
-                    float *pVertex = (float *)&pVertexByteBuffer[vertexStrideInBytes * GetIndex(pIndicies, vertexIndex + baseIndex, geometryDescriptor.m_indexBufferFormat)];
+                    const float *pVertex = (const float *)&pVertexByteBuffer[vertexStrideInBytes * GetIndex(pIndicies, vertexIndex + baseIndex, geometryDescriptor.m_indexBufferFormat)];
                     v[vertexIndex] = { pVertex[0], pVertex[1], pVertex[2] };
 
                     v[vertexIndex] = Transform(v[vertexIndex], geometryDescriptor.transform.data());
                 }
 
-                pLeafNodes.push_back(std::unique_ptr<LeafNode>(new TriangleLeafNode(v[0], v[1], v[2])));
-            }
+                expectedTriangles[firstTriangle + i] = { v[0], v[1], v[2] };
+            });
         }
 
-        return VerifyBVHOutput(pLeafNodes, pBVHData, errorMessage);
+        try
+        {
+            TriangleLeafVerifier leafVerifier(pBVHData, expectedTriangles, geometryOffsets);
+            BvhWalker<TriangleLeafVerifier> walker(pBVHData, false, leafVerifier);
+            BvhQualityReport report;
+            walker.Walk(report);
+            leafVerifier.VerifyAllLeavesFound();
+            m_qualityReport = std::move(report);
+        }
+        catch (BvhValidationError &error)
+        {
+            errorMessage = error.pMessage;
+            return false;
+        }
+        return true;
     }
 
     void DecompressAABB(
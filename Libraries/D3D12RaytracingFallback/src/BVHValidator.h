@@ -11,6 +11,49 @@
 #pragma once
 namespace FallbackLayer
 {
+    struct BvhLevelStatistics
+    {
+        UINT NumInternalNodes = 0;
+        UINT NumLeaves = 0;
+
+        // Averaged over the internal nodes of the level, see BvhQualityReport
+        float SiblingOverlapRatio = 0.0f;
+        float EmptySpaceRatio = 0.0f;
+    };
+
+    struct BvhQualityReport
+    {
+        // Same cost model as ComputeBvhSahCost
+        float SahCost = 0.0f;
+
+        UINT NumNodes = 0;
+        UINT NumLeaves = 0;
+        UINT NumPrimitives = 0;
+        UINT MaxDepth = 0;
+
+        // Surface area of the intersection of the two children over the
+        // surface area of the parent, averaged over all internal nodes
+        float SiblingOverlapRatio = 0.0f;
+
+        // Fraction of the parent volume covered by neither child, averaged
+        // over all internal nodes that have a non-zero volume
+        float EmptySpaceRatio = 0.0f;
+
+        // Indexed by depth, the depth histogram is Levels[depth].NumLeaves
+        std::vector<BvhLevelStatistics> Levels;
+
+        // LeafSizeHistogram[n] is the number of leaves holding n primitives
+        std::vector<UINT> LeafSizeHistogram;
+    };
+
+    // Walks a BVH2 checking only its structure (child indices, parent/child
+    // containment), without needing the geometry it was built from
+    bool ComputeBvhQualityReport(
+        _In_ const BYTE *pBvhData,
+        _In_ D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE type,
+        _Out_ BvhQualityReport &report,
+        _Out_ std::wstring &errorMessage);
+
     class BvhValidator : public IAccelerationStructureValidator
     {
     public:
@@ -26,67 +69,13 @@ namespace FallbackLayer
             const BYTE *pOutputCpuData,
             std::wstring &errorMessage);
 
-    private:
-
-        class LeafNode
-        {
-        public:
-            virtual bool IsContainedByBox(const AABB &box) = 0;
-            virtual bool IsLeafEqual(void *pLeafData, const AABB &leafAABB) = 0;
-            bool LeafFound = false;
-        };
-
-        struct Vertex
-        {
-            float x, y, z;
-        };
+        // Quality report of the last BVH that passed verification
+        const BvhQualityReport &GetQualityReport() const { return m_qualityReport; }
 
+    private:
         AABB TransformAABB(const AABB &box, _In_reads_(12) const float* transform);
 
-        class AABBLeafNode : public LeafNode
-        {
-        public:
-            AABBLeafNode(const AABB &nBox) : box(nBox) {}
-            virtual bool IsLeafEqual(void *pLeafData, const AABB &leafAABB);
-            virtual bool IsContainedByBox(const AABB &box);
-
-            AABB box;
-        };
-
-        class TriangleLeafNode : public LeafNode
-        {
-        public:
-            TriangleLeafNode(Vertex nV0, Vertex nV1, Vertex nV2) : v0(nV0), v1(nV1), v2(nV2) {}
-            virtual bool IsContainedByBox(const AABB &box);
-            virtual bool IsLeafEqual(void *pLeafData, const AABB &leafAABB);
-            Vertex v0, v1, v2;
-        };
-
-        typedef std::unique_ptr<LeafNode> LeafNodePtr;
-
-        bool VerifyBVHOutput(
-            std::vector<LeafNodePtr> &pExpectedLeafNodes,
-            const BYTE *pOutputCpuData,
-            std::wstring &errorMessage);
-
-        static bool IsVertexContainedByAABB(const AABB &aabb, const BvhValidator::Vertex &v);
-        static bool IsVertexEqual(const Vertex &vertex1, const Vertex &vertex2);
-
-        template <typename TriangleNode>
-        static bool IsTriangleEqual(const TriangleNode triangle, const Triangle *pTriangle)
-        {
-            BvhValidator::Vertex v[3];
-            for (UINT vertexIndex = 0; vertexIndex < 3; vertexIndex++)
-            {
-                v[vertexIndex].x = pTriangle->v[vertexIndex].x;
-                v[vertexIndex].y = pTriangle->v[vertexIndex].y;
-                v[vertexIndex].z = pTriangle->v[vertexIndex].z;
-            }
-
-            return IsVertexEqual(triangle.v0, v[0]) && 
-                   IsVertexEqual(triangle.v1, v[1]) &&
-                   IsVertexEqual(triangle.v2, v[2]);
-        }
+        BvhQualityReport m_qualityReport;
     };
 
     void DecompressAABB(
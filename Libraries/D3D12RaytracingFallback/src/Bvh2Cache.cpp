@@ -0,0 +1,421 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "pch.h"
+
+namespace FallbackLayer
+{
+    //
+    // Hashing
+    //
+
+    // Two lane 64-bit multiply/rotate hash with a murmur3 finalizer. Not
+    // cryptographic, only meant to make accidental collisions between
+    // different geometry negligible.
+    class Bvh2CacheHasher
+    {
+    public:
+        void Add(const void *pData, size_t size)
+        {
+            const BYTE *pBytes = (const BYTE *)pData;
+            m_length += size;
+
+            for (; size >= 16; size -= 16, pBytes += 16)
+            {
+                UINT64 words[2];
+                memcpy(words, pBytes, sizeof(words));
+                AddWords(words[0], words[1]);
+            }
+
+            if (size)
+            {
+                UINT64 words[2] = {};
+                memcpy(words, pBytes, size);
+                AddWords(words[0], words[1]);
+            }
+        }
+
+        template<typename T>
+        void Add(const T &value)
+        {
+            Add(&value, sizeof(value));
+        }
+
+        Bvh2CacheKey Finalize() const
+        {
+            UINT64 h0 = m_h0 ^ m_length;
+            UINT64 h1 = m_h1 ^ m_length;
+            h0 += h1;
+            h1 += h0;
+            h0 = Mix(h0);
+            h1 = Mix(h1);
+            h0 += h1;
+            h1 += h0;
+            return Bvh2CacheKey{ { h0, h1 } };
+        }
+
+    private:
+        static const UINT64 c0 = 0x87c37b91114253d5ull;
+        static const UINT64 c1 = 0x4cf5ad432745937full;
+
+        void AddWords(UINT64 a, UINT64 b)
+        {
+            m_h0 ^= _rotl64(a * c0, 31) * c1;
+            m_h0 = (_rotl64(m_h0, 27) + m_h1) * 5 + 0x52dce729;
+            m_h1 ^= _rotl64(b * c1, 33) * c0;
+            m_h1 = (_rotl64(m_h1, 31) + m_h0) * 5 + 0x38495ab5;
+        }
+
+        static UINT64 Mix(UINT64 k)
+        {
+            k ^= k >> 33;
+            k *= 0xff51afd7ed558ccdull;
+            k ^= k >> 33;
+            k *= 0xc4ceb9fe1a85ec53ull;
+            k ^= k >> 33;
+            return k;
+        }
+
+        UINT64 m_h0 = 0x9e3779b97f4a7c15ull;
+        UINT64 m_h1 = 0x6a09e667f3bcc909ull;
+        UINT64 m_length = 0;
+    };
+
+    static
+        UINT GetIndexFormatSize(DXGI_FORMAT format)
+    {
+        switch (format)
+        {
+        case DXGI_FORMAT_R32_UINT:
+            return sizeof(UINT32);
+        case DXGI_FORMAT_R16_UINT:
+            return sizeof(UINT16);
+        default:
+            return 0;
+        }
+    }
+
+    static
+        Bvh2CacheKey HashGeometry(
+            const D3D12_RAYTRACING_GEOMETRY_DESC &geometry)
+    {
+        Bvh2CacheHasher hasher;
+        hasher.Add(geometry.Type);
+        hasher.Add(geometry.Flags);
+
+        switch (geometry.Type)
+        {
+        case D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES:
+        {
+            const D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC &triangles = geometry.Triangles;
+            hasher.Add(triangles.IndexFormat);
+            hasher.Add(triangles.IndexCount);
+            hasher.Add(triangles.VertexCount);
+
+            const UINT indexSize = GetIndexFormatSize(triangles.IndexFormat);
+            if (indexSize && triangles.IndexBuffer)
+            {
+                hasher.Add((const void *)triangles.IndexBuffer, (size_t)triangles.IndexCount * indexSize);
+            }
+
+            // Only positions are read by the builder, so the stride and the
+            // w component of 4-wide formats don't need to match
+            const BYTE *pVertices = (const BYTE *)triangles.VertexBuffer.StartAddress;
+            const UINT64 stride = triangles.VertexBuffer.StrideInBytes;
+            if (stride == sizeof(float3))
+            {
+                hasher.Add(pVertices, (size_t)triangles.VertexCount * sizeof(float3));
+            }
+            else
+            {
+                for (UINT i = 0; i < triangles.VertexCount; i++)
+                {
+                    hasher.Add(pVertices + i * stride, sizeof(float3));
+                }
+            }
+
+            if (triangles.Transform3x4)
+            {
+                hasher.Add((const void *)triangles.Transform3x4, sizeof(float) * 12);
+            }
+            break;
+        }
+        case D3D12_RAYTRACING_GEOMETRY_TYPE_PROCEDURAL_PRIMITIVE_AABBS:
+        {
+            const D3D12_RAYTRACING_GEOMETRY_AABBS_DESC &aabbs = geometry.AABBs;
+            hasher.Add(aabbs.AABBCount);
+
+            const BYTE *pAABBs = (const BYTE *)aabbs.AABBs.StartAddress;
+            const UINT64 stride = aabbs.AABBs.StrideInBytes;
+            if (stride == sizeof(D3D12_RAYTRACING_AABB))
+            {
+                hasher.Add(pAABBs, (size_t)aabbs.AABBCount * sizeof(D3D12_RAYTRACING_AABB));
+            }
+            else
+            {
+                for (UINT i = 0; i < aabbs.AABBCount; i++)
+                {
+                    hasher.Add(pAABBs + i * stride, sizeof(D3D12_RAYTRACING_AABB));
+                }
+            }
+            break;
+        }
+        default:
+            ThrowFailure(E_INVALIDARG, L"Unrecognized D3D12_RAYTRACING_GEOMETRY_TYPE");
+        }
+
+        return hasher.Finalize();
+    }
+
+    Bvh2CacheKey ComputeBvh2CacheKey(
+        _In_ const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+        _In_ const CpuBvh2BuildSettings &settings)
+    {
+        if (inputs.Type != D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL)
+        {
+            ThrowFailure(E_INVALIDARG, L"Only bottom level acceleration structures can be cached");
+        }
+
+        // The result of an update depends on the source acceleration structure,
+        // which isn't part of the key
+        if (inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE)
+        {
+            ThrowFailure(E_INVALIDARG, L"Acceleration structure updates can't be cached");
+        }
+
+        // Geometries are hashed independently so large scenes spread across
+        // threads, the per-geometry keys are then combined in order
+        std::vector<Bvh2CacheKey> geometryKeys(inputs.NumDescs);
+        auto hashGeometry = [&](UINT i) { geometryKeys[i] = HashGeometry(GetGeometryDesc(inputs, i)); };
+        if (settings.UseMultithreadedBuild)
+        {
+            concurrency::parallel_for(0u, inputs.NumDescs, hashGeometry);
+        }
+        else
+        {
+            for (UINT i = 0; i < inputs.NumDescs; i++)
+            {
+                hashGeometry(i);
+            }
+        }
+
+        Bvh2CacheHasher hasher;
+        hasher.Add(Bvh2CacheFileVersion);
+        hasher.Add(inputs.Flags);
+        hasher.Add(inputs.NumDescs);
+
+        // Every setting that can change the tree, threading doesn't
+        hasher.Add(settings.MaxTrianglesInLeaf);
+        hasher.Add(settings.UseReferenceBuilder);
+        hasher.Add(settings.UseLowMemoryBuild);
+        if (settings.UseLowMemoryBuild)
+        {
+            hasher.Add(settings.LowMemoryBudgetInBytes);
+        }
+        hasher.Add(settings.UseLbvhBuilder);
+        if (settings.UseLbvhBuilder)
+        {
+            hasher.Add(settings.LbvhMortonCodeBits);
+        }
+
+        if (geometryKeys.size())
+        {
+            hasher.Add(geometryKeys.data(), geometryKeys.size() * sizeof(Bvh2CacheKey));
+        }
+        return hasher.Finalize();
+    }
+
+    //
+    // MappedBvh2Blob
+    //
+
+    MappedBvh2Blob &MappedBvh2Blob::operator=(MappedBvh2Blob &&other)
+    {
+        if (this != &other)
+        {
+            Release();
+            std::swap(m_hFile, other.m_hFile);
+            std::swap(m_hMapping, other.m_hMapping);
+            std::swap(m_pView, other.m_pView);
+            std::swap(m_pHeader, other.m_pHeader);
+        }
+        return *this;
+    }
+
+    bool MappedBvh2Blob::Map(_In_ LPCWSTR filename, _In_ const Bvh2CacheKey &key)
+    {
+        Release();
+
+        m_hFile = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_hFile == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(m_hFile, &fileSize) || (UINT64)fileSize.QuadPart < sizeof(Bvh2CacheFileHeader))
+        {
+            Release();
+            return false;
+        }
+
+        m_hMapping = CreateFileMappingW(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_hMapping)
+        {
+            m_pView = (const BYTE *)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+        }
+        if (!m_pView)
+        {
+            Release();
+            return false;
+        }
+
+        // Anything that doesn't look exactly like what Store wrote is a miss
+        m_pHeader = (const Bvh2CacheFileHeader *)m_pView;
+        const UINT64 size = (UINT64)fileSize.QuadPart;
+        bool bValid = m_pHeader->Magic == Bvh2CacheFileMagic &&
+            m_pHeader->Version == Bvh2CacheFileVersion &&
+            m_pHeader->Key == key &&
+            m_pHeader->BlobOffset % D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT == 0 &&
+            m_pHeader->BlobOffset <= size &&
+            m_pHeader->BlobSize <= size - m_pHeader->BlobOffset &&
+            m_pHeader->BlobSize >= sizeof(BVHOffsets);
+        if (bValid)
+        {
+            const BVHOffsets &offsets = *(const BVHOffsets *)GetData();
+            bValid = offsets.totalSize <= m_pHeader->BlobSize;
+        }
+
+        if (!bValid)
+        {
+            Release();
+        }
+        return bValid;
+    }
+
+    void MappedBvh2Blob::Release()
+    {
+        if (m_pView)
+        {
+            UnmapViewOfFile(m_pView);
+            m_pView = nullptr;
+        }
+        m_pHeader = nullptr;
+
+        if (m_hMapping)
+        {
+            CloseHandle(m_hMapping);
+            m_hMapping = nullptr;
+        }
+
+        if (m_hFile != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_hFile);
+            m_hFile = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    //
+    // Bvh2Cache
+    //
+
+    Bvh2Cache::Bvh2Cache(_In_ LPCWSTR directory) : m_directory(directory)
+    {
+        if (!CreateDirectoryW(directory, nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+        {
+            ThrowFailure(HRESULT_FROM_WIN32(GetLastError()), L"Failed to create the BVH cache directory");
+        }
+    }
+
+    std::wstring Bvh2Cache::GetFilename(_In_ const Bvh2CacheKey &key) const
+    {
+        wchar_t name[64];
+        swprintf_s(name, L"%016llx%016llx.bvh", key.Hash[0], key.Hash[1]);
+        return m_directory + L"\\" + name;
+    }
+
+    bool Bvh2Cache::TryLoad(_In_ const Bvh2CacheKey &key, _Out_ MappedBvh2Blob &blob) const
+    {
+        return blob.Map(GetFilename(key).c_str(), key);
+    }
+
+    void Bvh2Cache::Store(_In_ const Bvh2CacheKey &key, _In_ const void *pData, UINT64 size) const
+    {
+        const std::wstring filename = GetFilename(key);
+        const std::wstring tempFilename = filename + L"." + std::to_wstring(GetCurrentProcessId()) + L"." + std::to_wstring(GetCurrentThreadId()) + L".tmp";
+
+        HANDLE hFile = CreateFileW(tempFilename.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            ThrowFailure(HRESULT_FROM_WIN32(GetLastError()), L"Failed to create a BVH cache file");
+        }
+
+        Bvh2CacheFileHeader header = {};
+        header.Magic = Bvh2CacheFileMagic;
+        header.Version = Bvh2CacheFileVersion;
+        header.Key = key;
+        header.BlobOffset = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT;
+        header.BlobSize = size;
+        static_assert(sizeof(Bvh2CacheFileHeader) <= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, "Header must fit in front of the aligned blob");
+
+        BYTE headerBlock[D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT] = {};
+        memcpy(headerBlock, &header, sizeof(header));
+
+        auto writeAll = [hFile](const void *pBytes, UINT64 bytesToWrite)
+        {
+            const BYTE *pCurrent = (const BYTE *)pBytes;
+            while (bytesToWrite)
+            {
+                const DWORD chunkSize = (DWORD)std::min<UINT64>(bytesToWrite, 1u << 30);
+                DWORD bytesWritten = 0;
+                if (!WriteFile(hFile, pCurrent, chunkSize, &bytesWritten, nullptr) || bytesWritten != chunkSize)
+                {
+                    return false;
+                }
+                pCurrent += chunkSize;
+                bytesToWrite -= chunkSize;
+            }
+            return true;
+        };
+
+        const bool bWritten = writeAll(headerBlock, sizeof(headerBlock)) && writeAll(pData, size);
+        const HRESULT writeResult = bWritten ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(hFile);
+
+        if (FAILED(writeResult) || !MoveFileExW(tempFilename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING))
+        {
+            const HRESULT hr = FAILED(writeResult) ? writeResult : HRESULT_FROM_WIN32(GetLastError());
+            DeleteFileW(tempFilename.c_str());
+            ThrowFailure(hr, L"Failed to write a BVH cache file");
+        }
+    }
+
+    bool Bvh2Cache::LoadOrBuild(
+        _In_ const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
+        _In_ const CpuBvh2BuildSettings &settings,
+        _Out_ MappedBvh2Blob &blob) const
+    {
+        const Bvh2CacheKey key = ComputeBvh2CacheKey(pDesc->Inputs, settings);
+        if (TryLoad(key, blob))
+        {
+            return true;
+        }
+
+        std::vector<BYTE> data((size_t)GetRaytracingAccelerationStructureSizeOnCpu(pDesc->Inputs));
+        BuildRaytracingAccelerationStructureOnCpu(pDesc, settings, data.data());
+        Store(key, data.data(), GetRaytracingAccelerationStructureWrittenSizeOnCpu(pDesc->Inputs, data.data()));
+
+        if (!TryLoad(key, blob))
+        {
+            ThrowFailure(E_FAIL, L"Failed to map a BVH cache file that was just written");
+        }
+        return false;
+    }
+}
@@ -0,0 +1,106 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+namespace FallbackLayer
+{
+    // Bump whenever the BVH2 blob layout or the cache file header changes so
+    // stale files are treated as misses instead of being uploaded
+    static const UINT Bvh2CacheFileVersion = 2;
+    static const UINT Bvh2CacheFileMagic = 0x48564246; // "FBVH"
+
+    struct Bvh2CacheKey
+    {
+        UINT64 Hash[2];
+
+        bool operator==(const Bvh2CacheKey &other) const
+        {
+            return Hash[0] == other.Hash[0] && Hash[1] == other.Hash[1];
+        }
+    };
+
+    // On-disk layout, the blob starts at BlobOffset so a mapped view of the
+    // file is already aligned for D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT
+    struct Bvh2CacheFileHeader
+    {
+        UINT Magic;
+        UINT Version;
+        Bvh2CacheKey Key;
+        UINT64 BlobOffset;
+        UINT64 BlobSize;
+    };
+
+    // Hashes the contents of every buffer referenced by bottom level inputs
+    // along with the build flags and the CPU build settings that affect the
+    // output. Addresses are read as CPU addresses like the CPU builder does.
+    // Updates are rejected, their output depends on the source structure.
+    Bvh2CacheKey ComputeBvh2CacheKey(
+        _In_ const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+        _In_ const CpuBvh2BuildSettings &settings);
+
+    // Read-only view of a cached blob. The data stays mapped for the lifetime
+    // of the object and can be written straight into an upload heap, the
+    // blob is position independent so GpuBvh2Copy can then move it into its
+    // final acceleration structure buffer.
+    class MappedBvh2Blob
+    {
+    public:
+        MappedBvh2Blob() {}
+        ~MappedBvh2Blob() { Release(); }
+
+        MappedBvh2Blob(MappedBvh2Blob &&other) { *this = std::move(other); }
+        MappedBvh2Blob &operator=(MappedBvh2Blob &&other);
+
+        MappedBvh2Blob(const MappedBvh2Blob &) = delete;
+        MappedBvh2Blob &operator=(const MappedBvh2Blob &) = delete;
+
+        bool Map(_In_ LPCWSTR filename, _In_ const Bvh2CacheKey &key);
+        void Release();
+
+        bool IsValid() const { return m_pView != nullptr; }
+        const BYTE *GetData() const { return m_pView ? m_pView + m_pHeader->BlobOffset : nullptr; }
+        UINT64 GetSize() const { return m_pView ? m_pHeader->BlobSize : 0; }
+
+    private:
+        HANDLE m_hFile = INVALID_HANDLE_VALUE;
+        HANDLE m_hMapping = nullptr;
+        const BYTE *m_pView = nullptr;
+        const Bvh2CacheFileHeader *m_pHeader = nullptr;
+    };
+
+    // Content-addressed cache of bottom level BVH2 blobs stored one file per
+    // key in a directory. Top levels aren't cached since instance descs
+    // reference bottom levels by address, which isn't stable across runs.
+    class Bvh2Cache
+    {
+    public:
+        Bvh2Cache(_In_ LPCWSTR directory);
+
+        bool TryLoad(_In_ const Bvh2CacheKey &key, _Out_ MappedBvh2Blob &blob) const;
+
+        // Writes to a temporary file first so concurrent readers never map a
+        // partially written blob
+        void Store(_In_ const Bvh2CacheKey &key, _In_ const void *pData, UINT64 size) const;
+
+        // Maps the cached blob if there is one, otherwise builds it with
+        // BuildRaytracingAccelerationStructureOnCpu, stores it and maps the
+        // stored copy. Returns true on a cache hit.
+        bool LoadOrBuild(
+            _In_ const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
+            _In_ const CpuBvh2BuildSettings &settings,
+            _Out_ MappedBvh2Blob &blob) const;
+
+        std::wstring GetFilename(_In_ const Bvh2CacheKey &key) const;
+
+    private:
+        std::wstring m_directory;
+    };
+}
@@ -15,7 +15,7 @@ namespace FallbackLayer
     struct BVH
     {
         std::vector<AABBNode>   m_nodes;
-        std::vector<float> m_triangles;
+        std::vector<Primitive> m_primitives;
         std::vector<PrimitiveMetaData> m_metadata;
     };
 
@@ -67,48 +67,6 @@ namespace FallbackLayer
         }
     }
 
-    //
-    // Convert a 16-bit float to 32-bit.
-    //
-
-    static
-        float Fp16ToFp32(USHORT v)
-    {
-        static const UINT kMultiple = 0x77800000;   // 2**112
-        const UINT BiasedFloat = (v & 0x8000) << 16 | (v & 0x7FFF) << 13;
-        return (float&)BiasedFloat * (float&)kMultiple;
-    }
-
-    //
-    // Round toward minus infinity.  Guarantees output <= input.
-    //
-
-    static
-        USHORT Fp32ToFp16(float v, float RoundDirection = 0.0f)
-    {
-        assert(!!_finite(v));
-        assert(v > -65504 && v < 65504);
-
-        // Multiplying by 2^-112 causes exponents below -14 to denormalize
-        static const UINT kMultiple = 0x07800000;   // 2**-112
-        const float BiasedFloat = v * (float&)kMultiple;
-        const UINT u = (UINT&)BiasedFloat;
-
-        const UINT sign = u & 0x80000000;
-        UINT body = u & 0x0fffffff;
-
-        // Increase the magnitude before truncation to ensure proper bounds
-        if (v * RoundDirection > 0.0f)
-        {
-            if (body == 0)
-                body = 0x800000;
-            else
-                body += 0x1fff;
-        }
-
-        return (USHORT)(sign >> 16 | body >> 13);
-    }
-
     static
         float QuantizeToFp16(
             float v)
@@ -145,6 +103,7 @@ namespace FallbackLayer
         packedBox.halfDim[1] = dY;
         packedBox.halfDim[2] = dZ;
         packedBox.nodeAllBits = 0;
+        packedBox.rightNodeIndex = 0;
 
         bvh.m_nodes.push_back(packedBox);
 
@@ -175,6 +134,7 @@ namespace FallbackLayer
 
         bvh.m_nodes[nodeIndex].leafNode.firstTriangleId = idIndex;
         bvh.m_nodes[nodeIndex].leafNode.numTriangleIds = (UINT32)metadata.size();
+        bvh.m_nodes[nodeIndex].numTriangles = (UINT32)metadata.size();
 
         return nodeIndex;
     }
@@ -241,6 +201,14 @@ namespace FallbackLayer
         box.min.x = box.min.y = box.min.z = 10e10f;//FLT_MAX;
     }
 
+    static const UINT NUM_SAH_BINS = 64;
+
+    struct SahBin
+    {
+        AABB    box;
+        UINT    numTriangles;
+    };
+
     //
     // A feeble attempt at a SAH builder
     //
@@ -253,14 +221,6 @@ namespace FallbackLayer
             const AABB& nodeBox,
             const std::vector<AABB>& boxes)
     {
-        static const UINT NUM_SAH_BINS = 64;
-
-        struct SahBin
-        {
-            AABB    box;
-            UINT    numTriangles;
-        };
-
         // NOTE: use vector if this blows out the stack?
         SahBin  sahBins[3][NUM_SAH_BINS];
 
@@ -381,7 +341,7 @@ namespace FallbackLayer
     // -- there could be a varaible number of triangles in leaves
     //
     static
-        void BuildBVH(
+        void BuildBVHReference(
             BVH& bvh,
             const std::vector<AABB>& boxes,
             const std::vector<PrimitiveMetaData>& primitiveMetaData,
@@ -515,185 +475,2133 @@ namespace FallbackLayer
         }
     }
 
-    void BuildUniformBVH(
-        _In_  UINT NumElements,
-        _In_reads_opt_(NumElements)  const D3D12_RAYTRACING_GEOMETRY_DESC *pGeometries,
-        BVH &bvh)
+    //
+    // Task-parallel binned SAH builder
+    //
+    // Produces the same layout as BuildBVHReference: the right child of an internal
+    // node immediately follows its parent and the left child is stored explicitly.
+    // Every subtree with N primitives reserves 2N - 1 consecutive nodes, which lets
+    // both children be built concurrently without coordinating node allocation.
+    // Primitives are partitioned in place over a single index array, so a leaf
+    // simply references a contiguous range of that array.
+    //
+
+    // Subtrees smaller than this are built serially on the current thread
+    static const UINT ParallelSubtreeThreshold = 4096;
+
+    // Nodes larger than this compute their bounds and bins in parallel chunks
+    static const UINT ParallelBinningChunkSize = 64 * 1024;
+
+    struct SahBins
     {
-        using namespace DirectX;
-        //
-        // Compute number of triangles
-        //
+        SahBin  bins[3][NUM_SAH_BINS];
+    };
 
-        UINT    totalNumberOfTriangles = 0;
+    struct ParallelBuildContext
+    {
+        const std::vector<AABB>* pBoxes;
+        std::vector<float3>     centroids;
+        std::vector<UINT>       primitiveIndices;
+        std::vector<AABBNode>   nodes;
+        std::atomic<UINT>       numNodesWritten;
+        UINT                    maxTrisInLeaf;
+        bool                    bMultithreaded;
+    };
 
-        for (UINT i = 0; i < NumElements; ++i)
+    static
+        float GetAxis(
+            const float3& v,
+            UINT axis)
+    {
+        return (&v.x)[axis];
+    }
+
+    static
+        void AddPointToBox(
+            AABB& box,
+            const float3& point)
+    {
+        box.min = min(box.min, point);
+        box.max = max(box.max, point);
+    }
+
+    static
+        UINT GetBinIndex(
+            float centroid,
+            float rangeMin,
+            float binScale)
+    {
+        return std::min(NUM_SAH_BINS - 1, UINT((centroid - rangeMin) * binScale));
+    }
+
+    // Only writes the box, refits keep the flags and child indices
+    static
+        void EncodeNodeBox(
+            AABBNode& node,
+            const AABB& box)
+    {
+        float cX = QuantizeToFp16((box.max.x + box.min.x) * 0.5f);
+        float cY = QuantizeToFp16((box.max.y + box.min.y) * 0.5f);
+        float cZ = QuantizeToFp16((box.max.z + box.min.z) * 0.5f);
+
+        node.center[0] = cX;
+        node.center[1] = cY;
+        node.center[2] = cZ;
+        node.halfDim[0] = max(box.max.x - cX, cX - box.min.x);
+        node.halfDim[1] = max(box.max.y - cY, cY - box.min.y);
+        node.halfDim[2] = max(box.max.z - cZ, cZ - box.min.z);
+    }
+
+    static
+        void EncodeNode(
+            AABBNode& node,
+            const AABB& box)
+    {
+        EncodeNodeBox(node, box);
+        node.nodeAllBits = 0;
+        node.rightNodeIndex = 0;
+    }
+
+    //
+    // Leaves follow the encoding of the GPU builder (see ComputeAABBs.hlsli) so the
+    // traversal shader finds the primitive count in the second flag word
+    //
+    static
+        void EncodeLeaf(
+            AABBNode& node,
+            const AABB& box,
+            UINT firstPrimitive,
+            UINT numPrimitives)
+    {
+        assert(firstPrimitive < (1 << 24));
+
+        EncodeNode(node, box);
+        node.leafNode.firstTriangleId = firstPrimitive;
+        node.leaf = true;
+        node.numTriangles = numPrimitives;
+    }
+
+    static
+        UINT GetChunkCount(
+            bool bMultithreaded,
+            UINT numPrimitives)
+    {
+        return bMultithreaded ? DivideAndRoundUp(std::max(numPrimitives, 1u), ParallelBinningChunkSize) : 1;
+    }
+
+    template<typename Function>
+    static
+        void ForEachChunk(
+            UINT begin,
+            UINT end,
+            UINT numChunks,
+            Function function)
+    {
+        auto processChunk = [&](UINT chunkIndex)
+        {
+            const UINT chunkBegin = begin + chunkIndex * ParallelBinningChunkSize;
+            const UINT chunkEnd = (numChunks == 1) ? end : std::min(end, chunkBegin + ParallelBinningChunkSize);
+            function(chunkIndex, chunkBegin, chunkEnd);
+        };
+
+        if (numChunks == 1)
+        {
+            processChunk(0);
+        }
+        else
+        {
+            concurrency::parallel_for(0u, numChunks, processChunk);
+        }
+    }
+
+    //
+    // getPrimitiveBounds(i, box, centroid) returns the bounds of the primitive
+    // at position i of the range being split
+    //
+    template<typename GetPrimitiveBounds>
+    static
+        void ComputeRangeBounds(
+            bool bMultithreaded,
+            UINT begin,
+            UINT end,
+            GetPrimitiveBounds getPrimitiveBounds,
+            AABB& box,
+            AABB& centroidBox)
+    {
+        const UINT numChunks = GetChunkCount(bMultithreaded, end - begin);
+        std::vector<AABB> chunkBoxes(numChunks);
+        std::vector<AABB> chunkCentroidBoxes(numChunks);
+
+        ForEachChunk(begin, end, numChunks, [&](UINT chunkIndex, UINT chunkBegin, UINT chunkEnd)
         {
-            auto &geometry = pGeometries[i];
-            if (geometry.Type == D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES)
+            AABB& chunkBox = chunkBoxes[chunkIndex];
+            AABB& chunkCentroidBox = chunkCentroidBoxes[chunkIndex];
+            InitBoxToInverseMax(chunkBox);
+            InitBoxToInverseMax(chunkCentroidBox);
+
+            for (UINT i = chunkBegin; i < chunkEnd; ++i)
             {
-                totalNumberOfTriangles += GetPrimitiveCountFromGeometryDesc(geometry);
+                AABB primitiveBox;
+                float3 centroid;
+                getPrimitiveBounds(i, primitiveBox, centroid);
+                AddExtentToBox(chunkBox, primitiveBox);
+                AddPointToBox(chunkCentroidBox, centroid);
             }
-            else
+        });
+
+        box = chunkBoxes[0];
+        centroidBox = chunkCentroidBoxes[0];
+        for (UINT i = 1; i < numChunks; ++i)
+        {
+            AddExtentToBox(box, chunkBoxes[i]);
+            AddExtentToBox(centroidBox, chunkCentroidBoxes[i]);
+        }
+    }
+
+    //
+    // Bins are merged into chunkBins[0]. They live on the heap since BuildSubtree
+    // recurses and a full set of bins is several kilobytes.
+    //
+    template<typename GetPrimitiveBounds>
+    static
+        void BinRange(
+            bool bMultithreaded,
+            UINT begin,
+            UINT end,
+            GetPrimitiveBounds getPrimitiveBounds,
+            const AABB& centroidBox,
+            const float binScale[3],
+            std::vector<SahBins>& chunkBins)
+    {
+        const UINT numChunks = GetChunkCount(bMultithreaded, end - begin);
+        chunkBins.resize(numChunks);
+
+        ForEachChunk(begin, end, numChunks, [&](UINT chunkIndex, UINT chunkBegin, UINT chunkEnd)
+        {
+            SahBins& bins = chunkBins[chunkIndex];
+            for (UINT axis = 0; axis < 3; ++axis)
             {
-                throw - 1; // Intersection shaders not supported yet
+                for (UINT j = 0; j < NUM_SAH_BINS; ++j)
+                {
+                    bins.bins[axis][j].numTriangles = 0;
+                    InitBoxToInverseMax(bins.bins[axis][j].box);
+                }
             }
 
-        }
+            for (UINT i = chunkBegin; i < chunkEnd; ++i)
+            {
+                AABB primitiveBox;
+                float3 centroid;
+                getPrimitiveBounds(i, primitiveBox, centroid);
 
-        //
-        // Create AABBs
-        //
+                for (UINT axis = 0; axis < 3; ++axis)
+                {
+                    if (binScale[axis] == 0.0f)
+                        continue;
 
-        std::vector<AABB> boxes;
-        boxes.resize(totalNumberOfTriangles);
+                    const UINT binIndex = GetBinIndex(GetAxis(centroid, axis), centroidBox.minArr[axis], binScale[axis]);
+                    bins.bins[axis][binIndex].numTriangles++;
+                    AddExtentToBox(bins.bins[axis][binIndex].box, primitiveBox);
+                }
+            }
+        });
 
-        std::vector<PrimitiveMetaData> primitiveMetaData;
-        primitiveMetaData.resize(totalNumberOfTriangles);
+        SahBins& result = chunkBins[0];
+        for (UINT i = 1; i < numChunks; ++i)
+        {
+            for (UINT axis = 0; axis < 3; ++axis)
+            {
+                for (UINT j = 0; j < NUM_SAH_BINS; ++j)
+                {
+                    result.bins[axis][j].numTriangles += chunkBins[i].bins[axis][j].numTriangles;
+                    AddExtentToBox(result.bins[axis][j].box, chunkBins[i].bins[axis][j].box);
+                }
+            }
+        }
+    }
 
-        std::vector<float>  triangleVertices;
-        triangleVertices.resize(totalNumberOfTriangles * 9);
+    //
+    // Sweeps the bin boundaries of every axis and returns false if no plane
+    // separates the primitives into two non-empty sets
+    //
+    static
+        bool FindBestSahSplit(
+            const SahBins& sahBins,
+            const float binScale[3],
+            UINT numPrimitives,
+            UINT& splitAxis,
+            UINT& splitBin)
+    {
+        float bestSah = FLT_MAX;
+        bool bFoundSplit = false;
 
-        UINT triangleIndex = 0;
-        for (UINT i = 0; i < NumElements; ++i)
+        for (UINT axis = 0; axis < 3; ++axis)
         {
-            auto &geometry = pGeometries[i];
-            if (geometry.Type != D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES)
+            if (binScale[axis] == 0.0f)
+                continue;
+
+            const SahBin* bins = sahBins.bins[axis];
+
+            AABB rightBoxes[NUM_SAH_BINS];
+            rightBoxes[NUM_SAH_BINS - 1] = bins[NUM_SAH_BINS - 1].box;
+            for (UINT j = NUM_SAH_BINS - 1; j > 0; --j)
             {
-                throw - 1; // Intersection shaders not supported yet
+                rightBoxes[j - 1] = bins[j - 1].box;
+                AddExtentToBox(rightBoxes[j - 1], rightBoxes[j]);
             }
 
-            auto &triangles = geometry.Triangles;
-            if (GetPrimitiveCountFromGeometryDesc(geometry) == 0)
+            AABB leftBox;
+            InitBoxToInverseMax(leftBox);
+            UINT numLeft = 0;
 
+            for (UINT j = 0; j < NUM_SAH_BINS - 1; ++j)
             {
-                continue;
+                AddExtentToBox(leftBox, bins[j].box);
+                numLeft += bins[j].numTriangles;
+
+                if (numLeft == 0 || numLeft == numPrimitives)
+                    continue;
+
+                const float sah =
+                    numLeft * ComputeBoxSurfaceArea(leftBox) +
+                    (numPrimitives - numLeft) * ComputeBoxSurfaceArea(rightBoxes[j + 1]);
+
+                if (sah < bestSah)
+                {
+                    bestSah = sah;
+                    splitAxis = axis;
+                    splitBin = j;
+                    bFoundSplit = true;
+                }
+            }
+        }
+
+        return bFoundSplit;
+    }
+
+    static
+        void ComputeBinScale(
+            const AABB& centroidBox,
+            float binScale[3])
+    {
+        for (UINT axis = 0; axis < 3; ++axis)
+        {
+            const float extents = centroidBox.maxArr[axis] - centroidBox.minArr[axis];
+            binScale[axis] = extents > 0.0f ? NUM_SAH_BINS / extents : 0.0f;
+        }
+    }
+
+    static
+        UINT GetWidestAxis(
+            const AABB& box)
+    {
+        UINT widestAxis = 0;
+        for (UINT axis = 1; axis < 3; ++axis)
+        {
+            if (box.maxArr[axis] - box.minArr[axis] >
+                box.maxArr[widestAxis] - box.minArr[widestAxis])
+            {
+                widestAxis = axis;
             }
+        }
+        return widestAxis;
+    }
+
+    static
+        void BuildSubtree(
+            ParallelBuildContext& context,
+            UINT begin,
+            UINT end,
+            UINT nodeIndex)
+    {
+        const UINT numPrimitives = end - begin;
+
+        auto getPrimitiveBounds = [&context](UINT i, AABB& box, float3& centroid)
+        {
+            const UINT primitiveIndex = context.primitiveIndices[i];
+            box = (*context.pBoxes)[primitiveIndex];
+            centroid = context.centroids[primitiveIndex];
+        };
+
+        AABB nodeBox, centroidBox;
+        ComputeRangeBounds(context.bMultithreaded, begin, end, getPrimitiveBounds, nodeBox, centroidBox);
+        context.numNodesWritten++;
+
+        if (numPrimitives <= context.maxTrisInLeaf)
+        {
+            EncodeLeaf(context.nodes[nodeIndex], nodeBox, begin, numPrimitives);
+            return;
+        }
 
-            // 
-            const UINT64 vertexStrideDwords = triangles.VertexBuffer.StrideInBytes / 4;
-            const UINT numTris = GetPrimitiveCountFromGeometryDesc(geometry);
+        float binScale[3];
+        ComputeBinScale(centroidBox, binScale);
 
-            float *pVertexData = (float *)geometry.Triangles.VertexBuffer.StartAddress;
-            float *pIndexData = (float *)geometry.Triangles.IndexBuffer;
+        UINT splitAxis, splitBin;
+        bool bFoundSplit;
+        {
+            std::vector<SahBins> bins;
+            BinRange(context.bMultithreaded, begin, end, getPrimitiveBounds, centroidBox, binScale, bins);
+            bFoundSplit = FindBestSahSplit(bins[0], binScale, numPrimitives, splitAxis, splitBin);
+        }
 
-            const float* pVertices = (float*)(pVertexData);
-            const UINT16* pIndices = (UINT16*)(pIndexData);
+        UINT* pFirst = context.primitiveIndices.data() + begin;
+        UINT* pLast = pFirst + numPrimitives;
+        UINT numLeft;
 
-            for (UINT j = 0; j < numTris; ++j)
+        if (bFoundSplit)
+        {
+            const float rangeMin = centroidBox.minArr[splitAxis];
+            const float scale = binScale[splitAxis];
+            UINT* pMiddle = std::partition(pFirst, pLast, [&](UINT primitiveIndex)
             {
-                const UINT16 i0 = pIndices[j * 3 + 0];
-                const UINT16 i1 = pIndices[j * 3 + 1];
-                const UINT16 i2 = pIndices[j * 3 + 2];
+                return GetBinIndex(GetAxis(context.centroids[primitiveIndex], splitAxis), rangeMin, scale) <= splitBin;
+            });
+            numLeft = (UINT)(pMiddle - pFirst);
+        }
+        else
+        {
+            // Centroids are too close together for the bins to separate them,
+            // fall back to a median split along the widest axis
+            const UINT widestAxis = GetWidestAxis(centroidBox);
 
-                const float* v0 = &pVertices[i0 * vertexStrideDwords];
-                const float* v1 = &pVertices[i1 * vertexStrideDwords];
-                const float* v2 = &pVertices[i2 * vertexStrideDwords];
+            numLeft = numPrimitives / 2;
+            std::nth_element(pFirst, pFirst + numLeft, pLast, [&](UINT a, UINT b)
+            {
+                return GetAxis(context.centroids[a], widestAxis) < GetAxis(context.centroids[b], widestAxis);
+            });
+        }
+        assert(numLeft > 0 && numLeft < numPrimitives);
 
-                float* pTriVerts = &triangleVertices[triangleIndex * 9];
+        const UINT numRight = numPrimitives - numLeft;
+        const UINT rightNodeIndex = nodeIndex + 1;
+        const UINT leftNodeIndex = rightNodeIndex + (2 * numRight - 1);
+        assert(leftNodeIndex < (1 << 24));
 
-                pTriVerts[0] = v0[0];
-                pTriVerts[1] = v0[1];
-                pTriVerts[2] = v0[2];
+        AABBNode& node = context.nodes[nodeIndex];
+        EncodeNode(node, nodeBox);
+        node.internalNode.leftNodeIndex = leftNodeIndex;
+        node.rightNodeIndex = rightNodeIndex;
 
-                pTriVerts[3] = v1[0];
-                pTriVerts[4] = v1[1];
-                pTriVerts[5] = v1[2];
+        auto buildLeft = [&] { BuildSubtree(context, begin, begin + numLeft, leftNodeIndex); };
+        auto buildRight = [&] { BuildSubtree(context, begin + numLeft, end, rightNodeIndex); };
 
-                pTriVerts[6] = v2[0];
-                pTriVerts[7] = v2[1];
-                pTriVerts[8] = v2[2];
+        if (context.bMultithreaded && numPrimitives >= ParallelSubtreeThreshold)
+        {
+            concurrency::parallel_invoke(buildRight, buildLeft);
+        }
+        else
+        {
+            buildRight();
+            buildLeft();
+        }
+    }
 
-                AABB& box = boxes[triangleIndex];
-                for (UINT k = 0; k < 3; ++k)
-                {
-#define AABB_Min_Padding 0.001f
-                    box.minArr[k] = std::min(v2[k], std::min(v0[k], v1[k]));
-                    box.maxArr[k] = std::max(v2[k], std::max(v0[k], v1[k])) + AABB_Min_Padding;
-
-                    if (_isnan(box.minArr[k]) ||
-                        _isnan(box.maxArr[k]))
-                    {
-                        box.minArr[k] = 0;
-                        box.maxArr[k] = 0;
-                    }
-                }
+    //
+    // Leaves holding more than one primitive leave some of the reserved nodes unused.
+    // Re-emit the tree depth-first so the right child still follows its parent.
+    //
+    static
+        void CompactNodes(
+            std::vector<AABBNode>& nodes,
+            UINT numNodesWritten)
+    {
+        struct StackItem
+        {
+            UINT    sourceIndex;
+            UINT    parentIndex;
+            bool    bIsLeft;
+        };
 
-                // Create out internal triangle indices.
-                PrimitiveMetaData metadata;
-                metadata.GeometryContributionToHitGroupIndex = i;
-                metadata.PrimitiveIndex = triangleIndex;
-                metadata.GeometryFlags = geometry.Flags;
-                primitiveMetaData[triangleIndex] = metadata;
+        std::vector<AABBNode> compactedNodes;
+        compactedNodes.reserve(numNodesWritten);
+
+        std::vector<StackItem> stack;
+        stack.push_back({ 0, (UINT)-1, false });
+        while (!stack.empty())
+        {
+            const StackItem item = stack.back();
+            stack.pop_back();
+
+            const UINT nodeIndex = (UINT)compactedNodes.size();
+            compactedNodes.push_back(nodes[item.sourceIndex]);
 
-                // Next triangle
-                triangleIndex++;
+            if (item.parentIndex != (UINT)-1)
+            {
+                if (item.bIsLeft)
+                    compactedNodes[item.parentIndex].internalNode.leftNodeIndex = nodeIndex;
+                else
+                    compactedNodes[item.parentIndex].rightNodeIndex = nodeIndex;
+            }
+
+            const AABBNode& node = nodes[item.sourceIndex];
+            if (!node.leaf)
+            {
+                stack.push_back({ node.internalNode.leftNodeIndex, nodeIndex, true });
+                stack.push_back({ node.rightNodeIndex, nodeIndex, false });
             }
         }
 
-        //
-        // Create a BVH
-        //
+        assert(compactedNodes.size() == numNodesWritten);
+        nodes.swap(compactedNodes);
+    }
+
+    static
+        void BuildBVHParallel(
+            BVH& bvh,
+            const std::vector<AABB>& boxes,
+            const std::vector<PrimitiveMetaData>& primitiveMetaData,
+            UINT32 maxTrisInLeaf,
+            bool bMultithreaded)
+    {
+        const UINT numPrimitives = (UINT)primitiveMetaData.size();
+
+        if (numPrimitives == 0)
+        {
+            AABB emptyBox = {};
+            bvh.m_nodes.resize(1);
+            EncodeLeaf(bvh.m_nodes[0], emptyBox, 0, 0);
+            return;
+        }
 
-        BuildBVH(bvh, boxes, primitiveMetaData, MAX_TRIS_IN_LEAF);
+        ParallelBuildContext context;
+        context.pBoxes = &boxes;
+        context.centroids.resize(numPrimitives);
+        context.primitiveIndices.resize(numPrimitives);
+        context.nodes.resize(2 * numPrimitives - 1);
+        context.numNodesWritten = 0;
+        context.maxTrisInLeaf = std::max(maxTrisInLeaf, 1u);
+        context.bMultithreaded = bMultithreaded;
 
-        //
-        // Now copy and compress geometry
-        //
+        ForEachChunk(0, numPrimitives, GetChunkCount(bMultithreaded, numPrimitives), [&](UINT, UINT chunkBegin, UINT chunkEnd)
+        {
+            for (UINT i = chunkBegin; i < chunkEnd; ++i)
+            {
+                const AABB& box = boxes[i];
+                context.centroids[i] = (box.min + box.max) * 0.5f;
+                context.primitiveIndices[i] = i;
+            }
+        });
 
-        // Copy verts
-        const UINT numTris = triangleIndex;
-        bvh.m_triangles.resize(numTris * 3 * 3);
-        assert(bvh.m_triangles.size() == triangleVertices.size());
-        assert(sizeof(bvh.m_triangles[0]) == sizeof(triangleVertices[0]));
+        BuildSubtree(context, 0, numPrimitives, 0);
 
-        for (UINT i = 0; i < numTris; ++i)
+        if (context.numNodesWritten < context.nodes.size())
         {
-            UINT inputIndex = bvh.m_metadata[i].PrimitiveIndex;
-            float *pInputTriangle = &triangleVertices.data()[inputIndex * 9];
-            float* pOutputTriangle = &bvh.m_triangles[i * 9];
+            CompactNodes(context.nodes, context.numNodesWritten);
+        }
+        bvh.m_nodes.swap(context.nodes);
 
-            // Construct three planes and write to pPlanes
-            XMVECTOR V0 = XMVectorSet(pInputTriangle[0], pInputTriangle[1], pInputTriangle[2], 0.0f);
-            XMVECTOR V1 = XMVectorSet(pInputTriangle[3], pInputTriangle[4], pInputTriangle[5], 0.0f);
-            XMVECTOR V2 = XMVectorSet(pInputTriangle[6], pInputTriangle[7], pInputTriangle[8], 0.0f);
+        bvh.m_metadata.resize(numPrimitives);
+        ForEachChunk(0, numPrimitives, GetChunkCount(bMultithreaded, numPrimitives), [&](UINT, UINT chunkBegin, UINT chunkEnd)
+        {
+            for (UINT i = chunkBegin; i < chunkEnd; ++i)
+            {
+                bvh.m_metadata[i] = primitiveMetaData[context.primitiveIndices[i]];
+            }
+        });
+    }
 
-            XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 0, V0);
-            XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 1, V1);
-            XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 2, V2);
+    template<typename Function>
+    static
+        void ForEachIndex(
+            UINT count,
+            bool bMultithreaded,
+            Function function)
+    {
+        if (bMultithreaded)
+        {
+            concurrency::parallel_for(0u, count, function);
+        }
+        else
+        {
+            for (UINT i = 0; i < count; ++i)
+            {
+                function(i);
+            }
         }
     }
-}
 
-void BuildRaytracingAccelerationStructureOnCpu(
-    _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
-    _Out_ void *pData)
-{
-    FallbackLayer::BVH bvh;
-    FallbackLayer::BuildUniformBVH(pDesc->Inputs.NumDescs, pDesc->Inputs.pGeometryDescs, bvh);
+    //
+    // Primitive loading shared by the in-core and low-memory builds, mirrors
+    // LoadTrianglesFrom*.hlsl and LoadProceduralGeometry.hlsl
+    //
 
-    BYTE* outputData = (BYTE*)pData;
-    BVHOffsets offsets;
-    offsets.offsetToBoxes = sizeof(BVHOffsets);
-    const UINT sizeofBoxes = (UINT)(bvh.m_nodes.size() * sizeof(*bvh.m_nodes.data()));
-    offsets.offsetToVertices = offsets.offsetToBoxes + sizeofBoxes;
-    
-    UINT numTriangles = (UINT)bvh.m_triangles.size() / 9;
-    const UINT sizeofVertices = numTriangles * sizeof(Primitive);
-    offsets.offsetToPrimitiveMetaData = offsets.offsetToVertices + sizeofVertices;
+#define AABB_Min_Padding 0.001f
 
-    const UINT sizeofMetadata = (UINT)(bvh.m_metadata.size() * sizeof(*bvh.m_metadata.data()));
-    offsets.totalSize = offsets.offsetToPrimitiveMetaData + sizeofMetadata;
+    // Set in the first flag word of leaves holding procedural geometry, see
+    // IsProceduralGeometryFlag in RayTracingHelper.hlsli
+    static const UINT IsProceduralGeometryLeafFlag = 0x40000000;
 
-    memcpy(outputData,  &offsets, sizeof(offsets));
-    memcpy(outputData + offsets.offsetToBoxes, bvh.m_nodes.data(), sizeofBoxes);
+    static
+        UINT GetIndexFromIndexBuffer(
+            const D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC& triangles,
+            UINT index)
+    {
+        switch (triangles.IndexFormat)
+        {
+        case DXGI_FORMAT_R32_UINT:
+            return ((const UINT32*)triangles.IndexBuffer)[index];
+        case DXGI_FORMAT_R16_UINT:
+            return ((const UINT16*)triangles.IndexBuffer)[index];
+        default:
+            // No index buffer, vertices are consumed in order
+            return index;
+        }
+    }
 
-    Primitive *pPrimitives = (Primitive *)(outputData + offsets.offsetToVertices);
-    for (UINT i = 0; i < numTriangles; i++)
+    static
+        float3 TransformVertex(
+            const float3& v,
+            const float* pTransform)
     {
-        Triangle *pTriangle = (Triangle *)((BYTE *)bvh.m_triangles.data() + sizeof(Triangle) * i);
-        pPrimitives[i].PrimitiveType = TRIANGLE_TYPE;
-        pPrimitives[i].triangle = *pTriangle;
+        return float3
+        {
+            v.x * pTransform[0] + v.y * pTransform[1] + v.z * pTransform[2] + pTransform[3],
+            v.x * pTransform[4] + v.y * pTransform[5] + v.z * pTransform[6] + pTransform[7],
+            v.x * pTransform[8] + v.y * pTransform[9] + v.z * pTransform[10] + pTransform[11]
+        };
     }
-    memcpy(outputData + offsets.offsetToPrimitiveMetaData, bvh.m_metadata.data(), sizeofMetadata);
+
+    static
+        void LoadPrimitive(
+            const D3D12_RAYTRACING_GEOMETRY_DESC& geometry,
+            UINT primitiveIndex,
+            Primitive& primitive)
+    {
+        if (geometry.Type == D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES)
+        {
+            const D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC& triangles = geometry.Triangles;
+            const BYTE* pVertexData = (const BYTE*)triangles.VertexBuffer.StartAddress;
+            const float* pTransform = (const float*)triangles.Transform3x4;
+
+            primitive.PrimitiveType = TRIANGLE_TYPE;
+            for (UINT k = 0; k < 3; ++k)
+            {
+                const UINT vertexIndex = GetIndexFromIndexBuffer(triangles, primitiveIndex * 3 + k);
+                const float* pVertex = (const float*)(pVertexData + vertexIndex * triangles.VertexBuffer.StrideInBytes);
+                const float3 vertex = { pVertex[0], pVertex[1], pVertex[2] };
+                primitive.triangle.v[k] = pTransform ? TransformVertex(vertex, pTransform) : vertex;
+            }
+        }
+        else
+        {
+            const D3D12_RAYTRACING_GEOMETRY_AABBS_DESC& aabbs = geometry.AABBs;
+            const D3D12_RAYTRACING_AABB* pAABB = (const D3D12_RAYTRACING_AABB*)(aabbs.AABBs.StartAddress + primitiveIndex * aabbs.AABBs.StrideInBytes);
+
+            primitive.PrimitiveType = PROCEDURAL_PRIMITIVE_TYPE;
+            primitive.aabb.min = float3{ pAABB->MinX, pAABB->MinY, pAABB->MinZ };
+            primitive.aabb.max = float3{ pAABB->MaxX, pAABB->MaxY, pAABB->MaxZ };
+        }
+    }
+
+    static
+        void ComputePrimitiveBox(
+            const Primitive& primitive,
+            AABB& box)
+    {
+        if (primitive.PrimitiveType == TRIANGLE_TYPE)
+        {
+            const Triangle& triangle = primitive.triangle;
+            box.min = min(triangle.v0, min(triangle.v1, triangle.v2));
+            box.max = max(triangle.v0, max(triangle.v1, triangle.v2));
+            box.max = box.max + float3{ AABB_Min_Padding, AABB_Min_Padding, AABB_Min_Padding };
+        }
+        else
+        {
+            box = primitive.aabb;
+        }
+
+        for (UINT k = 0; k < 3; ++k)
+        {
+            if (_isnan(box.minArr[k]) ||
+                _isnan(box.maxArr[k]))
+            {
+                box.minArr[k] = 0;
+                box.maxArr[k] = 0;
+            }
+        }
+    }
+
+    static
+        void ValidateGeometryDesc(
+            const D3D12_RAYTRACING_GEOMETRY_DESC& geometry)
+    {
+        if (geometry.Type == D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES)
+        {
+            if (!IsVertexBufferFormatSupported(geometry.Triangles.VertexFormat))
+            {
+                ThrowFailure(E_NOTIMPL, L"Unsupported vertex buffer format provided");
+            }
+        }
+        else if (geometry.Type == D3D12_RAYTRACING_GEOMETRY_TYPE_PROCEDURAL_PRIMITIVE_AABBS)
+        {
+            if (geometry.AABBs.AABBs.StartAddress == 0 && geometry.AABBs.AABBCount > 0)
+            {
+                ThrowFailure(E_INVALIDARG, L"Non-zero AABBCount provided with a null AABB buffer");
+            }
+        }
+        else
+        {
+            ThrowFailure(E_INVALIDARG, L"Unrecognized D3D12_RAYTRACING_GEOMETRY_TYPE");
+        }
+    }
+
+    //
+    // Intersection shaders are invoked once per leaf, so leaves can only hold
+    // more than one primitive when there is no procedural geometry
+    //
+    static
+        UINT GetMaxPrimitivesInLeaf(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs,
+            const CpuBvh2BuildSettings& settings)
+    {
+        for (UINT i = 0; i < inputs.NumDescs; ++i)
+        {
+            if (GetGeometryDesc(inputs, i).Type == D3D12_RAYTRACING_GEOMETRY_TYPE_PROCEDURAL_PRIMITIVE_AABBS)
+            {
+                return 1;
+            }
+        }
+        return std::max(settings.MaxTrianglesInLeaf, 1u);
+    }
+
+    static
+        void MarkProceduralLeaves(
+            AABBNode* pNodes,
+            UINT numNodes,
+            const Primitive* pPrimitives,
+            bool bMultithreaded)
+    {
+        ForEachIndex(numNodes, bMultithreaded, [&](UINT i)
+        {
+            AABBNode& node = pNodes[i];
+            if (node.leaf && node.numTriangles > 0 &&
+                pPrimitives[node.leafNode.firstTriangleId].PrimitiveType == PROCEDURAL_PRIMITIVE_TYPE)
+            {
+                node.nodeAllBits |= IsProceduralGeometryLeafFlag;
+            }
+        });
+    }
+
+    void BuildUniformBVH(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+        _In_  const CpuBvh2BuildSettings &settings,
+        BVH &bvh)
+    {
+        const UINT NumElements = inputs.NumDescs;
+        for (UINT i = 0; i < NumElements; ++i)
+        {
+            ValidateGeometryDesc(GetGeometryDesc(inputs, i));
+        }
+
+        const UINT totalNumberOfPrimitives = GetTotalPrimitiveCount(inputs);
+        const bool bMultithreaded = settings.UseMultithreadedBuild && !settings.UseReferenceBuilder;
+
+        //
+        // Load primitives and create AABBs
+        //
+
+        std::vector<AABB> boxes;
+        boxes.resize(totalNumberOfPrimitives);
+
+        std::vector<Primitive> primitives;
+        primitives.resize(totalNumberOfPrimitives);
+
+        std::vector<PrimitiveMetaData> primitiveMetaData;
+        primitiveMetaData.resize(totalNumberOfPrimitives);
+
+        // The builders identify primitives by PrimitiveIndex, so they are handed
+        // global indices and the real, per-geometry metadata is looked up afterwards
+        std::vector<PrimitiveMetaData> buildKeys;
+        buildKeys.resize(totalNumberOfPrimitives);
+
+        UINT primitiveOffset = 0;
+        for (UINT i = 0; i < NumElements; ++i)
+        {
+            const D3D12_RAYTRACING_GEOMETRY_DESC &geometry = GetGeometryDesc(inputs, i);
+            const UINT numGeometryPrimitives = GetPrimitiveCountFromGeometryDesc(geometry);
+
+            ForEachIndex(numGeometryPrimitives, bMultithreaded, [&](UINT j)
+            {
+                const UINT globalIndex = primitiveOffset + j;
+
+                LoadPrimitive(geometry, j, primitives[globalIndex]);
+                ComputePrimitiveBox(primitives[globalIndex], boxes[globalIndex]);
+
+                PrimitiveMetaData metadata;
+                metadata.GeometryContributionToHitGroupIndex = i;
+                metadata.PrimitiveIndex = j;
+                metadata.GeometryFlags = geometry.Flags;
+                primitiveMetaData[globalIndex] = metadata;
+
+                metadata.PrimitiveIndex = globalIndex;
+                buildKeys[globalIndex] = metadata;
+            });
+
+            primitiveOffset += numGeometryPrimitives;
+        }
+
+        //
+        // Create a BVH
+        //
+
+        const UINT maxPrimitivesInLeaf = GetMaxPrimitivesInLeaf(inputs, settings);
+        if (settings.UseReferenceBuilder)
+        {
+            BuildBVHReference(bvh, boxes, buildKeys, maxPrimitivesInLeaf);
+        }
+        else
+        {
+            BuildBVHParallel(bvh, boxes, buildKeys, maxPrimitivesInLeaf, bMultithreaded);
+        }
+
+        //
+        // Reorder primitives and metadata to match the leaves
+        //
+
+        const UINT numPrimitives = (UINT)bvh.m_metadata.size();
+        bvh.m_primitives.resize(numPrimitives);
+        ForEachIndex(numPrimitives, bMultithreaded, [&](UINT i)
+        {
+            const UINT inputIndex = bvh.m_metadata[i].PrimitiveIndex;
+            bvh.m_primitives[i] = primitives[inputIndex];
+            bvh.m_metadata[i] = primitiveMetaData[inputIndex];
+        });
+
+        MarkProceduralLeaves(bvh.m_nodes.data(), (UINT)bvh.m_nodes.size(), bvh.m_primitives.data(), bMultithreaded);
+    }
+
+    //
+    // Low-memory build
+    //
+    // Nothing is copied up front. The PrimitiveMetaData array of the output
+    // doubles as the list of primitives being split, and primitive bounds are
+    // recomputed from the geometry buffers on every pass. Once a subtree fits in
+    // the memory budget it is handed to the in-core builder. Primitives are written
+    // straight into the Primitive array in leaf order at the end.
+    //
+
+    // Peak working memory per primitive of a subtree built in core. It peaks
+    // while CompactNodes copies the 2N-1 reserved nodes: the boxes and metadata
+    // loaded by BuildStreamedSubtreeInCore, the centroids and indices of
+    // BuildBVHParallel and both node arrays are alive then. Once the nodes are
+    // compacted, the reordered metadata takes less than the freed node array.
+    static const UINT InCoreBytesPerPrimitive =
+        sizeof(AABB) + sizeof(PrimitiveMetaData) + sizeof(float3) + sizeof(UINT) + 2 * 2 * sizeof(AABBNode);
+
+    struct StreamingBuildContext
+    {
+        const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS* pInputs;
+        PrimitiveMetaData*      pMetadata;
+        AABBNode*               pNodes;
+        UINT                    numNodesWritten;
+        UINT                    maxTrisInLeaf;
+        UINT                    maxInCorePrimitives;
+        bool                    bMultithreaded;
+    };
+
+    static
+        void GetStreamedPrimitiveBounds(
+            const StreamingBuildContext& context,
+            const PrimitiveMetaData& metadata,
+            AABB& box,
+            float3& centroid)
+    {
+        const D3D12_RAYTRACING_GEOMETRY_DESC& geometry = GetGeometryDesc(*context.pInputs, metadata.GeometryContributionToHitGroupIndex);
+
+        Primitive primitive;
+        LoadPrimitive(geometry, metadata.PrimitiveIndex, primitive);
+        ComputePrimitiveBox(primitive, box);
+        centroid = (box.min + box.max) * 0.5f;
+    }
+
+    static
+        float GetStreamedCentroid(
+            const StreamingBuildContext& context,
+            const PrimitiveMetaData& metadata,
+            UINT axis)
+    {
+        AABB box;
+        float3 centroid;
+        GetStreamedPrimitiveBounds(context, metadata, box, centroid);
+        return GetAxis(centroid, axis);
+    }
+
+    //
+    // Loads the boxes of a subtree that fits in the memory budget and builds it
+    // with BuildBVHParallel, then appends its nodes to the output
+    //
+    static
+        UINT BuildStreamedSubtreeInCore(
+            StreamingBuildContext& context,
+            UINT begin,
+            UINT end)
+    {
+        const UINT numPrimitives = end - begin;
+
+        BVH subtree;
+        {
+            std::vector<AABB> boxes(numPrimitives);
+            std::vector<PrimitiveMetaData> metadata(context.pMetadata + begin, context.pMetadata + end);
+            ForEachChunk(0, numPrimitives, GetChunkCount(context.bMultithreaded, numPrimitives), [&](UINT, UINT chunkBegin, UINT chunkEnd)
+            {
+                for (UINT i = chunkBegin; i < chunkEnd; ++i)
+                {
+                    float3 centroid;
+                    GetStreamedPrimitiveBounds(context, metadata[i], boxes[i], centroid);
+                }
+            });
+
+            BuildBVHParallel(subtree, boxes, metadata, context.maxTrisInLeaf, context.bMultithreaded);
+        }
+
+        const UINT firstNodeIndex = context.numNodesWritten;
+        const UINT numNodes = (UINT)subtree.m_nodes.size();
+        for (UINT i = 0; i < numNodes; ++i)
+        {
+            AABBNode node = subtree.m_nodes[i];
+            if (node.leaf)
+            {
+                node.leafNode.firstTriangleId += begin;
+            }
+            else
+            {
+                node.internalNode.leftNodeIndex += firstNodeIndex;
+                node.rightNodeIndex += firstNodeIndex;
+            }
+            context.pNodes[firstNodeIndex + i] = node;
+        }
+        context.numNodesWritten += numNodes;
+
+        std::copy(subtree.m_metadata.begin(), subtree.m_metadata.end(), context.pMetadata + begin);
+
+        return firstNodeIndex;
+    }
+
+    //
+    // Same split logic as BuildSubtree, but nodes are allocated depth-first as
+    // they are emitted so no space is reserved for unused nodes
+    //
+    static
+        UINT BuildStreamedSubtree(
+            StreamingBuildContext& context,
+            UINT begin,
+            UINT end)
+    {
+        const UINT numPrimitives = end - begin;
+        if (numPrimitives <= context.maxInCorePrimitives)
+        {
+            return BuildStreamedSubtreeInCore(context, begin, end);
+        }
+
+        auto getPrimitiveBounds = [&context](UINT i, AABB& box, float3& centroid)
+        {
+            GetStreamedPrimitiveBounds(context, context.pMetadata[i], box, centroid);
+        };
+
+        AABB nodeBox, centroidBox;
+        ComputeRangeBounds(context.bMultithreaded, begin, end, getPrimitiveBounds, nodeBox, centroidBox);
+        const UINT nodeIndex = context.numNodesWritten++;
+
+        if (numPrimitives <= context.maxTrisInLeaf)
+        {
+            EncodeLeaf(context.pNodes[nodeIndex], nodeBox, begin, numPrimitives);
+            return nodeIndex;
+        }
+
+        float binScale[3];
+        ComputeBinScale(centroidBox, binScale);
+
+        UINT splitAxis, splitBin;
+        bool bFoundSplit;
+        {
+            std::vector<SahBins> bins;
+            BinRange(context.bMultithreaded, begin, end, getPrimitiveBounds, centroidBox, binScale, bins);
+            bFoundSplit = FindBestSahSplit(bins[0], binScale, numPrimitives, splitAxis, splitBin);
+        }
+
+        PrimitiveMetaData* pFirst = context.pMetadata + begin;
+        PrimitiveMetaData* pLast = pFirst + numPrimitives;
+        UINT numLeft;
+
+        if (bFoundSplit)
+        {
+            const float rangeMin = centroidBox.minArr[splitAxis];
+            const float scale = binScale[splitAxis];
+            PrimitiveMetaData* pMiddle = std::partition(pFirst, pLast, [&](const PrimitiveMetaData& metadata)
+            {
+                return GetBinIndex(GetStreamedCentroid(context, metadata, splitAxis), rangeMin, scale) <= splitBin;
+            });
+            numLeft = (UINT)(pMiddle - pFirst);
+        }
+        else
+        {
+            const UINT widestAxis = GetWidestAxis(centroidBox);
+
+            numLeft = numPrimitives / 2;
+            std::nth_element(pFirst, pFirst + numLeft, pLast, [&](const PrimitiveMetaData& a, const PrimitiveMetaData& b)
+            {
+                return GetStreamedCentroid(context, a, widestAxis) < GetStreamedCentroid(context, b, widestAxis);
+            });
+        }
+        assert(numLeft > 0 && numLeft < numPrimitives);
+
+        const UINT rightNodeIndex = BuildStreamedSubtree(context, begin + numLeft, end);
+        const UINT leftNodeIndex = BuildStreamedSubtree(context, begin, begin + numLeft);
+        assert(rightNodeIndex == nodeIndex + 1);
+        assert(leftNodeIndex < (1 << 24));
+
+        AABBNode& node = context.pNodes[nodeIndex];
+        EncodeNode(node, nodeBox);
+        node.internalNode.leftNodeIndex = leftNodeIndex;
+        node.rightNodeIndex = rightNodeIndex;
+
+        return nodeIndex;
+    }
+
+    //
+    // Writes the BVH straight into pOutputData, which must be at least as large as
+    // the prebuild size of the GPU builder. While building, the metadata is kept
+    // past the worst case node count and it is moved down once the final node
+    // count is known.
+    //
+    static
+        void BuildBVHLowMemory(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs,
+            const CpuBvh2BuildSettings& settings,
+            BYTE* pOutputData,
+            UINT& numNodes,
+            UINT& numPrimitives)
+    {
+        for (UINT i = 0; i < inputs.NumDescs; ++i)
+        {
+            ValidateGeometryDesc(GetGeometryDesc(inputs, i));
+        }
+
+        const bool bMultithreaded = settings.UseMultithreadedBuild;
+        numPrimitives = GetTotalPrimitiveCount(inputs);
+        const UINT maxNumNodes = std::max(2 * numPrimitives, 2u) - 1;
+
+        BVHOffsets offsets;
+        offsets.offsetToBoxes = sizeof(BVHOffsets);
+        AABBNode* pNodes = (AABBNode*)(pOutputData + offsets.offsetToBoxes);
+
+        const UINT offsetToWorkingMetadata = offsets.offsetToBoxes + maxNumNodes * sizeof(AABBNode) + numPrimitives * sizeof(Primitive);
+        PrimitiveMetaData* pWorkingMetadata = (PrimitiveMetaData*)(pOutputData + offsetToWorkingMetadata);
+
+        UINT primitiveOffset = 0;
+        for (UINT i = 0; i < inputs.NumDescs; ++i)
+        {
+            const D3D12_RAYTRACING_GEOMETRY_DESC& geometry = GetGeometryDesc(inputs, i);
+            const UINT numGeometryPrimitives = GetPrimitiveCountFromGeometryDesc(geometry);
+
+            ForEachIndex(numGeometryPrimitives, bMultithreaded, [&](UINT j)
+            {
+                PrimitiveMetaData& metadata = pWorkingMetadata[primitiveOffset + j];
+                metadata.GeometryContributionToHitGroupIndex = i;
+                metadata.PrimitiveIndex = j;
+                metadata.GeometryFlags = geometry.Flags;
+            });
+
+            primitiveOffset += numGeometryPrimitives;
+        }
+
+        if (numPrimitives == 0)
+        {
+            AABB emptyBox = {};
+            EncodeLeaf(pNodes[0], emptyBox, 0, 0);
+            numNodes = 1;
+        }
+        else
+        {
+            StreamingBuildContext context;
+            context.pInputs = &inputs;
+            context.pMetadata = pWorkingMetadata;
+            context.pNodes = pNodes;
+            context.numNodesWritten = 0;
+            context.maxTrisInLeaf = GetMaxPrimitivesInLeaf(inputs, settings);
+            context.maxInCorePrimitives = (UINT)std::max<SIZE_T>(settings.LowMemoryBudgetInBytes / InCoreBytesPerPrimitive, 1);
+            context.bMultithreaded = bMultithreaded;
+
+            BuildStreamedSubtree(context, 0, numPrimitives);
+            numNodes = context.numNodesWritten;
+        }
+
+        offsets.offsetToVertices = offsets.offsetToBoxes + numNodes * sizeof(AABBNode);
+        offsets.offsetToPrimitiveMetaData = offsets.offsetToVertices + numPrimitives * sizeof(Primitive);
+        offsets.totalSize = offsets.offsetToPrimitiveMetaData + numPrimitives * sizeof(PrimitiveMetaData);
+
+        // The Primitive array ends at or before the working metadata, so it can be
+        // filled before the metadata is moved into place
+        Primitive* pPrimitives = (Primitive*)(pOutputData + offsets.offsetToVertices);
+        ForEachIndex(numPrimitives, bMultithreaded, [&](UINT i)
+        {
+            const PrimitiveMetaData& metadata = pWorkingMetadata[i];
+            const D3D12_RAYTRACING_GEOMETRY_DESC& geometry = GetGeometryDesc(inputs, metadata.GeometryContributionToHitGroupIndex);
+
+            LoadPrimitive(geometry, metadata.PrimitiveIndex, pPrimitives[i]);
+        });
+        MarkProceduralLeaves(pNodes, numNodes, pPrimitives, bMultithreaded);
+
+        memmove(pOutputData + offsets.offsetToPrimitiveMetaData, pWorkingMetadata, numPrimitives * sizeof(PrimitiveMetaData));
+        memcpy(pOutputData, &offsets, sizeof(offsets));
+    }
+
+    static
+        void WriteBottomLevelBVH(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs,
+            const CpuBvh2BuildSettings& settings,
+            BYTE* pOutputData,
+            UINT& numNodes,
+            UINT& numPrimitives)
+    {
+        BVH bvh;
+        BuildUniformBVH(inputs, settings, bvh);
+
+        numNodes = (UINT)bvh.m_nodes.size();
+        numPrimitives = (UINT)bvh.m_primitives.size();
+
+        BVHOffsets offsets;
+        offsets.offsetToBoxes = sizeof(BVHOffsets);
+        const UINT sizeofBoxes = numNodes * sizeof(AABBNode);
+        offsets.offsetToVertices = offsets.offsetToBoxes + sizeofBoxes;
+
+        const UINT sizeofPrimitives = numPrimitives * sizeof(Primitive);
+        offsets.offsetToPrimitiveMetaData = offsets.offsetToVertices + sizeofPrimitives;
+
+        const UINT sizeofMetadata = numPrimitives * sizeof(PrimitiveMetaData);
+        offsets.totalSize = offsets.offsetToPrimitiveMetaData + sizeofMetadata;
+
+        memcpy(pOutputData, &offsets, sizeof(offsets));
+        memcpy(pOutputData + offsets.offsetToBoxes, bvh.m_nodes.data(), sizeofBoxes);
+        memcpy(pOutputData + offsets.offsetToVertices, bvh.m_primitives.data(), sizeofPrimitives);
+        memcpy(pOutputData + offsets.offsetToPrimitiveMetaData, bvh.m_metadata.data(), sizeofMetadata);
+    }
+
+    //
+    // Top-level build
+    //
+    // AccelerationStructure in each instance desc is the CPU address of a bottom
+    // level built with BuildRaytracingAccelerationStructureOnCpu. The output follows
+    // the top-level layout of the GPU builder: the second offset points at a
+    // BVHMetadata array indexed by the leaf index stored in each leaf node, and
+    // each instance transform is stored inverted (WorldToObject). Instance descs
+    // are copied as is, so the bottom-level addresses need to be replaced with
+    // wrapped GPU pointers once everything is uploaded.
+    //
+
+    static
+        void ValidateDescsLayout(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs)
+    {
+        if (inputs.DescsLayout != D3D12_ELEMENTS_LAYOUT_ARRAY &&
+            inputs.DescsLayout != D3D12_ELEMENTS_LAYOUT_ARRAY_OF_POINTERS)
+        {
+            ThrowFailure(E_INVALIDARG, L"Unexpected value for D3D12_ELEMENTS_LAYOUT");
+        }
+    }
+
+    //
+    // The layout is checked by ValidateDescsLayout before any build starts
+    //
+    static
+        const D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC& GetInstanceDesc(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs,
+            UINT instanceIndex)
+    {
+        if (inputs.DescsLayout == D3D12_ELEMENTS_LAYOUT_ARRAY_OF_POINTERS)
+        {
+            return *((const D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC* const*)inputs.InstanceDescs)[instanceIndex];
+        }
+
+        assert(inputs.DescsLayout == D3D12_ELEMENTS_LAYOUT_ARRAY);
+        return ((const D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC*)inputs.InstanceDescs)[instanceIndex];
+    }
+
+    static
+        void TransformBox(
+            const AABB& box,
+            const FLOAT transform[3][4],
+            AABB& transformedBox)
+    {
+        const float3 center = (box.min + box.max) * 0.5f;
+        const float3 extents = (box.max - box.min) * 0.5f;
+        for (UINT row = 0; row < 3; ++row)
+        {
+            const float transformedCenter =
+                transform[row][0] * center.x + transform[row][1] * center.y + transform[row][2] * center.z + transform[row][3];
+            const float transformedExtents =
+                std::abs(transform[row][0]) * extents.x + std::abs(transform[row][1]) * extents.y + std::abs(transform[row][2]) * extents.z;
+
+            transformedBox.minArr[row] = transformedCenter - transformedExtents;
+            transformedBox.maxArr[row] = transformedCenter + transformedExtents;
+        }
+    }
+
+    static
+        void InvertAffineTransform(
+            const FLOAT transform[3][4],
+            FLOAT inverse[3][4])
+    {
+        using namespace DirectX;
+
+        // DirectXMath multiplies row vectors, so the matrix is transposed
+        const XMMATRIX objectToWorld(
+            transform[0][0], transform[1][0], transform[2][0], 0.0f,
+            transform[0][1], transform[1][1], transform[2][1], 0.0f,
+            transform[0][2], transform[1][2], transform[2][2], 0.0f,
+            transform[0][3], transform[1][3], transform[2][3], 1.0f);
+
+        XMFLOAT4X4 worldToObject;
+        XMStoreFloat4x4(&worldToObject, XMMatrixInverse(nullptr, objectToWorld));
+        for (UINT row = 0; row < 3; ++row)
+        {
+            for (UINT column = 0; column < 4; ++column)
+            {
+                inverse[row][column] = worldToObject.m[column][row];
+            }
+        }
+    }
+
+    static
+        void ComputeInstanceBox(
+            const D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC& instanceDesc,
+            AABB& box)
+    {
+        const BYTE* pBottomLevel = (const BYTE*)instanceDesc.AccelerationStructure.GpuVA;
+        const BVHOffsets& bottomLevelOffsets = *(const BVHOffsets*)pBottomLevel;
+
+        // The AABBs for all top level nodes need to be in world-space
+        AABB bottomLevelBox;
+        DecompressAABB(bottomLevelBox, *(const AABBNode*)(pBottomLevel + bottomLevelOffsets.offsetToBoxes));
+        TransformBox(bottomLevelBox, instanceDesc.Transform, box);
+    }
+
+    static
+        void WriteInstanceMetadata(
+            const D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC& instanceDesc,
+            UINT instanceIndex,
+            BVHMetadata& metadata)
+    {
+        metadata.instanceDesc = instanceDesc;
+        InvertAffineTransform(instanceDesc.Transform, metadata.instanceDesc.Transform);
+        for (UINT row = 0; row < 3; ++row)
+        {
+            metadata.ObjectToWorld[row] = float4{
+                instanceDesc.Transform[row][0],
+                instanceDesc.Transform[row][1],
+                instanceDesc.Transform[row][2],
+                instanceDesc.Transform[row][3] };
+        }
+        metadata.InstanceIndex = instanceIndex;
+    }
+
+    static
+        void WriteTopLevelBVH(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs,
+            const CpuBvh2BuildSettings& settings,
+            BYTE* pOutputData,
+            UINT& numNodes,
+            UINT& numInstances)
+    {
+        numInstances = inputs.NumDescs;
+        const bool bMultithreaded = settings.UseMultithreadedBuild;
+
+        std::vector<AABB> boxes(numInstances);
+        std::vector<PrimitiveMetaData> buildKeys(numInstances);
+        ForEachIndex(numInstances, bMultithreaded, [&](UINT i)
+        {
+            ComputeInstanceBox(GetInstanceDesc(inputs, i), boxes[i]);
+
+            buildKeys[i] = {};
+            buildKeys[i].PrimitiveIndex = i;
+        });
+
+        // Traversal expects one instance per leaf. The reference builder is
+        // bottom-level only as it doesn't use the GPU leaf encoding.
+        BVH bvh;
+        if (numInstances > 0)
+        {
+            BuildBVHParallel(bvh, boxes, buildKeys, 1, bMultithreaded);
+        }
+        else
+        {
+            // Same as the GPU builder, a single zeroed node
+            bvh.m_nodes.resize(1);
+            memset(bvh.m_nodes.data(), 0, sizeof(AABBNode));
+        }
+        numNodes = (UINT)bvh.m_nodes.size();
+
+        BVHOffsets offsets;
+        offsets.offsetToBoxes = sizeof(BVHOffsets);
+        const UINT sizeofBoxes = numNodes * sizeof(AABBNode);
+
+        // Top levels have no primitives, the second offset points at the BVHMetadata
+        offsets.offsetToVertices = offsets.offsetToBoxes + sizeofBoxes;
+        offsets.totalSize = offsets.offsetToVertices + numInstances * sizeof(BVHMetadata);
+        offsets.offsetToPrimitiveMetaData = offsets.totalSize;
+
+        memcpy(pOutputData, &offsets, sizeof(offsets));
+        memcpy(pOutputData + offsets.offsetToBoxes, bvh.m_nodes.data(), sizeofBoxes);
+
+        BVHMetadata* pMetadata = (BVHMetadata*)(pOutputData + offsets.offsetToVertices);
+        ForEachIndex(numInstances, bMultithreaded, [&](UINT i)
+        {
+            const UINT instanceIndex = bvh.m_metadata[i].PrimitiveIndex;
+            WriteInstanceMetadata(GetInstanceDesc(inputs, instanceIndex), instanceIndex, pMetadata[i]);
+        });
+    }
+
+    //
+    // LBVH build
+    //
+    // Elements are loaded the way the GPU passes see them and handed to
+    // BuildLbvh. Primitives, or instance metadata, are then moved into leaf
+    // order like RearrangeElementsPass. Every leaf holds a single element.
+    //
+
+    static
+        void GetLbvhPrimitiveBounds(
+            const Primitive& primitive,
+            AABB& sceneBox,
+            AABB& leafBox,
+            float3& centroid)
+    {
+        if (primitive.PrimitiveType == TRIANGLE_TYPE)
+        {
+            // CalculateSceneAABBFromPrimitives.hlsl and GetBoxDataFromTriangle
+            const Triangle& triangle = primitive.triangle;
+            sceneBox.min = min(min(triangle.v0, triangle.v1), triangle.v2);
+            sceneBox.max = max(max(triangle.v0, triangle.v1), triangle.v2);
+            centroid = (triangle.v0 + triangle.v1 + triangle.v2) / 3.0f;
+
+            leafBox = sceneBox;
+            leafBox.min = min(leafBox.min, leafBox.max - float3{ AABB_Min_Padding, AABB_Min_Padding, AABB_Min_Padding });
+        }
+        else
+        {
+            sceneBox = primitive.aabb;
+            leafBox = primitive.aabb;
+            centroid = (primitive.aabb.min + primitive.aabb.max) / 2.0f;
+        }
+    }
+
+    static
+        void LoadLbvhBottomLevelElements(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs,
+            bool bMultithreaded,
+            LbvhElements& elements,
+            std::vector<Primitive>& primitives,
+            std::vector<PrimitiveMetaData>& primitiveMetaData)
+    {
+        for (UINT i = 0; i < inputs.NumDescs; ++i)
+        {
+            ValidateGeometryDesc(GetGeometryDesc(inputs, i));
+        }
+
+        const UINT totalNumberOfPrimitives = GetTotalPrimitiveCount(inputs);
+        elements.Boxes.resize(totalNumberOfPrimitives);
+        elements.Centroids.resize(totalNumberOfPrimitives);
+        primitives.resize(totalNumberOfPrimitives);
+        primitiveMetaData.resize(totalNumberOfPrimitives);
+
+        UINT primitiveOffset = 0;
+        for (UINT i = 0; i < inputs.NumDescs; ++i)
+        {
+            const D3D12_RAYTRACING_GEOMETRY_DESC &geometry = GetGeometryDesc(inputs, i);
+            const UINT numGeometryPrimitives = GetPrimitiveCountFromGeometryDesc(geometry);
+
+            ForEachIndex(numGeometryPrimitives, bMultithreaded, [&](UINT j)
+            {
+                const UINT globalIndex = primitiveOffset + j;
+
+                LoadPrimitive(geometry, j, primitives[globalIndex]);
+
+                AABB unusedSceneBox;
+                GetLbvhPrimitiveBounds(primitives[globalIndex], unusedSceneBox, elements.Boxes[globalIndex], elements.Centroids[globalIndex]);
+
+                PrimitiveMetaData& metadata = primitiveMetaData[globalIndex];
+                metadata.GeometryContributionToHitGroupIndex = i;
+                metadata.PrimitiveIndex = j;
+                metadata.GeometryFlags = geometry.Flags;
+            });
+
+            primitiveOffset += numGeometryPrimitives;
+        }
+
+        AABB unusedCentroidBox;
+        ComputeRangeBounds(bMultithreaded, 0, totalNumberOfPrimitives, [&](UINT i, AABB& box, float3& centroid)
+        {
+            AABB unusedLeafBox;
+            GetLbvhPrimitiveBounds(primitives[i], box, unusedLeafBox, centroid);
+        }, elements.SceneBox, unusedCentroidBox);
+    }
+
+    //
+    // TransformAABB in RayTracingHelper.hlsli. Transforming the corners gives
+    // slightly different boxes than TransformBox, which the GPU doesn't use.
+    //
+    static
+        void TransformBoxCorners(
+            const AABB& box,
+            const FLOAT transform[3][4],
+            AABB& transformedBox)
+    {
+        InitBoxToInverseMax(transformedBox);
+        for (UINT corner = 0; corner < 8; ++corner)
+        {
+            const float3 vertex =
+            {
+                (corner & 4) ? box.max.x : box.min.x,
+                (corner & 2) ? box.max.y : box.min.y,
+                (corner & 1) ? box.max.z : box.min.z
+            };
+            AddPointToBox(transformedBox, TransformVertex(vertex, &transform[0][0]));
+        }
+    }
+
+    static
+        void LoadLbvhTopLevelElements(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs,
+            bool bMultithreaded,
+            LbvhElements& elements)
+    {
+        const UINT numInstances = inputs.NumDescs;
+        elements.Boxes.resize(numInstances);
+        elements.Centroids.resize(numInstances);
+
+        // TopLevelLoadAABBs.hlsli writes the boxes as leaf nodes and
+        // CalculateMortonCodesForAABBs.hlsl and CalculateSceneAABBFromBVHs.hlsl
+        // read them back, so both see the encoded box
+        std::vector<AABB> encodedBoxes(numInstances);
+        ForEachIndex(numInstances, bMultithreaded, [&](UINT i)
+        {
+            const D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC& instanceDesc = GetInstanceDesc(inputs, i);
+            const BYTE* pBottomLevel = (const BYTE*)instanceDesc.AccelerationStructure.GpuVA;
+            const BVHOffsets& bottomLevelOffsets = *(const BVHOffsets*)pBottomLevel;
+
+            AABB bottomLevelBox;
+            DecompressAABB(bottomLevelBox, *(const AABBNode*)(pBottomLevel + bottomLevelOffsets.offsetToBoxes));
+            TransformBoxCorners(bottomLevelBox, instanceDesc.Transform, elements.Boxes[i]);
+
+            const float3 center = (elements.Boxes[i].min + elements.Boxes[i].max) * 0.5f;
+            const float3 halfDim = elements.Boxes[i].max - center;
+            encodedBoxes[i].min = center - halfDim;
+            encodedBoxes[i].max = center + halfDim;
+            elements.Centroids[i] = center;
+        });
+
+        AABB unusedCentroidBox;
+        ComputeRangeBounds(bMultithreaded, 0, numInstances, [&](UINT i, AABB& box, float3& centroid)
+        {
+            box = encodedBoxes[i];
+            centroid = elements.Centroids[i];
+        }, elements.SceneBox, unusedCentroidBox);
+    }
+
+    static
+        void BuildLbvhFromInputs(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs,
+            const CpuBvh2BuildSettings& settings,
+            CpuLbvh& lbvh,
+            std::vector<Primitive>* pPrimitives,
+            std::vector<PrimitiveMetaData>* pPrimitiveMetaData)
+    {
+        const bool bMultithreaded = settings.UseMultithreadedBuild;
+
+        LbvhElements elements;
+        UINT numTreeletReorderPasses = 0;
+        if (inputs.Type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL)
+        {
+            LoadLbvhTopLevelElements(inputs, bMultithreaded, elements);
+        }
+        else
+        {
+            std::vector<Primitive> primitives;
+            std::vector<PrimitiveMetaData> primitiveMetaData;
+            LoadLbvhBottomLevelElements(inputs, bMultithreaded, elements,
+                pPrimitives ? *pPrimitives : primitives,
+                pPrimitiveMetaData ? *pPrimitiveMetaData : primitiveMetaData);
+
+#if ENABLE_TREELET_REORDERING
+            // GpuBvh2Builder only reorders bottom levels
+            numTreeletReorderPasses = TreeletReorder::GetNumOptimizationPasses(inputs.Flags);
+#endif
+        }
+
+        BuildLbvh(elements, settings.LbvhMortonCodeBits, numTreeletReorderPasses, bMultithreaded, lbvh);
+    }
+
+    static
+        void WriteBottomLevelLbvh(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs,
+            const CpuBvh2BuildSettings& settings,
+            BYTE* pOutputData,
+            UINT& numNodes,
+            UINT& numPrimitives)
+    {
+        const bool bMultithreaded = settings.UseMultithreadedBuild;
+
+        CpuLbvh lbvh;
+        std::vector<Primitive> primitives;
+        std::vector<PrimitiveMetaData> primitiveMetaData;
+        BuildLbvhFromInputs(inputs, settings, lbvh, &primitives, &primitiveMetaData);
+
+        numPrimitives = (UINT)primitives.size();
+        numNodes = std::max((UINT)lbvh.Nodes.size(), 1u);
+
+        BVHOffsets offsets;
+        offsets.offsetToBoxes = sizeof(BVHOffsets);
+        offsets.offsetToVertices = offsets.offsetToBoxes + numNodes * sizeof(AABBNode);
+        offsets.offsetToPrimitiveMetaData = offsets.offsetToVertices + numPrimitives * sizeof(Primitive);
+        offsets.totalSize = offsets.offsetToPrimitiveMetaData + numPrimitives * sizeof(PrimitiveMetaData);
+        memcpy(pOutputData, &offsets, sizeof(offsets));
+
+        AABBNode* pNodes = (AABBNode*)(pOutputData + offsets.offsetToBoxes);
+        if (numPrimitives == 0)
+        {
+            AABB emptyBox = {};
+            EncodeLeaf(pNodes[0], emptyBox, 0, 0);
+        }
+        else
+        {
+            memcpy(pNodes, lbvh.Nodes.data(), numNodes * sizeof(AABBNode));
+        }
+
+        Primitive* pPrimitives = (Primitive*)(pOutputData + offsets.offsetToVertices);
+        PrimitiveMetaData* pMetadata = (PrimitiveMetaData*)(pOutputData + offsets.offsetToPrimitiveMetaData);
+        ForEachIndex(numPrimitives, bMultithreaded, [&](UINT i)
+        {
+            const UINT inputIndex = lbvh.SortedIndices[i];
+            pPrimitives[i] = primitives[inputIndex];
+            pMetadata[i] = primitiveMetaData[inputIndex];
+        });
+
+        MarkProceduralLeaves(pNodes, numNodes, pPrimitives, bMultithreaded);
+    }
+
+    static
+        void WriteTopLevelLbvh(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs,
+            const CpuBvh2BuildSettings& settings,
+            BYTE* pOutputData,
+            UINT& numNodes,
+            UINT& numInstances)
+    {
+        const bool bMultithreaded = settings.UseMultithreadedBuild;
+
+        CpuLbvh lbvh;
+        BuildLbvhFromInputs(inputs, settings, lbvh, nullptr, nullptr);
+
+        numInstances = inputs.NumDescs;
+        numNodes = std::max((UINT)lbvh.Nodes.size(), 1u);
+
+        BVHOffsets offsets;
+        offsets.offsetToBoxes = sizeof(BVHOffsets);
+        offsets.offsetToVertices = offsets.offsetToBoxes + numNodes * sizeof(AABBNode);
+        offsets.totalSize = offsets.offsetToVertices + numInstances * sizeof(BVHMetadata);
+        offsets.offsetToPrimitiveMetaData = offsets.totalSize;
+        memcpy(pOutputData, &offsets, sizeof(offsets));
+
+        AABBNode* pNodes = (AABBNode*)(pOutputData + offsets.offsetToBoxes);
+        if (numInstances == 0)
+        {
+            memset(pNodes, 0, sizeof(AABBNode));
+        }
+        else
+        {
+            memcpy(pNodes, lbvh.Nodes.data(), numNodes * sizeof(AABBNode));
+        }
+
+        // The WorldToObject transforms are inverted with DirectXMath and can be
+        // off from InverseAffineTransform by a few ulps
+        BVHMetadata* pMetadata = (BVHMetadata*)(pOutputData + offsets.offsetToVertices);
+        ForEachIndex(numInstances, bMultithreaded, [&](UINT i)
+        {
+            const UINT instanceIndex = lbvh.SortedIndices[i];
+            WriteInstanceMetadata(GetInstanceDesc(inputs, instanceIndex), instanceIndex, pMetadata[i]);
+        });
+    }
+
+    //
+    // Updates
+    //
+    // With ALLOW_UPDATE the same data as the GPU builder is kept past
+    // BVHOffsets::totalSize: the output slot of every input primitive (or
+    // instance), followed by the parent of every node. PERFORM_UPDATE reloads
+    // the primitives into their slots and refits the boxes bottom-up like
+    // ComputeAABBs.hlsli, keeping the topology of the source.
+    //
+
+    static const UINT RootNodeParentIndex = 0xffffffff;
+
+    struct UpdateData
+    {
+        UINT*   pSortedIndices;
+        UINT*   pParentIndices;
+        UINT    numPrimitives;
+        UINT    numNodes;
+    };
+
+    static
+        UpdateData GetUpdateData(
+            BYTE* pOutputData,
+            bool bIsTopLevel)
+    {
+        const BVHOffsets& offsets = *(const BVHOffsets*)pOutputData;
+
+        UpdateData data;
+        data.numNodes = (offsets.offsetToVertices - offsets.offsetToBoxes) / sizeof(AABBNode);
+        data.numPrimitives = bIsTopLevel ?
+            (offsets.totalSize - offsets.offsetToVertices) / sizeof(BVHMetadata) :
+            (offsets.offsetToPrimitiveMetaData - offsets.offsetToVertices) / sizeof(Primitive);
+        data.pSortedIndices = (UINT*)(pOutputData + offsets.totalSize);
+        data.pParentIndices = data.pSortedIndices + data.numPrimitives;
+        return data;
+    }
+
+    static
+        UINT GetUpdateDataSize(
+            UINT numPrimitives,
+            UINT numNodes)
+    {
+        return (numPrimitives + numNodes) * sizeof(UINT);
+    }
+
+    static
+        std::vector<UINT> GetGeometryPrimitiveOffsets(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs)
+    {
+        std::vector<UINT> primitiveOffsets(inputs.NumDescs + 1, 0);
+        for (UINT i = 0; i < inputs.NumDescs; ++i)
+        {
+            primitiveOffsets[i + 1] = primitiveOffsets[i] + GetPrimitiveCountFromGeometryDesc(GetGeometryDesc(inputs, i));
+        }
+        return primitiveOffsets;
+    }
+
+    static
+        void WriteUpdateData(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs,
+            BYTE* pOutputData,
+            bool bMultithreaded)
+    {
+        const bool bIsTopLevel = inputs.Type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+        const BVHOffsets& offsets = *(const BVHOffsets*)pOutputData;
+        const UpdateData data = GetUpdateData(pOutputData, bIsTopLevel);
+
+        if (bIsTopLevel)
+        {
+            const BVHMetadata* pMetadata = (const BVHMetadata*)(pOutputData + offsets.offsetToVertices);
+            ForEachIndex(data.numPrimitives, bMultithreaded, [&](UINT slot)
+            {
+                data.pSortedIndices[pMetadata[slot].InstanceIndex] = slot;
+            });
+        }
+        else
+        {
+            const std::vector<UINT> primitiveOffsets = GetGeometryPrimitiveOffsets(inputs);
+            const PrimitiveMetaData* pMetadata = (const PrimitiveMetaData*)(pOutputData + offsets.offsetToPrimitiveMetaData);
+            ForEachIndex(data.numPrimitives, bMultithreaded, [&](UINT slot)
+            {
+                const PrimitiveMetaData& metadata = pMetadata[slot];
+                data.pSortedIndices[primitiveOffsets[metadata.GeometryContributionToHitGroupIndex] + metadata.PrimitiveIndex] = slot;
+            });
+        }
+
+        // Empty top levels are a single node with no children
+        data.pParentIndices[0] = RootNodeParentIndex;
+        if (data.numPrimitives == 0)
+        {
+            return;
+        }
+
+        const AABBNode* pNodes = (const AABBNode*)(pOutputData + offsets.offsetToBoxes);
+        ForEachIndex(data.numNodes, bMultithreaded, [&](UINT i)
+        {
+            const AABBNode& node = pNodes[i];
+            if (!node.leaf)
+            {
+                data.pParentIndices[node.internalNode.leftNodeIndex] = i;
+                data.pParentIndices[node.rightNodeIndex] = i;
+            }
+        });
+    }
+
+    //
+    // Each leaf walks up towards the root and the second child to arrive at a
+    // node computes its box, so every node is refit exactly once
+    //
+    static
+        void RefitBVH(
+            BYTE* pOutputData,
+            const UpdateData& data,
+            const std::vector<AABB>& primitiveBoxes,
+            bool bMultithreaded)
+    {
+        const BVHOffsets& offsets = *(const BVHOffsets*)pOutputData;
+        AABBNode* pNodes = (AABBNode*)(pOutputData + offsets.offsetToBoxes);
+
+        std::vector<LONG> childrenRefit(data.numNodes, 0);
+        ForEachIndex(data.numNodes, bMultithreaded, [&](UINT leafIndex)
+        {
+            AABBNode& leaf = pNodes[leafIndex];
+            if (!leaf.leaf)
+            {
+                return;
+            }
+
+            AABB box = {};
+            const UINT firstPrimitive = leaf.leafNode.firstTriangleId;
+            if (leaf.numTriangles > 0)
+            {
+                box = primitiveBoxes[firstPrimitive];
+                for (UINT i = 1; i < leaf.numTriangles; ++i)
+                {
+                    AddExtentToBox(box, primitiveBoxes[firstPrimitive + i]);
+                }
+            }
+            EncodeNodeBox(leaf, box);
+
+            UINT nodeIndex = leafIndex;
+            while (nodeIndex != 0)
+            {
+                const UINT parentIndex = data.pParentIndices[nodeIndex];
+                if (InterlockedIncrement(&childrenRefit[parentIndex]) == 1)
+                {
+                    // The sibling isn't refit yet, its leaf finishes the parent
+                    return;
+                }
+
+                AABBNode& parent = pNodes[parentIndex];
+                AABB leftBox, rightBox;
+                DecompressAABB(leftBox, pNodes[parent.internalNode.leftNodeIndex]);
+                DecompressAABB(rightBox, pNodes[parent.rightNodeIndex]);
+                AddExtentToBox(leftBox, rightBox);
+                EncodeNodeBox(parent, leftBox);
+
+                nodeIndex = parentIndex;
+            }
+        });
+    }
+
+    //
+    // Tree rotations (Kopta et al. 2012): a child of a node is swapped with a
+    // grandchild on the other side when that shrinks the surface area of the
+    // grandchild's parent. Nodes are visited children first, so this is a
+    // cheaper, local stand-in for the treelet reordering of the GPU builder
+    // that still undoes most of the damage animation does to a refit tree.
+    //
+
+    // Subtrees rooted at this depth are rotated in parallel
+    static const UINT ParallelRotationDepth = 8;
+
+    // Ignores swaps that only win on floating point noise
+    static const float MinimumRotationGain = 0.01f;
+
+    static
+        bool TryRotateNode(
+            AABBNode* pNodes,
+            UINT* pParentIndices,
+            UINT nodeIndex)
+    {
+        AABBNode& node = pNodes[nodeIndex];
+        const UINT children[2] = { node.internalNode.leftNodeIndex, node.rightNodeIndex };
+
+        float bestGain = 0.0f;
+        UINT bestSide = 0, bestGrandchild = 0;
+        AABB bestBox;
+        for (UINT side = 0; side < 2; ++side)
+        {
+            const AABBNode& child = pNodes[children[side]];
+            if (child.leaf)
+            {
+                continue;
+            }
+
+            AABB childBox, siblingBox;
+            DecompressAABB(childBox, child);
+            DecompressAABB(siblingBox, pNodes[children[1 - side]]);
+            const float childArea = ComputeBoxSurfaceArea(childBox);
+
+            const UINT grandchildren[2] = { child.internalNode.leftNodeIndex, child.rightNodeIndex };
+            for (UINT grandchild = 0; grandchild < 2; ++grandchild)
+            {
+                // The sibling takes the place of this grandchild, the child
+                // then bounds the sibling and the remaining grandchild
+                AABB rotatedBox;
+                DecompressAABB(rotatedBox, pNodes[grandchildren[1 - grandchild]]);
+                AddExtentToBox(rotatedBox, siblingBox);
+
+                const float gain = childArea - ComputeBoxSurfaceArea(rotatedBox);
+                if (gain > bestGain && gain > childArea * MinimumRotationGain)
+                {
+                    bestGain = gain;
+                    bestSide = side;
+                    bestGrandchild = grandchild;
+                    bestBox = rotatedBox;
+                }
+            }
+        }
+
+        if (bestGain <= 0.0f)
+        {
+            return false;
+        }
+
+        const UINT childIndex = children[bestSide];
+        const UINT siblingIndex = children[1 - bestSide];
+        AABBNode& child = pNodes[childIndex];
+        UINT grandchildIndex;
+        if (bestGrandchild == 0)
+        {
+            grandchildIndex = child.internalNode.leftNodeIndex;
+            child.internalNode.leftNodeIndex = siblingIndex;
+        }
+        else
+        {
+            grandchildIndex = child.rightNodeIndex;
+            child.rightNodeIndex = siblingIndex;
+        }
+
+        if (bestSide == 0)
+        {
+            node.rightNodeIndex = grandchildIndex;
+        }
+        else
+        {
+            node.internalNode.leftNodeIndex = grandchildIndex;
+        }
+
+        EncodeNodeBox(child, bestBox);
+        pParentIndices[siblingIndex] = childIndex;
+        pParentIndices[grandchildIndex] = nodeIndex;
+        return true;
+    }
+
+    static
+        UINT RotateSubtree(
+            AABBNode* pNodes,
+            UINT* pParentIndices,
+            UINT rootIndex)
+    {
+        // Reversed pre-order visits every node after its children
+        std::vector<UINT> preOrder;
+        std::vector<UINT> stack;
+        stack.push_back(rootIndex);
+        while (!stack.empty())
+        {
+            const UINT nodeIndex = stack.back();
+            stack.pop_back();
+
+            const AABBNode& node = pNodes[nodeIndex];
+            if (!node.leaf)
+            {
+                preOrder.push_back(nodeIndex);
+                stack.push_back(node.internalNode.leftNodeIndex);
+                stack.push_back(node.rightNodeIndex);
+            }
+        }
+
+        UINT numRotations = 0;
+        for (auto it = preOrder.rbegin(); it != preOrder.rend(); ++it)
+        {
+            numRotations += TryRotateNode(pNodes, pParentIndices, *it) ? 1 : 0;
+        }
+        return numRotations;
+    }
+
+    static
+        UINT RotateBVH(
+            BYTE* pOutputData,
+            const UpdateData& data,
+            bool bMultithreaded)
+    {
+        const BVHOffsets& offsets = *(const BVHOffsets*)pOutputData;
+        AABBNode* pNodes = (AABBNode*)(pOutputData + offsets.offsetToBoxes);
+
+        // Rotations at a node only move nodes within its subtree, so subtrees
+        // below ParallelRotationDepth are independent. The levels above are
+        // done afterwards, deepest first.
+        std::vector<UINT> upperNodes;
+        std::vector<UINT> subtreeRoots;
+        std::vector<UINT> level(1, 0);
+        for (UINT depth = 0; !level.empty(); ++depth)
+        {
+            std::vector<UINT> nextLevel;
+            for (UINT nodeIndex : level)
+            {
+                const AABBNode& node = pNodes[nodeIndex];
+                if (node.leaf)
+                {
+                    continue;
+                }
+
+                if (depth == ParallelRotationDepth)
+                {
+                    subtreeRoots.push_back(nodeIndex);
+                }
+                else
+                {
+                    upperNodes.push_back(nodeIndex);
+                    nextLevel.push_back(node.internalNode.leftNodeIndex);
+                    nextLevel.push_back(node.rightNodeIndex);
+                }
+            }
+            level.swap(nextLevel);
+        }
+
+        std::atomic<UINT> numRotations(0);
+        ForEachIndex((UINT)subtreeRoots.size(), bMultithreaded, [&](UINT i)
+        {
+            numRotations += RotateSubtree(pNodes, data.pParentIndices, subtreeRoots[i]);
+        });
+
+        for (auto it = upperNodes.rbegin(); it != upperNodes.rend(); ++it)
+        {
+            numRotations += TryRotateNode(pNodes, data.pParentIndices, *it) ? 1 : 0;
+        }
+        return numRotations;
+    }
+
+    static
+        void UpdateBVH(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC& desc,
+            const CpuBvh2BuildSettings& settings,
+            BYTE* pOutputData,
+            UINT& numNodes,
+            UINT& numPrimitives,
+            UINT& numRotations)
+    {
+        const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs = desc.Inputs;
+        const bool bIsTopLevel = inputs.Type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+        const bool bMultithreaded = settings.UseMultithreadedBuild;
+
+        if ((inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE) == 0)
+        {
+            ThrowFailure(E_INVALIDARG, L"PERFORM_UPDATE requires the ALLOW_UPDATE flag the source was built with");
+        }
+
+        BYTE* pSourceData = (BYTE*)desc.SourceAccelerationStructureData;
+        if (!pSourceData)
+        {
+            ThrowFailure(E_INVALIDARG, L"PERFORM_UPDATE requires a SourceAccelerationStructureData");
+        }
+
+        if (pSourceData != pOutputData)
+        {
+            const UpdateData sourceData = GetUpdateData(pSourceData, bIsTopLevel);
+            const UINT sourceSize = ((const BVHOffsets*)pSourceData)->totalSize + GetUpdateDataSize(sourceData.numPrimitives, sourceData.numNodes);
+            memcpy(pOutputData, pSourceData, sourceSize);
+        }
+
+        const UpdateData data = GetUpdateData(pOutputData, bIsTopLevel);
+        numNodes = data.numNodes;
+        numPrimitives = data.numPrimitives;
+        numRotations = 0;
+
+        const UINT expectedNumPrimitives = bIsTopLevel ? inputs.NumDescs : GetTotalPrimitiveCount(inputs);
+        if (expectedNumPrimitives != numPrimitives)
+        {
+            ThrowFailure(E_INVALIDARG, L"Updates can't change the number of primitives or instances");
+        }
+
+        const BVHOffsets& offsets = *(const BVHOffsets*)pOutputData;
+        std::vector<AABB> primitiveBoxes(numPrimitives);
+        if (bIsTopLevel)
+        {
+            BVHMetadata* pMetadata = (BVHMetadata*)(pOutputData + offsets.offsetToVertices);
+            ForEachIndex(numPrimitives, bMultithreaded, [&](UINT instanceIndex)
+            {
+                const UINT slot = data.pSortedIndices[instanceIndex];
+                const D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC& instanceDesc = GetInstanceDesc(inputs, instanceIndex);
+                WriteInstanceMetadata(instanceDesc, instanceIndex, pMetadata[slot]);
+                ComputeInstanceBox(instanceDesc, primitiveBoxes[slot]);
+            });
+        }
+        else
+        {
+            const std::vector<UINT> primitiveOffsets = GetGeometryPrimitiveOffsets(inputs);
+            Primitive* pPrimitives = (Primitive*)(pOutputData + offsets.offsetToVertices);
+            for (UINT i = 0; i < inputs.NumDescs; ++i)
+            {
+                const D3D12_RAYTRACING_GEOMETRY_DESC& geometry = GetGeometryDesc(inputs, i);
+                ValidateGeometryDesc(geometry);
+
+                ForEachIndex(primitiveOffsets[i + 1] - primitiveOffsets[i], bMultithreaded, [&](UINT j)
+                {
+                    const UINT slot = data.pSortedIndices[primitiveOffsets[i] + j];
+                    LoadPrimitive(geometry, j, pPrimitives[slot]);
+                    ComputePrimitiveBox(pPrimitives[slot], primitiveBoxes[slot]);
+                });
+            }
+        }
+
+        if (numPrimitives == 0)
+        {
+            return;
+        }
+
+        RefitBVH(pOutputData, data, primitiveBoxes, bMultithreaded);
+
+        if (settings.UpdateReoptimizationSahCost > 0.0f &&
+            ComputeBvhSahCost(pOutputData) > settings.UpdateReoptimizationSahCost)
+        {
+            numRotations = RotateBVH(pOutputData, data, bMultithreaded);
+        }
+    }
+
+    UINT64 GetRaytracingAccelerationStructureWrittenSizeOnCpu(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+        _In_  const BYTE *pData)
+    {
+        // The update data follows totalSize in builds that allow updates
+        UINT64 size = ((const BVHOffsets*)pData)->totalSize;
+        if (inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE)
+        {
+            const bool bIsTopLevel = inputs.Type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+            const UpdateData data = GetUpdateData(const_cast<BYTE*>(pData), bIsTopLevel);
+            size += GetUpdateDataSize(data.numPrimitives, data.numNodes);
+        }
+        return size;
+    }
+
+    UINT64 GetRaytracingAccelerationStructureSizeOnCpu(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs)
+    {
+        const bool bAllowUpdate = (inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE) != 0;
+        switch (inputs.Type)
+        {
+        case D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL:
+        {
+            const UINT numPrimitives = GetTotalPrimitiveCount(inputs);
+            const UINT numNodes = std::max(numPrimitives + GetNumberOfInternalNodes(numPrimitives), 1u);
+            return sizeof(BVHOffsets) + numNodes * sizeof(AABBNode) + numPrimitives * (sizeof(Primitive) + sizeof(PrimitiveMetaData)) +
+                (bAllowUpdate ? GetUpdateDataSize(numPrimitives, numNodes) : 0);
+        }
+        case D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL:
+        {
+            const UINT numInstances = inputs.NumDescs;
+            const UINT numNodes = std::max(numInstances + GetNumberOfInternalNodes(numInstances), 1u);
+            return sizeof(BVHOffsets) + numNodes * sizeof(AABBNode) + numInstances * sizeof(BVHMetadata) +
+                (bAllowUpdate ? GetUpdateDataSize(numInstances, numNodes) : 0);
+        }
+        default:
+            ThrowFailure(E_INVALIDARG, L"Unrecognized D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE provided");
+            return 0;
+        }
+    }
+
+    void BuildLbvhOnCpu(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+        _In_  const CpuBvh2BuildSettings &settings,
+        _Out_ CpuLbvh &lbvh)
+    {
+        ValidateDescsLayout(inputs);
+        BuildLbvhFromInputs(inputs, settings, lbvh, nullptr, nullptr);
+    }
+
+    float ComputeBvhSahCost(_In_ const BYTE *pBvhData)
+    {
+        const BVHOffsets &offsets = *(const BVHOffsets *)pBvhData;
+        const AABBNode *pNodes = (const AABBNode *)(pBvhData + offsets.offsetToBoxes);
+
+        AABB rootBox;
+        DecompressAABB(rootBox, pNodes[0]);
+        const float rootArea = ComputeBoxSurfaceArea(rootBox);
+        if (rootArea <= 0.0f)
+        {
+            return 0.0f;
+        }
+
+        float cost = 0.0f;
+        std::vector<UINT> stack;
+        stack.push_back(0);
+        while (!stack.empty())
+        {
+            const AABBNode &node = pNodes[stack.back()];
+            stack.pop_back();
+
+            AABB box;
+            DecompressAABB(box, node);
+            const float area = ComputeBoxSurfaceArea(box);
+            if (node.leaf)
+            {
+                cost += area * node.numTriangles;
+            }
+            else
+            {
+                cost += area;
+                stack.push_back(node.internalNode.leftNodeIndex);
+                stack.push_back(node.rightNodeIndex);
+            }
+        }
+
+        return cost / rootArea;
+    }
+
+    void BuildRaytracingAccelerationStructureOnCpu(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
+        _In_  const CpuBvh2BuildSettings &settings,
+        _Out_ void *pData,
+        _Out_opt_ CpuBvh2BuildStatistics *pStatistics)
+    {
+        const auto startTime = std::chrono::high_resolution_clock::now();
+
+        ValidateDescsLayout(pDesc->Inputs);
+
+        BYTE* pOutputData = (BYTE*)pData;
+        UINT numNodes, numPrimitives, numRotations = 0;
+        if (pDesc->Inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE)
+        {
+            UpdateBVH(*pDesc, settings, pOutputData, numNodes, numPrimitives, numRotations);
+        }
+        else
+        {
+            if (pDesc->Inputs.Type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL)
+            {
+                if (settings.UseLbvhBuilder)
+                {
+                    WriteTopLevelLbvh(pDesc->Inputs, settings, pOutputData, numNodes, numPrimitives);
+                }
+                else
+                {
+                    WriteTopLevelBVH(pDesc->Inputs, settings, pOutputData, numNodes, numPrimitives);
+                }
+            }
+            else if (settings.UseLbvhBuilder)
+            {
+                WriteBottomLevelLbvh(pDesc->Inputs, settings, pOutputData, numNodes, numPrimitives);
+            }
+            else if (settings.UseLowMemoryBuild)
+            {
+                BuildBVHLowMemory(pDesc->Inputs, settings, pOutputData, numNodes, numPrimitives);
+            }
+            else
+            {
+                WriteBottomLevelBVH(pDesc->Inputs, settings, pOutputData, numNodes, numPrimitives);
+            }
+
+            if (pDesc->Inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE)
+            {
+                WriteUpdateData(pDesc->Inputs, pOutputData, settings.UseMultithreadedBuild);
+            }
+        }
+
+        if (pStatistics)
+        {
+            const std::chrono::duration<double, std::milli> buildTime = std::chrono::high_resolution_clock::now() - startTime;
+            pStatistics->BuildTimeInMs = buildTime.count();
+            pStatistics->SahCost = ComputeBvhSahCost(pOutputData);
+            pStatistics->NumNodes = numNodes;
+            pStatistics->NumPrimitives = numPrimitives;
+            pStatistics->NumRotations = numRotations;
+        }
+    }
+}
+
+void BuildRaytracingAccelerationStructureOnCpu(
+    _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
+    _Out_ void *pData)
+{
+    FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(pDesc, FallbackLayer::CpuBvh2BuildSettings(), pData);
 }
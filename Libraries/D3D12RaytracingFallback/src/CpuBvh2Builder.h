@@ -0,0 +1,90 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+namespace FallbackLayer
+{
+    struct CpuBvh2BuildSettings
+    {
+        UINT MaxTrianglesInLeaf = MAX_TRIS_IN_LEAF;
+
+        // Splits subtrees across the PPL work-stealing scheduler
+        bool UseMultithreadedBuild = true;
+
+        // Selects the original single-threaded builder that copies the primitive
+        // list per node and re-sorts it after binning. Kept for comparisons only.
+        bool UseReferenceBuilder = false;
+
+        // Streams the geometry buffers instead of copying every triangle up front.
+        // Subtrees are only loaded into memory once their working set fits in
+        // LowMemoryBudgetInBytes. Above them, the streaming passes only need SAH
+        // bins per chunk and a stack frame per level, so the budget bounds the
+        // memory used on top of the output buffer.
+        bool UseLowMemoryBuild = false;
+        SIZE_T LowMemoryBudgetInBytes = 32 * 1024 * 1024;
+
+        // Builds with the Morton code pipeline of GpuBvh2Builder instead of SAH
+        // binning. Much faster but the trees are worse, the output can be
+        // compared to the GPU one, see BuildLbvh. LbvhMortonCodeBits is 30 or 63.
+        bool UseLbvhBuilder = false;
+        UINT LbvhMortonCodeBits = 30;
+
+        // PERFORM_UPDATE keeps the topology of the source and only refits the
+        // boxes. When the SAH cost after the refit is above this value, a pass
+        // of tree rotations runs on top of it. Usually the SahCost of the
+        // original build with some slack, 0 never runs the rotations.
+        float UpdateReoptimizationSahCost = 0.0f;
+    };
+
+    struct CpuBvh2BuildStatistics
+    {
+        double BuildTimeInMs;
+        float SahCost;
+        UINT NumNodes;
+        UINT NumPrimitives;
+
+        // Only non-zero for updates that ran the rotation pass
+        UINT NumRotations;
+    };
+
+    // Builds bottom or top level acceleration structures in the same format as
+    // GpuBvh2Builder. All GPU virtual addresses in the inputs are read as CPU
+    // addresses, including the AccelerationStructure of each instance desc and
+    // SourceAccelerationStructureData, which may be pData for in-place updates.
+    void BuildRaytracingAccelerationStructureOnCpu(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
+        _In_  const CpuBvh2BuildSettings &settings,
+        _Out_ void *pData,
+        _Out_opt_ CpuBvh2BuildStatistics *pStatistics = nullptr);
+
+    // Size of the output of BuildRaytracingAccelerationStructureOnCpu, usable
+    // without a device. Matches the prebuild size of GpuBvh2Builder.
+    UINT64 GetRaytracingAccelerationStructureSizeOnCpu(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs);
+
+    // Number of bytes of pData written by BuildRaytracingAccelerationStructureOnCpu
+    // for these inputs. The prebuild size is a worst case, this is usually less.
+    UINT64 GetRaytracingAccelerationStructureWrittenSizeOnCpu(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+        _In_  const BYTE *pData);
+
+    // Runs the LBVH build of BuildRaytracingAccelerationStructureOnCpu and
+    // returns the intermediate buffers instead of an acceleration structure.
+    // Top levels read the bottom levels the same way as the full build.
+    void BuildLbvhOnCpu(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+        _In_  const CpuBvh2BuildSettings &settings,
+        _Out_ CpuLbvh &lbvh);
+
+    // SAH cost of a BVH2 blob normalized to the surface area of the root, using
+    // a unit cost for both node traversal and primitive intersection
+    float ComputeBvhSahCost(_In_ const BYTE *pBvhData);
+}
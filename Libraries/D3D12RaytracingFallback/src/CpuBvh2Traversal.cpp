@@ -0,0 +1,509 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "pch.h"
+
+namespace FallbackLayer
+{
+    static const UINT PacketWidth = 4;
+    static const UINT PacketStackSize = 128;
+
+    //
+    // Packets are SoA with one ray per SSE lane. The scalar copies are used to
+    // pick a child traversal order from the first active ray.
+    //
+
+    struct RayPacket
+    {
+        __m128 Origin[3];
+        __m128 Direction[3];
+        __m128 InverseDirection[3];
+        __m128 TMin;
+        __m128 TMax;
+
+        float ScalarOrigin[3][PacketWidth];
+        float ScalarDirection[3][PacketWidth];
+    };
+
+    struct PacketContext
+    {
+        CpuTraversalMode Mode;
+        UINT InstanceInclusionMask;
+
+        // Lanes that still need traversal, any-hit lanes drop out on their first hit
+        UINT ActiveMask;
+        CpuTraversalHit Hits[PacketWidth];
+    };
+
+    static __forceinline
+        __m128 Select(
+            __m128 mask,
+            __m128 a,
+            __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    static __forceinline
+        __m128 LaneMask(
+            UINT mask)
+    {
+        const __m128i bits = _mm_and_si128(_mm_set1_epi32((int)mask), _mm_setr_epi32(1, 2, 4, 8));
+        return _mm_castsi128_ps(_mm_cmpgt_epi32(bits, _mm_setzero_si128()));
+    }
+
+    static __forceinline
+        float GetLane(
+            __m128 v,
+            UINT lane)
+    {
+        float values[PacketWidth];
+        _mm_storeu_ps(values, v);
+        return values[lane];
+    }
+
+    static
+        void InitializePacket(
+            RayPacket& packet,
+            const float origins[3][PacketWidth],
+            const float directions[3][PacketWidth],
+            const float tMin[PacketWidth],
+            const float tMax[PacketWidth])
+    {
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            memcpy(packet.ScalarOrigin[axis], origins[axis], sizeof(packet.ScalarOrigin[axis]));
+            memcpy(packet.ScalarDirection[axis], directions[axis], sizeof(packet.ScalarDirection[axis]));
+            packet.Origin[axis] = _mm_loadu_ps(origins[axis]);
+            packet.Direction[axis] = _mm_loadu_ps(directions[axis]);
+            packet.InverseDirection[axis] = _mm_div_ps(_mm_set1_ps(1.0f), packet.Direction[axis]);
+        }
+        packet.TMin = _mm_loadu_ps(tMin);
+        packet.TMax = _mm_loadu_ps(tMax);
+    }
+
+    // Applies a 3x4 row-major WorldToObject transform. Directions aren't
+    // normalized so hit distances stay in world space units.
+    static
+        void TransformPacket(
+            const RayPacket& packet,
+            const float transform[3][4],
+            RayPacket& transformedPacket)
+    {
+        float origins[3][PacketWidth];
+        float directions[3][PacketWidth];
+        for (UINT row = 0; row < 3; row++)
+        {
+            const __m128 m0 = _mm_set1_ps(transform[row][0]);
+            const __m128 m1 = _mm_set1_ps(transform[row][1]);
+            const __m128 m2 = _mm_set1_ps(transform[row][2]);
+            const __m128 m3 = _mm_set1_ps(transform[row][3]);
+
+            const __m128 origin = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(m0, packet.Origin[0]),
+                _mm_mul_ps(m1, packet.Origin[1])),
+                _mm_mul_ps(m2, packet.Origin[2])),
+                m3);
+            const __m128 direction = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(m0, packet.Direction[0]),
+                _mm_mul_ps(m1, packet.Direction[1])),
+                _mm_mul_ps(m2, packet.Direction[2]));
+            _mm_storeu_ps(origins[row], origin);
+            _mm_storeu_ps(directions[row], direction);
+        }
+
+        float tMin[PacketWidth];
+        float tMax[PacketWidth];
+        _mm_storeu_ps(tMin, packet.TMin);
+        _mm_storeu_ps(tMax, packet.TMax);
+        InitializePacket(transformedPacket, origins, directions, tMin, tMax);
+    }
+
+    //
+    // Intersection tests, four rays against one box or primitive
+    //
+
+    static __forceinline
+        UINT IntersectBoxPacket(
+            const RayPacket& packet,
+            const float boxMin[3],
+            const float boxMax[3],
+            UINT laneMask,
+            __m128& tNear)
+    {
+        __m128 tLow[3];
+        __m128 tHigh[3];
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxMin[axis]), packet.Origin[axis]), packet.InverseDirection[axis]);
+            const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxMax[axis]), packet.Origin[axis]), packet.InverseDirection[axis]);
+            tLow[axis] = _mm_min_ps(t0, t1);
+            tHigh[axis] = _mm_max_ps(t0, t1);
+        }
+
+        tNear = _mm_max_ps(_mm_max_ps(tLow[0], tLow[1]), _mm_max_ps(tLow[2], packet.TMin));
+        const __m128 tFar = _mm_min_ps(_mm_min_ps(tHigh[0], tHigh[1]), _mm_min_ps(tHigh[2], packet.TMax));
+        return (UINT)_mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) & laneMask;
+    }
+
+    static __forceinline
+        UINT IntersectNodePacket(
+            const RayPacket& packet,
+            const AABBNode& node,
+            UINT laneMask)
+    {
+        float boxMin[3];
+        float boxMax[3];
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            boxMin[axis] = node.center[axis] - node.halfDim[axis];
+            boxMax[axis] = node.center[axis] + node.halfDim[axis];
+        }
+
+        __m128 tNear;
+        return IntersectBoxPacket(packet, boxMin, boxMax, laneMask, tNear);
+    }
+
+    // Moller-Trumbore, double sided. Same operation order as the scalar test
+    // in CpuWideBvh.cpp so both report identical distances.
+    static
+        UINT IntersectTrianglePacket(
+            const RayPacket& packet,
+            const Triangle& triangle,
+            UINT laneMask,
+            __m128& t,
+            __m128& u,
+            __m128& v)
+    {
+        const float3 edge1 = triangle.v1 - triangle.v0;
+        const float3 edge2 = triangle.v2 - triangle.v0;
+        const __m128 e1x = _mm_set1_ps(edge1.x), e1y = _mm_set1_ps(edge1.y), e1z = _mm_set1_ps(edge1.z);
+        const __m128 e2x = _mm_set1_ps(edge2.x), e2y = _mm_set1_ps(edge2.y), e2z = _mm_set1_ps(edge2.z);
+        const __m128 *d = packet.Direction;
+
+        // p = cross(direction, edge2)
+        const __m128 px = _mm_sub_ps(_mm_mul_ps(d[1], e2z), _mm_mul_ps(d[2], e2y));
+        const __m128 py = _mm_sub_ps(_mm_mul_ps(d[2], e2x), _mm_mul_ps(d[0], e2z));
+        const __m128 pz = _mm_sub_ps(_mm_mul_ps(d[0], e2y), _mm_mul_ps(d[1], e2x));
+        const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        const __m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+
+        const __m128 sx = _mm_sub_ps(packet.Origin[0], _mm_set1_ps(triangle.v0.x));
+        const __m128 sy = _mm_sub_ps(packet.Origin[1], _mm_set1_ps(triangle.v0.y));
+        const __m128 sz = _mm_sub_ps(packet.Origin[2], _mm_set1_ps(triangle.v0.z));
+        u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDeterminant);
+
+        // q = cross(s, edge1)
+        const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], qx), _mm_mul_ps(d[1], qy)), _mm_mul_ps(d[2], qz)), inverseDeterminant);
+        t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDeterminant);
+
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        __m128 hit = _mm_cmpneq_ps(determinant, zero);
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(t, packet.TMin), _mm_cmplt_ps(t, packet.TMax)));
+        return (UINT)_mm_movemask_ps(hit) & laneMask;
+    }
+
+    static
+        UINT IntersectProceduralPacket(
+            const RayPacket& packet,
+            const AABB& aabb,
+            UINT laneMask,
+            __m128& t)
+    {
+        const UINT hitMask = IntersectBoxPacket(packet, aabb.minArr, aabb.maxArr, laneMask, t);
+        return hitMask & (UINT)_mm_movemask_ps(_mm_cmplt_ps(t, packet.TMax));
+    }
+
+    static
+        void CommitHits(
+            RayPacket& packet,
+            PacketContext& context,
+            UINT hitMask,
+            __m128 t,
+            __m128 u,
+            __m128 v,
+            const PrimitiveMetaData& metadata,
+            UINT instanceIndex,
+            UINT instanceID)
+    {
+        packet.TMax = Select(LaneMask(hitMask), t, packet.TMax);
+        for (UINT lane = 0; lane < PacketWidth; lane++)
+        {
+            if (hitMask & (1 << lane))
+            {
+                context.Hits[lane] = CpuTraversalHit{
+                    GetLane(t, lane), GetLane(u, lane), GetLane(v, lane),
+                    metadata.PrimitiveIndex, metadata.GeometryContributionToHitGroupIndex,
+                    instanceIndex, instanceID };
+            }
+        }
+
+        if (context.Mode == CpuTraversalAnyHit)
+        {
+            context.ActiveMask &= ~hitMask;
+        }
+    }
+
+    //
+    // Traversal
+    //
+
+    // Pushes the children of node so the one nearer to the first active ray
+    // along its direction is popped first
+    static __forceinline
+        void PushChildren(
+            const RayPacket& packet,
+            const AABBNode* pNodes,
+            const AABBNode& node,
+            UINT hitMask,
+            UINT* pStack,
+            UINT& stackSize)
+    {
+        unsigned long lane;
+        _BitScanForward(&lane, hitMask);
+
+        const UINT left = node.internalNode.leftNodeIndex;
+        const UINT right = node.rightNodeIndex;
+        float leftDistance = 0.0f;
+        float rightDistance = 0.0f;
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            leftDistance += (pNodes[left].center[axis] - packet.ScalarOrigin[axis][lane]) * packet.ScalarDirection[axis][lane];
+            rightDistance += (pNodes[right].center[axis] - packet.ScalarOrigin[axis][lane]) * packet.ScalarDirection[axis][lane];
+        }
+
+        if (stackSize > PacketStackSize - 2)
+        {
+            ThrowFailure(E_FAIL, L"BVH is too deep for the CPU traversal stack");
+        }
+        pStack[stackSize++] = leftDistance <= rightDistance ? right : left;
+        pStack[stackSize++] = leftDistance <= rightDistance ? left : right;
+    }
+
+    static
+        void TraverseBottomLevel(
+            const BYTE* pBottomLevel,
+            RayPacket& packet,
+            UINT laneMask,
+            UINT instanceIndex,
+            UINT instanceID,
+            PacketContext& context)
+    {
+        const BVHOffsets &offsets = *(const BVHOffsets *)pBottomLevel;
+        const AABBNode *pNodes = (const AABBNode *)(pBottomLevel + offsets.offsetToBoxes);
+        const Primitive *pPrimitives = (const Primitive *)(pBottomLevel + offsets.offsetToVertices);
+        const PrimitiveMetaData *pMetadata = (const PrimitiveMetaData *)(pBottomLevel + offsets.offsetToPrimitiveMetaData);
+
+        UINT stack[PacketStackSize];
+        UINT stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize)
+        {
+            const UINT mask = laneMask & context.ActiveMask;
+            if (!mask)
+            {
+                break;
+            }
+
+            const AABBNode &node = pNodes[stack[--stackSize]];
+            const UINT hitMask = IntersectNodePacket(packet, node, mask);
+            if (!hitMask)
+            {
+                continue;
+            }
+
+            if (!node.leaf)
+            {
+                PushChildren(packet, pNodes, node, hitMask, stack, stackSize);
+                continue;
+            }
+
+            const UINT firstPrimitive = node.leafNode.firstTriangleId;
+            for (UINT i = firstPrimitive; i < firstPrimitive + node.numTriangles; i++)
+            {
+                const UINT primitiveMask = hitMask & context.ActiveMask;
+                const Primitive &primitive = pPrimitives[i];
+                __m128 t, u, v;
+                UINT primitiveHitMask;
+                if (primitive.PrimitiveType == PROCEDURAL_PRIMITIVE_TYPE)
+                {
+                    primitiveHitMask = IntersectProceduralPacket(packet, primitive.aabb, primitiveMask, t);
+                    u = v = _mm_setzero_ps();
+                }
+                else
+                {
+                    primitiveHitMask = IntersectTrianglePacket(packet, primitive.triangle, primitiveMask, t, u, v);
+                }
+
+                if (primitiveHitMask)
+                {
+                    CommitHits(packet, context, primitiveHitMask, t, u, v, pMetadata[i], instanceIndex, instanceID);
+                }
+            }
+        }
+    }
+
+    static
+        void TraverseTopLevel(
+            const BYTE* pTopLevel,
+            RayPacket& packet,
+            PacketContext& context)
+    {
+        // Top levels keep their BVHMetadata where bottom levels keep primitives
+        const BVHOffsets &offsets = *(const BVHOffsets *)pTopLevel;
+        const AABBNode *pNodes = (const AABBNode *)(pTopLevel + offsets.offsetToBoxes);
+        const BVHMetadata *pInstances = (const BVHMetadata *)(pTopLevel + offsets.offsetToVertices);
+        if (offsets.offsetToVertices == offsets.totalSize)
+        {
+            return;
+        }
+
+        UINT stack[PacketStackSize];
+        UINT stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize && context.ActiveMask)
+        {
+            const AABBNode &node = pNodes[stack[--stackSize]];
+            const UINT hitMask = IntersectNodePacket(packet, node, context.ActiveMask);
+            if (!hitMask)
+            {
+                continue;
+            }
+
+            if (!node.leaf)
+            {
+                PushChildren(packet, pNodes, node, hitMask, stack, stackSize);
+                continue;
+            }
+
+            const BVHMetadata &instance = pInstances[node.leafNode.firstTriangleId];
+            const D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC &instanceDesc = instance.instanceDesc;
+            if (!(instanceDesc.InstanceMask & context.InstanceInclusionMask))
+            {
+                continue;
+            }
+
+            // instanceDesc.Transform holds WorldToObject in the output
+            RayPacket objectPacket;
+            TransformPacket(packet, instanceDesc.Transform, objectPacket);
+            TraverseBottomLevel(
+                (const BYTE *)instanceDesc.AccelerationStructure.GpuVA,
+                objectPacket,
+                hitMask,
+                instance.InstanceIndex,
+                instanceDesc.InstanceID,
+                context);
+            packet.TMax = objectPacket.TMax;
+        }
+    }
+
+    static
+        void TracePacket(
+            const BYTE* pAccelerationStructure,
+            D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE type,
+            const CpuRay* pRays,
+            UINT numRays,
+            const CpuTraversalSettings& settings,
+            CpuTraversalHit* pHits)
+    {
+        assert(numRays > 0 && numRays <= PacketWidth);
+
+        // Unused lanes repeat the first ray and stay masked off
+        float origins[3][PacketWidth];
+        float directions[3][PacketWidth];
+        float tMin[PacketWidth];
+        float tMax[PacketWidth];
+        PacketContext context;
+        context.Mode = settings.Mode;
+        context.InstanceInclusionMask = settings.InstanceInclusionMask;
+        context.ActiveMask = (1 << numRays) - 1;
+        for (UINT lane = 0; lane < PacketWidth; lane++)
+        {
+            const CpuRay &ray = pRays[lane < numRays ? lane : 0];
+            const float *pOrigin = &ray.Origin.x;
+            const float *pDirection = &ray.Direction.x;
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                origins[axis][lane] = pOrigin[axis];
+                directions[axis][lane] = pDirection[axis];
+            }
+            tMin[lane] = ray.TMin;
+            tMax[lane] = ray.TMax;
+            context.Hits[lane] = CpuTraversalHit{ ray.TMax, 0.0f, 0.0f, CpuTraversalNoHit, CpuTraversalNoHit, CpuTraversalNoHit, CpuTraversalNoHit };
+        }
+
+        RayPacket packet;
+        InitializePacket(packet, origins, directions, tMin, tMax);
+        if (type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL)
+        {
+            TraverseTopLevel(pAccelerationStructure, packet, context);
+        }
+        else
+        {
+            TraverseBottomLevel(pAccelerationStructure, packet, context.ActiveMask, 0, 0, context);
+        }
+
+        for (UINT i = 0; i < numRays; i++)
+        {
+            pHits[i] = context.Hits[i];
+        }
+    }
+
+    void TraceRaysOnCpu(
+        _In_ const BYTE *pAccelerationStructure,
+        _In_ D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE type,
+        _In_reads_(numRays) const CpuRay *pRays,
+        UINT numRays,
+        _In_ const CpuTraversalSettings &settings,
+        _Out_writes_(numRays) CpuTraversalHit *pHits)
+    {
+        if (numRays == 0)
+        {
+            return;
+        }
+
+        const UINT raysPerPacket = settings.UseRayPackets ? PacketWidth : 1;
+        const UINT numPackets = DivideAndRoundUp(numRays, raysPerPacket);
+        auto tracePacket = [&](UINT packetIndex)
+        {
+            const UINT firstRay = packetIndex * raysPerPacket;
+            TracePacket(pAccelerationStructure, type, pRays + firstRay, std::min(raysPerPacket, numRays - firstRay), settings, pHits + firstRay);
+        };
+
+        if (settings.UseMultithreadedTraversal)
+        {
+            concurrency::parallel_for(0u, numPackets, tracePacket);
+        }
+        else
+        {
+            for (UINT i = 0; i < numPackets; i++)
+            {
+                tracePacket(i);
+            }
+        }
+    }
+
+    bool TraceRayOnCpu(
+        _In_ const BYTE *pAccelerationStructure,
+        _In_ D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE type,
+        _In_ const CpuRay &ray,
+        _In_ const CpuTraversalSettings &settings,
+        _Out_ CpuTraversalHit &hit)
+    {
+        TracePacket(pAccelerationStructure, type, &ray, 1, settings, &hit);
+        return hit.PrimitiveIndex != CpuTraversalNoHit;
+    }
+}
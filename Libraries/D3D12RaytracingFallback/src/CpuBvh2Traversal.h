@@ -0,0 +1,72 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+namespace FallbackLayer
+{
+    enum CpuTraversalMode
+    {
+        CpuTraversalClosestHit = 0,
+
+        // Stops at the first intersection found, for visibility and AO rays
+        CpuTraversalAnyHit,
+    };
+
+    static const UINT CpuTraversalNoHit = 0xffffffff;
+
+    struct CpuTraversalHit
+    {
+        // TMax of the ray on a miss
+        float T;
+        float U;
+        float V;
+
+        // PrimitiveMetaData::PrimitiveIndex, CpuTraversalNoHit on a miss
+        UINT PrimitiveIndex;
+        UINT GeometryIndex;
+
+        // Always 0 when tracing a bottom level directly
+        UINT InstanceIndex;
+        UINT InstanceID;
+    };
+
+    struct CpuTraversalSettings
+    {
+        CpuTraversalMode Mode = CpuTraversalClosestHit;
+
+        // Traces each group of 4 consecutive rays as an SSE packet. Pays off
+        // when neighboring rays are coherent, otherwise rays are traced alone.
+        bool UseRayPackets = true;
+
+        bool UseMultithreadedTraversal = true;
+
+        UINT InstanceInclusionMask = 0xff;
+    };
+
+    // Traverses a BVH2 built by BuildRaytracingAccelerationStructureOnCpu. For
+    // top levels, instance AccelerationStructure addresses are read as CPU
+    // addresses of bottom levels, as written by the CPU builder. Procedural
+    // primitives are hit at the entry of their AABB.
+    void TraceRaysOnCpu(
+        _In_ const BYTE *pAccelerationStructure,
+        _In_ D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE type,
+        _In_reads_(numRays) const CpuRay *pRays,
+        UINT numRays,
+        _In_ const CpuTraversalSettings &settings,
+        _Out_writes_(numRays) CpuTraversalHit *pHits);
+
+    bool TraceRayOnCpu(
+        _In_ const BYTE *pAccelerationStructure,
+        _In_ D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE type,
+        _In_ const CpuRay &ray,
+        _In_ const CpuTraversalSettings &settings,
+        _Out_ CpuTraversalHit &hit);
+}
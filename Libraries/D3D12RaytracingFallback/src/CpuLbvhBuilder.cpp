@@ -0,0 +1,793 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "pch.h"
+#include "TreeletReorderBindings.h"
+
+namespace FallbackLayer
+{
+    template<typename Function>
+    static
+        void ForEachIndex(
+            UINT count,
+            bool bMultithreaded,
+            Function function)
+    {
+        if (bMultithreaded)
+        {
+            concurrency::parallel_for(0u, count, function);
+        }
+        else
+        {
+            for (UINT i = 0; i < count; ++i)
+            {
+                function(i);
+            }
+        }
+    }
+
+    // Subtrees below this depth are walked on the current thread
+    static const UINT ParallelSubtreeDepth = 10;
+
+    template<typename LeftFunction, typename RightFunction>
+    static
+        void InvokeChildren(
+            UINT depth,
+            bool bMultithreaded,
+            LeftFunction left,
+            RightFunction right)
+    {
+        if (bMultithreaded && depth < ParallelSubtreeDepth)
+        {
+            concurrency::parallel_invoke(left, right);
+        }
+        else
+        {
+            left();
+            right();
+        }
+    }
+
+    static
+        float ComputeBoxSurfaceArea(
+            const AABB& box)
+    {
+        const float3 dim = box.max - box.min;
+        return 2.0f * (dim.x * dim.y + dim.x * dim.z + dim.y * dim.z);
+    }
+
+    static
+        AABB CombineAABB(
+            const AABB& box0,
+            const AABB& box1)
+    {
+        AABB box;
+        box.min = min(box0.min, box1.min);
+        box.max = max(box0.max, box1.max);
+        return box;
+    }
+
+    // AABBtoBoundingBox in RayTracingHelper.hlsli, DecompressAABB is the inverse
+    static
+        void EncodeBoundingBox(
+            AABBNode& node,
+            const AABB& box)
+    {
+        for (UINT axis = 0; axis < 3; ++axis)
+        {
+            const float center = (box.minArr[axis] + box.maxArr[axis]) * 0.5f;
+            node.center[axis] = center;
+            node.halfDim[axis] = box.maxArr[axis] - center;
+        }
+    }
+
+    //
+    // Morton codes, mirrors CalculateMortonCodes.hlsli
+    //
+
+    // Moves the low 21 bits of value to every third bit
+    static
+        UINT64 SpreadBits(
+            UINT64 value)
+    {
+        value &= 0x1fffff;
+        value = (value | value << 32) & 0x001f00000000ffffull;
+        value = (value | value << 16) & 0x001f0000ff0000ffull;
+        value = (value | value << 8) & 0x100f00f00f00f00full;
+        value = (value | value << 4) & 0x10c30c30c30c30c3ull;
+        value = (value | value << 2) & 0x1249249249249249ull;
+        return value;
+    }
+
+    static
+        UINT64 CalculateMortonCode(
+            const float3& centroid,
+            const float3& sceneMin,
+            const float3& sceneDimension,
+            UINT bitsPerAxis)
+    {
+        const float3 unitCoord = (centroid - sceneMin) / sceneDimension;
+        const float maxCoord = (float)(1u << bitsPerAxis);
+        const float unitCoords[3] = { unitCoord.x, unitCoord.y, unitCoord.z };
+
+        UINT64 coords[3];
+        for (UINT axis = 0; axis < 3; ++axis)
+        {
+            // 0 first so NaNs are dropped like the HLSL max does
+            coords[axis] = (UINT64)std::min(std::max(0.0f, unitCoords[axis] * maxCoord), maxCoord - 1);
+        }
+
+        // The shader interleaves y, x, z starting from the lowest bit
+        return SpreadBits(coords[1]) | SpreadBits(coords[0]) << 1 | SpreadBits(coords[2]) << 2;
+    }
+
+    //
+    // Least significant digit radix sort. Equal codes keep their input order,
+    // which is how BitonicSortCommon.hlsli breaks ties.
+    //
+
+    static const UINT RadixSortDigitBits = 8;
+    static const UINT RadixSortDigitCount = 1 << RadixSortDigitBits;
+    static const UINT RadixSortChunkSize = 64 * 1024;
+
+    static
+        void RadixSortByKey(
+            std::vector<UINT64>& keys,
+            std::vector<UINT>& values,
+            UINT numKeyBits,
+            bool bMultithreaded)
+    {
+        const UINT numElements = (UINT)keys.size();
+        const UINT numChunks = bMultithreaded ? DivideAndRoundUp(std::max(numElements, 1u), RadixSortChunkSize) : 1;
+
+        std::vector<UINT64> sortedKeys(numElements);
+        std::vector<UINT> sortedValues(numElements);
+        std::vector<UINT> chunkOffsets(numChunks * RadixSortDigitCount);
+
+        auto forEachChunk = [&](auto function)
+        {
+            ForEachIndex(numChunks, bMultithreaded, [&](UINT chunkIndex)
+            {
+                const UINT begin = chunkIndex * RadixSortChunkSize;
+                const UINT end = (numChunks == 1) ? numElements : std::min(numElements, begin + RadixSortChunkSize);
+                function(&chunkOffsets[chunkIndex * RadixSortDigitCount], begin, end);
+            });
+        };
+
+        for (UINT shift = 0; shift < numKeyBits; shift += RadixSortDigitBits)
+        {
+            forEachChunk([&](UINT* pCounts, UINT begin, UINT end)
+            {
+                std::fill(pCounts, pCounts + RadixSortDigitCount, 0);
+                for (UINT i = begin; i < end; ++i)
+                {
+                    pCounts[(keys[i] >> shift) & (RadixSortDigitCount - 1)]++;
+                }
+            });
+
+            // Digit-major prefix sum so chunks scatter in order and the sort stays stable
+            UINT offset = 0;
+            bool bSingleDigit = false;
+            for (UINT digit = 0; digit < RadixSortDigitCount; ++digit)
+            {
+                const UINT digitStart = offset;
+                for (UINT chunkIndex = 0; chunkIndex < numChunks; ++chunkIndex)
+                {
+                    UINT& chunkOffset = chunkOffsets[chunkIndex * RadixSortDigitCount + digit];
+                    const UINT count = chunkOffset;
+                    chunkOffset = offset;
+                    offset += count;
+                }
+                bSingleDigit |= (offset - digitStart) == numElements;
+            }
+
+            // Scattering would be a copy
+            if (bSingleDigit)
+            {
+                continue;
+            }
+
+            forEachChunk([&](UINT* pOffsets, UINT begin, UINT end)
+            {
+                for (UINT i = begin; i < end; ++i)
+                {
+                    const UINT destination = pOffsets[(keys[i] >> shift) & (RadixSortDigitCount - 1)]++;
+                    sortedKeys[destination] = keys[i];
+                    sortedValues[destination] = values[i];
+                }
+            });
+
+            keys.swap(sortedKeys);
+            values.swap(sortedValues);
+        }
+    }
+
+    //
+    // Hierarchy, mirrors BuildBVHSplits.hlsli (Karras 2012). Internal node i is
+    // node i and sorted leaf i is node NumElements - 1 + i.
+    //
+
+    struct HierarchyBuildContext
+    {
+        const UINT64*   pMortonCodes;
+        HierarchyNode*  pHierarchy;
+        INT64           numElements;
+        UINT            numCodeBits;
+    };
+
+    static
+        int CountLeadingZeroes(
+            UINT64 value,
+            UINT numBits)
+    {
+        unsigned long highestBit;
+        if (!_BitScanReverse64(&highestBit, value))
+        {
+            return numBits;
+        }
+        return numBits - 1 - highestBit;
+    }
+
+    static
+        int GetLongestCommonPrefix(
+            const HierarchyBuildContext& context,
+            INT64 indexA,
+            INT64 indexB)
+    {
+        if (indexA < 0 || indexB < 0 || indexA >= context.numElements || indexB >= context.numElements)
+        {
+            return -1;
+        }
+
+        const UINT64 mortonCodeA = context.pMortonCodes[indexA];
+        const UINT64 mortonCodeB = context.pMortonCodes[indexB];
+        if (mortonCodeA != mortonCodeB)
+        {
+            return CountLeadingZeroes(mortonCodeA ^ mortonCodeB, context.numCodeBits);
+        }
+        else
+        {
+            // Duplicates are told apart by their sorted index, which always
+            // shares fewer bits than two different codes
+            return CountLeadingZeroes(indexA ^ indexB, 32) + context.numCodeBits - 1;
+        }
+    }
+
+    static
+        void DetermineRange(
+            const HierarchyBuildContext& context,
+            INT64 index,
+            INT64& first,
+            INT64& last)
+    {
+        int direction = GetLongestCommonPrefix(context, index, index + 1) - GetLongestCommonPrefix(context, index, index - 1);
+        direction = std::max(-1, std::min(direction, 1));
+        const int minPrefix = GetLongestCommonPrefix(context, index, index - direction);
+
+        INT64 maxLength = 2;
+        while (GetLongestCommonPrefix(context, index, index + maxLength * direction) > minPrefix)
+        {
+            maxLength *= 4;
+        }
+
+        INT64 length = 0;
+        for (INT64 t = maxLength / 2; t > 0; t /= 2)
+        {
+            if (GetLongestCommonPrefix(context, index, index + (length + t) * direction) > minPrefix)
+            {
+                length = length + t;
+            }
+        }
+
+        const INT64 other = index + length * direction;
+        first = std::min(index, other);
+        last = std::max(index, other);
+    }
+
+    static
+        INT64 FindSplit(
+            const HierarchyBuildContext& context,
+            INT64 first,
+            INT64 last)
+    {
+        const int commonPrefix = GetLongestCommonPrefix(context, first, last);
+        INT64 split = first;
+        INT64 step = last - first;
+
+        do
+        {
+            step = (step + 1) >> 1;
+            const INT64 newSplit = split + step;
+
+            if (newSplit < last)
+            {
+                const int splitPrefix = GetLongestCommonPrefix(context, first, newSplit);
+                if (splitPrefix > commonPrefix)
+                {
+                    split = newSplit;
+                }
+            }
+        } while (step > 1);
+
+        return split;
+    }
+
+    static
+        void GenerateHierarchy(
+            const HierarchyBuildContext& context,
+            UINT index)
+    {
+        INT64 first, last;
+        DetermineRange(context, index, first, last);
+        const INT64 split = FindSplit(context, first, last);
+
+        const UINT leafNodeOffset = (UINT)context.numElements - 1;
+        const UINT childAIndex = (UINT)split + (split == first ? leafNodeOffset : 0);
+        const UINT childBIndex = (UINT)split + 1 + (split + 1 == last ? leafNodeOffset : 0);
+
+        // Every node has a single parent, so no other thread touches these
+        HierarchyNode* pHierarchy = context.pHierarchy;
+        pHierarchy[index].LeftChildIndex = childAIndex;
+        pHierarchy[index].RightChildIndex = childBIndex;
+        pHierarchy[childAIndex].ParentIndex = index;
+        pHierarchy[childBIndex].ParentIndex = index;
+    }
+
+    //
+    // Treelet reordering, mirrors FindTreelets.hlsl and TreeletReorder.hlsl
+    // (Karras and Aila 2013)
+    //
+    // A pass of FindTreelets.hlsl and TreeletReorder.hlsl visits nodes bottom
+    // up: a node is reordered once both children are done, when it is the first
+    // node on the way up with at least minElementsPerTreelet leaves or when one
+    // of its children was reordered. Walking the tree depth-first produces the
+    // same result without the counters.
+    //
+
+    static const float CostOfRayBoxIntersection = 1.2f;
+    static const float CostOfRayTriangleIntersection = 1.0f;
+
+    static const UINT NumInternalTreeletNodes = FullTreeletSize - 1;
+    static const UINT NumTreeletSplitPermutations = 1 << FullTreeletSize;
+    static const UINT FullPartitionMask = NumTreeletSplitPermutations - 1;
+    static const UINT CollapseChildrenPartitionBit = NumTreeletSplitPermutations;
+
+    struct TreeletReorderContext
+    {
+        HierarchyNode*  pHierarchy;
+        const AABB*     pLeafBoxes;
+        AABB*           pBoxes;
+        UINT            numInternalNodes;
+        UINT            minElementsPerTreelet;
+        bool            bMultithreaded;
+    };
+
+    enum class TreeletWalkResult
+    {
+        Climbed,
+        Reordered,
+        Stopped
+    };
+
+    static
+        bool IsLeafIndex(
+            const TreeletReorderContext& context,
+            UINT nodeIndex)
+    {
+        return nodeIndex >= context.numInternalNodes;
+    }
+
+    static
+        void SetParent(
+            HierarchyNode& node,
+            UINT parentIndex,
+            bool bCollapseChildren)
+    {
+        node.ParentIndex = parentIndex;
+        node.bCollapseChildren = bCollapseChildren;
+    }
+
+    static
+        void ReorderTreelet(
+            const TreeletReorderContext& context,
+            UINT nodeIndex)
+    {
+        HierarchyNode* pHierarchy = context.pHierarchy;
+        AABB* pBoxes = context.pBoxes;
+
+        //
+        // FormTreelet: keep opening the internal node with the largest surface area
+        //
+
+        UINT internalNodes[NumInternalTreeletNodes];
+        UINT treeletToReorder[FullTreeletSize];
+        internalNodes[0] = nodeIndex;
+        treeletToReorder[0] = pHierarchy[nodeIndex].LeftChildIndex;
+        treeletToReorder[1] = pHierarchy[nodeIndex].RightChildIndex;
+
+        for (UINT treeletSize = 2; treeletSize < FullTreeletSize; treeletSize++)
+        {
+            // The shader starts at 0 and falls back to the root when every
+            // candidate is flat. Zero area nodes can still be opened here.
+            float largestSurfaceArea = -1.0f;
+            UINT indexOfNodeIndexToTraverse = 0;
+            for (UINT i = 0; i < treeletSize; i++)
+            {
+                if (!IsLeafIndex(context, treeletToReorder[i]))
+                {
+                    const float surfaceArea = ComputeBoxSurfaceArea(pBoxes[treeletToReorder[i]]);
+                    if (surfaceArea > largestSurfaceArea)
+                    {
+                        largestSurfaceArea = surfaceArea;
+                        indexOfNodeIndexToTraverse = i;
+                    }
+                }
+            }
+
+            const UINT nodeIndexToTraverse = treeletToReorder[indexOfNodeIndexToTraverse];
+            internalNodes[treeletSize - 1] = nodeIndexToTraverse;
+            treeletToReorder[indexOfNodeIndexToTraverse] = pHierarchy[nodeIndexToTraverse].LeftChildIndex;
+            treeletToReorder[treeletSize] = pHierarchy[nodeIndexToTraverse].RightChildIndex;
+        }
+
+        //
+        // FindOptimalPartitions
+        //
+
+        float optimalCost[NumTreeletSplitPermutations];
+        UINT optimalPartition[NumTreeletSplitPermutations];
+        for (UINT treeletBitmask = 1; treeletBitmask < NumTreeletSplitPermutations; treeletBitmask++)
+        {
+            AABB box;
+            box.min = float3{ FLT_MAX, FLT_MAX, FLT_MAX };
+            box.max = float3{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+            for (UINT i = 0; i < FullTreeletSize; i++)
+            {
+                if ((1 << i) & treeletBitmask)
+                {
+                    box = CombineAABB(box, pBoxes[treeletToReorder[i]]);
+                }
+            }
+
+            // Intermediate value
+            optimalCost[treeletBitmask] = ComputeBoxSurfaceArea(box);
+        }
+
+        // Single leaves are normalized to the root but larger subsets aren't,
+        // kept as is so the partitions match the shader
+        const float rootSurfaceArea = ComputeBoxSurfaceArea(pBoxes[nodeIndex]);
+        for (UINT i = 0; i < FullTreeletSize; i++)
+        {
+            optimalCost[1 << i] = CostOfRayBoxIntersection * ComputeBoxSurfaceArea(pBoxes[treeletToReorder[i]]) / rootSurfaceArea;
+        }
+
+        for (UINT subsetSize = 2; subsetSize <= FullTreeletSize; subsetSize++)
+        {
+            for (UINT treeletBitmask = 1; treeletBitmask < NumTreeletSplitPermutations; treeletBitmask++)
+            {
+                if (__popcnt(treeletBitmask) != subsetSize)
+                {
+                    continue;
+                }
+
+                float lowestCost = FLT_MAX;
+                UINT bestPartition = 0;
+
+                const UINT delta = (treeletBitmask - 1) & treeletBitmask;
+                UINT partitionBitmask = (0 - delta) & treeletBitmask;
+                do
+                {
+                    const float cost = optimalCost[partitionBitmask] + optimalCost[treeletBitmask ^ partitionBitmask];
+                    if (cost < lowestCost)
+                    {
+                        lowestCost = cost;
+                        bestPartition = partitionBitmask;
+                    }
+                    partitionBitmask = (partitionBitmask - delta) & treeletBitmask;
+                } while (partitionBitmask != 0);
+
+                // COMBINE_LEAF_NODES: the collapse flag is only recorded in the
+                // hierarchy, ComputeAABBs.hlsli doesn't act on it yet
+                const float costAsLeafNode = CostOfRayTriangleIntersection * optimalCost[treeletBitmask] * subsetSize;
+                const float costAsInternalNode = CostOfRayBoxIntersection * optimalCost[treeletBitmask] + lowestCost;
+                optimalCost[treeletBitmask] = std::min(costAsInternalNode, costAsLeafNode);
+                optimalPartition[treeletBitmask] = bestPartition;
+                if (costAsLeafNode < costAsInternalNode)
+                {
+                    optimalPartition[treeletBitmask] |= CollapseChildrenPartitionBit;
+                }
+            }
+        }
+
+        //
+        // ReformTree
+        //
+
+        struct PartitionEntry
+        {
+            UINT Mask;
+            UINT NodeIndex;
+        };
+
+        auto allocateEntry = [&](UINT mask, UINT& nodesAllocated, PartitionEntry* pStack, UINT& stackSize)
+        {
+            PartitionEntry entry;
+            entry.Mask = mask;
+            if (__popcnt(mask) > 1)
+            {
+                entry.NodeIndex = internalNodes[nodesAllocated++];
+                pStack[stackSize++] = entry;
+            }
+            else
+            {
+                unsigned long leafBit;
+                _BitScanForward(&leafBit, mask);
+                entry.NodeIndex = treeletToReorder[leafBit];
+            }
+            return entry;
+        };
+
+        UINT nodesAllocated = 1;
+        UINT partitionStackSize = 1;
+        PartitionEntry partitionStack[FullTreeletSize];
+        partitionStack[0].Mask = FullPartitionMask;
+        partitionStack[0].NodeIndex = internalNodes[0];
+
+        while (partitionStackSize > 0)
+        {
+            const PartitionEntry partition = partitionStack[--partitionStackSize];
+            const bool bCollapseChildren = (optimalPartition[partition.Mask] & CollapseChildrenPartitionBit) != 0;
+            const UINT leftMask = optimalPartition[partition.Mask] & FullPartitionMask;
+
+            const PartitionEntry leftEntry = allocateEntry(leftMask, nodesAllocated, partitionStack, partitionStackSize);
+            const PartitionEntry rightEntry = allocateEntry(partition.Mask ^ leftMask, nodesAllocated, partitionStack, partitionStackSize);
+
+            pHierarchy[partition.NodeIndex].LeftChildIndex = leftEntry.NodeIndex;
+            pHierarchy[partition.NodeIndex].RightChildIndex = rightEntry.NodeIndex;
+            SetParent(pHierarchy[leftEntry.NodeIndex], partition.NodeIndex, bCollapseChildren);
+            SetParent(pHierarchy[rightEntry.NodeIndex], partition.NodeIndex, bCollapseChildren);
+        }
+
+        // Nodes were allocated top-down, so the reverse order is bottom-up
+        for (int j = NumInternalTreeletNodes - 1; j >= 0; j--)
+        {
+            const HierarchyNode& node = pHierarchy[internalNodes[j]];
+            pBoxes[internalNodes[j]] = CombineAABB(pBoxes[node.LeftChildIndex], pBoxes[node.RightChildIndex]);
+        }
+    }
+
+    static
+        TreeletWalkResult ReorderTreeletsInSubtree(
+            const TreeletReorderContext& context,
+            UINT nodeIndex,
+            UINT depth,
+            UINT& numElements)
+    {
+        HierarchyNode* pHierarchy = context.pHierarchy;
+        if (IsLeafIndex(context, nodeIndex))
+        {
+            context.pBoxes[nodeIndex] = context.pLeafBoxes[nodeIndex - context.numInternalNodes];
+            numElements = 1;
+        }
+        else
+        {
+            // Reordering a child only rewires nodes below it
+            const UINT leftChildIndex = pHierarchy[nodeIndex].LeftChildIndex;
+            const UINT rightChildIndex = pHierarchy[nodeIndex].RightChildIndex;
+
+            UINT numLeftElements = 0, numRightElements = 0;
+            TreeletWalkResult leftResult = TreeletWalkResult::Climbed, rightResult = TreeletWalkResult::Climbed;
+            InvokeChildren(depth, context.bMultithreaded,
+                [&] { leftResult = ReorderTreeletsInSubtree(context, leftChildIndex, depth + 1, numLeftElements); },
+                [&] { rightResult = ReorderTreeletsInSubtree(context, rightChildIndex, depth + 1, numRightElements); });
+
+            if (leftResult == TreeletWalkResult::Stopped || rightResult == TreeletWalkResult::Stopped)
+            {
+                return TreeletWalkResult::Stopped;
+            }
+
+            context.pBoxes[nodeIndex] = CombineAABB(context.pBoxes[leftChildIndex], context.pBoxes[rightChildIndex]);
+            numElements = numLeftElements + numRightElements;
+
+            if (leftResult == TreeletWalkResult::Reordered ||
+                rightResult == TreeletWalkResult::Reordered ||
+                numElements >= context.minElementsPerTreelet)
+            {
+                ReorderTreelet(context, nodeIndex);
+                return TreeletWalkResult::Reordered;
+            }
+        }
+
+        // FindTreelets.hlsl follows the raw ParentIndex. Nodes flagged by an
+        // earlier pass point out of bounds there and never reach their parent.
+        return pHierarchy[nodeIndex].bCollapseChildren ? TreeletWalkResult::Stopped : TreeletWalkResult::Climbed;
+    }
+
+    static
+        void ReorderTreelets(
+            std::vector<HierarchyNode>& hierarchy,
+            const std::vector<AABB>& leafBoxes,
+            UINT numPasses,
+            bool bMultithreaded)
+    {
+        const UINT numElements = (UINT)leafBoxes.size();
+
+        // The AABBBuffer of the shaders, leaves included
+        std::vector<AABB> boxes(hierarchy.size());
+
+        TreeletReorderContext context;
+        context.pHierarchy = hierarchy.data();
+        context.pLeafBoxes = leafBoxes.data();
+        context.pBoxes = boxes.data();
+        context.numInternalNodes = numElements - 1;
+        context.minElementsPerTreelet = FullTreeletSize;
+        context.bMultithreaded = bMultithreaded;
+
+        for (UINT i = 0; i < numPasses && context.minElementsPerTreelet <= numElements; i++)
+        {
+            UINT numRootElements;
+            ReorderTreeletsInSubtree(context, 0, 0, numRootElements);
+            context.minElementsPerTreelet *= 2;
+        }
+    }
+
+    //
+    // Final nodes, mirrors ComputeAABBs.hlsli
+    //
+
+    struct NodeConstructionContext
+    {
+        const HierarchyNode*    pHierarchy;
+        const AABB*             pLeafBoxes;
+        AABBNode*               pNodes;
+        UINT                    numInternalNodes;
+        bool                    bMultithreaded;
+    };
+
+    static
+        UINT ConstructNodes(
+            const NodeConstructionContext& context,
+            UINT nodeIndex,
+            UINT depth)
+    {
+        AABBNode& node = context.pNodes[nodeIndex];
+        if (nodeIndex >= context.numInternalNodes)
+        {
+            const UINT leafIndex = nodeIndex - context.numInternalNodes;
+            EncodeBoundingBox(node, context.pLeafBoxes[leafIndex]);
+            node.nodeAllBits = 0;
+            node.leafNode.firstTriangleId = leafIndex;
+            node.leaf = true;
+            node.numTriangles = 1;
+            return 1;
+        }
+
+        UINT leftNodeIndex = context.pHierarchy[nodeIndex].LeftChildIndex;
+        UINT rightNodeIndex = context.pHierarchy[nodeIndex].RightChildIndex;
+
+        UINT numLeftElements = 0, numRightElements = 0;
+        InvokeChildren(depth, context.bMultithreaded,
+            [&] { numLeftElements = ConstructNodes(context, leftNodeIndex, depth + 1); },
+            [&] { numRightElements = ConstructNodes(context, rightNodeIndex, depth + 1); });
+
+        // Smaller side on the left. The shader decides ties by which child
+        // finishes last, they are left in hierarchy order here.
+        if (numLeftElements > numRightElements)
+        {
+            std::swap(leftNodeIndex, rightNodeIndex);
+        }
+
+        AABB leftBox, rightBox;
+        DecompressAABB(leftBox, context.pNodes[leftNodeIndex]);
+        DecompressAABB(rightBox, context.pNodes[rightNodeIndex]);
+        EncodeBoundingBox(node, CombineAABB(leftBox, rightBox));
+        node.nodeAllBits = leftNodeIndex & 0x00ffffff;
+        node.rightNodeIndex = rightNodeIndex;
+
+        return numLeftElements + numRightElements;
+    }
+
+    void BuildLbvh(
+        _In_ const LbvhElements &elements,
+        UINT mortonCodeBits,
+        UINT numTreeletReorderPasses,
+        bool bMultithreaded,
+        _Out_ CpuLbvh &lbvh)
+    {
+        if (mortonCodeBits != 30 && mortonCodeBits != 63)
+        {
+            ThrowFailure(E_INVALIDARG, L"LBVH Morton codes need to be either 30 or 63 bits");
+        }
+
+        const UINT numElements = (UINT)elements.Boxes.size();
+        lbvh.MortonCodes.resize(numElements);
+        lbvh.SortedIndices.resize(numElements);
+        lbvh.Hierarchy.clear();
+        lbvh.Nodes.clear();
+        if (numElements == 0)
+        {
+            return;
+        }
+
+        //
+        // MortonCodesCalculator and BitonicSort
+        //
+
+        const float epsilon = 0.00001f;
+        const float3 sceneDimension = max(elements.SceneBox.max - elements.SceneBox.min, float3{ epsilon, epsilon, epsilon });
+        const UINT bitsPerAxis = mortonCodeBits / 3;
+        ForEachIndex(numElements, bMultithreaded, [&](UINT i)
+        {
+            lbvh.MortonCodes[i] = CalculateMortonCode(elements.Centroids[i], elements.SceneBox.min, sceneDimension, bitsPerAxis);
+            lbvh.SortedIndices[i] = i;
+        });
+
+        RadixSortByKey(lbvh.MortonCodes, lbvh.SortedIndices, mortonCodeBits, bMultithreaded);
+
+        //
+        // ConstructHierarchyPass
+        //
+
+        const UINT numInternalNodes = numElements - 1;
+        const UINT numNodes = numInternalNodes + numElements;
+        lbvh.Hierarchy.resize(numNodes);
+        memset(lbvh.Hierarchy.data(), 0, numNodes * sizeof(HierarchyNode));
+
+        HierarchyBuildContext hierarchyContext;
+        hierarchyContext.pMortonCodes = lbvh.MortonCodes.data();
+        hierarchyContext.pHierarchy = lbvh.Hierarchy.data();
+        hierarchyContext.numElements = numElements;
+        hierarchyContext.numCodeBits = (mortonCodeBits == 30) ? 32 : 64;
+        ForEachIndex(numInternalNodes, bMultithreaded, [&](UINT i)
+        {
+            GenerateHierarchy(hierarchyContext, i);
+        });
+
+        // RearrangeElementsPass moves the elements into sorted order before the
+        // boxes are computed
+        std::vector<AABB> leafBoxes(numElements);
+        ForEachIndex(numElements, bMultithreaded, [&](UINT i)
+        {
+            leafBoxes[i] = elements.Boxes[lbvh.SortedIndices[i]];
+        });
+
+        //
+        // TreeletReorder
+        //
+
+        if (numTreeletReorderPasses > 0)
+        {
+            // The shaders load the leaf boxes back from the packed node format
+            std::vector<AABB> treeletLeafBoxes(numElements);
+            ForEachIndex(numElements, bMultithreaded, [&](UINT i)
+            {
+                AABBNode node;
+                EncodeBoundingBox(node, leafBoxes[i]);
+                DecompressAABB(treeletLeafBoxes[i], node);
+            });
+
+            ReorderTreelets(lbvh.Hierarchy, treeletLeafBoxes, numTreeletReorderPasses, bMultithreaded);
+        }
+
+        //
+        // ConstructAABBPass
+        //
+
+        lbvh.Nodes.resize(numNodes);
+
+        NodeConstructionContext nodeContext;
+        nodeContext.pHierarchy = lbvh.Hierarchy.data();
+        nodeContext.pLeafBoxes = leafBoxes.data();
+        nodeContext.pNodes = lbvh.Nodes.data();
+        nodeContext.numInternalNodes = numInternalNodes;
+        nodeContext.bMultithreaded = bMultithreaded;
+        ConstructNodes(nodeContext, 0, 0);
+    }
+}
@@ -0,0 +1,57 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+namespace FallbackLayer
+{
+    // Bounds of the elements (primitives or instances) being built over, as
+    // the GPU passes see them: Boxes are the padded leaf boxes written by
+    // ComputeAABBs.hlsli, Centroids the input of CalculateMortonCodes.hlsli
+    // and SceneBox the output of SceneAABBCalculator.
+    struct LbvhElements
+    {
+        std::vector<AABB> Boxes;
+        std::vector<float3> Centroids;
+        AABB SceneBox;
+    };
+
+    // Contents of the GpuBvh2Builder scratch buffers at the end of a build, so a
+    // readback can be compared against them
+    struct CpuLbvh
+    {
+        // MortonCodeBuffer and IndexBuffer after BitonicSort
+        std::vector<UINT64> MortonCodes;
+        std::vector<UINT> SortedIndices;
+
+        // HierarchyBuffer after TreeletReorder. The parent of the root is never
+        // written by the GPU and is left at 0.
+        std::vector<HierarchyNode> Hierarchy;
+
+        // Output of ConstructAABBPass. Leaf i of the sorted order is node
+        // NumElements - 1 + i and references primitive i.
+        std::vector<AABBNode> Nodes;
+    };
+
+    // CPU version of MortonCodesCalculator, BitonicSort, ConstructHierarchyPass,
+    // TreeletReorder and ConstructAABBPass. With 30 bit Morton codes the
+    // hierarchy matches the GPU one exactly. The only difference in Nodes is
+    // the order of two children with the same number of leaves, which the GPU
+    // picks based on which of them finishes last.
+    //
+    // 63 bit codes (21 bits per axis) keep nearby primitives of large scenes
+    // apart, but the tree no longer matches the GPU.
+    void BuildLbvh(
+        _In_ const LbvhElements &elements,
+        UINT mortonCodeBits,
+        UINT numTreeletReorderPasses,
+        bool bMultithreaded,
+        _Out_ CpuLbvh &lbvh);
+}
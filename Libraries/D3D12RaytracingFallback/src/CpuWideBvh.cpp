@@ -0,0 +1,747 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "pch.h"
+
+namespace FallbackLayer
+{
+    struct Bvh2View
+    {
+        Bvh2View(const BYTE *pBvh2)
+        {
+            const BVHOffsets &offsets = *(const BVHOffsets *)pBvh2;
+            pNodes = (const AABBNode *)(pBvh2 + offsets.offsetToBoxes);
+            pPrimitives = (const Primitive *)(pBvh2 + offsets.offsetToVertices);
+            NumNodes = (offsets.offsetToVertices - offsets.offsetToBoxes) / sizeof(AABBNode);
+        }
+
+        const AABBNode *pNodes;
+        const Primitive *pPrimitives;
+        UINT NumNodes;
+    };
+
+    static
+        float SurfaceArea(
+            const AABB& box)
+    {
+        const float3 extents = box.max - box.min;
+        return extents.x * extents.y + extents.y * extents.z + extents.z * extents.x;
+    }
+
+    static
+        AABB GetPrimitiveBox(
+            const Primitive& primitive)
+    {
+        if (primitive.PrimitiveType == PROCEDURAL_PRIMITIVE_TYPE)
+        {
+            return primitive.aabb;
+        }
+
+        const Triangle &triangle = primitive.triangle;
+        AABB box;
+        box.min = min(min(triangle.v0, triangle.v1), triangle.v2);
+        box.max = max(max(triangle.v0, triangle.v1), triangle.v2);
+        return box;
+    }
+
+    //
+    // The center/halfDim boxes of the BVH2 are rounded, so the wide nodes are
+    // quantized from boxes recomputed bottom-up from the primitives instead
+    //
+
+    static
+        void ComputeExactNodeBoxes(
+            const Bvh2View& bvh2,
+            std::vector<AABB>& boxes)
+    {
+        boxes.resize(bvh2.NumNodes);
+
+        // Reverse pre-order visits children before their parent regardless of
+        // how the builder laid the nodes out
+        std::vector<UINT> preOrder;
+        preOrder.reserve(bvh2.NumNodes);
+        std::vector<UINT> stack(1, 0);
+        while (!stack.empty())
+        {
+            const UINT nodeIndex = stack.back();
+            stack.pop_back();
+            preOrder.push_back(nodeIndex);
+
+            const AABBNode &node = bvh2.pNodes[nodeIndex];
+            if (!node.leaf)
+            {
+                stack.push_back(node.internalNode.leftNodeIndex);
+                stack.push_back(node.rightNodeIndex);
+            }
+        }
+
+        for (auto it = preOrder.rbegin(); it != preOrder.rend(); ++it)
+        {
+            const AABBNode &node = bvh2.pNodes[*it];
+            AABB &box = boxes[*it];
+            if (node.leaf)
+            {
+                const UINT firstPrimitive = node.leafNode.firstTriangleId;
+                box = node.numTriangles ? GetPrimitiveBox(bvh2.pPrimitives[firstPrimitive]) : AABB{};
+                for (UINT i = 1; i < node.numTriangles; i++)
+                {
+                    const AABB primitiveBox = GetPrimitiveBox(bvh2.pPrimitives[firstPrimitive + i]);
+                    box.min = min(box.min, primitiveBox.min);
+                    box.max = max(box.max, primitiveBox.max);
+                }
+            }
+            else
+            {
+                const AABB &left = boxes[node.internalNode.leftNodeIndex];
+                const AABB &right = boxes[node.rightNodeIndex];
+                box.min = min(left.min, right.min);
+                box.max = max(left.max, right.max);
+            }
+        }
+    }
+
+    //
+    // Conservative fp16 quantization
+    //
+
+    // Must match the decode in the SIMD kernels exactly, so no FMA contraction
+    static
+        float DecodeQuantized(
+            USHORT q,
+            float origin,
+            float scale)
+    {
+        const __m128 offset = _mm_mul_ss(_mm_set_ss(Fp16ToFp32(q)), _mm_set_ss(scale));
+        return _mm_cvtss_f32(_mm_add_ss(_mm_set_ss(origin), offset));
+    }
+
+    static
+        USHORT Fp16NextDown(
+            USHORT q)
+    {
+        if ((q & 0x7fff) == 0)
+        {
+            return 0x8001;
+        }
+        return (q & 0x8000) ? q + 1 : q - 1;
+    }
+
+    static
+        USHORT Fp16NextUp(
+            USHORT q)
+    {
+        if ((q & 0x7fff) == 0)
+        {
+            return 0x0001;
+        }
+        return (q & 0x8000) ? q - 1 : q + 1;
+    }
+
+    static
+        USHORT QuantizeLower(
+            float v,
+            float origin,
+            float scale)
+    {
+        USHORT q = Fp32ToFp16((v - origin) / scale, -1.0f);
+        while (DecodeQuantized(q, origin, scale) > v)
+        {
+            q = Fp16NextDown(q);
+        }
+        return q;
+    }
+
+    static
+        USHORT QuantizeUpper(
+            float v,
+            float origin,
+            float scale)
+    {
+        USHORT q = Fp32ToFp16((v - origin) / scale, 1.0f);
+        while (DecodeQuantized(q, origin, scale) < v)
+        {
+            q = Fp16NextUp(q);
+        }
+        return q;
+    }
+
+    template<UINT Width>
+    void CollapseBvh2(_In_ const BYTE *pBvh2, _Out_ WideBvh<Width> &wideBvh)
+    {
+        static_assert(Width >= 2 && Width <= 8, "Unsupported BVH width");
+
+        const Bvh2View bvh2(pBvh2);
+        std::vector<AABB> boxes;
+        ComputeExactNodeBoxes(bvh2, boxes);
+
+        wideBvh.pBvh2 = pBvh2;
+        wideBvh.Nodes.clear();
+        wideBvh.Nodes.reserve(bvh2.NumNodes / (Width - 1) + 1);
+
+        struct PendingNode
+        {
+            UINT Bvh2Node;
+            UINT WideNode;
+        };
+        std::vector<PendingNode> stack;
+        wideBvh.Nodes.emplace_back();
+        stack.push_back({ 0, 0 });
+
+        while (!stack.empty())
+        {
+            const PendingNode pending = stack.back();
+            stack.pop_back();
+
+            UINT children[Width];
+            UINT numChildren = 0;
+            const AABBNode &bvh2Node = bvh2.pNodes[pending.Bvh2Node];
+            if (bvh2Node.leaf)
+            {
+                // Only the root can be a leaf here, an empty one has no children
+                if (bvh2Node.numTriangles)
+                {
+                    children[numChildren++] = pending.Bvh2Node;
+                }
+            }
+            else
+            {
+                children[numChildren++] = bvh2Node.internalNode.leftNodeIndex;
+                children[numChildren++] = bvh2Node.rightNodeIndex;
+                while (numChildren < Width)
+                {
+                    UINT childToOpen = numChildren;
+                    float largestArea = -1.0f;
+                    for (UINT i = 0; i < numChildren; i++)
+                    {
+                        const float area = SurfaceArea(boxes[children[i]]);
+                        if (!bvh2.pNodes[children[i]].leaf && area > largestArea)
+                        {
+                            childToOpen = i;
+                            largestArea = area;
+                        }
+                    }
+
+                    if (childToOpen == numChildren)
+                    {
+                        break;
+                    }
+
+                    const AABBNode &opened = bvh2.pNodes[children[childToOpen]];
+                    children[childToOpen] = opened.internalNode.leftNodeIndex;
+                    children[numChildren++] = opened.rightNodeIndex;
+                }
+            }
+
+            WideBvhNode<Width> node = {};
+            node.Scale = 1.0f;
+            if (numChildren)
+            {
+                AABB bounds = boxes[children[0]];
+                for (UINT i = 1; i < numChildren; i++)
+                {
+                    bounds.min = min(bounds.min, boxes[children[i]].min);
+                    bounds.max = max(bounds.max, boxes[children[i]].max);
+                }
+
+                // Power of two so dividing by it is exact, chosen to keep
+                // every offset below 2^15 and well inside the fp16 range
+                const float3 extents = bounds.max - bounds.min;
+                int exponent;
+                frexpf(std::max(extents.x, std::max(extents.y, extents.z)), &exponent);
+                node.Scale = ldexpf(1.0f, exponent - 15);
+                node.Origin[0] = bounds.min.x;
+                node.Origin[1] = bounds.min.y;
+                node.Origin[2] = bounds.min.z;
+            }
+
+            for (UINT i = 0; i < Width; i++)
+            {
+                if (i >= numChildren)
+                {
+                    node.Children[i] = WideBvhEmptyChild;
+                    continue;
+                }
+
+                const AABB &box = boxes[children[i]];
+                node.LowerX[i] = QuantizeLower(box.min.x, node.Origin[0], node.Scale);
+                node.LowerY[i] = QuantizeLower(box.min.y, node.Origin[1], node.Scale);
+                node.LowerZ[i] = QuantizeLower(box.min.z, node.Origin[2], node.Scale);
+                node.UpperX[i] = QuantizeUpper(box.max.x, node.Origin[0], node.Scale);
+                node.UpperY[i] = QuantizeUpper(box.max.y, node.Origin[1], node.Scale);
+                node.UpperZ[i] = QuantizeUpper(box.max.z, node.Origin[2], node.Scale);
+
+                const AABBNode &child = bvh2.pNodes[children[i]];
+                if (child.leaf)
+                {
+                    if (child.numTriangles >= (1 << (32 - WideBvhLeafCountShift - 1)))
+                    {
+                        ThrowFailure(E_INVALIDARG, L"Leaf has too many primitives to be collapsed into a wide BVH");
+                    }
+                    node.Children[i] = WideBvhLeafFlag | child.numTriangles << WideBvhLeafCountShift | child.leafNode.firstTriangleId;
+                }
+                else
+                {
+                    node.Children[i] = (UINT)wideBvh.Nodes.size();
+                    wideBvh.Nodes.emplace_back();
+                    stack.push_back({ children[i], node.Children[i] });
+                }
+            }
+
+            wideBvh.Nodes[pending.WideNode] = node;
+        }
+    }
+
+    template void CollapseBvh2<4>(_In_ const BYTE *pBvh2, _Out_ WideBvh<4> &wideBvh);
+    template void CollapseBvh2<8>(_In_ const BYTE *pBvh2, _Out_ WideBvh<8> &wideBvh);
+
+    //
+    // Primitive intersection shared by every layout so they report identical hits
+    //
+
+    struct TraversalRay
+    {
+        TraversalRay(const CpuRay &ray) : Ray(ray)
+        {
+            InverseDirection = float3{ 1.0f / ray.Direction.x, 1.0f / ray.Direction.y, 1.0f / ray.Direction.z };
+        }
+
+        const CpuRay &Ray;
+        float3 InverseDirection;
+    };
+
+    static
+        bool IntersectBox(
+            const TraversalRay& ray,
+            const float3& boxMin,
+            const float3& boxMax,
+            float tMax,
+            float& tNear)
+    {
+        const float3 t0 = (boxMin - ray.Ray.Origin) * ray.InverseDirection;
+        const float3 t1 = (boxMax - ray.Ray.Origin) * ray.InverseDirection;
+        const float3 tLow = min(t0, t1);
+        const float3 tHigh = max(t0, t1);
+        tNear = std::max(std::max(tLow.x, tLow.y), std::max(tLow.z, ray.Ray.TMin));
+        const float tFar = std::min(std::min(tHigh.x, tHigh.y), std::min(tHigh.z, tMax));
+        return tNear <= tFar;
+    }
+
+    static
+        bool IntersectPrimitive(
+            const TraversalRay& ray,
+            const Primitive& primitive,
+            UINT primitiveIndex,
+            CpuRayHit& hit)
+    {
+        if (primitive.PrimitiveType == PROCEDURAL_PRIMITIVE_TYPE)
+        {
+            float tNear;
+            if (IntersectBox(ray, primitive.aabb.min, primitive.aabb.max, hit.T, tNear) && tNear < hit.T)
+            {
+                hit = CpuRayHit{ tNear, 0.0f, 0.0f, primitiveIndex };
+                return true;
+            }
+            return false;
+        }
+
+        // Moller-Trumbore, double sided
+        const Triangle &triangle = primitive.triangle;
+        const float3 edge1 = triangle.v1 - triangle.v0;
+        const float3 edge2 = triangle.v2 - triangle.v0;
+        const float3 p = cross(ray.Ray.Direction, edge2);
+        const float determinant = dot(edge1, p);
+        if (determinant == 0.0f)
+        {
+            return false;
+        }
+
+        const float inverseDeterminant = 1.0f / determinant;
+        const float3 s = ray.Ray.Origin - triangle.v0;
+        const float u = dot(s, p) * inverseDeterminant;
+        if (u < 0.0f || u > 1.0f)
+        {
+            return false;
+        }
+
+        const float3 q = cross(s, edge1);
+        const float v = dot(ray.Ray.Direction, q) * inverseDeterminant;
+        if (v < 0.0f || u + v > 1.0f)
+        {
+            return false;
+        }
+
+        const float t = dot(edge2, q) * inverseDeterminant;
+        if (t < ray.Ray.TMin || t >= hit.T)
+        {
+            return false;
+        }
+
+        hit = CpuRayHit{ t, u, v, primitiveIndex };
+        return true;
+    }
+
+    static
+        bool IntersectLeaf(
+            const TraversalRay& ray,
+            const Primitive* pPrimitives,
+            UINT firstPrimitive,
+            UINT numPrimitives,
+            CpuRayHit& hit)
+    {
+        bool bHit = false;
+        for (UINT i = 0; i < numPrimitives; i++)
+        {
+            bHit |= IntersectPrimitive(ray, pPrimitives[firstPrimitive + i], firstPrimitive + i, hit);
+        }
+        return bHit;
+    }
+
+    static const UINT TraversalStackSize = 128;
+
+    //
+    // BVH2
+    //
+
+    bool TraceRayBvh2(
+        _In_ const BYTE *pBvh2,
+        _In_ const CpuRay &cpuRay,
+        _Out_ CpuRayHit &hit,
+        _Inout_opt_ UINT *pNodesVisited)
+    {
+        const Bvh2View bvh2(pBvh2);
+        const TraversalRay ray(cpuRay);
+        hit = CpuRayHit{ cpuRay.TMax, 0.0f, 0.0f, 0 };
+
+        UINT nodesVisited = 1;
+        bool bHit = false;
+
+        auto intersectNode = [&](UINT nodeIndex, float &tNear)
+        {
+            const AABBNode &node = bvh2.pNodes[nodeIndex];
+            const float3 center = float3{ node.center[0], node.center[1], node.center[2] };
+            const float3 halfDim = float3{ node.halfDim[0], node.halfDim[1], node.halfDim[2] };
+            return IntersectBox(ray, center - halfDim, center + halfDim, hit.T, tNear);
+        };
+
+        float rootNear;
+        if (!intersectNode(0, rootNear))
+        {
+            if (pNodesVisited) *pNodesVisited += nodesVisited;
+            return false;
+        }
+
+        struct StackEntry
+        {
+            UINT NodeIndex;
+            float TNear;
+        };
+        StackEntry stack[TraversalStackSize];
+        UINT stackSize = 0;
+        stack[stackSize++] = { 0, rootNear };
+
+        while (stackSize)
+        {
+            const StackEntry entry = stack[--stackSize];
+            if (entry.TNear > hit.T)
+            {
+                continue;
+            }
+
+            const AABBNode &node = bvh2.pNodes[entry.NodeIndex];
+            if (node.leaf)
+            {
+                bHit |= IntersectLeaf(ray, bvh2.pPrimitives, node.leafNode.firstTriangleId, node.numTriangles, hit);
+                continue;
+            }
+
+            const UINT left = node.internalNode.leftNodeIndex;
+            const UINT right = node.rightNodeIndex;
+            float leftNear, rightNear;
+            const bool bHitLeft = intersectNode(left, leftNear);
+            const bool bHitRight = intersectNode(right, rightNear);
+            nodesVisited += 2;
+
+            // Push the farther child first so the nearer one is popped next
+            if (bHitLeft && bHitRight)
+            {
+                const bool bLeftFirst = leftNear <= rightNear;
+                stack[stackSize++] = bLeftFirst ? StackEntry{ right, rightNear } : StackEntry{ left, leftNear };
+                stack[stackSize++] = bLeftFirst ? StackEntry{ left, leftNear } : StackEntry{ right, rightNear };
+            }
+            else if (bHitLeft)
+            {
+                stack[stackSize++] = { left, leftNear };
+            }
+            else if (bHitRight)
+            {
+                stack[stackSize++] = { right, rightNear };
+            }
+
+            if (stackSize > TraversalStackSize - 2)
+            {
+                ThrowFailure(E_FAIL, L"BVH2 is too deep for the CPU traversal stack");
+            }
+        }
+
+        if (pNodesVisited) *pNodesVisited += nodesVisited;
+        return bHit;
+    }
+
+    //
+    // Wide BVH kernels
+    //
+
+    // Vector version of Fp16ToFp32 on the low four 16-bit lanes
+    static __forceinline
+        __m128 DecodeFp16x4(
+            const USHORT* pValues)
+    {
+        const __m128i halves = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)pValues), _mm_setzero_si128());
+        const __m128i sign = _mm_slli_epi32(_mm_and_si128(halves, _mm_set1_epi32(0x8000)), 16);
+        const __m128i body = _mm_slli_epi32(_mm_and_si128(halves, _mm_set1_epi32(0x7fff)), 13);
+        const __m128 magnitude = _mm_mul_ps(_mm_castsi128_ps(body), _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+        return _mm_or_ps(magnitude, _mm_castsi128_ps(sign));
+    }
+
+    struct SseRay
+    {
+        SseRay(const TraversalRay &ray) :
+            OriginX(_mm_set1_ps(ray.Ray.Origin.x)),
+            OriginY(_mm_set1_ps(ray.Ray.Origin.y)),
+            OriginZ(_mm_set1_ps(ray.Ray.Origin.z)),
+            InverseDirectionX(_mm_set1_ps(ray.InverseDirection.x)),
+            InverseDirectionY(_mm_set1_ps(ray.InverseDirection.y)),
+            InverseDirectionZ(_mm_set1_ps(ray.InverseDirection.z)),
+            TMin(_mm_set1_ps(ray.Ray.TMin)) {}
+
+        __m128 OriginX, OriginY, OriginZ;
+        __m128 InverseDirectionX, InverseDirectionY, InverseDirectionZ;
+        __m128 TMin;
+    };
+
+    static __forceinline
+        __m128 SlabDistance(
+            const USHORT* pQuantized,
+            __m128 origin,
+            __m128 scale,
+            __m128 rayOrigin,
+            __m128 inverseDirection)
+    {
+        const __m128 bound = _mm_add_ps(origin, _mm_mul_ps(DecodeFp16x4(pQuantized), scale));
+        return _mm_mul_ps(_mm_sub_ps(bound, rayOrigin), inverseDirection);
+    }
+
+    // Tests four consecutive children starting at lane offset, returns a hit
+    // mask and writes the entry distance of each lane
+    template<UINT Width>
+    static __forceinline
+        UINT IntersectChildrenSse(
+            const WideBvhNode<Width>& node,
+            UINT offset,
+            const SseRay& ray,
+            float tMax,
+            float* pTNear)
+    {
+        const __m128 scale = _mm_set1_ps(node.Scale);
+        const __m128 originX = _mm_set1_ps(node.Origin[0]);
+        const __m128 originY = _mm_set1_ps(node.Origin[1]);
+        const __m128 originZ = _mm_set1_ps(node.Origin[2]);
+
+        const __m128 t0x = SlabDistance(node.LowerX + offset, originX, scale, ray.OriginX, ray.InverseDirectionX);
+        const __m128 t1x = SlabDistance(node.UpperX + offset, originX, scale, ray.OriginX, ray.InverseDirectionX);
+        const __m128 t0y = SlabDistance(node.LowerY + offset, originY, scale, ray.OriginY, ray.InverseDirectionY);
+        const __m128 t1y = SlabDistance(node.UpperY + offset, originY, scale, ray.OriginY, ray.InverseDirectionY);
+        const __m128 t0z = SlabDistance(node.LowerZ + offset, originZ, scale, ray.OriginZ, ray.InverseDirectionZ);
+        const __m128 t1z = SlabDistance(node.UpperZ + offset, originZ, scale, ray.OriginZ, ray.InverseDirectionZ);
+
+        const __m128 tNear = _mm_max_ps(
+            _mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+            _mm_max_ps(_mm_min_ps(t0z, t1z), ray.TMin));
+        const __m128 tFar = _mm_min_ps(
+            _mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+            _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(tMax)));
+
+        _mm_storeu_ps(pTNear, tNear);
+        return (UINT)_mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+    }
+
+    static __forceinline
+        __m256 SlabDistanceAvx(
+            const USHORT* pQuantized,
+            __m256 origin,
+            __m256 scale,
+            __m256 rayOrigin,
+            __m256 inverseDirection)
+    {
+        const __m256 decoded = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)pQuantized));
+        const __m256 bound = _mm256_add_ps(origin, _mm256_mul_ps(decoded, scale));
+        return _mm256_mul_ps(_mm256_sub_ps(bound, rayOrigin), inverseDirection);
+    }
+
+    // Only called after IsAvxTraversalSupported, MSVC emits AVX/F16C
+    // intrinsics without /arch:AVX
+    static
+        UINT IntersectChildrenAvx(
+            const WideBvhNode<8>& node,
+            const SseRay& ray,
+            float tMax,
+            float* pTNear)
+    {
+        const __m256 scale = _mm256_set1_ps(node.Scale);
+        const __m256 originX = _mm256_set1_ps(node.Origin[0]);
+        const __m256 originY = _mm256_set1_ps(node.Origin[1]);
+        const __m256 originZ = _mm256_set1_ps(node.Origin[2]);
+        const __m256 rayOriginX = _mm256_set_m128(ray.OriginX, ray.OriginX);
+        const __m256 rayOriginY = _mm256_set_m128(ray.OriginY, ray.OriginY);
+        const __m256 rayOriginZ = _mm256_set_m128(ray.OriginZ, ray.OriginZ);
+        const __m256 inverseDirectionX = _mm256_set_m128(ray.InverseDirectionX, ray.InverseDirectionX);
+        const __m256 inverseDirectionY = _mm256_set_m128(ray.InverseDirectionY, ray.InverseDirectionY);
+        const __m256 inverseDirectionZ = _mm256_set_m128(ray.InverseDirectionZ, ray.InverseDirectionZ);
+
+        const __m256 t0x = SlabDistanceAvx(node.LowerX, originX, scale, rayOriginX, inverseDirectionX);
+        const __m256 t1x = SlabDistanceAvx(node.UpperX, originX, scale, rayOriginX, inverseDirectionX);
+        const __m256 t0y = SlabDistanceAvx(node.LowerY, originY, scale, rayOriginY, inverseDirectionY);
+        const __m256 t1y = SlabDistanceAvx(node.UpperY, originY, scale, rayOriginY, inverseDirectionY);
+        const __m256 t0z = SlabDistanceAvx(node.LowerZ, originZ, scale, rayOriginZ, inverseDirectionZ);
+        const __m256 t1z = SlabDistanceAvx(node.UpperZ, originZ, scale, rayOriginZ, inverseDirectionZ);
+
+        const __m256 tNear = _mm256_max_ps(
+            _mm256_max_ps(_mm256_min_ps(t0x, t1x), _mm256_min_ps(t0y, t1y)),
+            _mm256_max_ps(_mm256_min_ps(t0z, t1z), _mm256_set_m128(ray.TMin, ray.TMin)));
+        const __m256 tFar = _mm256_min_ps(
+            _mm256_min_ps(_mm256_max_ps(t0x, t1x), _mm256_max_ps(t0y, t1y)),
+            _mm256_min_ps(_mm256_max_ps(t0z, t1z), _mm256_set1_ps(tMax)));
+
+        _mm256_storeu_ps(pTNear, tNear);
+        const UINT mask = (UINT)_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+        _mm256_zeroupper();
+        return mask;
+    }
+
+    bool IsAvxTraversalSupported()
+    {
+        static const bool bSupported = []()
+        {
+            int cpuInfo[4];
+            __cpuid(cpuInfo, 1);
+            const bool bOsXSave = (cpuInfo[2] & (1 << 27)) != 0;
+            const bool bAvx = (cpuInfo[2] & (1 << 28)) != 0;
+            const bool bF16C = (cpuInfo[2] & (1 << 29)) != 0;
+            return bOsXSave && bAvx && bF16C && (_xgetbv(0) & 0x6) == 0x6;
+        }();
+        return bSupported;
+    }
+
+    template<UINT Width, bool bUseAvx>
+    static
+        bool TraceRayWide(
+            const WideBvh<Width>& bvh,
+            const CpuRay& cpuRay,
+            CpuRayHit& hit,
+            UINT* pNodesVisited)
+    {
+        const Primitive *pPrimitives = Bvh2View(bvh.pBvh2).pPrimitives;
+        const TraversalRay ray(cpuRay);
+        const SseRay sseRay(ray);
+        hit = CpuRayHit{ cpuRay.TMax, 0.0f, 0.0f, 0 };
+
+        struct StackEntry
+        {
+            UINT Child;
+            float TNear;
+        };
+        StackEntry stack[TraversalStackSize];
+        UINT stackSize = 0;
+        stack[stackSize++] = { 0, cpuRay.TMin };
+
+        UINT nodesVisited = 0;
+        bool bHit = false;
+        while (stackSize)
+        {
+            const StackEntry entry = stack[--stackSize];
+            if (entry.TNear > hit.T)
+            {
+                continue;
+            }
+
+            if (entry.Child & WideBvhLeafFlag)
+            {
+                const UINT firstPrimitive = entry.Child & WideBvhLeafFirstPrimitiveMask;
+                const UINT numPrimitives = (entry.Child & ~WideBvhLeafFlag) >> WideBvhLeafCountShift;
+                bHit |= IntersectLeaf(ray, pPrimitives, firstPrimitive, numPrimitives, hit);
+                continue;
+            }
+
+            const WideBvhNode<Width> &node = bvh.Nodes[entry.Child];
+            float tNear[Width];
+            UINT hitMask = 0;
+            if (bUseAvx)
+            {
+                hitMask = IntersectChildrenAvx((const WideBvhNode<8> &)node, sseRay, hit.T, tNear);
+            }
+            else
+            {
+                for (UINT offset = 0; offset < Width; offset += 4)
+                {
+                    hitMask |= IntersectChildrenSse(node, offset, sseRay, hit.T, tNear + offset) << offset;
+                }
+            }
+            nodesVisited += Width;
+
+            // Insertion sort the hit children so the nearest ends on top
+            const UINT stackBase = stackSize;
+            for (UINT i = 0; i < Width; i++)
+            {
+                if (!(hitMask & (1 << i)) || node.Children[i] == WideBvhEmptyChild)
+                {
+                    continue;
+                }
+
+                UINT position = stackSize++;
+                while (position > stackBase && stack[position - 1].TNear < tNear[i])
+                {
+                    stack[position] = stack[position - 1];
+                    position--;
+                }
+                stack[position] = { node.Children[i], tNear[i] };
+            }
+
+            if (stackSize > TraversalStackSize - Width)
+            {
+                ThrowFailure(E_FAIL, L"Wide BVH is too deep for the CPU traversal stack");
+            }
+        }
+
+        if (pNodesVisited) *pNodesVisited += nodesVisited;
+        return bHit;
+    }
+
+    bool TraceRayBvh4(
+        _In_ const Bvh4 &bvh,
+        _In_ const CpuRay &ray,
+        _Out_ CpuRayHit &hit,
+        _Inout_opt_ UINT *pNodesVisited)
+    {
+        return TraceRayWide<4, false>(bvh, ray, hit, pNodesVisited);
+    }
+
+    bool TraceRayBvh8(
+        _In_ const Bvh8 &bvh,
+        _In_ const CpuRay &ray,
+        _Out_ CpuRayHit &hit,
+        _Inout_opt_ UINT *pNodesVisited)
+    {
+        if (IsAvxTraversalSupported())
+        {
+            return TraceRayWide<8, true>(bvh, ray, hit, pNodesVisited);
+        }
+        return TraceRayWide<8, false>(bvh, ray, hit, pNodesVisited);
+    }
+}
@@ -0,0 +1,101 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+namespace FallbackLayer
+{
+    static const UINT WideBvhEmptyChild = 0xffffffff;
+    static const UINT WideBvhLeafFlag = 0x80000000;
+    static const UINT WideBvhLeafCountShift = 24;
+    static const UINT WideBvhLeafFirstPrimitiveMask = 0x00ffffff;
+
+    // N-ary node with the child boxes stored as SoA so one node is tested
+    // against a ray with a single SIMD slab test. Child bounds are fp16
+    // offsets from Origin in units of Scale (a power of two), rounded so the
+    // decoded box always contains the original one.
+    //
+    // Children[i] is either the index of another node, WideBvhEmptyChild, or
+    // WideBvhLeafFlag | count << WideBvhLeafCountShift | first primitive,
+    // where primitives index into the Primitive array of the source BVH2.
+    template<UINT Width>
+    struct WideBvhNode
+    {
+        float Origin[3];
+        float Scale;
+        USHORT LowerX[Width];
+        USHORT LowerY[Width];
+        USHORT LowerZ[Width];
+        USHORT UpperX[Width];
+        USHORT UpperY[Width];
+        USHORT UpperZ[Width];
+        UINT Children[Width];
+    };
+
+    template<UINT Width>
+    struct WideBvh
+    {
+        std::vector<WideBvhNode<Width>> Nodes;
+
+        // Leaves aren't copied, the source BVH2 blob must outlive this
+        const BYTE *pBvh2;
+    };
+
+    typedef WideBvh<4> Bvh4;
+    typedef WideBvh<8> Bvh8;
+
+    // Collapses a bottom level BVH2 produced by the CPU builder by repeatedly
+    // opening the child with the largest surface area until a node is full
+    template<UINT Width>
+    void CollapseBvh2(_In_ const BYTE *pBvh2, _Out_ WideBvh<Width> &wideBvh);
+
+    struct CpuRay
+    {
+        float3 Origin;
+        float TMin;
+        float3 Direction;
+        float TMax;
+    };
+
+    struct CpuRayHit
+    {
+        float T;
+        float U;
+        float V;
+
+        // Index into the Primitive and PrimitiveMetaData arrays of the BVH2
+        UINT PrimitiveIndex;
+    };
+
+    // Closest hit traversal of the binary layout, used as the baseline for the
+    // wide kernels. Procedural primitives are hit at the entry of their AABB.
+    // pNodesVisited is optional and counts every node whose box is tested.
+    bool TraceRayBvh2(
+        _In_ const BYTE *pBvh2,
+        _In_ const CpuRay &ray,
+        _Out_ CpuRayHit &hit,
+        _Inout_opt_ UINT *pNodesVisited = nullptr);
+
+    // SSE kernel, tests all four children of a node at once
+    bool TraceRayBvh4(
+        _In_ const Bvh4 &bvh,
+        _In_ const CpuRay &ray,
+        _Out_ CpuRayHit &hit,
+        _Inout_opt_ UINT *pNodesVisited = nullptr);
+
+    // AVX kernel when the CPU supports AVX and F16C, otherwise two SSE halves
+    bool TraceRayBvh8(
+        _In_ const Bvh8 &bvh,
+        _In_ const CpuRay &ray,
+        _Out_ CpuRayHit &hit,
+        _Inout_opt_ UINT *pNodesVisited = nullptr);
+
+    bool IsAvxTraversalSupported();
+}
@@ -156,6 +156,40 @@ namespace FallbackLayerUnitTests
         }
     }
 
+    // Creates a gridDimension x gridDimension height field with random heights, offset
+    // along X so that multiple grids can be laid out side by side
+    template <typename IndexType>
+    void GenerateRandomHeightField(
+        UINT gridDimension,
+        float offsetX,
+        std::vector<float> &vertices,
+        std::vector<IndexType> &indices)
+    {
+        for (UINT z = 0; z < gridDimension; z++)
+        {
+            for (UINT x = 0; x < gridDimension; x++)
+            {
+                vertices.push_back(offsetX + (float)x);
+                vertices.push_back((rand() / (float)RAND_MAX) * 4.0f);
+                vertices.push_back((float)z);
+            }
+        }
+
+        for (UINT z = 0; z + 1 < gridDimension; z++)
+        {
+            for (UINT x = 0; x + 1 < gridDimension; x++)
+            {
+                const IndexType i0 = (IndexType)(z * gridDimension + x);
+                const IndexType i1 = (IndexType)(i0 + 1);
+                const IndexType i2 = (IndexType)(i0 + gridDimension);
+                const IndexType i3 = (IndexType)(i2 + 1);
+
+                indices.push_back(i0); indices.push_back(i2); indices.push_back(i1);
+                indices.push_back(i1); indices.push_back(i2); indices.push_back(i3);
+            }
+        }
+    }
+
 #define ALIGN(alignment, num) (((num + alignment - 1) / alignment) * alignment)
 
     class BuilderWrapper
@@ -775,6 +809,1416 @@ namespace FallbackLayerUnitTests
                 testCase);
         }
 
+        TEST_METHOD(R32IndexBufferBottomLevelCpuBVHBuilder)
+        {
+            CpuGeometryDescriptor testCases[] =
+            {
+                CpuGeometryDescriptor(ReferenceVerticies0, VERTEX_COUNT(ReferenceVerticies0), ReferenceR32Indices0, ARRAYSIZE(ReferenceR32Indices0)),
+                CpuGeometryDescriptor(ReferenceVerticies1, VERTEX_COUNT(ReferenceVerticies1), ReferenceR32Indices1, ARRAYSIZE(ReferenceR32Indices1))
+            };
+
+            for (UINT testIndex = 0; testIndex < ARRAYSIZE(testCases); testIndex++)
+            {
+                TestCpuBvh2Builder(testCases[testIndex]);
+            }
+        }
+
+        TEST_METHOD(NoIndexBufferBottomLevelCpuBVHBuilder)
+        {
+            CpuGeometryDescriptor testCases[] =
+            {
+                CpuGeometryDescriptor(ReferenceVerticies0, VERTEX_COUNT(ReferenceVerticies0)),
+                CpuGeometryDescriptor(ReferenceVerticies1, VERTEX_COUNT(ReferenceVerticies1))
+            };
+
+            for (UINT testIndex = 0; testIndex < ARRAYSIZE(testCases); testIndex++)
+            {
+                TestCpuBvh2Builder(testCases[testIndex]);
+            }
+        }
+
+        TEST_METHOD(BottomLevelCpuBVHBuilderWithTransforms)
+        {
+            const UINT numGeoms = 10;
+            float pMatrixStorage[numGeoms * 12];
+            std::vector<CpuGeometryDescriptor> testCases;
+            srand(10);
+            for (UINT i = 0; i < numGeoms; i++)
+            {
+                float *pMatrix = &pMatrixStorage[i * 12];
+                GenerateRandomTranformation(pMatrix);
+                testCases.push_back(
+                    CpuGeometryDescriptor(ReferenceVerticies0, VERTEX_COUNT(ReferenceVerticies0), ReferenceR32Indices0, ARRAYSIZE(ReferenceR32Indices0), DXGI_FORMAT_R32_UINT, pMatrix));
+            }
+            TestCpuBvh2Builder(testCases.data(), (UINT)testCases.size());
+        }
+
+        TEST_METHOD(ProceduralGeometryBottomLevelCpuBVHBuilder)
+        {
+            // Mix AABBs with triangles to make sure leaves are flagged per primitive
+            const UINT numAABBs = 64;
+            std::vector<D3D12_RAYTRACING_AABB> aabbs(numAABBs);
+            srand(10);
+            for (auto &aabb : aabbs)
+            {
+                aabb.MinX = (float)(rand() % 100);
+                aabb.MinY = (float)(rand() % 100);
+                aabb.MinZ = (float)(rand() % 100);
+                aabb.MaxX = aabb.MinX + 1.0f + (rand() % 10);
+                aabb.MaxY = aabb.MinY + 1.0f + (rand() % 10);
+                aabb.MaxZ = aabb.MinZ + 1.0f + (rand() % 10);
+            }
+
+            D3D12_RAYTRACING_GEOMETRY_DESC geomDescs[2] = {};
+            geomDescs[0].Type = D3D12_RAYTRACING_GEOMETRY_TYPE_PROCEDURAL_PRIMITIVE_AABBS;
+            geomDescs[0].AABBs.AABBCount = numAABBs;
+            geomDescs[0].AABBs.AABBs.StartAddress = (D3D12_GPU_VIRTUAL_ADDRESS)aabbs.data();
+            geomDescs[0].AABBs.AABBs.StrideInBytes = sizeof(D3D12_RAYTRACING_AABB);
+
+            geomDescs[1].Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+            geomDescs[1].Triangles.VertexBuffer.StartAddress = (D3D12_GPU_VIRTUAL_ADDRESS)ReferenceVerticies0;
+            geomDescs[1].Triangles.VertexBuffer.StrideInBytes = sizeof(float) * 3;
+            geomDescs[1].Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+            geomDescs[1].Triangles.VertexCount = VERTEX_COUNT(ReferenceVerticies0);
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc = {};
+            desc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            desc.Inputs.NumDescs = ARRAYSIZE(geomDescs);
+            desc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            desc.Inputs.pGeometryDescs = geomDescs;
+
+            const UINT numTriangles = VERTEX_COUNT(ReferenceVerticies0) / 3;
+            std::unique_ptr<BYTE[]> pData(new BYTE[(size_t)FallbackLayer::GetRaytracingAccelerationStructureSizeOnCpu(desc.Inputs)]);
+
+            for (bool bLowMemory : { false, true })
+            {
+                FallbackLayer::CpuBvh2BuildSettings settings;
+                settings.UseLowMemoryBuild = bLowMemory;
+                settings.LowMemoryBudgetInBytes = 0;
+                FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&desc, settings, pData.get());
+
+                const BVHOffsets &offsets = *(BVHOffsets *)pData.get();
+                const AABBNode *pNodes = (AABBNode *)(pData.get() + offsets.offsetToBoxes);
+                const Primitive *pPrimitives = (Primitive *)(pData.get() + offsets.offsetToVertices);
+                const PrimitiveMetaData *pMetadata = (PrimitiveMetaData *)(pData.get() + offsets.offsetToPrimitiveMetaData);
+                const UINT numNodes = (offsets.offsetToVertices - offsets.offsetToBoxes) / sizeof(AABBNode);
+
+                UINT numProceduralLeaves = 0;
+                for (UINT i = 0; i < numNodes; i++)
+                {
+                    const AABBNode &node = pNodes[i];
+                    if (!node.leaf)
+                    {
+                        continue;
+                    }
+
+                    Assert::AreEqual(1u, (UINT)node.numTriangles, L"Procedural geometry must be in single primitive leaves");
+                    const UINT leafIndex = node.leafNode.firstTriangleId;
+                    const bool bProceduralFlag = (node.nodeAllBits & 0x40000000) != 0;
+                    const PrimitiveMetaData &metadata = pMetadata[leafIndex];
+                    if (pPrimitives[leafIndex].PrimitiveType == PROCEDURAL_PRIMITIVE_TYPE)
+                    {
+                        Assert::IsTrue(bProceduralFlag, L"Procedural leaf is missing the procedural flag");
+                        Assert::AreEqual(0u, metadata.GeometryContributionToHitGroupIndex);
+                        Assert::IsTrue(metadata.PrimitiveIndex < numAABBs);
+
+                        const D3D12_RAYTRACING_AABB &expected = aabbs[metadata.PrimitiveIndex];
+                        const AABB &aabb = pPrimitives[leafIndex].aabb;
+                        Assert::IsTrue(
+                            aabb.min.x == expected.MinX && aabb.min.y == expected.MinY && aabb.min.z == expected.MinZ &&
+                            aabb.max.x == expected.MaxX && aabb.max.y == expected.MaxY && aabb.max.z == expected.MaxZ,
+                            L"Procedural primitive doesn't match the PrimitiveIndex in its metadata");
+                        numProceduralLeaves++;
+                    }
+                    else
+                    {
+                        Assert::IsFalse(bProceduralFlag, L"Triangle leaf has the procedural flag");
+                        Assert::AreEqual(1u, metadata.GeometryContributionToHitGroupIndex);
+                        Assert::IsTrue(metadata.PrimitiveIndex < numTriangles);
+                    }
+                }
+                Assert::AreEqual(numAABBs, numProceduralLeaves);
+            }
+        }
+
+        TEST_METHOD(SimpleTopLevelCpuBVHBuilder)
+        {
+            const UINT numBottomLevels = 32;
+
+            // Every bottom level is the same geometry, instances place them apart
+            CpuGeometryDescriptor geomDesc(ReferenceVerticies0, VERTEX_COUNT(ReferenceVerticies0), ReferenceIndices0, ARRAYSIZE(ReferenceIndices0));
+            D3D12_RAYTRACING_GEOMETRY_DESC bottomLevelGeometry = {};
+            bottomLevelGeometry.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+            bottomLevelGeometry.Triangles.IndexBuffer = (D3D12_GPU_VIRTUAL_ADDRESS)ReferenceIndices0;
+            bottomLevelGeometry.Triangles.IndexFormat = DXGI_FORMAT_R16_UINT;
+            bottomLevelGeometry.Triangles.IndexCount = ARRAYSIZE(ReferenceIndices0);
+            bottomLevelGeometry.Triangles.VertexBuffer.StartAddress = (D3D12_GPU_VIRTUAL_ADDRESS)ReferenceVerticies0;
+            bottomLevelGeometry.Triangles.VertexBuffer.StrideInBytes = sizeof(float) * 3;
+            bottomLevelGeometry.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+            bottomLevelGeometry.Triangles.VertexCount = VERTEX_COUNT(ReferenceVerticies0);
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC bottomLevelDesc = {};
+            bottomLevelDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            bottomLevelDesc.Inputs.NumDescs = 1;
+            bottomLevelDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            bottomLevelDesc.Inputs.pGeometryDescs = &bottomLevelGeometry;
+
+            std::unique_ptr<BYTE[]> pBottomLevel(new BYTE[(size_t)FallbackLayer::GetRaytracingAccelerationStructureSizeOnCpu(bottomLevelDesc.Inputs)]);
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&bottomLevelDesc, FallbackLayer::CpuBvh2BuildSettings(), pBottomLevel.get());
+
+            AABB bottomLevelBox = {};
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                bottomLevelBox.minArr[axis] = FLT_MAX;
+                bottomLevelBox.maxArr[axis] = -FLT_MAX;
+            }
+            for (UINT i = 0; i < ARRAYSIZE(ReferenceVerticies0); i++)
+            {
+                const UINT axis = i % 3;
+                bottomLevelBox.minArr[axis] = std::min(ReferenceVerticies0[i], bottomLevelBox.minArr[axis]);
+                bottomLevelBox.maxArr[axis] = std::max(ReferenceVerticies0[i], bottomLevelBox.maxArr[axis]);
+            }
+
+            float matrixStorage[numBottomLevels * FloatsPerMatrix];
+            float *pTransformations[numBottomLevels];
+            AABB containingBoxes[numBottomLevels];
+            std::vector<D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC> instanceDescs(numBottomLevels);
+            std::vector<D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC *> instanceDescPointers(numBottomLevels);
+            srand(10);
+            for (UINT i = 0; i < numBottomLevels; i++)
+            {
+                pTransformations[i] = &matrixStorage[i * FloatsPerMatrix];
+                GenerateRandomTranformation(pTransformations[i]);
+                containingBoxes[i] = bottomLevelBox;
+
+                D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC &instanceDesc = instanceDescs[i];
+                instanceDesc = {};
+                memcpy(instanceDesc.Transform, pTransformations[i], sizeof(instanceDesc.Transform));
+                instanceDesc.InstanceID = i;
+                instanceDesc.InstanceMask = 0xff;
+                instanceDesc.AccelerationStructure.GpuVA = (D3D12_GPU_VIRTUAL_ADDRESS)pBottomLevel.get();
+                instanceDescPointers[i] = &instanceDesc;
+            }
+
+            for (bool bUseLbvhBuilder : { false, true })
+            {
+                FallbackLayer::CpuBvh2BuildSettings settings;
+                settings.UseLbvhBuilder = bUseLbvhBuilder;
+
+                for (D3D12_ELEMENTS_LAYOUT layout : { D3D12_ELEMENTS_LAYOUT_ARRAY, D3D12_ELEMENTS_LAYOUT_ARRAY_OF_POINTERS })
+                {
+                    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC topLevelDesc = {};
+                    topLevelDesc.Inputs.DescsLayout = layout;
+                    topLevelDesc.Inputs.NumDescs = numBottomLevels;
+                    topLevelDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+                    topLevelDesc.Inputs.InstanceDescs = layout == D3D12_ELEMENTS_LAYOUT_ARRAY ?
+                        (D3D12_GPU_VIRTUAL_ADDRESS)instanceDescs.data() :
+                        (D3D12_GPU_VIRTUAL_ADDRESS)instanceDescPointers.data();
+
+                    std::unique_ptr<BYTE[]> pTopLevel(new BYTE[(size_t)FallbackLayer::GetRaytracingAccelerationStructureSizeOnCpu(topLevelDesc.Inputs)]);
+                    FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&topLevelDesc, settings, pTopLevel.get());
+
+                    std::wstring errorMessage;
+                    auto &validator = FallbackLayer::GetAccelerationStructureValidator(FallbackLayer::BVH2);
+                    if (!validator.VerifyTopLevelOutput(containingBoxes, pTransformations, numBottomLevels, pTopLevel.get(), errorMessage))
+                    {
+                        Assert::Fail(errorMessage.c_str());
+                    }
+
+                    // Every instance must be referenced by exactly one leaf with its transforms intact
+                    const BVHOffsets &offsets = *(BVHOffsets *)pTopLevel.get();
+                    const BVHMetadata *pMetadata = (BVHMetadata *)(pTopLevel.get() + offsets.offsetToVertices);
+                    std::vector<bool> instanceFound(numBottomLevels, false);
+                    for (UINT i = 0; i < numBottomLevels; i++)
+                    {
+                        const BVHMetadata &metadata = pMetadata[i];
+                        Assert::IsTrue(metadata.InstanceIndex < numBottomLevels && !instanceFound[metadata.InstanceIndex]);
+                        instanceFound[metadata.InstanceIndex] = true;
+
+                        const float *pObjectToWorld = pTransformations[metadata.InstanceIndex];
+                        for (UINT row = 0; row < 3; row++)
+                        {
+                            for (UINT column = 0; column < 4; column++)
+                            {
+                                const float *pRow = &metadata.ObjectToWorld[row].x;
+                                Assert::AreEqual(pObjectToWorld[row * 4 + column], pRow[column]);
+
+                                // WorldToObject * ObjectToWorld should be the identity
+                                float product = column == 3 ? metadata.instanceDesc.Transform[row][3] : 0.0f;
+                                for (UINT k = 0; k < 3; k++)
+                                {
+                                    product += metadata.instanceDesc.Transform[row][k] * pObjectToWorld[k * 4 + column];
+                                }
+                                Assert::AreEqual(row == column ? 1.0f : 0.0f, product, 0.001f, L"Instance transform wasn't inverted");
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        TEST_METHOD(Bvh2CacheRoundTrip)
+        {
+            std::vector<float> vertices(ReferenceVerticies0, ReferenceVerticies0 + ARRAYSIZE(ReferenceVerticies0));
+
+            D3D12_RAYTRACING_GEOMETRY_DESC geometry = {};
+            geometry.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+            geometry.Triangles.IndexBuffer = (D3D12_GPU_VIRTUAL_ADDRESS)ReferenceIndices0;
+            geometry.Triangles.IndexFormat = DXGI_FORMAT_R16_UINT;
+            geometry.Triangles.IndexCount = ARRAYSIZE(ReferenceIndices0);
+            geometry.Triangles.VertexBuffer.StartAddress = (D3D12_GPU_VIRTUAL_ADDRESS)vertices.data();
+            geometry.Triangles.VertexBuffer.StrideInBytes = sizeof(float) * 3;
+            geometry.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+            geometry.Triangles.VertexCount = (UINT)vertices.size() / 3;
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc = {};
+            desc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            desc.Inputs.NumDescs = 1;
+            desc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            desc.Inputs.pGeometryDescs = &geometry;
+
+            wchar_t tempPath[MAX_PATH];
+            GetTempPathW(ARRAYSIZE(tempPath), tempPath);
+            const std::wstring cacheDirectory = std::wstring(tempPath) + L"FallbackLayerBvh2CacheTest";
+
+            FallbackLayer::CpuBvh2BuildSettings settings;
+            FallbackLayer::Bvh2Cache cache(cacheDirectory.c_str());
+            const FallbackLayer::Bvh2CacheKey key = FallbackLayer::ComputeBvh2CacheKey(desc.Inputs, settings);
+            DeleteFileW(cache.GetFilename(key).c_str());
+
+            FallbackLayer::MappedBvh2Blob builtBlob;
+            Assert::IsFalse(cache.LoadOrBuild(&desc, settings, builtBlob), L"Expected a miss on an empty cache");
+
+            FallbackLayer::MappedBvh2Blob cachedBlob;
+            Assert::IsTrue(cache.LoadOrBuild(&desc, settings, cachedBlob), L"Expected a hit after storing the blob");
+            Assert::IsTrue((size_t)cachedBlob.GetData() % D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT == 0);
+
+            std::vector<BYTE> expected((size_t)FallbackLayer::GetRaytracingAccelerationStructureSizeOnCpu(desc.Inputs));
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&desc, settings, expected.data());
+            const UINT64 expectedSize = FallbackLayer::GetRaytracingAccelerationStructureWrittenSizeOnCpu(desc.Inputs, expected.data());
+            Assert::AreEqual(expectedSize, cachedBlob.GetSize());
+            Assert::IsTrue(memcmp(expected.data(), cachedBlob.GetData(), (size_t)expectedSize) == 0, L"Cached blob doesn't match a fresh build");
+
+            std::wstring errorMessage;
+            CpuGeometryDescriptor geomDesc(vertices.data(), geometry.Triangles.VertexCount, ReferenceIndices0, ARRAYSIZE(ReferenceIndices0), DXGI_FORMAT_R16_UINT);
+            auto &validator = FallbackLayer::GetAccelerationStructureValidator(FallbackLayer::BVH2);
+            if (!validator.VerifyBottomLevelOutput(&geomDesc, 1, cachedBlob.GetData(), errorMessage))
+            {
+                Assert::Fail(errorMessage.c_str());
+            }
+
+            // Any change to the geometry or the settings must land on a different file
+            vertices[0] += 1.0f;
+            Assert::IsFalse(FallbackLayer::ComputeBvh2CacheKey(desc.Inputs, settings) == key, L"Vertex edit didn't change the cache key");
+            vertices[0] -= 1.0f;
+
+            FallbackLayer::CpuBvh2BuildSettings otherSettings;
+            otherSettings.MaxTrianglesInLeaf = 1;
+            otherSettings.UseMultithreadedBuild = false;
+            Assert::IsFalse(FallbackLayer::ComputeBvh2CacheKey(desc.Inputs, otherSettings) == key, L"Leaf size didn't change the cache key");
+
+            FallbackLayer::CpuBvh2BuildSettings lbvhSettings;
+            lbvhSettings.UseLbvhBuilder = true;
+            const FallbackLayer::Bvh2CacheKey lbvhKey = FallbackLayer::ComputeBvh2CacheKey(desc.Inputs, lbvhSettings);
+            Assert::IsFalse(lbvhKey == key, L"The LBVH builder didn't change the cache key");
+            lbvhSettings.LbvhMortonCodeBits = 63;
+            Assert::IsFalse(FallbackLayer::ComputeBvh2CacheKey(desc.Inputs, lbvhSettings) == lbvhKey, L"Morton code bits didn't change the cache key");
+
+            FallbackLayer::MappedBvh2Blob staleBlob;
+            Assert::IsFalse(staleBlob.Map(cache.GetFilename(key).c_str(), FallbackLayer::ComputeBvh2CacheKey(desc.Inputs, otherSettings)), L"Mapped a file with a mismatched key");
+
+            builtBlob.Release();
+            cachedBlob.Release();
+            DeleteFileW(cache.GetFilename(key).c_str());
+        }
+
+        TEST_METHOD(RandomHeightFieldBottomLevelCpuBVHBuilder)
+        {
+            std::vector<float> vertices;
+            std::vector<UINT16> indices;
+            srand(10);
+            GenerateRandomHeightField(24, 0.0f, vertices, indices);
+
+            CpuGeometryDescriptor testCase(vertices.data(), (UINT)(vertices.size() / 3), indices.data(), (UINT)indices.size());
+
+            FallbackLayer::CpuBvh2BuildSettings multithreadedSettings;
+            TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, multithreadedSettings);
+
+            FallbackLayer::CpuBvh2BuildSettings referenceSettings;
+            referenceSettings.UseReferenceBuilder = true;
+            TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, referenceSettings);
+        }
+
+        // 8 grids of 256x256 vertices, ~1 million triangles total
+        static const UINT HeightFieldBenchmarkGeometryCount = 8;
+        static const UINT HeightFieldBenchmarkGridDimension = 256;
+
+        void CreateHeightFieldBenchmarkGeometry(
+            std::vector<float> *pVertices,
+            std::vector<UINT16> *pIndices,
+            std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> &geomDescs,
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC &desc)
+        {
+            const UINT numGeoms = HeightFieldBenchmarkGeometryCount;
+            const UINT gridDimension = HeightFieldBenchmarkGridDimension;
+            geomDescs.resize(numGeoms);
+            srand(10);
+            for (UINT i = 0; i < numGeoms; i++)
+            {
+                GenerateRandomHeightField(gridDimension, (float)(i * gridDimension), pVertices[i], pIndices[i]);
+
+                geomDescs[i] = {};
+                geomDescs[i].Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+                auto &triangleDesc = geomDescs[i].Triangles;
+                triangleDesc.IndexBuffer = (D3D12_GPU_VIRTUAL_ADDRESS)pIndices[i].data();
+                triangleDesc.IndexFormat = DXGI_FORMAT_R16_UINT;
+                triangleDesc.IndexCount = (UINT)pIndices[i].size();
+                triangleDesc.VertexBuffer.StartAddress = (D3D12_GPU_VIRTUAL_ADDRESS)pVertices[i].data();
+                triangleDesc.VertexBuffer.StrideInBytes = sizeof(float) * 3;
+                triangleDesc.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+                triangleDesc.VertexCount = (UINT)(pVertices[i].size() / 3);
+            }
+
+            desc = {};
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs = desc.Inputs;
+            inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            inputs.NumDescs = numGeoms;
+            inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            inputs.pGeometryDescs = geomDescs.data();
+        }
+
+        UINT GetCpuBvh2OutputSize(UINT numTriangles)
+        {
+            return sizeof(BVHOffsets) + (2 * numTriangles - 1) * sizeof(AABBNode) + numTriangles * (sizeof(Primitive) + sizeof(PrimitiveMetaData));
+        }
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(CpuBVHBuilderPerformance)
+            TEST_METHOD_ATTRIBUTE(L"TestCategory", L"Benchmark")
+            TEST_IGNORE()
+        END_TEST_METHOD_ATTRIBUTE()
+        TEST_METHOD(CpuBVHBuilderPerformance)
+        {
+            std::vector<float> vertices[HeightFieldBenchmarkGeometryCount];
+            std::vector<UINT16> indices[HeightFieldBenchmarkGeometryCount];
+            std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs;
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc;
+            CreateHeightFieldBenchmarkGeometry(vertices, indices, geomDescs, desc);
+
+            const UINT numTriangles = GetTotalPrimitiveCount(desc.Inputs);
+            const UINT maxSize = GetCpuBvh2OutputSize(numTriangles);
+
+            struct BuilderConfiguration
+            {
+                LPCWSTR Name;
+                bool UseReferenceBuilder;
+                bool UseMultithreadedBuild;
+                bool UseLbvhBuilder;
+            };
+            const BuilderConfiguration configurations[] =
+            {
+                { L"Reference", true, false, false },
+                { L"Binned SAH, single-threaded", false, false, false },
+                { L"Binned SAH, multithreaded", false, true, false },
+                { L"LBVH, single-threaded", false, false, true },
+                { L"LBVH, multithreaded", false, true, true },
+            };
+
+            std::unique_ptr<BYTE[]> pOutputs[ARRAYSIZE(configurations)];
+            for (UINT i = 0; i < ARRAYSIZE(configurations); i++)
+            {
+                FallbackLayer::CpuBvh2BuildSettings settings;
+                settings.UseReferenceBuilder = configurations[i].UseReferenceBuilder;
+                settings.UseMultithreadedBuild = configurations[i].UseMultithreadedBuild;
+                settings.UseLbvhBuilder = configurations[i].UseLbvhBuilder;
+
+                pOutputs[i] = std::unique_ptr<BYTE[]>(new BYTE[maxSize]);
+                FallbackLayer::CpuBvh2BuildStatistics statistics;
+                FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&desc, settings, pOutputs[i].get(), &statistics);
+
+                Assert::AreEqual(numTriangles, statistics.NumPrimitives, L"Not every triangle was placed in the BVH");
+                Assert::AreEqual(2 * numTriangles - 1, statistics.NumNodes, L"Unexpected node count");
+
+                wchar_t message[256];
+                swprintf_s(message, L"%s: %u triangles, %.1f ms, SAH cost %.2f\n",
+                    configurations[i].Name, statistics.NumPrimitives, statistics.BuildTimeInMs, statistics.SahCost);
+                Logger::WriteMessage(message);
+            }
+
+            // Threading must not change the result
+            const UINT outputSize = ((BVHOffsets *)pOutputs[1].get())->totalSize;
+            Assert::AreEqual(0, memcmp(pOutputs[1].get(), pOutputs[2].get(), outputSize), L"Multithreaded build differs from single-threaded build");
+            Assert::AreEqual(0, memcmp(pOutputs[3].get(), pOutputs[4].get(), outputSize), L"Multithreaded LBVH build differs from single-threaded build");
+        }
+
+        TEST_METHOD(BVHValidatorQualityReport)
+        {
+            std::vector<float> vertices[HeightFieldBenchmarkGeometryCount];
+            std::vector<UINT16> indices[HeightFieldBenchmarkGeometryCount];
+            std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs;
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc;
+            CreateHeightFieldBenchmarkGeometry(vertices, indices, geomDescs, desc);
+
+            const UINT numTriangles = GetTotalPrimitiveCount(desc.Inputs);
+            std::unique_ptr<BYTE[]> pOutput(new BYTE[GetCpuBvh2OutputSize(numTriangles)]);
+            FallbackLayer::CpuBvh2BuildStatistics statistics;
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&desc, FallbackLayer::CpuBvh2BuildSettings(), pOutput.get(), &statistics);
+
+            CpuGeometryDescriptor cpuGeomDescs[HeightFieldBenchmarkGeometryCount];
+            for (UINT i = 0; i < HeightFieldBenchmarkGeometryCount; i++)
+            {
+                cpuGeomDescs[i] = CpuGeometryDescriptor(vertices[i].data(), (UINT)(vertices[i].size() / 3), indices[i].data(), (UINT)indices[i].size());
+            }
+
+            FallbackLayer::BvhValidator validator;
+            std::wstring errorMessage;
+            const auto startTime = std::chrono::high_resolution_clock::now();
+            if (!validator.VerifyBottomLevelOutput(cpuGeomDescs, HeightFieldBenchmarkGeometryCount, pOutput.get(), errorMessage))
+            {
+                Assert::Fail(errorMessage.c_str());
+            }
+            const std::chrono::duration<double, std::milli> validationTime = std::chrono::high_resolution_clock::now() - startTime;
+
+            const FallbackLayer::BvhQualityReport &report = validator.GetQualityReport();
+            Assert::AreEqual(numTriangles, report.NumPrimitives, L"Quality report is missing primitives");
+            Assert::AreEqual(statistics.NumNodes, report.NumNodes, L"Quality report node count doesn't match the builder");
+            Assert::IsTrue(fabs(report.SahCost - statistics.SahCost) <= 0.001f * statistics.SahCost, L"Quality report SAH cost doesn't match the builder");
+
+            UINT leafSizeSum = 0;
+            for (UINT leafSize = 0; leafSize < report.LeafSizeHistogram.size(); leafSize++)
+            {
+                leafSizeSum += leafSize * report.LeafSizeHistogram[leafSize];
+            }
+            Assert::AreEqual(numTriangles, leafSizeSum, L"Leaf size histogram doesn't add up to the primitive count");
+
+            // Structure-only walk must agree with the full validation
+            FallbackLayer::BvhQualityReport structureReport;
+            Assert::IsTrue(FallbackLayer::ComputeBvhQualityReport(pOutput.get(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL, structureReport, errorMessage), errorMessage.c_str());
+            Assert::AreEqual(report.NumLeaves, structureReport.NumLeaves, L"Structure-only walk found a different number of leaves");
+            Assert::AreEqual(report.MaxDepth, structureReport.MaxDepth, L"Structure-only walk found a different depth");
+
+            wchar_t message[256];
+            swprintf_s(message, L"Validated %u triangles in %.1f ms: SAH cost %.2f, %u leaves, max depth %u, sibling overlap %.3f, empty space %.3f\n",
+                numTriangles, validationTime.count(), report.SahCost, report.NumLeaves, report.MaxDepth, report.SiblingOverlapRatio, report.EmptySpaceRatio);
+            Logger::WriteMessage(message);
+            for (UINT depth = 0; depth < report.Levels.size(); depth++)
+            {
+                const FallbackLayer::BvhLevelStatistics &level = report.Levels[depth];
+                swprintf_s(message, L"  Depth %u: %u internal nodes, %u leaves, sibling overlap %.3f, empty space %.3f\n",
+                    depth, level.NumInternalNodes, level.NumLeaves, level.SiblingOverlapRatio, level.EmptySpaceRatio);
+                Logger::WriteMessage(message);
+            }
+
+            // A primitive whose metadata points at the wrong input triangle has to be caught
+            BVHOffsets &offsets = *(BVHOffsets *)pOutput.get();
+            PrimitiveMetaData *pMetadata = (PrimitiveMetaData *)(pOutput.get() + offsets.offsetToPrimitiveMetaData);
+            std::swap(pMetadata[0].PrimitiveIndex, pMetadata[1].PrimitiveIndex);
+            Assert::IsFalse(validator.VerifyBottomLevelOutput(cpuGeomDescs, HeightFieldBenchmarkGeometryCount, pOutput.get(), errorMessage), L"Mismatched primitive metadata wasn't detected");
+            std::swap(pMetadata[0].PrimitiveIndex, pMetadata[1].PrimitiveIndex);
+
+            // So does a node reachable from two parents
+            AABBNode *pNodes = (AABBNode *)(pOutput.get() + offsets.offsetToBoxes);
+            const UINT rightNodeIndex = pNodes[0].rightNodeIndex;
+            pNodes[0].rightNodeIndex = pNodes[0].internalNode.leftNodeIndex;
+            Assert::IsFalse(FallbackLayer::ComputeBvhQualityReport(pOutput.get(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL, structureReport, errorMessage), L"Node with two parents wasn't detected");
+            pNodes[0].rightNodeIndex = rightNodeIndex;
+        }
+
+        TEST_METHOD(UpdateBottomLevelCpuBVHBuilder)
+        {
+            std::vector<float> vertices[HeightFieldBenchmarkGeometryCount];
+            std::vector<UINT16> indices[HeightFieldBenchmarkGeometryCount];
+            std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs;
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc;
+            CreateHeightFieldBenchmarkGeometry(vertices, indices, geomDescs, desc);
+            desc.Inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
+
+            CpuGeometryDescriptor cpuGeomDescs[HeightFieldBenchmarkGeometryCount];
+            for (UINT i = 0; i < HeightFieldBenchmarkGeometryCount; i++)
+            {
+                cpuGeomDescs[i] = CpuGeometryDescriptor(vertices[i].data(), (UINT)(vertices[i].size() / 3), indices[i].data(), (UINT)indices[i].size());
+            }
+
+            const size_t outputSize = (size_t)FallbackLayer::GetRaytracingAccelerationStructureSizeOnCpu(desc.Inputs);
+            std::unique_ptr<BYTE[]> pOutput(new BYTE[outputSize]);
+            FallbackLayer::CpuBvh2BuildStatistics buildStatistics;
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&desc, FallbackLayer::CpuBvh2BuildSettings(), pOutput.get(), &buildStatistics);
+
+            FallbackLayer::BvhValidator validator;
+            std::wstring errorMessage;
+
+            // A small deformation, as a skinned mesh would see from frame to frame,
+            // updated in place
+            for (UINT i = 0; i < HeightFieldBenchmarkGeometryCount; i++)
+            {
+                for (size_t v = 0; v < vertices[i].size(); v += 3)
+                {
+                    vertices[i][v + 1] += sinf(vertices[i][v] * 0.1f) + cosf(vertices[i][v + 2] * 0.1f);
+                }
+            }
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC updateDesc = desc;
+            updateDesc.Inputs.Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+            updateDesc.SourceAccelerationStructureData = (D3D12_GPU_VIRTUAL_ADDRESS)pOutput.get();
+
+            FallbackLayer::CpuBvh2BuildStatistics updateStatistics;
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&updateDesc, FallbackLayer::CpuBvh2BuildSettings(), pOutput.get(), &updateStatistics);
+            if (!validator.VerifyBottomLevelOutput(cpuGeomDescs, HeightFieldBenchmarkGeometryCount, pOutput.get(), errorMessage))
+            {
+                Assert::Fail(errorMessage.c_str());
+            }
+            Assert::AreEqual(buildStatistics.NumNodes, updateStatistics.NumNodes, L"Update changed the node count");
+            Assert::AreEqual(0u, updateStatistics.NumRotations, L"Rotations ran without a reoptimization threshold");
+
+            std::unique_ptr<BYTE[]> pRebuildOutput(new BYTE[outputSize]);
+            FallbackLayer::CpuBvh2BuildStatistics rebuildStatistics;
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&desc, FallbackLayer::CpuBvh2BuildSettings(), pRebuildOutput.get(), &rebuildStatistics);
+
+            wchar_t message[256];
+            swprintf_s(message, L"Refit: %.1f ms, SAH cost %.2f. Rebuild: %.1f ms, SAH cost %.2f\n",
+                updateStatistics.BuildTimeInMs, updateStatistics.SahCost, rebuildStatistics.BuildTimeInMs, rebuildStatistics.SahCost);
+            Logger::WriteMessage(message);
+
+            // Pulling every other grid away wrecks the upper levels, which the
+            // rotations should partly recover. Updated out of place from the
+            // same source with and without them.
+            for (UINT i = 1; i < HeightFieldBenchmarkGeometryCount; i += 2)
+            {
+                for (size_t v = 0; v < vertices[i].size(); v += 3)
+                {
+                    vertices[i][v + 2] += 8.0f * HeightFieldBenchmarkGridDimension;
+                }
+            }
+
+            std::unique_ptr<BYTE[]> pRefitOutput(new BYTE[outputSize]);
+            FallbackLayer::CpuBvh2BuildStatistics refitStatistics;
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&updateDesc, FallbackLayer::CpuBvh2BuildSettings(), pRefitOutput.get(), &refitStatistics);
+            if (!validator.VerifyBottomLevelOutput(cpuGeomDescs, HeightFieldBenchmarkGeometryCount, pRefitOutput.get(), errorMessage))
+            {
+                Assert::Fail(errorMessage.c_str());
+            }
+
+            FallbackLayer::CpuBvh2BuildSettings updateSettings;
+            updateSettings.UpdateReoptimizationSahCost = buildStatistics.SahCost * 1.5f;
+            std::unique_ptr<BYTE[]> pRotatedOutput(new BYTE[outputSize]);
+            FallbackLayer::CpuBvh2BuildStatistics rotatedStatistics;
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&updateDesc, updateSettings, pRotatedOutput.get(), &rotatedStatistics);
+            if (!validator.VerifyBottomLevelOutput(cpuGeomDescs, HeightFieldBenchmarkGeometryCount, pRotatedOutput.get(), errorMessage))
+            {
+                Assert::Fail(errorMessage.c_str());
+            }
+
+            Assert::IsTrue(rotatedStatistics.NumRotations > 0, L"Rotations didn't run after the SAH cost degraded");
+            Assert::IsTrue(rotatedStatistics.SahCost < refitStatistics.SahCost, L"Rotations didn't lower the SAH cost");
+
+            swprintf_s(message, L"Degraded refit: SAH cost %.2f. With %u rotations: %.1f ms, SAH cost %.2f\n",
+                refitStatistics.SahCost, rotatedStatistics.NumRotations, rotatedStatistics.BuildTimeInMs, rotatedStatistics.SahCost);
+            Logger::WriteMessage(message);
+
+            // The rotated tree has to stay updatable
+            updateDesc.SourceAccelerationStructureData = (D3D12_GPU_VIRTUAL_ADDRESS)pRotatedOutput.get();
+            for (UINT i = 0; i < HeightFieldBenchmarkGeometryCount; i++)
+            {
+                for (size_t v = 0; v < vertices[i].size(); v += 3)
+                {
+                    vertices[i][v + 1] *= 0.5f;
+                }
+            }
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&updateDesc, FallbackLayer::CpuBvh2BuildSettings(), pRotatedOutput.get());
+            if (!validator.VerifyBottomLevelOutput(cpuGeomDescs, HeightFieldBenchmarkGeometryCount, pRotatedOutput.get(), errorMessage))
+            {
+                Assert::Fail(errorMessage.c_str());
+            }
+        }
+
+        TEST_METHOD(UpdateTopLevelCpuBVHBuilder)
+        {
+            const UINT numBottomLevels = 32;
+
+            CpuGeometryDescriptor geomDesc(ReferenceVerticies0, VERTEX_COUNT(ReferenceVerticies0), ReferenceIndices0, ARRAYSIZE(ReferenceIndices0));
+            D3D12_RAYTRACING_GEOMETRY_DESC bottomLevelGeometry = {};
+            bottomLevelGeometry.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+            bottomLevelGeometry.Triangles.IndexBuffer = (D3D12_GPU_VIRTUAL_ADDRESS)ReferenceIndices0;
+            bottomLevelGeometry.Triangles.IndexFormat = DXGI_FORMAT_R16_UINT;
+            bottomLevelGeometry.Triangles.IndexCount = ARRAYSIZE(ReferenceIndices0);
+            bottomLevelGeometry.Triangles.VertexBuffer.StartAddress = (D3D12_GPU_VIRTUAL_ADDRESS)ReferenceVerticies0;
+            bottomLevelGeometry.Triangles.VertexBuffer.StrideInBytes = sizeof(float) * 3;
+            bottomLevelGeometry.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+            bottomLevelGeometry.Triangles.VertexCount = VERTEX_COUNT(ReferenceVerticies0);
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC bottomLevelDesc = {};
+            bottomLevelDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            bottomLevelDesc.Inputs.NumDescs = 1;
+            bottomLevelDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            bottomLevelDesc.Inputs.pGeometryDescs = &bottomLevelGeometry;
+
+            std::unique_ptr<BYTE[]> pBottomLevel(new BYTE[(size_t)FallbackLayer::GetRaytracingAccelerationStructureSizeOnCpu(bottomLevelDesc.Inputs)]);
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&bottomLevelDesc, FallbackLayer::CpuBvh2BuildSettings(), pBottomLevel.get());
+
+            AABB bottomLevelBox = {};
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                bottomLevelBox.minArr[axis] = FLT_MAX;
+                bottomLevelBox.maxArr[axis] = -FLT_MAX;
+            }
+            for (UINT i = 0; i < ARRAYSIZE(ReferenceVerticies0); i++)
+            {
+                const UINT axis = i % 3;
+                bottomLevelBox.minArr[axis] = std::min(ReferenceVerticies0[i], bottomLevelBox.minArr[axis]);
+                bottomLevelBox.maxArr[axis] = std::max(ReferenceVerticies0[i], bottomLevelBox.maxArr[axis]);
+            }
+
+            float matrixStorage[numBottomLevels * FloatsPerMatrix];
+            float *pTransformations[numBottomLevels];
+            AABB containingBoxes[numBottomLevels];
+            std::vector<D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC> instanceDescs(numBottomLevels);
+            srand(10);
+            for (UINT i = 0; i < numBottomLevels; i++)
+            {
+                pTransformations[i] = &matrixStorage[i * FloatsPerMatrix];
+                GenerateRandomTranformation(pTransformations[i]);
+                containingBoxes[i] = bottomLevelBox;
+
+                D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC &instanceDesc = instanceDescs[i];
+                instanceDesc = {};
+                memcpy(instanceDesc.Transform, pTransformations[i], sizeof(instanceDesc.Transform));
+                instanceDesc.InstanceID = i;
+                instanceDesc.InstanceMask = 0xff;
+                instanceDesc.AccelerationStructure.GpuVA = (D3D12_GPU_VIRTUAL_ADDRESS)pBottomLevel.get();
+            }
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC topLevelDesc = {};
+            topLevelDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            topLevelDesc.Inputs.NumDescs = numBottomLevels;
+            topLevelDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+            topLevelDesc.Inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
+            topLevelDesc.Inputs.InstanceDescs = (D3D12_GPU_VIRTUAL_ADDRESS)instanceDescs.data();
+
+            std::unique_ptr<BYTE[]> pTopLevel(new BYTE[(size_t)FallbackLayer::GetRaytracingAccelerationStructureSizeOnCpu(topLevelDesc.Inputs)]);
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&topLevelDesc, FallbackLayer::CpuBvh2BuildSettings(), pTopLevel.get());
+
+            // Move every instance and update in place
+            srand(20);
+            for (UINT i = 0; i < numBottomLevels; i++)
+            {
+                GenerateRandomTranformation(pTransformations[i]);
+                memcpy(instanceDescs[i].Transform, pTransformations[i], sizeof(instanceDescs[i].Transform));
+            }
+
+            topLevelDesc.Inputs.Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+            topLevelDesc.SourceAccelerationStructureData = (D3D12_GPU_VIRTUAL_ADDRESS)pTopLevel.get();
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&topLevelDesc, FallbackLayer::CpuBvh2BuildSettings(), pTopLevel.get());
+
+            std::wstring errorMessage;
+            auto &validator = FallbackLayer::GetAccelerationStructureValidator(FallbackLayer::BVH2);
+            if (!validator.VerifyTopLevelOutput(containingBoxes, pTransformations, numBottomLevels, pTopLevel.get(), errorMessage))
+            {
+                Assert::Fail(errorMessage.c_str());
+            }
+
+            const BVHOffsets &offsets = *(BVHOffsets *)pTopLevel.get();
+            const BVHMetadata *pMetadata = (BVHMetadata *)(pTopLevel.get() + offsets.offsetToVertices);
+            for (UINT i = 0; i < numBottomLevels; i++)
+            {
+                const BVHMetadata &metadata = pMetadata[i];
+                Assert::AreEqual(0, memcmp(metadata.ObjectToWorld, pTransformations[metadata.InstanceIndex], sizeof(metadata.ObjectToWorld)), L"Instance transform wasn't updated");
+            }
+        }
+
+        TEST_METHOD(LbvhBottomLevelCpuBVHBuilder)
+        {
+            std::vector<float> vertices;
+            std::vector<UINT16> indices;
+            srand(10);
+            GenerateRandomHeightField(24, 0.0f, vertices, indices);
+
+            CpuGeometryDescriptor testCase(vertices.data(), (UINT)(vertices.size() / 3), indices.data(), (UINT)indices.size());
+
+            FallbackLayer::CpuBvh2BuildSettings settings;
+            settings.UseLbvhBuilder = true;
+            TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, settings);
+
+            settings.LbvhMortonCodeBits = 63;
+            TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, settings);
+        }
+
+        TEST_METHOD(LbvhIntermediatesCpuBVHBuilder)
+        {
+            std::vector<float> vertices[HeightFieldBenchmarkGeometryCount];
+            std::vector<UINT16> indices[HeightFieldBenchmarkGeometryCount];
+            std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs;
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc;
+            CreateHeightFieldBenchmarkGeometry(vertices, indices, geomDescs, desc);
+
+            // Three treelet reordering passes
+            desc.Inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+            const UINT numTriangles = GetTotalPrimitiveCount(desc.Inputs);
+            const UINT numInternalNodes = numTriangles - 1;
+
+            FallbackLayer::CpuBvh2BuildSettings settings;
+            settings.UseLbvhBuilder = true;
+            FallbackLayer::CpuLbvh lbvh;
+            FallbackLayer::BuildLbvhOnCpu(desc.Inputs, settings, lbvh);
+
+            FallbackLayer::CpuBvh2BuildSettings singleThreadedSettings = settings;
+            singleThreadedSettings.UseMultithreadedBuild = false;
+            FallbackLayer::CpuLbvh singleThreadedLbvh;
+            FallbackLayer::BuildLbvhOnCpu(desc.Inputs, singleThreadedSettings, singleThreadedLbvh);
+
+            Assert::AreEqual(numTriangles, (UINT)lbvh.SortedIndices.size());
+            Assert::AreEqual(numInternalNodes + numTriangles, (UINT)lbvh.Hierarchy.size());
+            Assert::IsTrue(lbvh.MortonCodes == singleThreadedLbvh.MortonCodes && lbvh.SortedIndices == singleThreadedLbvh.SortedIndices,
+                L"Multithreaded sort differs from single-threaded sort");
+            Assert::AreEqual(0, memcmp(lbvh.Hierarchy.data(), singleThreadedLbvh.Hierarchy.data(), lbvh.Hierarchy.size() * sizeof(HierarchyNode)),
+                L"Multithreaded hierarchy differs from single-threaded hierarchy");
+
+            // Sorted by code, then by input index like the bitonic sort
+            for (UINT i = 1; i < numTriangles; i++)
+            {
+                Assert::IsTrue(lbvh.MortonCodes[i - 1] < lbvh.MortonCodes[i] ||
+                    (lbvh.MortonCodes[i - 1] == lbvh.MortonCodes[i] && lbvh.SortedIndices[i - 1] < lbvh.SortedIndices[i]),
+                    L"Morton codes aren't sorted");
+            }
+
+            // Every node but the root hangs off exactly one parent, and the
+            // output nodes keep the children of the hierarchy
+            std::vector<UINT> numParents(lbvh.Hierarchy.size(), 0);
+            for (UINT i = 0; i < numInternalNodes; i++)
+            {
+                const HierarchyNode &node = lbvh.Hierarchy[i];
+                numParents[node.LeftChildIndex]++;
+                numParents[node.RightChildIndex]++;
+                Assert::AreEqual(i, (UINT)lbvh.Hierarchy[node.LeftChildIndex].ParentIndex, L"Parent index doesn't match the hierarchy");
+                Assert::AreEqual(i, (UINT)lbvh.Hierarchy[node.RightChildIndex].ParentIndex, L"Parent index doesn't match the hierarchy");
+
+                const AABBNode &outputNode = lbvh.Nodes[i];
+                Assert::IsFalse((bool)outputNode.leaf);
+                const UINT outputLeft = outputNode.internalNode.leftNodeIndex;
+                const UINT outputRight = outputNode.rightNodeIndex;
+                Assert::IsTrue((outputLeft == node.LeftChildIndex && outputRight == node.RightChildIndex) ||
+                    (outputLeft == node.RightChildIndex && outputRight == node.LeftChildIndex), L"Output node children don't match the hierarchy");
+            }
+            Assert::AreEqual(0u, numParents[0]);
+            for (UINT i = 1; i < numParents.size(); i++)
+            {
+                Assert::AreEqual(1u, numParents[i], L"Node isn't referenced exactly once");
+            }
+            for (UINT i = 0; i < numTriangles; i++)
+            {
+                const AABBNode &leaf = lbvh.Nodes[numInternalNodes + i];
+                Assert::IsTrue(leaf.leaf && leaf.leafNode.firstTriangleId == i && leaf.numTriangles == 1, L"Leaf doesn't reference its sorted primitive");
+            }
+
+            // The acceleration structure holds the same nodes
+            std::unique_ptr<BYTE[]> pOutput(new BYTE[GetCpuBvh2OutputSize(numTriangles)]);
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&desc, settings, pOutput.get());
+            const BVHOffsets &offsets = *(BVHOffsets *)pOutput.get();
+            Assert::AreEqual(0, memcmp(pOutput.get() + offsets.offsetToBoxes, lbvh.Nodes.data(), lbvh.Nodes.size() * sizeof(AABBNode)),
+                L"Acceleration structure nodes differ from the LBVH nodes");
+        }
+
+        TEST_METHOD(LowMemoryBottomLevelCpuBVHBuilder)
+        {
+            std::vector<float> vertices;
+            std::vector<UINT32> indices;
+            srand(10);
+            GenerateRandomHeightField(24, 0.0f, vertices, indices);
+
+            CpuGeometryDescriptor testCases[] =
+            {
+                CpuGeometryDescriptor(vertices.data(), (UINT)(vertices.size() / 3), indices.data(), (UINT)indices.size()),
+                CpuGeometryDescriptor(ReferenceVerticies0, VERTEX_COUNT(ReferenceVerticies0), ReferenceIndices0, ARRAYSIZE(ReferenceIndices0)),
+                CpuGeometryDescriptor(ReferenceVerticies1, VERTEX_COUNT(ReferenceVerticies1), ReferenceR32Indices1, ARRAYSIZE(ReferenceR32Indices1)),
+                CpuGeometryDescriptor(ReferenceVerticies0, VERTEX_COUNT(ReferenceVerticies0)),
+            };
+
+            // Budgets small enough that the upper levels are always streamed
+            const SIZE_T budgets[] = { 0, 2048, 64 * 1024 };
+            for (UINT budgetIndex = 0; budgetIndex < ARRAYSIZE(budgets); budgetIndex++)
+            {
+                FallbackLayer::CpuBvh2BuildSettings settings;
+                settings.UseLowMemoryBuild = true;
+                settings.LowMemoryBudgetInBytes = budgets[budgetIndex];
+
+                for (UINT testIndex = 0; testIndex < ARRAYSIZE(testCases); testIndex++)
+                {
+                    TestCpuBvh2Builder(&testCases[testIndex], 1, D3D12_ELEMENTS_LAYOUT_ARRAY, settings);
+                }
+                TestCpuBvh2Builder(testCases, ARRAYSIZE(testCases), D3D12_ELEMENTS_LAYOUT_ARRAY, settings);
+            }
+        }
+
+        SIZE_T GetPeakWorkingSetSize()
+        {
+            PROCESS_MEMORY_COUNTERS memoryCounters = {};
+            GetProcessMemoryInfo(GetCurrentProcess(), &memoryCounters, sizeof(memoryCounters));
+            return memoryCounters.PeakWorkingSetSize;
+        }
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(CpuBVHBuilderPeakMemory)
+            TEST_METHOD_ATTRIBUTE(L"TestCategory", L"Benchmark")
+            TEST_IGNORE()
+        END_TEST_METHOD_ATTRIBUTE()
+        TEST_METHOD(CpuBVHBuilderPeakMemory)
+        {
+            std::vector<float> vertices[HeightFieldBenchmarkGeometryCount];
+            std::vector<UINT16> indices[HeightFieldBenchmarkGeometryCount];
+            std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs;
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc;
+            CreateHeightFieldBenchmarkGeometry(vertices, indices, geomDescs, desc);
+
+            const UINT numTriangles = GetTotalPrimitiveCount(desc.Inputs);
+            const UINT maxSize = GetCpuBvh2OutputSize(numTriangles);
+
+            // Touch both outputs up front so they count towards the baseline
+            std::unique_ptr<BYTE[]> pLowMemoryOutput(new BYTE[maxSize]);
+            std::unique_ptr<BYTE[]> pInCoreOutput(new BYTE[maxSize]);
+            memset(pLowMemoryOutput.get(), 0, maxSize);
+            memset(pInCoreOutput.get(), 0, maxSize);
+
+            // The peak working set can't be reset, so the low-memory build has to
+            // run first for its peak to be measurable
+            const SIZE_T baseline = GetPeakWorkingSetSize();
+
+            FallbackLayer::CpuBvh2BuildSettings lowMemorySettings;
+            lowMemorySettings.UseLowMemoryBuild = true;
+            lowMemorySettings.LowMemoryBudgetInBytes = 4 * 1024 * 1024;
+            FallbackLayer::CpuBvh2BuildStatistics lowMemoryStatistics;
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&desc, lowMemorySettings, pLowMemoryOutput.get(), &lowMemoryStatistics);
+            const SIZE_T lowMemoryPeak = GetPeakWorkingSetSize();
+
+            FallbackLayer::CpuBvh2BuildStatistics inCoreStatistics;
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&desc, FallbackLayer::CpuBvh2BuildSettings(), pInCoreOutput.get(), &inCoreStatistics);
+            const SIZE_T inCorePeak = GetPeakWorkingSetSize();
+
+            Assert::AreEqual(numTriangles, lowMemoryStatistics.NumPrimitives, L"Not every triangle was placed in the BVH");
+
+            wchar_t message[256];
+            swprintf_s(message, L"Input: %u triangles, output %.1f MB\n", numTriangles, maxSize / (1024.0 * 1024.0));
+            Logger::WriteMessage(message);
+            swprintf_s(message, L"Low memory (%.1f MB budget): peak working set +%.1f MB, %.1f ms, SAH cost %.2f\n",
+                lowMemorySettings.LowMemoryBudgetInBytes / (1024.0 * 1024.0),
+                (lowMemoryPeak - baseline) / (1024.0 * 1024.0),
+                lowMemoryStatistics.BuildTimeInMs,
+                lowMemoryStatistics.SahCost);
+            Logger::WriteMessage(message);
+            swprintf_s(message, L"In-core: peak working set +%.1f MB, %.1f ms, SAH cost %.2f\n",
+                (inCorePeak - baseline) / (1024.0 * 1024.0),
+                inCoreStatistics.BuildTimeInMs,
+                inCoreStatistics.SahCost);
+            Logger::WriteMessage(message);
+        }
+
+        static float RandomFloat(float minValue, float maxValue)
+        {
+            return minValue + (rand() / (float)RAND_MAX) * (maxValue - minValue);
+        }
+
+        // Coherent rays are a grid looking down on the height fields, incoherent
+        // rays start anywhere around the scene and point in random directions
+        void GenerateBenchmarkRays(
+            const AABB &sceneBounds,
+            UINT numRays,
+            bool bCoherent,
+            std::vector<FallbackLayer::CpuRay> &rays)
+        {
+            rays.resize(numRays);
+            const UINT gridWidth = (UINT)sqrt((double)numRays);
+            for (UINT i = 0; i < numRays; i++)
+            {
+                FallbackLayer::CpuRay &ray = rays[i];
+                ray.TMin = 0.0f;
+                ray.TMax = FLT_MAX;
+                if (bCoherent)
+                {
+                    const float u = (float)(i % gridWidth) / gridWidth;
+                    const float v = (float)(i / gridWidth) / gridWidth;
+                    ray.Origin = float3{
+                        sceneBounds.min.x + u * (sceneBounds.max.x - sceneBounds.min.x),
+                        sceneBounds.max.y + 10.0f,
+                        sceneBounds.min.z + v * (sceneBounds.max.z - sceneBounds.min.z) };
+                    ray.Direction = float3{ 0.1f, -1.0f, 0.05f };
+                }
+                else
+                {
+                    ray.Origin = float3{
+                        RandomFloat(sceneBounds.min.x, sceneBounds.max.x),
+                        RandomFloat(sceneBounds.min.y - 1.0f, sceneBounds.max.y + 1.0f),
+                        RandomFloat(sceneBounds.min.z, sceneBounds.max.z) };
+                    ray.Direction = float3{ RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f) };
+                }
+            }
+        }
+
+        AABB GetBvh2Bounds(const BYTE *pBvh2)
+        {
+            const BVHOffsets &offsets = *(const BVHOffsets *)pBvh2;
+            const AABBNode &root = *(const AABBNode *)(pBvh2 + offsets.offsetToBoxes);
+            AABB bounds;
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                bounds.minArr[axis] = root.center[axis] - root.halfDim[axis];
+                bounds.maxArr[axis] = root.center[axis] + root.halfDim[axis];
+            }
+            return bounds;
+        }
+
+        template<UINT Width>
+        void VerifyWideBvh(const FallbackLayer::WideBvh<Width> &wideBvh, UINT numPrimitives)
+        {
+            const BVHOffsets &offsets = *(const BVHOffsets *)wideBvh.pBvh2;
+            const Primitive *pPrimitives = (const Primitive *)(wideBvh.pBvh2 + offsets.offsetToVertices);
+
+            struct PendingChild
+            {
+                UINT Child;
+                AABB Bounds;
+            };
+
+            // Carries the intersection of every ancestor box, so containment
+            // in it means the primitive is inside all of them
+            AABB everything;
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                everything.minArr[axis] = -FLT_MAX;
+                everything.maxArr[axis] = FLT_MAX;
+            }
+            std::vector<PendingChild> stack(1, PendingChild{ 0, everything });
+            std::vector<bool> primitiveFound(numPrimitives, false);
+            while (!stack.empty())
+            {
+                const PendingChild pending = stack.back();
+                stack.pop_back();
+
+                if (pending.Child & FallbackLayer::WideBvhLeafFlag)
+                {
+                    const UINT firstPrimitive = pending.Child & FallbackLayer::WideBvhLeafFirstPrimitiveMask;
+                    const UINT count = (pending.Child & ~FallbackLayer::WideBvhLeafFlag) >> FallbackLayer::WideBvhLeafCountShift;
+                    for (UINT i = firstPrimitive; i < firstPrimitive + count; i++)
+                    {
+                        Assert::IsTrue(i < numPrimitives && !primitiveFound[i], L"Primitive referenced more than once");
+                        primitiveFound[i] = true;
+
+                        const Primitive &primitive = pPrimitives[i];
+                        for (UINT v = 0; v < 3; v++)
+                        {
+                            const float3 &vertex = primitive.triangle.v[v];
+                            const float *pVertex = &vertex.x;
+                            for (UINT axis = 0; axis < 3; axis++)
+                            {
+                                Assert::IsTrue(pVertex[axis] >= pending.Bounds.minArr[axis] && pVertex[axis] <= pending.Bounds.maxArr[axis],
+                                    L"Quantized box doesn't contain its primitives");
+                            }
+                        }
+                    }
+                    continue;
+                }
+
+                const FallbackLayer::WideBvhNode<Width> &node = wideBvh.Nodes[pending.Child];
+                const USHORT *pLower[3] = { node.LowerX, node.LowerY, node.LowerZ };
+                const USHORT *pUpper[3] = { node.UpperX, node.UpperY, node.UpperZ };
+                for (UINT i = 0; i < Width; i++)
+                {
+                    if (node.Children[i] == FallbackLayer::WideBvhEmptyChild)
+                    {
+                        continue;
+                    }
+
+                    PendingChild child = { node.Children[i], pending.Bounds };
+                    for (UINT axis = 0; axis < 3; axis++)
+                    {
+                        child.Bounds.minArr[axis] = std::max(child.Bounds.minArr[axis], node.Origin[axis] + Fp16ToFp32(pLower[axis][i]) * node.Scale);
+                        child.Bounds.maxArr[axis] = std::min(child.Bounds.maxArr[axis], node.Origin[axis] + Fp16ToFp32(pUpper[axis][i]) * node.Scale);
+                    }
+                    stack.push_back(child);
+                }
+            }
+
+            for (UINT i = 0; i < numPrimitives; i++)
+            {
+                Assert::IsTrue(primitiveFound[i], L"Primitive missing from the wide BVH");
+            }
+        }
+
+        TEST_METHOD(WideBvhCollapse)
+        {
+            std::vector<float> vertices;
+            std::vector<UINT16> indices;
+            srand(10);
+            GenerateRandomHeightField(24, 0.0f, vertices, indices);
+
+            D3D12_RAYTRACING_GEOMETRY_DESC geometry = {};
+            geometry.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+            geometry.Triangles.IndexBuffer = (D3D12_GPU_VIRTUAL_ADDRESS)indices.data();
+            geometry.Triangles.IndexFormat = DXGI_FORMAT_R16_UINT;
+            geometry.Triangles.IndexCount = (UINT)indices.size();
+            geometry.Triangles.VertexBuffer.StartAddress = (D3D12_GPU_VIRTUAL_ADDRESS)vertices.data();
+            geometry.Triangles.VertexBuffer.StrideInBytes = sizeof(float) * 3;
+            geometry.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+            geometry.Triangles.VertexCount = (UINT)(vertices.size() / 3);
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc = {};
+            desc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            desc.Inputs.NumDescs = 1;
+            desc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            desc.Inputs.pGeometryDescs = &geometry;
+            const UINT numTriangles = GetTotalPrimitiveCount(desc.Inputs);
+
+            for (UINT maxTrianglesInLeaf : { 1u, 4u })
+            {
+                FallbackLayer::CpuBvh2BuildSettings settings;
+                settings.MaxTrianglesInLeaf = maxTrianglesInLeaf;
+                std::vector<BYTE> bvh2((size_t)FallbackLayer::GetRaytracingAccelerationStructureSizeOnCpu(desc.Inputs));
+                FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&desc, settings, bvh2.data());
+
+                FallbackLayer::Bvh4 bvh4;
+                FallbackLayer::Bvh8 bvh8;
+                FallbackLayer::CollapseBvh2(bvh2.data(), bvh4);
+                FallbackLayer::CollapseBvh2(bvh2.data(), bvh8);
+                VerifyWideBvh(bvh4, numTriangles);
+                VerifyWideBvh(bvh8, numTriangles);
+
+                // Every layout shares the primitive test, so the closest hit
+                // distance must match exactly
+                for (bool bCoherent : { true, false })
+                {
+                    std::vector<FallbackLayer::CpuRay> rays;
+                    GenerateBenchmarkRays(GetBvh2Bounds(bvh2.data()), 4096, bCoherent, rays);
+                    for (const FallbackLayer::CpuRay &ray : rays)
+                    {
+                        FallbackLayer::CpuRayHit bvh2Hit, bvh4Hit, bvh8Hit;
+                        const bool bBvh2Hit = FallbackLayer::TraceRayBvh2(bvh2.data(), ray, bvh2Hit);
+                        Assert::AreEqual(bBvh2Hit, FallbackLayer::TraceRayBvh4(bvh4, ray, bvh4Hit), L"BVH4 hit doesn't match BVH2");
+                        Assert::AreEqual(bBvh2Hit, FallbackLayer::TraceRayBvh8(bvh8, ray, bvh8Hit), L"BVH8 hit doesn't match BVH2");
+                        if (bBvh2Hit)
+                        {
+                            Assert::AreEqual(bvh2Hit.T, bvh4Hit.T, L"BVH4 closest hit doesn't match BVH2");
+                            Assert::AreEqual(bvh2Hit.T, bvh8Hit.T, L"BVH8 closest hit doesn't match BVH2");
+                        }
+                    }
+                }
+            }
+        }
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(WideBvhTraversalPerformance)
+            TEST_METHOD_ATTRIBUTE(L"TestCategory", L"Benchmark")
+            TEST_IGNORE()
+        END_TEST_METHOD_ATTRIBUTE()
+        TEST_METHOD(WideBvhTraversalPerformance)
+        {
+            std::vector<float> vertices[HeightFieldBenchmarkGeometryCount];
+            std::vector<UINT16> indices[HeightFieldBenchmarkGeometryCount];
+            std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs;
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc;
+            CreateHeightFieldBenchmarkGeometry(vertices, indices, geomDescs, desc);
+
+            std::vector<BYTE> bvh2((size_t)FallbackLayer::GetRaytracingAccelerationStructureSizeOnCpu(desc.Inputs));
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&desc, FallbackLayer::CpuBvh2BuildSettings(), bvh2.data());
+            const BVHOffsets &offsets = *(const BVHOffsets *)bvh2.data();
+            const UINT numBvh2Nodes = (offsets.offsetToVertices - offsets.offsetToBoxes) / sizeof(AABBNode);
+
+            FallbackLayer::Bvh4 bvh4;
+            FallbackLayer::Bvh8 bvh8;
+            FallbackLayer::CollapseBvh2(bvh2.data(), bvh4);
+            FallbackLayer::CollapseBvh2(bvh2.data(), bvh8);
+
+            wchar_t message[256];
+            swprintf_s(message, L"BVH2: %u nodes, %u bytes/node, %.1f MB\n", numBvh2Nodes, (UINT)sizeof(AABBNode), numBvh2Nodes * sizeof(AABBNode) / (1024.0 * 1024.0));
+            Logger::WriteMessage(message);
+            swprintf_s(message, L"BVH4: %u nodes, %u bytes/node, %.1f MB\n", (UINT)bvh4.Nodes.size(), (UINT)sizeof(bvh4.Nodes[0]), bvh4.Nodes.size() * sizeof(bvh4.Nodes[0]) / (1024.0 * 1024.0));
+            Logger::WriteMessage(message);
+            swprintf_s(message, L"BVH8: %u nodes, %u bytes/node, %.1f MB (%s)\n", (UINT)bvh8.Nodes.size(), (UINT)sizeof(bvh8.Nodes[0]), bvh8.Nodes.size() * sizeof(bvh8.Nodes[0]) / (1024.0 * 1024.0),
+                FallbackLayer::IsAvxTraversalSupported() ? L"AVX" : L"SSE");
+            Logger::WriteMessage(message);
+
+            const UINT numRays = 1 << 18;
+            for (bool bCoherent : { true, false })
+            {
+                std::vector<FallbackLayer::CpuRay> rays;
+                srand(10);
+                GenerateBenchmarkRays(GetBvh2Bounds(bvh2.data()), numRays, bCoherent, rays);
+
+                auto benchmark = [&](LPCWSTR name, auto traceRay)
+                {
+                    UINT nodesVisited = 0;
+                    UINT numHits = 0;
+                    const auto start = std::chrono::high_resolution_clock::now();
+                    for (const FallbackLayer::CpuRay &ray : rays)
+                    {
+                        FallbackLayer::CpuRayHit hit;
+                        numHits += traceRay(ray, hit, &nodesVisited) ? 1 : 0;
+                    }
+                    const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+                    swprintf_s(message, L"%s, %s rays: %.2f Mrays/s, %.1f box tests/ray, %u hits\n",
+                        name, bCoherent ? L"coherent" : L"incoherent", numRays / seconds / 1e6, (double)nodesVisited / numRays, numHits);
+                    Logger::WriteMessage(message);
+                    return numHits;
+                };
+
+                const UINT bvh2Hits = benchmark(L"BVH2", [&](const FallbackLayer::CpuRay &ray, FallbackLayer::CpuRayHit &hit, UINT *pNodesVisited)
+                    { return FallbackLayer::TraceRayBvh2(bvh2.data(), ray, hit, pNodesVisited); });
+                const UINT bvh4Hits = benchmark(L"BVH4", [&](const FallbackLayer::CpuRay &ray, FallbackLayer::CpuRayHit &hit, UINT *pNodesVisited)
+                    { return FallbackLayer::TraceRayBvh4(bvh4, ray, hit, pNodesVisited); });
+                const UINT bvh8Hits = benchmark(L"BVH8", [&](const FallbackLayer::CpuRay &ray, FallbackLayer::CpuRayHit &hit, UINT *pNodesVisited)
+                    { return FallbackLayer::TraceRayBvh8(bvh8, ray, hit, pNodesVisited); });
+
+                Assert::AreEqual(bvh2Hits, bvh4Hits, L"BVH4 hit count doesn't match BVH2");
+                Assert::AreEqual(bvh2Hits, bvh8Hits, L"BVH8 hit count doesn't match BVH2");
+            }
+        }
+
+        void BuildHeightFieldBottomLevelOnCpu(
+            UINT gridDimension,
+            const FallbackLayer::CpuBvh2BuildSettings &settings,
+            std::vector<float> &vertices,
+            std::vector<UINT16> &indices,
+            std::vector<BYTE> &bottomLevel)
+        {
+            GenerateRandomHeightField(gridDimension, 0.0f, vertices, indices);
+
+            D3D12_RAYTRACING_GEOMETRY_DESC geometry = {};
+            geometry.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+            geometry.Triangles.IndexBuffer = (D3D12_GPU_VIRTUAL_ADDRESS)indices.data();
+            geometry.Triangles.IndexFormat = DXGI_FORMAT_R16_UINT;
+            geometry.Triangles.IndexCount = (UINT)indices.size();
+            geometry.Triangles.VertexBuffer.StartAddress = (D3D12_GPU_VIRTUAL_ADDRESS)vertices.data();
+            geometry.Triangles.VertexBuffer.StrideInBytes = sizeof(float) * 3;
+            geometry.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+            geometry.Triangles.VertexCount = (UINT)(vertices.size() / 3);
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc = {};
+            desc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            desc.Inputs.NumDescs = 1;
+            desc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            desc.Inputs.pGeometryDescs = &geometry;
+
+            bottomLevel.resize((size_t)FallbackLayer::GetRaytracingAccelerationStructureSizeOnCpu(desc.Inputs));
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&desc, settings, bottomLevel.data());
+        }
+
+        TEST_METHOD(CpuTraversalBottomLevel)
+        {
+            std::vector<float> vertices;
+            std::vector<UINT16> indices;
+            std::vector<BYTE> bottomLevel;
+            FallbackLayer::CpuBvh2BuildSettings buildSettings;
+            buildSettings.MaxTrianglesInLeaf = 4;
+            srand(10);
+            BuildHeightFieldBottomLevelOnCpu(24, buildSettings, vertices, indices, bottomLevel);
+
+            const BVHOffsets &offsets = *(const BVHOffsets *)bottomLevel.data();
+            const PrimitiveMetaData *pMetadata = (const PrimitiveMetaData *)(bottomLevel.data() + offsets.offsetToPrimitiveMetaData);
+
+            for (bool bCoherent : { true, false })
+            {
+                std::vector<FallbackLayer::CpuRay> rays;
+                GenerateBenchmarkRays(GetBvh2Bounds(bottomLevel.data()), 4099, bCoherent, rays);
+                const UINT numRays = (UINT)rays.size();
+
+                // Packets, single rays and threading must all agree with the
+                // scalar BVH2 traversal
+                std::vector<FallbackLayer::CpuTraversalHit> hits[3];
+                std::vector<FallbackLayer::CpuTraversalHit> anyHits(numRays);
+                for (UINT configuration = 0; configuration < ARRAYSIZE(hits); configuration++)
+                {
+                    FallbackLayer::CpuTraversalSettings settings;
+                    settings.UseRayPackets = configuration != 0;
+                    settings.UseMultithreadedTraversal = configuration == 2;
+                    hits[configuration].resize(numRays);
+                    FallbackLayer::TraceRaysOnCpu(bottomLevel.data(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL,
+                        rays.data(), numRays, settings, hits[configuration].data());
+                }
+
+                FallbackLayer::CpuTraversalSettings anyHitSettings;
+                anyHitSettings.Mode = FallbackLayer::CpuTraversalAnyHit;
+                FallbackLayer::TraceRaysOnCpu(bottomLevel.data(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL,
+                    rays.data(), numRays, anyHitSettings, anyHits.data());
+
+                for (UINT i = 0; i < numRays; i++)
+                {
+                    FallbackLayer::CpuRayHit referenceHit;
+                    const bool bReferenceHit = FallbackLayer::TraceRayBvh2(bottomLevel.data(), rays[i], referenceHit);
+                    for (auto &configurationHits : hits)
+                    {
+                        const FallbackLayer::CpuTraversalHit &hit = configurationHits[i];
+                        Assert::AreEqual(bReferenceHit, hit.PrimitiveIndex != FallbackLayer::CpuTraversalNoHit, L"Hit doesn't match the scalar traversal");
+                        if (bReferenceHit)
+                        {
+                            Assert::AreEqual(referenceHit.T, hit.T, L"Closest hit distance doesn't match the scalar traversal");
+                            Assert::AreEqual(0u, hit.GeometryIndex);
+                            if (referenceHit.U == hit.U && referenceHit.V == hit.V)
+                            {
+                                Assert::AreEqual(pMetadata[referenceHit.PrimitiveIndex].PrimitiveIndex, hit.PrimitiveIndex);
+                            }
+                        }
+                    }
+
+                    const FallbackLayer::CpuTraversalHit &anyHit = anyHits[i];
+                    Assert::AreEqual(bReferenceHit, anyHit.PrimitiveIndex != FallbackLayer::CpuTraversalNoHit, L"Any hit doesn't match closest hit");
+                    if (bReferenceHit)
+                    {
+                        Assert::IsTrue(anyHit.T >= referenceHit.T, L"Any hit is closer than the closest hit");
+                    }
+                }
+            }
+        }
+
+        TEST_METHOD(CpuTraversalTopLevel)
+        {
+            const UINT numBottomLevels = 2;
+            const UINT numInstances = 16;
+            std::vector<float> vertices[numBottomLevels];
+            std::vector<UINT16> indices[numBottomLevels];
+            std::vector<BYTE> bottomLevels[numBottomLevels];
+            srand(10);
+            for (UINT i = 0; i < numBottomLevels; i++)
+            {
+                BuildHeightFieldBottomLevelOnCpu(16 + 8 * i, FallbackLayer::CpuBvh2BuildSettings(), vertices[i], indices[i], bottomLevels[i]);
+            }
+
+            std::vector<D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC> instanceDescs(numInstances);
+            for (UINT i = 0; i < numInstances; i++)
+            {
+                instanceDescs[i] = {};
+                D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC &instanceDesc = instanceDescs[i];
+                GenerateRandomTranformation(&instanceDesc.Transform[0][0]);
+                instanceDesc.InstanceID = 100 + i;
+                instanceDesc.InstanceMask = (i % 4) ? 0x1 : 0x2;
+                instanceDesc.AccelerationStructure.GpuVA = (D3D12_GPU_VIRTUAL_ADDRESS)bottomLevels[i % numBottomLevels].data();
+            }
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC topLevelDesc = {};
+            topLevelDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            topLevelDesc.Inputs.NumDescs = numInstances;
+            topLevelDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+            topLevelDesc.Inputs.InstanceDescs = (D3D12_GPU_VIRTUAL_ADDRESS)instanceDescs.data();
+            std::vector<BYTE> topLevel((size_t)FallbackLayer::GetRaytracingAccelerationStructureSizeOnCpu(topLevelDesc.Inputs));
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&topLevelDesc, FallbackLayer::CpuBvh2BuildSettings(), topLevel.data());
+
+            const BVHOffsets &offsets = *(const BVHOffsets *)topLevel.data();
+            const BVHMetadata *pInstances = (const BVHMetadata *)(topLevel.data() + offsets.offsetToVertices);
+
+            for (UINT instanceInclusionMask : { 0xffu, 0x1u })
+            {
+                for (bool bCoherent : { true, false })
+                {
+                    std::vector<FallbackLayer::CpuRay> rays;
+                    GenerateBenchmarkRays(GetBvh2Bounds(topLevel.data()), 4096, bCoherent, rays);
+                    const UINT numRays = (UINT)rays.size();
+
+                    FallbackLayer::CpuTraversalSettings settings;
+                    settings.InstanceInclusionMask = instanceInclusionMask;
+                    std::vector<FallbackLayer::CpuTraversalHit> hits(numRays);
+                    FallbackLayer::TraceRaysOnCpu(topLevel.data(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL,
+                        rays.data(), numRays, settings, hits.data());
+
+                    // Brute force over every instance with the scalar bottom level traversal
+                    for (UINT i = 0; i < numRays; i++)
+                    {
+                        const FallbackLayer::CpuRay &ray = rays[i];
+                        float closestT = ray.TMax;
+                        UINT closestInstance = FallbackLayer::CpuTraversalNoHit;
+                        for (UINT instanceIndex = 0; instanceIndex < numInstances; instanceIndex++)
+                        {
+                            const BVHMetadata &instance = pInstances[instanceIndex];
+                            if (!(instance.instanceDesc.InstanceMask & instanceInclusionMask))
+                            {
+                                continue;
+                            }
+
+                            const float (&worldToObject)[3][4] = instance.instanceDesc.Transform;
+                            FallbackLayer::CpuRay objectRay = ray;
+                            float *pOrigin = &objectRay.Origin.x;
+                            float *pDirection = &objectRay.Direction.x;
+                            for (UINT row = 0; row < 3; row++)
+                            {
+                                pOrigin[row] = worldToObject[row][0] * ray.Origin.x + worldToObject[row][1] * ray.Origin.y + worldToObject[row][2] * ray.Origin.z + worldToObject[row][3];
+                                pDirection[row] = worldToObject[row][0] * ray.Direction.x + worldToObject[row][1] * ray.Direction.y + worldToObject[row][2] * ray.Direction.z;
+                            }
+
+                            FallbackLayer::CpuRayHit instanceHit;
+                            if (FallbackLayer::TraceRayBvh2((const BYTE *)instance.instanceDesc.AccelerationStructure.GpuVA, objectRay, instanceHit) && instanceHit.T < closestT)
+                            {
+                                closestT = instanceHit.T;
+                                closestInstance = instance.InstanceIndex;
+                            }
+                        }
+
+                        const FallbackLayer::CpuTraversalHit &hit = hits[i];
+                        Assert::AreEqual(closestInstance != FallbackLayer::CpuTraversalNoHit, hit.PrimitiveIndex != FallbackLayer::CpuTraversalNoHit, L"Top level hit doesn't match brute force");
+                        if (closestInstance != FallbackLayer::CpuTraversalNoHit)
+                        {
+                            Assert::AreEqual(closestT, hit.T, closestT * 1e-5f, L"Top level closest hit doesn't match brute force");
+                            Assert::IsTrue(instanceDescs[hit.InstanceIndex].InstanceMask & instanceInclusionMask, L"Masked out instance was hit");
+                            Assert::AreEqual(100 + hit.InstanceIndex, hit.InstanceID);
+                        }
+                    }
+                }
+            }
+        }
+
+        BEGIN_TEST_METHOD_ATTRIBUTE(CpuTraversalPerformance)
+            TEST_METHOD_ATTRIBUTE(L"TestCategory", L"Benchmark")
+            TEST_IGNORE()
+        END_TEST_METHOD_ATTRIBUTE()
+        TEST_METHOD(CpuTraversalPerformance)
+        {
+            std::vector<float> vertices[HeightFieldBenchmarkGeometryCount];
+            std::vector<UINT16> indices[HeightFieldBenchmarkGeometryCount];
+            std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs;
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc;
+            CreateHeightFieldBenchmarkGeometry(vertices, indices, geomDescs, desc);
+
+            std::vector<BYTE> bottomLevel((size_t)FallbackLayer::GetRaytracingAccelerationStructureSizeOnCpu(desc.Inputs));
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&desc, FallbackLayer::CpuBvh2BuildSettings(), bottomLevel.data());
+
+            struct TraversalConfiguration
+            {
+                LPCWSTR Name;
+                FallbackLayer::CpuTraversalMode Mode;
+                bool UseRayPackets;
+                bool UseMultithreadedTraversal;
+            };
+            const TraversalConfiguration configurations[] =
+            {
+                { L"Closest hit, single rays, single-threaded", FallbackLayer::CpuTraversalClosestHit, false, false },
+                { L"Closest hit, packets, single-threaded", FallbackLayer::CpuTraversalClosestHit, true, false },
+                { L"Closest hit, single rays, multithreaded", FallbackLayer::CpuTraversalClosestHit, false, true },
+                { L"Closest hit, packets, multithreaded", FallbackLayer::CpuTraversalClosestHit, true, true },
+                { L"Any hit, packets, multithreaded", FallbackLayer::CpuTraversalAnyHit, true, true },
+            };
+
+            const UINT numRays = 1 << 20;
+            std::vector<FallbackLayer::CpuTraversalHit> hits(numRays);
+            for (bool bCoherent : { true, false })
+            {
+                std::vector<FallbackLayer::CpuRay> rays;
+                srand(10);
+                GenerateBenchmarkRays(GetBvh2Bounds(bottomLevel.data()), numRays, bCoherent, rays);
+
+                for (const TraversalConfiguration &configuration : configurations)
+                {
+                    FallbackLayer::CpuTraversalSettings settings;
+                    settings.Mode = configuration.Mode;
+                    settings.UseRayPackets = configuration.UseRayPackets;
+                    settings.UseMultithreadedTraversal = configuration.UseMultithreadedTraversal;
+
+                    const auto start = std::chrono::high_resolution_clock::now();
+                    FallbackLayer::TraceRaysOnCpu(bottomLevel.data(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL,
+                        rays.data(), numRays, settings, hits.data());
+                    const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+                    const UINT numHits = (UINT)std::count_if(hits.begin(), hits.end(),
+                        [](const FallbackLayer::CpuTraversalHit &hit) { return hit.PrimitiveIndex != FallbackLayer::CpuTraversalNoHit; });
+
+                    wchar_t message[256];
+                    swprintf_s(message, L"%s, %s rays: %.2f Mrays/s, %u hits\n",
+                        configuration.Name, bCoherent ? L"coherent" : L"incoherent", numRays / seconds / 1e6, numHits);
+                    Logger::WriteMessage(message);
+                }
+            }
+        }
+
         template <UINT numBottomLevels>
         void SimpleTopLevelGpuBVHBuilder(
             D3D12_ELEMENTS_LAYOUT layoutToTest,
@@ -1341,7 +2785,11 @@ namespace FallbackLayerUnitTests
             }
         }
 
-        void TestCpuBvh2Builder(CpuGeometryDescriptor *pGeomDescs, UINT numGeoms, D3D12_ELEMENTS_LAYOUT layoutToTest = D3D12_ELEMENTS_LAYOUT_ARRAY)
+        void TestCpuBvh2Builder(
+            CpuGeometryDescriptor *pGeomDescs,
+            UINT numGeoms,
+            D3D12_ELEMENTS_LAYOUT layoutToTest = D3D12_ELEMENTS_LAYOUT_ARRAY,
+            const FallbackLayer::CpuBvh2BuildSettings &settings = FallbackLayer::CpuBvh2BuildSettings())
         {
             ID3D12Device &device = m_d3d12Context.GetDevice();
             std::unique_ptr<FallbackLayer::IAccelerationStructureBuilder> pBuilder =
@@ -1360,6 +2808,8 @@ namespace FallbackLayerUnitTests
                 triangleDesc.IndexCount = pGeomDescs[i].m_numIndicies;
                 triangleDesc.VertexCount = pGeomDescs[i].m_numVerticies;
                 triangleDesc.VertexBuffer.StrideInBytes = sizeof(float) * 3;
+                triangleDesc.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+                triangleDesc.Transform3x4 = (D3D12_GPU_VIRTUAL_ADDRESS)pGeomDescs[i].transform.data();
             }
 
             D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO prebuildInfo;
@@ -1377,8 +2827,9 @@ namespace FallbackLayerUnitTests
             inputs.NumDescs = numGeoms;
             inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
             inputs.pGeometryDescs = geomDescs.data();
+            Assert::AreEqual(prebuildInfo.ResultDataMaxSizeInBytes, FallbackLayer::GetRaytracingAccelerationStructureSizeOnCpu(inputs), L"CPU and GPU output sizes don't match");
 
-            BuildRaytracingAccelerationStructureOnCpu(&desc, pData.get());
+            FallbackLayer::BuildRaytracingAccelerationStructureOnCpu(&desc, settings, pData.get());
             std::wstring errorMessage;
             auto &validator = FallbackLayer::GetAccelerationStructureValidator(pBuilder->GetAccelerationStructureType());
             if (!validator.VerifyBottomLevelOutput(pGeomDescs, numGeoms, pData.get(), errorMessage))
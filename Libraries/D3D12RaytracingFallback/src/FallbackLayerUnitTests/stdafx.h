@@ -12,6 +12,7 @@
 
 #include "..\pch.h"
 #include "DXGI1_4.h"
+#include <psapi.h>
 
 #include "D3DTestHelper.h"
 #include "D3D12Context.h"
@@ -60,23 +60,7 @@ namespace FallbackLayer
         pCommandList->SetComputeRootUnorderedAccessView(BaseTreeletsCountBufferSlot, baseTreeletsCountBuffer);
         pCommandList->SetComputeRootUnorderedAccessView(BaseTreeletsIndexBufferSlot, baseTreeletsIndexBuffer);
 
-        bool bPrioritizeTrace = buildFlag & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
-        bool bPrioritizeBuild = buildFlag & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD;
-
-        UINT numOptimizationPasses;
-
-        if (bPrioritizeBuild)
-        {
-            numOptimizationPasses = 0;
-        }
-        else if (bPrioritizeTrace)
-        {
-            numOptimizationPasses = 3;
-        }
-        else
-        {
-            numOptimizationPasses = 1;
-        }
+        UINT numOptimizationPasses = GetNumOptimizationPasses(buildFlag);
 
         for (UINT i = 0; i < numOptimizationPasses; i++)
         {
@@ -108,6 +92,25 @@ namespace FallbackLayer
         }
     }
 
+    UINT TreeletReorder::GetNumOptimizationPasses(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlag)
+    {
+        bool bPrioritizeTrace = buildFlag & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+        bool bPrioritizeBuild = buildFlag & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD;
+
+        if (bPrioritizeBuild)
+        {
+            return 0;
+        }
+        else if (bPrioritizeTrace)
+        {
+            return 3;
+        }
+        else
+        {
+            return 1;
+        }
+    }
+
     UINT TreeletReorder::RequiredSizeForAABBBuffer(UINT numElements)
     {
         if (numElements == 0)
@@ -27,6 +27,7 @@ namespace FallbackLayer
             D3D12_GPU_VIRTUAL_ADDRESS baseTreeletsBuffer,
             D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlag);
 
+        static UINT GetNumOptimizationPasses(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlag);
         static UINT RequiredSizeForAABBBuffer(UINT numElements);
         static UINT RequiredSizeForBaseTreeletBuffers(UINT numElements);
     private:
@@ -49,6 +49,46 @@ template <typename T> T AlignPowerOfTwo(T value)
     return value == 0 ? 0 : 1 << Log2(value);
 }
 
+//
+// Convert a 16-bit float to 32-bit.
+//
+
+static float Fp16ToFp32(USHORT v)
+{
+    static const UINT kMultiple = 0x77800000;   // 2**112
+    const UINT BiasedFloat = (v & 0x8000) << 16 | (v & 0x7FFF) << 13;
+    return (float&)BiasedFloat * (float&)kMultiple;
+}
+
+//
+// Round toward minus infinity.  Guarantees output <= input.
+//
+
+static USHORT Fp32ToFp16(float v, float RoundDirection = 0.0f)
+{
+    assert(!!_finite(v));
+    assert(v > -65504 && v < 65504);
+
+    // Multiplying by 2^-112 causes exponents below -14 to denormalize
+    static const UINT kMultiple = 0x07800000;   // 2**-112
+    const float BiasedFloat = v * (float&)kMultiple;
+    const UINT u = (UINT&)BiasedFloat;
+
+    const UINT sign = u & 0x80000000;
+    UINT body = u & 0x0fffffff;
+
+    // Increase the magnitude before truncation to ensure proper bounds
+    if (v * RoundDirection > 0.0f)
+    {
+        if (body == 0)
+            body = 0x800000;
+        else
+            body += 0x1fff;
+    }
+
+    return (USHORT)(sign >> 16 | body >> 13);
+}
+
 static void CreateRootSignatureHelper(ID3D12Device *pDevice, D3D12_VERSIONED_ROOT_SIGNATURE_DESC &desc, ID3D12RootSignature **ppRootSignature)
 {
     CComPtr<ID3DBlob> pRootSignatureBlob;
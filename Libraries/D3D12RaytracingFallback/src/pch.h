@@ -26,6 +26,11 @@
 #include <map>
 #include <deque>
 #include <string>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <ppl.h>
+#include <immintrin.h>
 #include <strsafe.h>
 #include "d3d12_1.h"
 #include "d3dx12.h"
@@ -86,6 +91,11 @@
 #include "GpuBvh2Copy.h"
 #include "TreeletReorder.h"
 #include "GpuBvh2Builder.h"
+#include "CpuLbvhBuilder.h"
+#include "CpuBvh2Builder.h"
+#include "Bvh2Cache.h"
+#include "CpuWideBvh.h"
+#include "CpuBvh2Traversal.h"
 
 // Dispatchers
 #include "UberShaderBindings.h"
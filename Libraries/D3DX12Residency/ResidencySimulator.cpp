@@ -0,0 +1,152 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+// Command line front end for d3dx12ResidencySimulator.h. Replays a residency trace against one or more budgets
+// with each policy and prints the paging traffic, stalls and thrashing that result. Only needs a C++11 compiler:
+//
+//     ResidencySimulator <trace> <budget MB> [<budget MB> ...] [-policy lru|size|frequency|priority] [-latency N] [-thrash N]
+
+#include "d3dx12ResidencySimulator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+using namespace D3DX12Residency;
+
+namespace
+{
+    const uint64_t cMegabyte = 1024 * 1024;
+
+    void PrintUsage()
+    {
+        std::cerr << "Usage: ResidencySimulator <trace> <budget MB> [<budget MB> ...] [-policy lru|size|frequency|priority]"
+                  << " [-latency N] [-thrash N]" << std::endl;
+    }
+
+    void PrintResults(const char* PolicyName, uint64_t Budget, const ResidencySimulationResults& Results)
+    {
+        printf("%-10s %8llu %10llu %10.1f %10.1f %10.1f %8llu %8llu %8llu %10.1f\n",
+               PolicyName,
+               (unsigned long long)(Budget / cMegabyte),
+               (unsigned long long)Results.Executions,
+               double(Results.BytesMadeResident) / cMegabyte,
+               double(Results.BytesEvicted) / cMegabyte,
+               double(Results.BytesTrimmed) / cMegabyte,
+               (unsigned long long)Results.Stalls,
+               (unsigned long long)Results.ThrashEvents,
+               (unsigned long long)Results.OverBudgetExecutions,
+               double(Results.PeakUsage) / cMegabyte);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* TraceFilename = nullptr;
+    const char* PolicyFilter = nullptr;
+    std::vector<uint64_t> Budgets;
+    ResidencySimulationSettings Settings;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-policy") == 0 && i + 1 < argc)
+        {
+            PolicyFilter = argv[++i];
+        }
+        else if (strcmp(argv[i], "-latency") == 0 && i + 1 < argc)
+        {
+            Settings.MaxLatency = uint32_t(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "-thrash") == 0 && i + 1 < argc)
+        {
+            Settings.ThrashWindow = uint32_t(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (TraceFilename == nullptr)
+        {
+            TraceFilename = argv[i];
+        }
+        else
+        {
+            char* End = nullptr;
+            const uint64_t BudgetMB = strtoull(argv[i], &End, 10);
+            if (End == argv[i] || *End != '\0' || BudgetMB == 0 || BudgetMB > UINT64_MAX / cMegabyte)
+            {
+                std::cerr << "Invalid budget " << argv[i] << std::endl;
+                PrintUsage();
+                return 1;
+            }
+
+            Budgets.push_back(BudgetMB * cMegabyte);
+        }
+    }
+
+    if (TraceFilename == nullptr || Budgets.empty())
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    std::unique_ptr<ResidencyPolicy> Policies[] =
+    {
+        std::unique_ptr<ResidencyPolicy>(new LRUResidencyPolicy()),
+        std::unique_ptr<ResidencyPolicy>(new SizeAwareResidencyPolicy()),
+        std::unique_ptr<ResidencyPolicy>(new FrequencyResidencyPolicy()),
+        std::unique_ptr<ResidencyPolicy>(new PriorityResidencyPolicy()),
+    };
+
+    if (PolicyFilter && std::none_of(std::begin(Policies), std::end(Policies),
+        [PolicyFilter](const std::unique_ptr<ResidencyPolicy>& Policy) { return strcmp(PolicyFilter, Policy->GetName()) == 0; }))
+    {
+        std::cerr << "Unknown policy " << PolicyFilter << std::endl;
+        PrintUsage();
+        return 1;
+    }
+
+    std::ifstream TraceFile(TraceFilename);
+    if (!TraceFile)
+    {
+        std::cerr << "Failed to open " << TraceFilename << std::endl;
+        return 1;
+    }
+
+    ResidencyTrace Trace;
+    std::string Error;
+    if (!Trace.Load(TraceFile, &Error))
+    {
+        std::cerr << Error << std::endl;
+        return 1;
+    }
+
+    printf("%-10s %8s %10s %10s %10s %10s %8s %8s %8s %10s\n",
+           "Policy", "Budget", "Executions", "Paged in", "Evicted", "Trimmed", "Stalls", "Thrash", "Over", "Peak");
+
+    for (uint64_t Budget : Budgets)
+    {
+        Settings.Budget = Budget;
+
+        for (auto& Policy : Policies)
+        {
+            if (PolicyFilter && strcmp(PolicyFilter, Policy->GetName()) != 0)
+            {
+                continue;
+            }
+
+            ResidencySimulator Simulator(Trace, *Policy, Settings);
+            PrintResults(Policy->GetName(), Budget, Simulator.Run());
+        }
+    }
+
+    return 0;
+}
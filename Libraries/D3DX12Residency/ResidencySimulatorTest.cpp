@@ -0,0 +1,97 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+// Smoke test for d3dx12ResidencySimulator.h. Replays a small trace and checks the paging it reports. Returns 0 if
+// every check passes:
+//
+//     g++ -std=c++11 ResidencySimulatorTest.cpp -o ResidencySimulatorTest && ./ResidencySimulatorTest
+
+#include "d3dx12ResidencySimulator.h"
+
+#include <cstdio>
+#include <sstream>
+
+using namespace D3DX12Residency;
+
+namespace
+{
+    const uint64_t cMegabyte = 1024 * 1024;
+
+    // Three 1MB objects. The first execution uses two of them, the second needs the third and the last one uses the
+    // first object again.
+    const char* cTrace =
+        "residency-trace 1\n"
+        "frequency 1000\n"
+        "create a 1048576 0 0\n"
+        "create b 1048576 0 0\n"
+        "create c 1048576 0 0\n"
+        "execute 0 a b\n"
+        "execute 1 c\n"
+        "execute 2 a\n";
+
+    uint32_t Failures = 0;
+
+    void Check(bool Condition, const char* Description)
+    {
+        if (!Condition)
+        {
+            printf("FAILED: %s\n", Description);
+            Failures++;
+        }
+    }
+
+    ResidencySimulationResults Simulate(const ResidencyTrace& Trace, uint64_t Budget)
+    {
+        LRUResidencyPolicy Policy;
+
+        ResidencySimulationSettings Settings;
+        Settings.Budget = Budget;
+        Settings.MaxLatency = 1;
+
+        ResidencySimulator Simulator(Trace, Policy, Settings);
+        return Simulator.Run();
+    }
+}
+
+int main()
+{
+    std::istringstream TraceStream(cTrace);
+    ResidencyTrace Trace;
+    std::string Error;
+    Check(Trace.Load(TraceStream, &Error), "the trace loads");
+    Check(Trace.Objects.size() == 3 && Trace.Events.size() == 6, "the trace has 3 objects and 6 events");
+
+    // Everything fits, so each object is paged in once and nothing is evicted
+    ResidencySimulationResults Results = Simulate(Trace, 3 * cMegabyte);
+    Check(Results.Executions == 3, "3MB: 3 executions");
+    Check(Results.ObjectsMadeResident == 3 && Results.BytesMadeResident == 3 * cMegabyte, "3MB: 3 objects paged in");
+    Check(Results.ObjectsEvicted == 0 && Results.ObjectsTrimmed == 0, "3MB: nothing evicted");
+    Check(Results.Stalls == 0 && Results.ThrashEvents == 0 && Results.OverBudgetExecutions == 0, "3MB: no stalls");
+    Check(Results.PeakUsage == 3 * cMegabyte, "3MB: peak usage");
+
+    // The second execution waits for the first and evicts its objects to get under budget, so the first object is
+    // paged back in by the last execution
+    Results = Simulate(Trace, 2 * cMegabyte);
+    Check(Results.Executions == 3, "2MB: 3 executions");
+    Check(Results.ObjectsMadeResident == 4 && Results.BytesMadeResident == 4 * cMegabyte, "2MB: 4 objects paged in");
+    Check(Results.ObjectsEvicted == 2 && Results.BytesEvicted == 2 * cMegabyte, "2MB: 2 objects evicted");
+    Check(Results.ObjectsTrimmed == 0, "2MB: nothing trimmed");
+    Check(Results.Stalls == 1, "2MB: 1 stall");
+    Check(Results.ThrashEvents == 1, "2MB: 1 thrash event");
+    Check(Results.OverBudgetExecutions == 0, "2MB: never over budget");
+    Check(Results.PeakUsage == 2 * cMegabyte, "2MB: peak usage");
+
+    if (Failures == 0)
+    {
+        printf("All residency simulator checks passed\n");
+    }
+    return Failures == 0 ? 0 : 1;
+}
@@ -10,6 +10,9 @@
 //*********************************************************
 
 #pragma once
+
+#include "d3dx12ResidencyPolicy.h"
+
 namespace D3DX12Residency
 {
 #if 0
@@ -117,7 +120,9 @@ namespace D3DX12Residency
             Size(0),
             ResidencyStatus(RESIDENCY_STATUS::RESIDENT),
             LastGPUSyncPoint(0),
-            LastUsedTimestamp(0)
+            LastUsedTimestamp(0),
+            UseCount(0),
+            Priority(cResidencyPriorityNormal)
         {
             memset(CommandListsUsedOn, 0, sizeof(CommandListsUsedOn));
         }
@@ -143,6 +148,12 @@ namespace D3DX12Residency
         UINT64 LastGPUSyncPoint;
         UINT64 LastUsedTimestamp;
 
+        // The number of executions this object was used in, halved each time it is evicted
+        UINT64 UseCount;
+        // Hint to the residency policy, on the same scale as D3D12_RESIDENCY_PRIORITY. Traces record the value
+        // it had when ResidencyManager::BeginTrackingObject was called.
+        UINT32 Priority;
+
         // This is used to track which open command lists this resource is currently used on.
         bool CommandListsUsedOn[MAX_NUM_CONCURRENT_CMD_LISTS];
 
@@ -496,12 +507,14 @@ namespace D3DX12Residency
             QueueSyncPoint pQueueSyncPoints[1];
         };
 
-        // A Least Recently Used Cache. Tracks all of the objects requested by the app so that objects
-        // that aren't used freqently can get evicted to help the app stay under buget.
-        class LRUCache
+        // Tracks all of the objects requested by the app in least recently used order so that objects that
+        // aren't used freqently can get evicted to help the app stay under buget. Which of the objects that are
+        // safe to evict actually get evicted is left to the ResidencyPolicy.
+        class ResidencyCache
         {
         public:
-            LRUCache() :
+            ResidencyCache(ResidencyPolicy* pPolicyIn) :
+                pPolicy(pPolicyIn),
                 NumResidentObjects(0),
                 NumEvictedObjects(0),
                 ResidentSize(0)
@@ -510,6 +523,11 @@ namespace D3DX12Residency
                 Internal::InitializeListHead(&EvictedObjectListHead);
             };
 
+            void SetPolicy(ResidencyPolicy* pPolicyIn)
+            {
+                pPolicy = pPolicyIn;
+            }
+
             void Insert(ManagedObject* pObject)
             {
                 if (pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::RESIDENT)
@@ -548,6 +566,8 @@ namespace D3DX12Residency
 
                 Internal::RemoveEntryList(&pObject->ListEntry);
                 Internal::InsertTailList(&ResidentObjectListHead, &pObject->ListEntry);
+
+                pObject->UseCount++;
             }
 
             void MakeResident(ManagedObject* pObject)
@@ -574,53 +594,81 @@ namespace D3DX12Residency
                 NumResidentObjects--;
                 ResidentSize -= pObject->Size;
                 NumEvictedObjects++;
+
+                pObject->UseCount /= 2;
             }
 
-            // Evict all of the resident objects used in sync points up to the specficied one (inclusive)
+            // Evict resident objects used in sync points up to the specficied one (inclusive) until usage is under budget
             void TrimToSyncPointInclusive(INT64 CurrentUsage, INT64 CurrentBudget, ID3D12Pageable** EvictionList, UINT32& NumObjectsToEvict, UINT64 SyncPoint)
             {
                 NumObjectsToEvict = 0;
 
+                if (CurrentUsage < CurrentBudget || NumResidentObjects == 0)
+                {
+                    return;
+                }
+
+                ManagedObject** ppObjects = new ManagedObject*[NumResidentObjects];
+                ResidencyCandidate* pCandidates = new ResidencyCandidate[NumResidentObjects];
+
+                // Objects are referenced in sync point order, so the ones the GPU is done with are at the head of the list
+                UINT32 NumCandidates = 0;
                 LIST_ENTRY* pResourceEntry = ResidentObjectListHead.Flink;
                 while (pResourceEntry != &ResidentObjectListHead)
                 {
                     ManagedObject* pObject = CONTAINING_RECORD(pResourceEntry, ManagedObject, ListEntry);
 
-                    if (pObject->LastGPUSyncPoint > SyncPoint || CurrentUsage < CurrentBudget)
+                    if (pObject->LastGPUSyncPoint > SyncPoint)
                     {
                         break;
                     }
 
+                    ppObjects[NumCandidates] = pObject;
+                    pCandidates[NumCandidates] = GetCandidate(pObject, NumCandidates);
+                    NumCandidates++;
+
+                    pResourceEntry = pResourceEntry->Flink;
+                }
+
+                const UINT32 NumVictims = pPolicy->SelectVictims(pCandidates, NumCandidates, UINT64(CurrentUsage - CurrentBudget) + 1);
+
+                for (UINT32 i = 0; i < NumVictims; i++)
+                {
+                    ManagedObject* pObject = ppObjects[pCandidates[i].Index];
+
                     RESIDENCY_CHECK(pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::RESIDENT);
 
                     EvictionList[NumObjectsToEvict++] = pObject->pUnderlying;
                     Evict(pObject);
-
-                    CurrentUsage -= pObject->Size;
-
-                    pResourceEntry = ResidentObjectListHead.Flink;
                 }
+
+                delete[](pCandidates);
+                delete[](ppObjects);
             }
 
-            // Trim all objects which are older than the specified time
+            // Trim all objects which have gone unused for longer than the policy's grace period
             void TrimAgedAllocations(DeviceWideSyncPoint* MaxSyncPoint, ID3D12Pageable** EvictionList, UINT32& NumObjectsToEvict, UINT64 CurrentTimeStamp, UINT64 MinDelta)
             {
                 LIST_ENTRY* pResourceEntry = ResidentObjectListHead.Flink;
                 while (pResourceEntry != &ResidentObjectListHead)
                 {
                     ManagedObject* pObject = CONTAINING_RECORD(pResourceEntry, ManagedObject, ListEntry);
+                    pResourceEntry = pResourceEntry->Flink;
 
+                    const UINT64 Age = CurrentTimeStamp - pObject->LastUsedTimestamp;
                     if ((MaxSyncPoint && pObject->LastGPUSyncPoint >= MaxSyncPoint->GenerationID) || // Only trim allocations done on the GPU
-                        CurrentTimeStamp - pObject->LastUsedTimestamp <= MinDelta) // Don't evict things which have been used recently
+                        Age <= MinDelta) // Don't evict things which have been used recently
                     {
                         break;
                     }
 
-                    RESIDENCY_CHECK(pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::RESIDENT);
-                    EvictionList[NumObjectsToEvict++] = pObject->pUnderlying;
-                    Evict(pObject);
-
-                    pResourceEntry = ResidentObjectListHead.Flink;
+                    // The policy may keep some objects around for longer
+                    if (Age > pPolicy->GetGracePeriod(GetCandidate(pObject, 0), MinDelta))
+                    {
+                        RESIDENCY_CHECK(pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::RESIDENT);
+                        EvictionList[NumObjectsToEvict++] = pObject->pUnderlying;
+                        Evict(pObject);
+                    }
                 }
             }
 
@@ -640,6 +688,20 @@ namespace D3DX12Residency
             UINT32 NumEvictedObjects;
 
             UINT64 ResidentSize;
+
+        private:
+            static ResidencyCandidate GetCandidate(ManagedObject* pObject, UINT32 Index)
+            {
+                ResidencyCandidate Candidate;
+                Candidate.Size = pObject->Size;
+                Candidate.LastUsedTimestamp = pObject->LastUsedTimestamp;
+                Candidate.UseCount = pObject->UseCount;
+                Candidate.Priority = pObject->Priority;
+                Candidate.Index = Index;
+                return Candidate;
+            }
+
+            ResidencyPolicy* pPolicy;
         };
 
         class ResidencyManagerInternal
@@ -670,6 +732,8 @@ namespace D3DX12Residency
                 AsyncWorkQueue(nullptr),
                 MaxSoftwareQueueLatency(6),
                 AsyncWorkQueueSize(7),
+                Cache(&DefaultPolicy),
+                pTraceFile(nullptr),
                 pSyncManager(pSyncManagerIn)
             {
                 Internal::InitializeListHead(&QueueFencesListHead);
@@ -681,12 +745,17 @@ namespace D3DX12Residency
             };
 
             // NOTE: DeviceNodeIndex is an index not a mask. The majority of D3D12 uses bit masks to identify a GPU node whereas DXGI uses 0 based indices.
-            HRESULT Initialize(ID3D12Device* ParentDevice, UINT DeviceNodeIndex, IDXGIAdapter* ParentAdapter, UINT32 MaxLatency)
+            HRESULT Initialize(ID3D12Device* ParentDevice, UINT DeviceNodeIndex, IDXGIAdapter* ParentAdapter, UINT32 MaxLatency, ResidencyPolicy* pPolicy)
             {
                 Device = ParentDevice;
                 NodeIndex = DeviceNodeIndex;
                 MaxSoftwareQueueLatency = MaxLatency;
 
+                if (pPolicy)
+                {
+                    Cache.SetPolicy(pPolicy);
+                }
+
                 // Try to query for the device interface with a queued MakeResident API.
                 if (FAILED(Device->QueryInterface(&Device3)))
                 {
@@ -711,7 +780,6 @@ namespace D3DX12Residency
                     return E_OUTOFMEMORY;
                 }
 
-                LARGE_INTEGER Frequency;
                 QueryPerformanceFrequency(&Frequency);
 
                 // Calculate how many QPC ticks are equivalent to the given time in seconds
@@ -765,6 +833,8 @@ namespace D3DX12Residency
 
             void Destroy()
             {
+                StopRecording();
+
                 AsyncThreadFence.Destroy();
 
                 if (CompletionEvent != INVALID_HANDLE_VALUE)
@@ -864,7 +934,12 @@ namespace D3DX12Residency
                         RESIDENCY_CHECK_RESULT(Device->Evict(1, &pObject->pUnderlying));
                     }
 
-                    LRU.Insert(pObject);
+                    Cache.Insert(pObject);
+
+                    if (pTraceFile)
+                    {
+                        RecordObject(pObject);
+                    }
                 }
             }
 
@@ -872,7 +947,50 @@ namespace D3DX12Residency
             {
                 Internal::ScopedLock Lock(&Mutex);
 
-                LRU.Remove(pObject);
+                Cache.Remove(pObject);
+
+                if (pTraceFile)
+                {
+                    fprintf(pTraceFile, "destroy %llx\n", UINT64(UINT_PTR(pObject)));
+                }
+            }
+
+            // Writes every tracked object and each subsequent execution to a text file, which can be replayed by
+            // the simulator in d3dx12ResidencySimulator.h against other budgets and policies.
+            HRESULT StartRecording(const wchar_t* Filename)
+            {
+                Internal::ScopedLock Lock(&Mutex);
+
+                StopRecordingInternal();
+
+                if (_wfopen_s(&pTraceFile, Filename, L"w") != 0 || pTraceFile == nullptr)
+                {
+                    pTraceFile = nullptr;
+                    return E_FAIL;
+                }
+
+                fprintf(pTraceFile, "residency-trace 1\n");
+                fprintf(pTraceFile, "frequency %llu\n", UINT64(Frequency.QuadPart));
+
+                // Most recently used first; the simulator inserts each created object at the head of its list,
+                // so replaying these reproduces the current recency order
+                LIST_ENTRY* Lists[] = { &Cache.EvictedObjectListHead, &Cache.ResidentObjectListHead };
+                for (LIST_ENTRY* pHead : Lists)
+                {
+                    for (LIST_ENTRY* pEntry = pHead->Blink; pEntry != pHead; pEntry = pEntry->Blink)
+                    {
+                        RecordObject(CONTAINING_RECORD(pEntry, ManagedObject, ListEntry));
+                    }
+                }
+
+                return S_OK;
+            }
+
+            void StopRecording()
+            {
+                Internal::ScopedLock Lock(&Mutex);
+
+                StopRecordingInternal();
             }
 
             // One residency set per command-list
@@ -897,6 +1015,21 @@ namespace D3DX12Residency
             }
 
         private:
+            void RecordObject(ManagedObject* pObject)
+            {
+                fprintf(pTraceFile, "create %llx %llu %u %u\n", UINT64(UINT_PTR(pObject)), pObject->Size, pObject->Priority,
+                        pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::RESIDENT ? 1 : 0);
+            }
+
+            void StopRecordingInternal()
+            {
+                if (pTraceFile)
+                {
+                    fclose(pTraceFile);
+                    pTraceFile = nullptr;
+                }
+            }
+
             HRESULT GetFence(ID3D12CommandQueue *Queue, Internal::Fence *&QueueFence)
             {
                 // We have to track each object on each queue so we know when it is safe to evict them. Therefore, for every queue that we
@@ -1171,7 +1304,17 @@ namespace D3DX12Residency
                     Internal::ScopedLock Lock(&Mutex);
 
                     pMakeResidentList = new ResidentScratchSpace[pWork->pMasterSet->CurrentSetSize];
-                    pEvictionList = new ID3D12Pageable*[LRU.NumResidentObjects];
+                    pEvictionList = new ID3D12Pageable*[Cache.NumResidentObjects];
+
+                    if (pTraceFile)
+                    {
+                        fprintf(pTraceFile, "execute %llu", UINT64(CurrentTime.QuadPart));
+                        for (INT32 i = 0; i < pWork->pMasterSet->CurrentSetSize; i++)
+                        {
+                            fprintf(pTraceFile, " %llx", UINT64(UINT_PTR(pWork->pMasterSet->ppSet[i])));
+                        }
+                        fprintf(pTraceFile, "\n");
+                    }
 
                     // Mark the objects used by this command list to be made resident
                     for (INT32 i = 0; i < pWork->pMasterSet->CurrentSetSize; i++)
@@ -1181,7 +1324,7 @@ namespace D3DX12Residency
                         if (pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::EVICTED)
                         {
                             pMakeResidentList[NumObjectsToMakeResident++].pManagedObject = pObject;
-                            LRU.MakeResident(pObject);
+                            Cache.MakeResident(pObject);
 
                             SizeToMakeResident += pObject->Size;
                         }
@@ -1190,7 +1333,7 @@ namespace D3DX12Residency
                         pObject->LastGPUSyncPoint = pWork->SyncPointGeneration;
 
                         pObject->LastUsedTimestamp = CurrentTime.QuadPart;
-                        LRU.ObjectReferenced(pObject);
+                        Cache.ObjectReferenced(pObject);
                     }
 
                     DXGI_QUERY_VIDEO_MEMORY_INFO LocalMemory;
@@ -1198,7 +1341,7 @@ namespace D3DX12Residency
                     GetCurrentBudget(&LocalMemory, DXGI_MEMORY_SEGMENT_GROUP_LOCAL);
 
                     UINT64 EvictionGracePeriod = GetCurrentEvictionGracePeriod(&LocalMemory);
-                    LRU.TrimAgedAllocations(FirstUncompletedSyncPoint, pEvictionList, NumObjectsToEvict, CurrentTime.QuadPart, EvictionGracePeriod);
+                    Cache.TrimAgedAllocations(FirstUncompletedSyncPoint, pEvictionList, NumObjectsToEvict, CurrentTime.QuadPart, EvictionGracePeriod);
 
                     if (NumObjectsToEvict)
                     {
@@ -1274,7 +1417,7 @@ namespace D3DX12Residency
 
                             if (FAILED(hr) || ObjectsMadeResident != NumObjectsToMakeResident)
                             {
-                                ManagedObject* pResidentHead = LRU.GetResidentListHead();
+                                ManagedObject* pResidentHead = Cache.GetResidentListHead();
 
                                 // Get the next sync point to wait for
                                 FirstUncompletedSyncPoint = DequeueCompletedSyncPoints();
@@ -1296,8 +1439,8 @@ namespace D3DX12Residency
                                     if (Device3)
                                     {
                                         hr = Device3->EnqueueMakeResident(D3D12_RESIDENCY_FLAG_NONE,
-                                                                          NumObjectsInBatch,
-                                                                          &pMakeResidentList[BatchStart].pUnderlying,
+                                                                          NumObjects,
+                                                                          &pMakeResidentList[MakeResidentIndex].pUnderlying,
                                                                           AsyncThreadFence.pFence,
                                                                           AsyncThreadFence.FenceValue + 1);
                                         if (SUCCEEDED(hr))
@@ -1329,7 +1472,7 @@ namespace D3DX12Residency
                                 // Wait until the GPU is done
                                 WaitForSyncPoint(GenerationToWaitFor);
 
-                                LRU.TrimToSyncPointInclusive(TotalUsage + INT64(SizeToMakeResident), TotalBudget, pEvictionList, NumObjectsToEvict, GenerationToWaitFor);
+                                Cache.TrimToSyncPointInclusive(TotalUsage + INT64(SizeToMakeResident), TotalBudget, pEvictionList, NumObjectsToEvict, GenerationToWaitFor);
 
                                 RESIDENCY_CHECK_RESULT(Device->Evict(NumObjectsToEvict, pEvictionList));
                             }
@@ -1492,28 +1635,10 @@ namespace D3DX12Residency
                 }
             }
 
-            // Generate a result between the minimum period and the maximum period based on the current
-            // local memory pressure. I.e. when memory pressure is low, objects will persist longer before
-            // being evicted.
             UINT64 GetCurrentEvictionGracePeriod(DXGI_QUERY_VIDEO_MEMORY_INFO* LocalMemoryState)
             {
-                // 1 == full pressure, 0 == no pressure
-                double Pressure = (double(LocalMemoryState->CurrentUsage) / double(LocalMemoryState->Budget));
-                Pressure = RESIDENCY_MIN(Pressure, 1.0);
-
-                if (Pressure > cTrimPercentageMemoryUsageThreshold)
-                {
-                    // Normalize the pressure for the range 0 to cTrimPercentageMemoryUsageThreshold
-                    Pressure = (Pressure - cTrimPercentageMemoryUsageThreshold) / (1.0 - cTrimPercentageMemoryUsageThreshold);
-
-                    // Linearly interpolate between the min period and the max period based on the pressure
-                    return UINT64((MaxEvictionGracePeriodTicks - MinEvictionGracePeriodTicks) * (1.0 - Pressure)) + MinEvictionGracePeriodTicks;
-                }
-                else
-                {
-                    // Essentially don't trim at all
-                    return MAXUINT64;
-                }
+                return Internal::GetEvictionGracePeriod(LocalMemoryState->CurrentUsage, LocalMemoryState->Budget, cTrimPercentageMemoryUsageThreshold,
+                                                        MinEvictionGracePeriodTicks, MaxEvictionGracePeriodTicks);
             }
 
             LIST_ENTRY QueueFencesListHead;
@@ -1534,7 +1659,13 @@ namespace D3DX12Residency
             // NOTE: This is an index not a mask. The majority of D3D12 uses bit masks to identify a GPU node whereas DXGI uses 0 based indices.
             UINT NodeIndex;
             IDXGIAdapter3* Adapter;
-            Internal::LRUCache LRU;
+
+            LRUResidencyPolicy DefaultPolicy;
+            Internal::ResidencyCache Cache;
+
+            // QPC ticks per second
+            LARGE_INTEGER Frequency;
+            FILE* pTraceFile;
 
             Internal::CriticalSection Mutex;
 
@@ -1566,9 +1697,10 @@ namespace D3DX12Residency
         }
 
         // NOTE: DeviceNodeIndex is an index not a mask. The majority of D3D12 uses bit masks to identify a GPU node whereas DXGI uses 0 based indices.
-        FORCEINLINE HRESULT Initialize(ID3D12Device* ParentDevice, UINT DeviceNodeIndex, IDXGIAdapter* ParentAdapter, UINT32 MaxLatency)
+        // The policy decides which objects to evict; it defaults to least recently used and must outlive the manager.
+        FORCEINLINE HRESULT Initialize(ID3D12Device* ParentDevice, UINT DeviceNodeIndex, IDXGIAdapter* ParentAdapter, UINT32 MaxLatency, ResidencyPolicy* pPolicy = nullptr)
         {
-            return Manager.Initialize(ParentDevice, DeviceNodeIndex, ParentAdapter, MaxLatency);
+            return Manager.Initialize(ParentDevice, DeviceNodeIndex, ParentAdapter, MaxLatency, pPolicy);
         }
 
         FORCEINLINE void Destroy()
@@ -1591,6 +1723,17 @@ namespace D3DX12Residency
             return Manager.GetCurrentGPUSyncPoint(Queue, pCurrentGPUSyncPoint);
         }
 
+        // Record the objects and executions seen by the manager to a trace file for the residency simulator
+        FORCEINLINE HRESULT StartRecording(const wchar_t* Filename)
+        {
+            return Manager.StartRecording(Filename);
+        }
+
+        FORCEINLINE void StopRecording()
+        {
+            Manager.StopRecording();
+        }
+
         // One residency set per command-list
         FORCEINLINE HRESULT ExecuteCommandLists(ID3D12CommandQueue* Queue, ID3D12CommandList** CommandLists, ResidencySet** ResidencySets, UINT32 Count)
         {
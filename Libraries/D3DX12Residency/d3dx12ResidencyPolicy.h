@@ -0,0 +1,225 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+// The eviction policies used by the residency manager. This header only depends on the standard library so that
+// policies can be evaluated by the trace simulator (d3dx12ResidencySimulator.h) on any platform.
+
+#include <algorithm>
+#include <cstdint>
+
+namespace D3DX12Residency
+{
+    // Priority hints use the same scale as D3D12_RESIDENCY_PRIORITY, so those values can be used directly.
+    // Objects with a higher priority are kept resident in preference to objects with a lower priority.
+    const uint32_t cResidencyPriorityMinimum = 0x28000000;
+    const uint32_t cResidencyPriorityLow = 0x50000000;
+    const uint32_t cResidencyPriorityNormal = 0x78000000;
+    const uint32_t cResidencyPriorityHigh = 0xa0010000;
+    const uint32_t cResidencyPriorityMaximum = 0xc8000000;
+
+    // What a policy knows about a resident object which the GPU has finished using.
+    struct ResidencyCandidate
+    {
+        uint64_t Size;
+        uint64_t LastUsedTimestamp;
+        // The number of executions which referenced the object. This is halved whenever the object is evicted,
+        // so objects which were used heavily before being evicted regain their standing quickly.
+        uint64_t UseCount;
+        uint32_t Priority;
+        // Position of the object in recency order, 0 being the least recently used
+        uint32_t Index;
+    };
+
+    // Decides which objects are evicted when the app goes over budget, and how long unused objects may stay
+    // resident when it isn't. Policies only choose between objects which are safe to evict; the residency manager
+    // remains responsible for synchronizing with the GPU.
+    class ResidencyPolicy
+    {
+    public:
+        virtual ~ResidencyPolicy() {}
+
+        virtual const char* GetName() const = 0;
+
+        // Reorder the candidates, which are given least recently used first, so that the preferred victims
+        // come first. BytesToFree is the amount that needs to be evicted to get back under budget.
+        virtual void OrderCandidates(ResidencyCandidate* pCandidates, uint32_t NumCandidates, uint64_t BytesToFree) = 0;
+
+        // How many timestamp ticks an object may go unused before it is trimmed. GracePeriod is derived from the
+        // current memory pressure; the result must not be less than it.
+        virtual uint64_t GetGracePeriod(const ResidencyCandidate& Candidate, uint64_t GracePeriod)
+        {
+            (void)Candidate;
+            return GracePeriod;
+        }
+
+        // Orders the candidates and returns how many of them, from the front, need to be evicted to free BytesToFree.
+        uint32_t SelectVictims(ResidencyCandidate* pCandidates, uint32_t NumCandidates, uint64_t BytesToFree)
+        {
+            if (NumCandidates == 0 || BytesToFree == 0)
+            {
+                return 0;
+            }
+
+            OrderCandidates(pCandidates, NumCandidates, BytesToFree);
+
+            uint64_t BytesFreed = 0;
+            uint32_t NumVictims = 0;
+            while (NumVictims < NumCandidates && BytesFreed < BytesToFree)
+            {
+                BytesFreed += pCandidates[NumVictims++].Size;
+            }
+            return NumVictims;
+        }
+
+    protected:
+        static uint64_t ScaleGracePeriod(uint64_t GracePeriod, uint64_t Scale)
+        {
+            return GracePeriod > UINT64_MAX / Scale ? UINT64_MAX : GracePeriod * Scale;
+        }
+    };
+
+    // Evicts the least recently used objects first. This is the default policy.
+    class LRUResidencyPolicy : public ResidencyPolicy
+    {
+    public:
+        const char* GetName() const override { return "lru"; }
+
+        void OrderCandidates(ResidencyCandidate*, uint32_t, uint64_t) override
+        {
+        }
+    };
+
+    // Evicts as few bytes as possible: the smallest object which covers what is still needed, or the largest object
+    // if none does. This keeps paging traffic down when large, rarely used objects share the budget with small ones.
+    class SizeAwareResidencyPolicy : public ResidencyPolicy
+    {
+    public:
+        const char* GetName() const override { return "size"; }
+
+        void OrderCandidates(ResidencyCandidate* pCandidates, uint32_t NumCandidates, uint64_t BytesToFree) override
+        {
+            // Stable so that objects of the same size are still evicted least recently used first
+            std::stable_sort(pCandidates, pCandidates + NumCandidates,
+                [](const ResidencyCandidate& a, const ResidencyCandidate& b) { return a.Size < b.Size; });
+
+            uint64_t BytesNeeded = BytesToFree;
+            for (uint32_t i = 0; i < NumCandidates && BytesNeeded > 0; i++)
+            {
+                // The unordered candidates [i, NumCandidates) are sorted by size, so the best fit is the first which
+                // covers the remainder, or the last if none does.
+                ResidencyCandidate* pFit = std::find_if(pCandidates + i, pCandidates + NumCandidates,
+                    [BytesNeeded](const ResidencyCandidate& c) { return c.Size >= BytesNeeded; });
+
+                if (pFit == pCandidates + NumCandidates)
+                {
+                    pFit = pCandidates + NumCandidates - 1;
+                }
+
+                // Keep the remainder sorted by size
+                std::rotate(pCandidates + i, pFit, pFit + 1);
+
+                BytesNeeded -= std::min(BytesNeeded, pCandidates[i].Size);
+            }
+        }
+    };
+
+    // Splits the candidates into objects used by only a few executions and frequently used objects, and evicts
+    // from the former first (least recently used first within each), in the spirit of ARC/2Q. Objects streamed in
+    // for a short while then can't push out the app's working set.
+    class FrequencyResidencyPolicy : public ResidencyPolicy
+    {
+    public:
+        FrequencyResidencyPolicy(uint64_t FrequentUseCount = 4) :
+            cFrequentUseCount(FrequentUseCount)
+        {
+        }
+
+        const char* GetName() const override { return "frequency"; }
+
+        void OrderCandidates(ResidencyCandidate* pCandidates, uint32_t NumCandidates, uint64_t) override
+        {
+            const uint64_t FrequentUseCount = cFrequentUseCount;
+            std::stable_partition(pCandidates, pCandidates + NumCandidates,
+                [FrequentUseCount](const ResidencyCandidate& c) { return c.UseCount < FrequentUseCount; });
+        }
+
+        // Frequently used objects are kept for twice as long before they are trimmed
+        uint64_t GetGracePeriod(const ResidencyCandidate& Candidate, uint64_t GracePeriod) override
+        {
+            return Candidate.UseCount >= cFrequentUseCount ? ScaleGracePeriod(GracePeriod, 2) : GracePeriod;
+        }
+
+    private:
+        const uint64_t cFrequentUseCount;
+    };
+
+    // Evicts objects with a lower priority hint first, least recently used first among equal priorities. Objects
+    // above normal priority are also kept for longer before they are trimmed.
+    class PriorityResidencyPolicy : public ResidencyPolicy
+    {
+    public:
+        const char* GetName() const override { return "priority"; }
+
+        void OrderCandidates(ResidencyCandidate* pCandidates, uint32_t NumCandidates, uint64_t) override
+        {
+            std::stable_sort(pCandidates, pCandidates + NumCandidates,
+                [](const ResidencyCandidate& a, const ResidencyCandidate& b) { return a.Priority < b.Priority; });
+        }
+
+        uint64_t GetGracePeriod(const ResidencyCandidate& Candidate, uint64_t GracePeriod) override
+        {
+            uint64_t Scale = 1;
+            if (Candidate.Priority >= cResidencyPriorityMaximum)
+            {
+                Scale = 8;
+            }
+            else if (Candidate.Priority >= cResidencyPriorityHigh)
+            {
+                Scale = 4;
+            }
+            else if (Candidate.Priority > cResidencyPriorityNormal)
+            {
+                Scale = 2;
+            }
+            return ScaleGracePeriod(GracePeriod, Scale);
+        }
+    };
+
+    namespace Internal
+    {
+        // Generate a result between the minimum period and the maximum period based on the current
+        // local memory pressure. I.e. when memory pressure is low, objects will persist longer before
+        // being evicted.
+        inline uint64_t GetEvictionGracePeriod(uint64_t CurrentUsage, uint64_t Budget, double TrimPercentageMemoryUsageThreshold,
+                                               uint64_t MinEvictionGracePeriodTicks, uint64_t MaxEvictionGracePeriodTicks)
+        {
+            // 1 == full pressure, 0 == no pressure
+            double Pressure = (double(CurrentUsage) / double(Budget));
+            Pressure = Pressure < 1.0 ? Pressure : 1.0;
+
+            if (Pressure > TrimPercentageMemoryUsageThreshold)
+            {
+                // Normalize the pressure for the range 0 to TrimPercentageMemoryUsageThreshold
+                Pressure = (Pressure - TrimPercentageMemoryUsageThreshold) / (1.0 - TrimPercentageMemoryUsageThreshold);
+
+                // Linearly interpolate between the min period and the max period based on the pressure
+                return uint64_t((MaxEvictionGracePeriodTicks - MinEvictionGracePeriodTicks) * (1.0 - Pressure)) + MinEvictionGracePeriodTicks;
+            }
+            else
+            {
+                // Essentially don't trim at all
+                return UINT64_MAX;
+            }
+        }
+    }
+};
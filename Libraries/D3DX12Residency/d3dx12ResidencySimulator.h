@@ -0,0 +1,519 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+// Replays traces recorded with ResidencyManager::StartRecording against a simulated device with a fixed budget, so
+// residency policies and budgets can be compared without a GPU. Like d3dx12ResidencyPolicy.h this only depends on
+// the standard library.
+
+#include "d3dx12ResidencyPolicy.h"
+
+#include <istream>
+#include <list>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace D3DX12Residency
+{
+    // A recorded stream of the objects tracked by a residency manager and the residency sets it executed
+    struct ResidencyTrace
+    {
+        enum class EVENT_TYPE
+        {
+            CREATE,
+            DESTROY,
+            EXECUTE
+        };
+
+        struct Object
+        {
+            uint64_t Size;
+            uint32_t Priority;
+            bool Resident;
+        };
+
+        struct Event
+        {
+            Event(EVENT_TYPE TypeIn, uint32_t ObjectIn = 0) : Type(TypeIn), Object(ObjectIn), Timestamp(0) {}
+
+            EVENT_TYPE Type;
+            // The object created or destroyed
+            uint32_t Object;
+            // The time and the unique objects referenced by an execution
+            uint64_t Timestamp;
+            std::vector<uint32_t> Objects;
+        };
+
+        ResidencyTrace() : Frequency(0) {}
+
+        // Returns false and describes the problem in pError if the stream isn't a valid trace
+        bool Load(std::istream& Stream, std::string* pError = nullptr)
+        {
+            Objects.clear();
+            Events.clear();
+            Frequency = 0;
+
+            // Recorded ids are object addresses which may be reused once an object is destroyed, so every create
+            // gets its own object
+            std::unordered_map<uint64_t, uint32_t> LiveObjects;
+
+            std::string Line;
+            uint32_t LineNumber = 0;
+            bool HeaderFound = false;
+            while (std::getline(Stream, Line))
+            {
+                LineNumber++;
+
+                std::istringstream Tokens(Line);
+                std::string Type;
+                if (!(Tokens >> Type) || Type[0] == '#')
+                {
+                    continue;
+                }
+
+                bool Valid = true;
+                if (!HeaderFound)
+                {
+                    uint32_t Version = 0;
+                    Valid = Type == "residency-trace" && (Tokens >> Version) && Version == 1;
+                    HeaderFound = Valid;
+                }
+                else if (Type == "frequency")
+                {
+                    Valid = !!(Tokens >> Frequency) && Frequency > 0;
+                }
+                else if (Type == "create")
+                {
+                    uint64_t Id = 0;
+                    uint32_t Resident = 0;
+                    Object NewObject = {};
+                    Valid = !!(Tokens >> std::hex >> Id >> std::dec >> NewObject.Size >> NewObject.Priority >> Resident);
+                    if (Valid)
+                    {
+                        NewObject.Resident = Resident != 0;
+                        LiveObjects[Id] = uint32_t(Objects.size());
+
+                        Events.push_back(Event(EVENT_TYPE::CREATE, uint32_t(Objects.size())));
+                        Objects.push_back(NewObject);
+                    }
+                }
+                else if (Type == "destroy")
+                {
+                    uint64_t Id = 0;
+                    Valid = !!(Tokens >> std::hex >> Id);
+
+                    auto Found = LiveObjects.find(Id);
+                    Valid = Valid && Found != LiveObjects.end();
+                    if (Valid)
+                    {
+                        Events.push_back(Event(EVENT_TYPE::DESTROY, Found->second));
+                        LiveObjects.erase(Found);
+                    }
+                }
+                else if (Type == "execute")
+                {
+                    Event NewEvent(EVENT_TYPE::EXECUTE);
+                    Valid = !!(Tokens >> NewEvent.Timestamp);
+
+                    uint64_t Id = 0;
+                    while (Valid && (Tokens >> std::hex >> Id))
+                    {
+                        auto Found = LiveObjects.find(Id);
+                        Valid = Found != LiveObjects.end();
+                        if (Valid)
+                        {
+                            NewEvent.Objects.push_back(Found->second);
+                        }
+                    }
+
+                    if (Valid)
+                    {
+                        Events.push_back(std::move(NewEvent));
+                    }
+                }
+                else
+                {
+                    Valid = false;
+                }
+
+                if (!Valid)
+                {
+                    if (pError)
+                    {
+                        *pError = "Invalid residency trace at line " + std::to_string(LineNumber) + ": " + Line;
+                    }
+                    return false;
+                }
+            }
+
+            if (!HeaderFound || Frequency == 0)
+            {
+                if (pError)
+                {
+                    *pError = "Missing residency trace header";
+                }
+                return false;
+            }
+            return true;
+        }
+
+        // Timestamp ticks per second
+        uint64_t Frequency;
+        std::vector<Object> Objects;
+        std::vector<Event> Events;
+    };
+
+    struct ResidencySimulationSettings
+    {
+        ResidencySimulationSettings() :
+            Budget(0),
+            MaxLatency(3),
+            ThrashWindow(16),
+            MinEvictionGracePeriod(1.0),
+            MaxEvictionGracePeriod(60.0),
+            TrimPercentageMemoryUsageThreshold(0.7)
+        {
+        }
+
+        // Bytes of video memory available to the app
+        uint64_t Budget;
+        // How many executions the simulated GPU may be behind the CPU
+        uint32_t MaxLatency;
+        // An object made resident again within this many executions of being evicted counts as thrashing
+        uint32_t ThrashWindow;
+
+        // The residency manager's eviction grace period parameters, in seconds
+        double MinEvictionGracePeriod;
+        double MaxEvictionGracePeriod;
+        double TrimPercentageMemoryUsageThreshold;
+    };
+
+    struct ResidencySimulationResults
+    {
+        uint64_t Executions;
+
+        uint64_t ObjectsMadeResident;
+        uint64_t BytesMadeResident;
+
+        // Objects evicted to get back under budget
+        uint64_t ObjectsEvicted;
+        uint64_t BytesEvicted;
+
+        // Objects evicted because they went unused for longer than the grace period
+        uint64_t ObjectsTrimmed;
+        uint64_t BytesTrimmed;
+
+        // Times the CPU had to wait for the GPU to finish with objects before it could evict them
+        uint64_t Stalls;
+
+        // Objects made resident again shortly after being evicted
+        uint64_t ThrashEvents;
+
+        // Executions which couldn't fit within the budget even after evicting everything possible
+        uint64_t OverBudgetExecutions;
+
+        uint64_t PeakUsage;
+    };
+
+    // Models the residency manager's paging work against a device with a fixed budget. The simulated GPU finishes
+    // each execution once MaxLatency newer ones have been submitted, unless the CPU waits for it first, and paging
+    // is instantaneous. Local and non-local memory are treated as a single budget.
+    class ResidencySimulator
+    {
+    public:
+        ResidencySimulator(const ResidencyTrace& TraceIn, ResidencyPolicy& PolicyIn, const ResidencySimulationSettings& SettingsIn) :
+            Trace(TraceIn),
+            Policy(PolicyIn),
+            Settings(SettingsIn)
+        {
+        }
+
+        ResidencySimulationResults Run()
+        {
+            Results = ResidencySimulationResults();
+            States.assign(Trace.Objects.size(), ObjectState());
+            ResidentObjects.clear();
+            Usage = 0;
+            CompletedSyncPoint = 0;
+
+            MinEvictionGracePeriodTicks = uint64_t(Trace.Frequency * Settings.MinEvictionGracePeriod);
+            MaxEvictionGracePeriodTicks = uint64_t(Trace.Frequency * Settings.MaxEvictionGracePeriod);
+
+            for (const ResidencyTrace::Event& Event : Trace.Events)
+            {
+                switch (Event.Type)
+                {
+                case ResidencyTrace::EVENT_TYPE::CREATE:
+                    Create(Event.Object);
+                    break;
+                case ResidencyTrace::EVENT_TYPE::DESTROY:
+                    Destroy(Event.Object);
+                    break;
+                case ResidencyTrace::EVENT_TYPE::EXECUTE:
+                    Execute(Event);
+                    break;
+                }
+            }
+
+            return Results;
+        }
+
+    private:
+        struct ObjectState
+        {
+            ObjectState() :
+                Resident(false),
+                LastGPUSyncPoint(0),
+                LastUsedTimestamp(0),
+                UseCount(0),
+                LastEvicted(UINT64_MAX)
+            {
+            }
+
+            bool Resident;
+            uint64_t LastGPUSyncPoint;
+            uint64_t LastUsedTimestamp;
+            uint64_t UseCount;
+            // The execution at which the object was last evicted
+            uint64_t LastEvicted;
+            std::list<uint32_t>::iterator ListEntry;
+        };
+
+        void Create(uint32_t Object)
+        {
+            ObjectState& State = States[Object];
+            State.Resident = Trace.Objects[Object].Resident;
+
+            // New objects are the first candidates for eviction, as in ResidencyCache::Insert
+            if (State.Resident)
+            {
+                State.ListEntry = ResidentObjects.insert(ResidentObjects.begin(), Object);
+                AddUsage(Trace.Objects[Object].Size);
+            }
+        }
+
+        void Destroy(uint32_t Object)
+        {
+            ObjectState& State = States[Object];
+            if (State.Resident)
+            {
+                ResidentObjects.erase(State.ListEntry);
+                Usage -= Trace.Objects[Object].Size;
+                State.Resident = false;
+            }
+        }
+
+        // Mirrors ResidencyManagerInternal::ProcessPagingWork
+        void Execute(const ResidencyTrace::Event& Event)
+        {
+            // Sync points start at 1 so objects which have never been used can always be evicted
+            const uint64_t SyncPoint = ++Results.Executions;
+
+            // The GPU has finished everything but the last MaxLatency executions
+            if (SyncPoint > uint64_t(Settings.MaxLatency) + 1)
+            {
+                CompletedSyncPoint = std::max(CompletedSyncPoint, SyncPoint - 1 - Settings.MaxLatency);
+            }
+
+            std::vector<uint32_t> MakeResidentList;
+            uint64_t SizeToMakeResident = 0;
+
+            for (uint32_t Object : Event.Objects)
+            {
+                ObjectState& State = States[Object];
+                if (!State.Resident)
+                {
+                    if (State.LastEvicted != UINT64_MAX && SyncPoint - State.LastEvicted <= Settings.ThrashWindow)
+                    {
+                        Results.ThrashEvents++;
+                    }
+
+                    State.Resident = true;
+                    State.ListEntry = ResidentObjects.insert(ResidentObjects.end(), Object);
+
+                    MakeResidentList.push_back(Object);
+                    SizeToMakeResident += Trace.Objects[Object].Size;
+                }
+
+                State.LastGPUSyncPoint = SyncPoint;
+                State.LastUsedTimestamp = Event.Timestamp;
+                State.UseCount++;
+                ResidentObjects.splice(ResidentObjects.end(), ResidentObjects, State.ListEntry);
+            }
+
+            const uint64_t GracePeriod = Internal::GetEvictionGracePeriod(Usage, Settings.Budget, Settings.TrimPercentageMemoryUsageThreshold,
+                                                                          MinEvictionGracePeriodTicks, MaxEvictionGracePeriodTicks);
+            TrimAgedAllocations(SyncPoint, Event.Timestamp, GracePeriod);
+
+            size_t MakeResidentIndex = 0;
+            while (MakeResidentIndex < MakeResidentList.size())
+            {
+                // Make resident as much as fits in the budget
+                uint64_t AvailableSpace = Settings.Budget > Usage ? Settings.Budget - Usage : 0;
+                for (; MakeResidentIndex < MakeResidentList.size(); MakeResidentIndex++)
+                {
+                    const uint64_t Size = Trace.Objects[MakeResidentList[MakeResidentIndex]].Size;
+                    if (Size > AvailableSpace)
+                    {
+                        break;
+                    }
+
+                    AvailableSpace -= Size;
+                    SizeToMakeResident -= Size;
+                    MakeResident(Size);
+                }
+
+                if (MakeResidentIndex == MakeResidentList.size())
+                {
+                    break;
+                }
+
+                // If there is nothing to trim OR the only objects 'Resident' are the ones about to be used by this execute,
+                // make the rest resident regardless of the budget
+                const uint64_t FirstUncompletedSyncPoint = CompletedSyncPoint + 1;
+                if (ResidentObjects.empty() ||
+                    States[ResidentObjects.front()].LastGPUSyncPoint >= SyncPoint ||
+                    FirstUncompletedSyncPoint >= SyncPoint)
+                {
+                    for (; MakeResidentIndex < MakeResidentList.size(); MakeResidentIndex++)
+                    {
+                        MakeResident(Trace.Objects[MakeResidentList[MakeResidentIndex]].Size);
+                    }
+                    SizeToMakeResident = 0;
+
+                    Results.OverBudgetExecutions++;
+                    break;
+                }
+
+                // Wait until the GPU is done
+                Results.Stalls++;
+                CompletedSyncPoint = FirstUncompletedSyncPoint;
+
+                TrimToSyncPointInclusive(Usage + SizeToMakeResident, FirstUncompletedSyncPoint);
+            }
+        }
+
+        // Mirrors ResidencyCache::TrimAgedAllocations
+        void TrimAgedAllocations(uint64_t SyncPoint, uint64_t CurrentTimeStamp, uint64_t MinDelta)
+        {
+            const bool AnyUncompleted = CompletedSyncPoint + 1 < SyncPoint;
+
+            auto Entry = ResidentObjects.begin();
+            while (Entry != ResidentObjects.end())
+            {
+                const uint32_t Object = *Entry++;
+                const ObjectState& State = States[Object];
+
+                const uint64_t Age = CurrentTimeStamp - State.LastUsedTimestamp;
+                if ((AnyUncompleted && State.LastGPUSyncPoint > CompletedSyncPoint) || Age <= MinDelta)
+                {
+                    break;
+                }
+
+                if (Age > Policy.GetGracePeriod(GetCandidate(Object, 0), MinDelta))
+                {
+                    Evict(Object);
+                    Results.ObjectsTrimmed++;
+                    Results.BytesTrimmed += Trace.Objects[Object].Size;
+                }
+            }
+        }
+
+        // Mirrors ResidencyCache::TrimToSyncPointInclusive
+        void TrimToSyncPointInclusive(uint64_t CurrentUsage, uint64_t SyncPoint)
+        {
+            if (CurrentUsage < Settings.Budget)
+            {
+                return;
+            }
+
+            Objects.clear();
+            Candidates.clear();
+            for (uint32_t Object : ResidentObjects)
+            {
+                if (States[Object].LastGPUSyncPoint > SyncPoint)
+                {
+                    break;
+                }
+
+                Candidates.push_back(GetCandidate(Object, uint32_t(Objects.size())));
+                Objects.push_back(Object);
+            }
+
+            const uint32_t NumVictims = Policy.SelectVictims(Candidates.data(), uint32_t(Candidates.size()), CurrentUsage - Settings.Budget + 1);
+            for (uint32_t i = 0; i < NumVictims; i++)
+            {
+                const uint32_t Object = Objects[Candidates[i].Index];
+                Evict(Object);
+                Results.ObjectsEvicted++;
+                Results.BytesEvicted += Trace.Objects[Object].Size;
+            }
+        }
+
+        ResidencyCandidate GetCandidate(uint32_t Object, uint32_t Index) const
+        {
+            ResidencyCandidate Candidate;
+            Candidate.Size = Trace.Objects[Object].Size;
+            Candidate.LastUsedTimestamp = States[Object].LastUsedTimestamp;
+            Candidate.UseCount = States[Object].UseCount;
+            Candidate.Priority = Trace.Objects[Object].Priority;
+            Candidate.Index = Index;
+            return Candidate;
+        }
+
+        void MakeResident(uint64_t Size)
+        {
+            Results.ObjectsMadeResident++;
+            Results.BytesMadeResident += Size;
+            AddUsage(Size);
+        }
+
+        void Evict(uint32_t Object)
+        {
+            ObjectState& State = States[Object];
+            ResidentObjects.erase(State.ListEntry);
+            State.Resident = false;
+            State.UseCount /= 2;
+            State.LastEvicted = Results.Executions;
+
+            Usage -= Trace.Objects[Object].Size;
+        }
+
+        void AddUsage(uint64_t Size)
+        {
+            Usage += Size;
+            Results.PeakUsage = std::max(Results.PeakUsage, Usage);
+        }
+
+        const ResidencyTrace& Trace;
+        ResidencyPolicy& Policy;
+        const ResidencySimulationSettings Settings;
+
+        ResidencySimulationResults Results;
+
+        std::vector<ObjectState> States;
+        // Resident objects, least recently used first
+        std::list<uint32_t> ResidentObjects;
+        // Bytes resident on the simulated device
+        uint64_t Usage;
+        uint64_t CompletedSyncPoint;
+
+        uint64_t MinEvictionGracePeriodTicks;
+        uint64_t MaxEvictionGracePeriodTicks;
+
+        // Scratch space for TrimToSyncPointInclusive
+        std::vector<uint32_t> Objects;
+        std::vector<ResidencyCandidate> Candidates;
+    };
+};
@@ -26,6 +26,12 @@
 
 using namespace Graphics;
 
+namespace
+{
+    // The upload batch open on this thread, and the bytes of upload memory it has reserved
+    thread_local CommandContext* s_UploadBatch = nullptr;
+    thread_local size_t s_UploadBatchSize = 0;
+}
 
 void ContextManager::DestroyAllContexts(void)
 {
@@ -448,17 +454,46 @@ void CommandContext::InitializeTexture( GpuResource& Dest, UINT NumSubresources,
 {
     UINT64 uploadBufferSize = GetRequiredIntermediateSize(Dest.GetResource(), 0, NumSubresources);
 
-    CommandContext& InitContext = CommandContext::Begin();
+    CommandContext& InitContext = s_UploadBatch != nullptr ? *s_UploadBatch : CommandContext::Begin();
 
     // copy data to the intermediate upload heap and then schedule a copy from the upload heap to the default texture
     DynAlloc mem = InitContext.ReserveUploadMemory(uploadBufferSize);
     UpdateSubresources(InitContext.m_CommandList, Dest.GetResource(), mem.Buffer.GetResource(), 0, 0, NumSubresources, SubData);
     InitContext.TransitionResource(Dest, D3D12_RESOURCE_STATE_GENERIC_READ);
 
+    if (s_UploadBatch != nullptr)
+    {
+        s_UploadBatchSize += (size_t)uploadBufferSize;
+        return;
+    }
+
     // Execute the command list and wait for it to finish so we can release the upload buffer
     InitContext.Finish(true);
 }
 
+void CommandContext::BeginUploadBatch(void)
+{
+    ASSERT(s_UploadBatch == nullptr, "An upload batch is already open on this thread");
+    s_UploadBatch = &CommandContext::Begin();
+    s_UploadBatchSize = 0;
+}
+
+uint64_t CommandContext::EndUploadBatch( bool WaitForCompletion )
+{
+    ASSERT(s_UploadBatch != nullptr, "No upload batch is open on this thread");
+
+    // The upload memory is retired with the batch's fence, so there's no need to wait to release it
+    uint64_t FenceValue = s_UploadBatch->Finish(WaitForCompletion);
+    s_UploadBatch = nullptr;
+    s_UploadBatchSize = 0;
+    return FenceValue;
+}
+
+size_t CommandContext::GetUploadBatchSize(void)
+{
+    return s_UploadBatchSize;
+}
+
 void CommandContext::CopySubresource(GpuResource& Dest, UINT DestSubIndex, GpuResource& Src, UINT SrcSubIndex)
 {
     FlushResourceBarriers();
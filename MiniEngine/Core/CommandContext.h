@@ -130,6 +130,13 @@ public:
     }
 
     static void InitializeTexture( GpuResource& Dest, UINT NumSubresources, D3D12_SUBRESOURCE_DATA SubData[] );
+
+    // While an upload batch is open on the calling thread, InitializeTexture() records into the batch instead of
+    // submitting and waiting for each texture.  The textures must not be used until the batch is ended.
+    static void BeginUploadBatch(void);
+    static uint64_t EndUploadBatch( bool WaitForCompletion = false );
+    static size_t GetUploadBatchSize(void);
+
     static void InitializeBuffer( GpuResource& Dest, const void* Data, size_t NumBytes, size_t Offset = 0);
     static void InitializeTextureArraySlice(GpuResource& Dest, UINT SliceIndex, GpuResource& Src);
     static void ReadbackTexture2D(GpuResource& ReadbackBuffer, PixelBuffer& SrcBuffer);
@@ -13,8 +13,10 @@
 
 #include "pch.h"
 #include "FileUtility.h"
+#include "SystemTime.h"
 #include <fstream>
 #include <mutex>
+#include <atomic>
 #include <zlib.h> // From NuGet package 
 
 using namespace std;
@@ -57,72 +59,420 @@ ByteArray ReadFileHelperEx( shared_ptr<wstring> fileName)
     return ReadFileHelper(*fileName);
 }
 
-ByteArray Inflate(ByteArray CompressedSource, int& err, uint32_t ChunkSize = 0x100000 ) 
+namespace
 {
-    // Create a dynamic buffer to hold compressed blocks
-    vector<unique_ptr<byte> > blocks;
+    // Maps a file read-only, so compressed data is paged in as it's decoded rather than copied into memory up front
+    class MappedFile
+    {
+    public:
+        MappedFile( const wstring& fileName ) : m_File(INVALID_HANDLE_VALUE), m_Mapping(nullptr), m_Data(nullptr), m_Size(0)
+        {
+            m_File = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (m_File == INVALID_HANDLE_VALUE)
+                return;
+
+            // Empty files can't be mapped
+            LARGE_INTEGER FileSize;
+            if (!GetFileSizeEx(m_File, &FileSize) || FileSize.QuadPart == 0)
+                return;
+
+            m_Mapping = CreateFileMappingW(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (m_Mapping == nullptr)
+                return;
+
+            m_Data = (const byte*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+            if (m_Data != nullptr)
+                m_Size = (size_t)FileSize.QuadPart;
+        }
+
+        ~MappedFile()
+        {
+            if (m_Data != nullptr)
+                UnmapViewOfFile(m_Data);
+            if (m_Mapping != nullptr)
+                CloseHandle(m_Mapping);
+            if (m_File != INVALID_HANDLE_VALUE)
+                CloseHandle(m_File);
+        }
+
+        const byte* GetData( void ) const { return m_Data; }
+        size_t GetSize( void ) const { return m_Size; }
+
+    private:
+        MappedFile( const MappedFile& ) = delete;
+        MappedFile& operator=( const MappedFile& ) = delete;
+
+        HANDLE m_File;
+        HANDLE m_Mapping;
+        const byte* m_Data;
+        size_t m_Size;
+    };
+
+    // RFC 1952
+    enum
+    {
+        kGzipFlagHeaderCrc = 0x02,
+        kGzipFlagExtra = 0x04,
+        kGzipFlagName = 0x08,
+        kGzipFlagComment = 0x10,
+
+        kGzipHeaderSize = 10,
+        kGzipTrailerSize = 8,
+    };
+
+    uint16_t ReadLE16( const byte* p ) { return (uint16_t)(p[0] | p[1] << 8); }
+    uint32_t ReadLE32( const byte* p ) { return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24; }
+
+    bool IsGzip( const byte* Data, size_t Size )
+    {
+        return Size >= kGzipHeaderSize + kGzipTrailerSize && Data[0] == 0x1f && Data[1] == 0x8b && Data[2] == Z_DEFLATED;
+    }
+
+    // A gzip member of a blocked archive, which records its compressed size in a "BC" extra subfield as BGZF does.
+    // Blocked members can be located without decoding the ones before them, so they're decoded in parallel.
+    struct BlockedMember
+    {
+        size_t SrcOffset;   // deflate stream
+        size_t SrcSize;
+        size_t DestOffset;
+        uint32_t DestSize;  // ISIZE
+        uint32_t Crc;
+    };
+
+    // Returns the size of the member's header, and its total size if it's recorded (otherwise 0)
+    bool ParseGzipHeader( const byte* Data, size_t Size, size_t& HeaderSize, size_t& MemberSize )
+    {
+        if (!IsGzip(Data, Size))
+            return false;
+
+        const byte Flags = Data[3];
+        size_t Pos = kGzipHeaderSize;
+        MemberSize = 0;
+
+        if (Flags & kGzipFlagExtra)
+        {
+            if (Pos + 2 > Size)
+                return false;
+
+            const size_t ExtraEnd = Pos + 2 + ReadLE16(Data + Pos);
+            if (ExtraEnd > Size)
+                return false;
 
-    z_stream strm  = {};
-    strm.data_type = Z_BINARY;
-    strm.total_in  = strm.avail_in  = (uInt)CompressedSource->size();
-    strm.next_in   = CompressedSource->data();
+            for (Pos += 2; Pos + 4 <= ExtraEnd; Pos += 4 + ReadLE16(Data + Pos + 2))
+            {
+                if (Data[Pos] == 'B' && Data[Pos + 1] == 'C' && ReadLE16(Data + Pos + 2) == 2 && Pos + 6 <= ExtraEnd)
+                    MemberSize = (size_t)ReadLE16(Data + Pos + 4) + 1;
+            }
+            Pos = ExtraEnd;
+        }
 
-    err = inflateInit2(&strm, (15 + 32)); //15 window bits, and the +32 tells zlib to to detect if using gzip or zlib
+        for (byte StringFlag : { (byte)kGzipFlagName, (byte)kGzipFlagComment })
+        {
+            if (Flags & StringFlag)
+            {
+                while (Pos < Size && Data[Pos] != 0)
+                    ++Pos;
+                ++Pos;
+            }
+        }
 
-    while (err == Z_OK || err == Z_BUF_ERROR)
+        if (Flags & kGzipFlagHeaderCrc)
+            Pos += 2;
+
+        HeaderSize = Pos;
+        return Pos + kGzipTrailerSize <= Size && (MemberSize == 0 || (MemberSize >= Pos + kGzipTrailerSize && MemberSize <= Size));
+    }
+
+    // Locates every member of a blocked archive.  Fails if any member doesn't record its size.
+    bool FindBlockedMembers( const byte* Data, size_t Size, vector<BlockedMember>& Members, size_t& DecompressedSize )
     {
-        strm.avail_out = ChunkSize;
-        strm.next_out = (byte*)malloc(ChunkSize);
-        blocks.emplace_back(strm.next_out);
-        err = inflate(&strm, Z_NO_FLUSH);
+        DecompressedSize = 0;
+
+        for (size_t Pos = 0; Pos < Size; )
+        {
+            size_t HeaderSize, MemberSize;
+            if (!ParseGzipHeader(Data + Pos, Size - Pos, HeaderSize, MemberSize) || MemberSize == 0)
+                return false;
+
+            const byte* Trailer = Data + Pos + MemberSize - kGzipTrailerSize;
+
+            BlockedMember Member;
+            Member.SrcOffset = Pos + HeaderSize;
+            Member.SrcSize = MemberSize - HeaderSize - kGzipTrailerSize;
+            Member.DestOffset = DecompressedSize;
+            Member.Crc = ReadLE32(Trailer);
+            Member.DestSize = ReadLE32(Trailer + 4);
+            Members.push_back(Member);
+
+            DecompressedSize += Member.DestSize;
+            Pos += MemberSize;
+        }
+
+        return Members.size() > 1;
     }
 
-    if (err != Z_STREAM_END) 
+    // Inflates one blocked member into exactly its recorded size, verifying its CRC
+    bool InflateBlockedMember( const byte* Src, const BlockedMember& Member, byte* Dest )
     {
+        byte Empty;
+
+        z_stream strm = {};
+        if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+            return false;
+
+        strm.next_in = (Bytef*)Src + Member.SrcOffset;
+        strm.avail_in = (uInt)Member.SrcSize;
+        strm.next_out = Member.DestSize > 0 ? Dest + Member.DestOffset : &Empty;
+        strm.avail_out = Member.DestSize;
+
+        int err = inflate(&strm, Z_FINISH);
+        bool Succeeded = err == Z_STREAM_END && strm.total_out == Member.DestSize;
         inflateEnd(&strm);
-        return NullFile;
+
+        return Succeeded && crc32(0, Dest + Member.DestOffset, Member.DestSize) == Member.Crc;
     }
 
-    ASSERT(strm.total_out > 0, "Nothing to decompress");
+    // Inflates a zlib or gzip stream, continuing through concatenated gzip members, into one window of output at a
+    // time.  The source stays mapped, so it's fed to zlib directly.
+    class StreamInflater
+    {
+    public:
+        StreamInflater( const byte* Src, size_t SrcSize ) : m_Stream(), m_Remaining(SrcSize), m_Members(0)
+        {
+            m_Stream.next_in = (Bytef*)Src;
+            m_Error = inflateInit2(&m_Stream, MAX_WBITS + 32); // +32 tells zlib to detect gzip or zlib headers
+            m_Initialized = m_Error == Z_OK;
+        }
+
+        ~StreamInflater()
+        {
+            if (m_Initialized)
+                inflateEnd(&m_Stream);
+        }
+
+        // Fills the window, returning Z_OK if it filled before the end of the stream, Z_STREAM_END at the end, or
+        // a zlib error.
+        int Inflate( byte* Window, size_t WindowSize, size_t& Written )
+        {
+            Written = 0;
+
+            while (m_Error == Z_OK && Written < WindowSize)
+            {
+                if (m_Stream.avail_in == 0)
+                {
+                    m_Stream.avail_in = (uInt)min(m_Remaining, (size_t)kMaxStep);
+                    m_Remaining -= m_Stream.avail_in;
+                }
+
+                m_Stream.next_out = Window + Written;
+                m_Stream.avail_out = (uInt)min(WindowSize - Written, (size_t)kMaxStep);
+
+                uInt AvailOut = m_Stream.avail_out;
+                int err = inflate(&m_Stream, Z_NO_FLUSH);
+                Written += AvailOut - m_Stream.avail_out;
+
+                if (err == Z_STREAM_END)
+                {
+                    ++m_Members;
+                    if (!StartNextMember())
+                        m_Error = Z_STREAM_END;
+                }
+                else if (err == Z_BUF_ERROR && m_Stream.avail_in == 0 && m_Remaining == 0)
+                    m_Error = Z_DATA_ERROR; // truncated
+                else if (err != Z_OK && err != Z_BUF_ERROR)
+                    m_Error = err;
+            }
+
+            return m_Error;
+        }
+
+        uint32_t GetMemberCount( void ) const { return m_Members; }
 
-    Utility::ByteArray byteArray = make_shared<vector<byte> >( strm.total_out );
+    private:
+        static const uint32_t kMaxStep = 1u << 30;
 
-    // Allocate actual memory for this.
-    // copy the bits into that RAM.
-    // Free everything else up!!
-    void* curDest = byteArray->data();
-    size_t remaining = byteArray->size();
+        // Gzip members may be concatenated.  Anything else after the stream is ignored, as gzip does.
+        bool StartNextMember( void )
+        {
+            size_t Left = m_Stream.avail_in + m_Remaining;
+            if (Left < 2 || m_Stream.next_in[0] != 0x1f || m_Stream.next_in[1] != 0x8b)
+                return false;
 
-    for (size_t i = 0; i < blocks.size(); ++i)
+            return inflateReset(&m_Stream) == Z_OK;
+        }
+
+        z_stream m_Stream;
+        size_t m_Remaining;
+        uint32_t m_Members;
+        int m_Error;
+        bool m_Initialized;
+    };
+
+    ByteArray InflateSequential( const byte* Src, size_t SrcSize, InflateStats& Stats )
     {
-        ASSERT(remaining > 0);
+        // A gzip trailer records the size of its member, which is the whole file unless members were concatenated.
+        // Otherwise start from a guess, and grow as needed.  The trailer isn't checked until the end, so a corrupt
+        // one mustn't be able to demand an arbitrarily large buffer up front.
+        const size_t kMaxSizeHintRatio = 64;
+
+        size_t SizeHint = IsGzip(Src, SrcSize) ? ReadLE32(Src + SrcSize - 4) : 0;
+        if (SizeHint == 0)
+            SizeHint = SrcSize * 4;
+        SizeHint = min(SizeHint, SrcSize * kMaxSizeHintRatio);
+
+        ByteArray Dest = make_shared<vector<byte> >( SizeHint );
+        StreamInflater Inflater(Src, SrcSize);
+        size_t Total = 0;
+
+        for (;;)
+        {
+            size_t Written;
+            Stats.Error = Inflater.Inflate(Dest->data() + Total, Dest->size() - Total, Written);
+            Total += Written;
+
+            if (Stats.Error != Z_OK)
+                break;
 
-        size_t CopySize = min(remaining, (size_t)ChunkSize);
+            // The destination is full; finish into a small window in case the stream ends exactly here
+            byte Probe[4096];
+            Stats.Error = Inflater.Inflate(Probe, sizeof(Probe), Written);
+            if (Written > 0)
+            {
+                Dest->resize(max(Total * 2, Total + Written));
+                memcpy(Dest->data() + Total, Probe, Written);
+                Total += Written;
+            }
 
-        memcpy(curDest, blocks[i].get(), CopySize);
-        curDest = (byte*)curDest + CopySize;
-        remaining -= CopySize;
+            if (Stats.Error != Z_OK)
+                break;
+        }
+
+        Stats.Members = Inflater.GetMemberCount();
+
+        if (Stats.Error != Z_STREAM_END || Total == 0)
+            return NullFile;
+
+        Dest->resize(Total);
+        return Dest;
     }
 
-    inflateEnd(&strm);
+    ByteArray InflateBlocked( const byte* Src, const vector<BlockedMember>& Members, size_t DecompressedSize, InflateStats& Stats )
+    {
+        if (DecompressedSize == 0)
+            return NullFile;
 
-    return byteArray;
+        ByteArray Dest = make_shared<vector<byte> >( DecompressedSize );
+        atomic<bool> Succeeded(true);
+
+        parallel_for(size_t(0), Members.size(), [&]( size_t i )
+        {
+            if (!InflateBlockedMember(Src, Members[i], Dest->data()))
+                Succeeded = false;
+        });
+
+        Stats.Members = (uint32_t)Members.size();
+        Stats.Parallel = true;
+        Stats.Error = Succeeded ? Z_STREAM_END : Z_DATA_ERROR;
+
+        return Succeeded ? Dest : NullFile;
+    }
+}
+
+ByteArray Utility::InflateFile( const wstring& fileName, InflateStats* pStats )
+{
+    InflateStats Stats = {};
+    int64_t StartTick = SystemTime::GetCurrentTick();
+
+    ByteArray Result = NullFile;
+
+    MappedFile Source(fileName);
+    if (Source.GetData() != nullptr)
+    {
+        const byte* Src = Source.GetData();
+        Stats.CompressedBytes = Source.GetSize();
+
+        vector<BlockedMember> Members;
+        size_t DecompressedSize;
+
+        if (IsGzip(Src, Stats.CompressedBytes) && FindBlockedMembers(Src, Stats.CompressedBytes, Members, DecompressedSize))
+            Result = InflateBlocked(Src, Members, DecompressedSize, Stats);
+        else
+            Result = InflateSequential(Src, Stats.CompressedBytes, Stats);
+    }
+
+    Stats.DecompressedBytes = Result->size();
+    Stats.Seconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+
+    if (pStats != nullptr)
+        *pStats = Stats;
+
+    return Result;
+}
+
+InflateResult Utility::InflateFile( const wstring& fileName, const InflateSink& Sink, size_t ChunkSize, InflateStats* pStats )
+{
+    InflateStats Stats = {};
+    int64_t StartTick = SystemTime::GetCurrentTick();
+    bool Stopped = false;
+
+    MappedFile Source(fileName);
+    if (Source.GetData() != nullptr)
+    {
+        Stats.CompressedBytes = Source.GetSize();
+
+        StreamInflater Inflater(Source.GetData(), Source.GetSize());
+        vector<byte> Chunk(ChunkSize);
+
+        do
+        {
+            size_t Written;
+            Stats.Error = Inflater.Inflate(Chunk.data(), Chunk.size(), Written);
+            Stats.DecompressedBytes += Written;
+
+            if (Written > 0 && !Sink(Chunk.data(), Written))
+            {
+                Stopped = true;
+                break;
+            }
+        }
+        while (Stats.Error == Z_OK);
+
+        Stats.Members = Inflater.GetMemberCount();
+    }
+
+    Stats.Seconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick());
+
+    if (pStats != nullptr)
+        *pStats = Stats;
+
+    if (Stopped)
+        return InflateResult::Stopped;
+
+    return Stats.Error == Z_STREAM_END ? InflateResult::Complete : InflateResult::Failed;
 }
 
 ByteArray DecompressZippedFile( wstring& fileName )
 {
-    ByteArray CompressedFile = ReadFileHelper(fileName);
-    if (CompressedFile == NullFile)
+    InflateStats Stats;
+    ByteArray DecompressedFile = InflateFile(fileName, &Stats);
+
+    // A missing file isn't an error; the caller falls back to the uncompressed file
+    if (Stats.CompressedBytes == 0)
         return NullFile;
 
-    int error;
-    ByteArray DecompressedFile = Inflate(CompressedFile, error);
     if (DecompressedFile->size() == 0)
     {
-        Utility::Printf(L"Couldn't unzip file %s:  Error = %d\n", fileName.c_str(), error);
+        Utility::Printf(L"Couldn't unzip file %s:  Error = %d\n", fileName.c_str(), Stats.Error);
         return NullFile;
     }
 
+#ifndef RELEASE
+    Utility::Printf(L"Inflated %s: %zu -> %zu bytes in %u member(s)%s, %.1f MB/s\n", fileName.c_str(),
+        Stats.CompressedBytes, Stats.DecompressedBytes, Stats.Members, Stats.Parallel ? L" in parallel" : L"",
+        Stats.DecompressedBytes / (Stats.Seconds * 1024.0 * 1024.0 + 1e-9));
+#endif
+
     return DecompressedFile;
 }
 
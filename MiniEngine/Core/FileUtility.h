@@ -17,6 +17,7 @@
 #include <vector>
 #include <string>
 #include <ppl.h>
+#include <functional>
 
 namespace Utility
 {
@@ -34,4 +35,28 @@ namespace Utility
     // Same as previous except that it does not block but instead returns a task.
     task<ByteArray> ReadFileAsync(const wstring& fileName);
 
+    struct InflateStats
+    {
+        size_t CompressedBytes;     // 0 if the file couldn't be opened
+        size_t DecompressedBytes;
+        uint32_t Members;           // gzip members decoded
+        bool Parallel;              // members were decoded concurrently
+        double Seconds;
+        int Error;                  // zlib result; Z_STREAM_END on success
+    };
+
+    // Decompresses a zlib or gzip file, including concatenated gzip members, straight into a buffer sized from the
+    // gzip trailer.  The compressed file is memory mapped rather than read.  Archives of blocked members which
+    // record their compressed sizes (as written by bgzip) are decoded in parallel.  Returns NullFile on failure.
+    ByteArray InflateFile(const wstring& fileName, InflateStats* pStats = nullptr);
+
+    // Receives decompressed data in order.  Returning false stops decompression.
+    typedef function<bool(const byte* Data, size_t Size)> InflateSink;
+
+    enum class InflateResult { Complete, Stopped, Failed };
+
+    // Decompresses a zlib or gzip file through a ChunkSize buffer, so the whole output is never held in memory.
+    // Returns Stopped if the sink ended decompression early, or Failed if the file couldn't be decompressed.
+    InflateResult InflateFile(const wstring& fileName, const InflateSink& Sink, size_t ChunkSize = 1024 * 1024, InflateStats* pStats = nullptr);
+
 } // namespace Utility
@@ -94,6 +94,10 @@ namespace
 
     BoolVar s_LimitTo30Hz("Timing/Limit To 30Hz", false);
     BoolVar s_DropRandomFrames("Timing/Drop Random Frames", false);
+
+    // Keeps compiled PSOs in a pipeline library file between runs.  Read once at startup.
+    BoolVar s_EnablePipelineLibrary("Graphics/PSO Library", true);
+    const wchar_t* kPipelineLibraryFileName = L"PipelineLibrary.bin";
 }
 
 namespace Graphics
@@ -459,6 +463,10 @@ void Graphics::Initialize(void)
         }
     }
 
+    // Must happen before any PSOs are finalized
+    if (s_EnablePipelineLibrary && !PSO::OpenPipelineLibrary(kPipelineLibraryFileName))
+        Utility::Print("Pipeline libraries are not supported, so PSOs will not be cached between runs\n");
+
     g_CommandManager.Create(g_Device);
 
     DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
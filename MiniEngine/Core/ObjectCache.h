@@ -0,0 +1,120 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard 
+//
+
+#pragma once
+
+#include "pch.h"
+#include "Hash.h"
+#include <vector>
+#include <unordered_map>
+#include <future>
+#include <mutex>
+#include <functional>
+
+namespace Utility
+{
+    // The complete state an object was created from, as words.  Keys are compared in full, so objects whose
+    // hashes collide are never confused.
+    class ObjectKey
+    {
+    public:
+        template <typename T> void Append( const T* State, size_t Count = 1 )
+        {
+            static_assert((sizeof(T) & 3) == 0 && alignof(T) >= 4, "State object is not word-aligned");
+            m_Words.insert(m_Words.end(), (const uint32_t*)State, (const uint32_t*)(State + Count));
+        }
+
+        void Append( uint32_t Word ) { m_Words.push_back(Word); }
+
+        size_t GetHash( void ) const { return HashRange(m_Words.data(), m_Words.data() + m_Words.size(), 2166136261U); }
+
+        bool operator==( const ObjectKey& rhs ) const { return m_Words == rhs.m_Words; }
+
+    private:
+        std::vector<uint32_t> m_Words;
+    };
+
+    // A concurrent cache of device objects.  Lookups lock one of several shards, only for as long as it takes to find
+    // or insert an entry.  The first request for a key creates the object outside of the lock, and concurrent
+    // requests for the same key wait on its future rather than spinning.
+    template <typename T>
+    class ObjectCache
+    {
+    public:
+        typedef Microsoft::WRL::ComPtr<T> ObjectPtr;
+
+        // Returns the object for Key, calling Create if it isn't cached.  The cache holds the only reference.
+        T* GetOrCreate( const ObjectKey& Key, const std::function<ObjectPtr(void)>& Create )
+        {
+            const size_t Hash = Key.GetHash();
+            Shard& shard = m_Shards[Hash % kNumShards];
+
+            std::promise<ObjectPtr> Promise;
+            std::shared_future<ObjectPtr> Future;
+            bool FirstRequest = false;
+            {
+                std::lock_guard<std::mutex> Lock(shard.Mutex);
+
+                auto Range = shard.Map.equal_range(Hash);
+                for (auto Iter = Range.first; Iter != Range.second; ++Iter)
+                {
+                    if (Iter->second.Key == Key)
+                    {
+                        Future = Iter->second.Object;
+                        break;
+                    }
+                }
+
+                // Reserve the entry so the next request will find that someone got here first
+                if (!Future.valid())
+                {
+                    Future = Promise.get_future().share();
+                    shard.Map.emplace(Hash, Entry{ Key, Future });
+                    FirstRequest = true;
+                }
+            }
+
+            if (FirstRequest)
+                Promise.set_value(Create());
+
+            return Future.get().Get();
+        }
+
+        void Clear( void )
+        {
+            for (Shard& shard : m_Shards)
+            {
+                std::lock_guard<std::mutex> Lock(shard.Mutex);
+                shard.Map.clear();
+            }
+        }
+
+    private:
+        static const size_t kNumShards = 16;
+
+        struct Entry
+        {
+            ObjectKey Key;
+            std::shared_future<ObjectPtr> Object;
+        };
+
+        struct Shard
+        {
+            std::mutex Mutex;
+            std::unordered_multimap<size_t, Entry> Map;
+        };
+
+        Shard m_Shards[kNumShards];
+    };
+
+} // namespace Utility
@@ -15,8 +15,10 @@
 #include "PipelineState.h"
 #include "RootSignature.h"
 #include "Hash.h"
-#include <map>
-#include <thread>
+#include "ObjectCache.h"
+#include "FileUtility.h"
+#include <fstream>
+#include <atomic>
 #include <mutex>
 
 using Math::IsAligned;
@@ -24,13 +26,213 @@ using namespace Graphics;
 using Microsoft::WRL::ComPtr;
 using namespace std;
 
-static map< size_t, ComPtr<ID3D12PipelineState> > s_GraphicsPSOHashMap;
-static map< size_t, ComPtr<ID3D12PipelineState> > s_ComputePSOHashMap;
+namespace
+{
+    Utility::ObjectCache<ID3D12PipelineState> s_GraphicsPSOCache;
+    Utility::ObjectCache<ID3D12PipelineState> s_ComputePSOCache;
+
+    // Hashes bytes which may not be a whole number of words
+    size_t HashBytes( const void* Data, size_t Size, size_t Hash )
+    {
+        const uint32_t* Words = (const uint32_t*)Data;
+        Hash = Utility::HashRange(Words, Words + Size / 4, Hash);
+
+        uint32_t Tail = 0;
+        memcpy(&Tail, Words + Size / 4, Size & 3);
+        return Utility::HashRange(&Tail, &Tail + 1, Hash);
+    }
+
+    size_t HashShader( const D3D12_SHADER_BYTECODE& Shader, size_t Hash )
+    {
+        Hash = HashBytes(&Shader.BytecodeLength, sizeof(Shader.BytecodeLength), Hash);
+        return HashBytes(Shader.pShaderBytecode, Shader.BytecodeLength, Hash);
+    }
+
+    // Pipeline library entries are named by the content of their state rather than the addresses in it, so that
+    // names are stable from one run to the next.  The runtime validates the description when loading a pipeline,
+    // so a name collision only costs a recompile.  Descriptions are zeroed when PSOs are constructed, and are copied
+    // bytewise here because copying a struct doesn't necessarily copy its padding.
+    size_t HashPipelineContent( const D3D12_GRAPHICS_PIPELINE_STATE_DESC& Desc )
+    {
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC Content;
+        memcpy(&Content, &Desc, sizeof(Content));
+        Content.pRootSignature = nullptr;
+        Content.VS = Content.PS = Content.DS = Content.HS = Content.GS = D3D12_SHADER_BYTECODE();
+        Content.StreamOutput = D3D12_STREAM_OUTPUT_DESC();
+        Content.InputLayout.pInputElementDescs = nullptr;
+        Content.CachedPSO = D3D12_CACHED_PIPELINE_STATE();
+
+        size_t Hash = Utility::HashState(&Content);
+        for (const D3D12_SHADER_BYTECODE* Shader : { &Desc.VS, &Desc.PS, &Desc.DS, &Desc.HS, &Desc.GS })
+            Hash = HashShader(*Shader, Hash);
+
+        for (UINT i = 0; i < Desc.InputLayout.NumElements; ++i)
+        {
+            D3D12_INPUT_ELEMENT_DESC Element = Desc.InputLayout.pInputElementDescs[i];
+            Hash = HashBytes(Element.SemanticName, strlen(Element.SemanticName), Hash);
+            Element.SemanticName = nullptr;
+            Hash = Utility::HashState(&Element, 1, Hash);
+        }
+
+        return Hash;
+    }
+
+    size_t HashPipelineContent( const D3D12_COMPUTE_PIPELINE_STATE_DESC& Desc )
+    {
+        D3D12_COMPUTE_PIPELINE_STATE_DESC Content;
+        memcpy(&Content, &Desc, sizeof(Content));
+        Content.pRootSignature = nullptr;
+        Content.CS = D3D12_SHADER_BYTECODE();
+        Content.CachedPSO = D3D12_CACHED_PIPELINE_STATE();
+
+        return HashShader(Desc.CS, Utility::HashState(&Content));
+    }
+
+    HRESULT CreatePipeline( const D3D12_GRAPHICS_PIPELINE_STATE_DESC& Desc, ComPtr<ID3D12PipelineState>& PSO )
+    {
+        return g_Device->CreateGraphicsPipelineState(&Desc, MY_IID_PPV_ARGS(PSO.GetAddressOf()));
+    }
+
+    HRESULT CreatePipeline( const D3D12_COMPUTE_PIPELINE_STATE_DESC& Desc, ComPtr<ID3D12PipelineState>& PSO )
+    {
+        return g_Device->CreateComputePipelineState(&Desc, MY_IID_PPV_ARGS(PSO.GetAddressOf()));
+    }
+
+    HRESULT LoadPipeline( ID3D12PipelineLibrary* Library, const wchar_t* Name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& Desc, ComPtr<ID3D12PipelineState>& PSO )
+    {
+        return Library->LoadGraphicsPipeline(Name, &Desc, MY_IID_PPV_ARGS(PSO.GetAddressOf()));
+    }
+
+    HRESULT LoadPipeline( ID3D12PipelineLibrary* Library, const wchar_t* Name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& Desc, ComPtr<ID3D12PipelineState>& PSO )
+    {
+        return Library->LoadComputePipeline(Name, &Desc, MY_IID_PPV_ARGS(PSO.GetAddressOf()));
+    }
+
+    // A pipeline library read from disk at startup and written back at shutdown if new pipelines were added to it.
+    // The file is read into memory rather than mapped, so the library can be serialized to a new file without
+    // invalidating it.
+    class PipelineLibraryFile
+    {
+    public:
+        PipelineLibraryFile() : m_Modified(false) {}
+
+        bool Open( const wstring& FileName )
+        {
+            Close();
+
+            // Pipeline libraries require ID3D12Device1 and a WDDM 2.1 driver
+            ComPtr<ID3D12Device1> Device1;
+            if (FAILED(g_Device->QueryInterface(MY_IID_PPV_ARGS(Device1.GetAddressOf()))))
+                return false;
+
+            // The library doesn't copy its blob, so it has to outlive the library
+            m_Blob = Utility::ReadFileSync(FileName);
+            m_FileName = FileName;
+
+            HRESULT hr = Device1->CreatePipelineLibrary(m_Blob->data(), m_Blob->size(), MY_IID_PPV_ARGS(m_Library.GetAddressOf()));
+            switch (hr)
+            {
+            case E_INVALIDARG:                          // Corrupt or unrecognized
+            case D3D12_ERROR_ADAPTER_NOT_FOUND:         // Created on different hardware
+            case D3D12_ERROR_DRIVER_VERSION_MISMATCH:   // Created by an older driver or runtime
+                Utility::Printf(L"Discarding stale pipeline library %s\n", FileName.c_str());
+                m_Blob = Utility::NullFile;
+                hr = Device1->CreatePipelineLibrary(nullptr, 0, MY_IID_PPV_ARGS(m_Library.GetAddressOf()));
+                break;
+            }
+
+            if (FAILED(hr))
+            {
+                m_Library = nullptr;
+                m_Blob = nullptr;
+                return false;
+            }
+
+            m_Library->SetName(L"PSO::PipelineLibrary");
+            return true;
+        }
+
+        void Close( void )
+        {
+            if (m_Library != nullptr && m_Modified)
+                Save();
+
+            m_Library = nullptr;
+            m_Blob = nullptr;
+            m_Modified = false;
+        }
+
+        // Loads the pipeline from the library, or creates it and adds it to the library
+        template <typename DescType>
+        ComPtr<ID3D12PipelineState> LoadOrCreate( const DescType& Desc )
+        {
+            ComPtr<ID3D12PipelineState> PSO;
+
+            if (m_Library == nullptr)
+            {
+                ASSERT_SUCCEEDED( CreatePipeline(Desc, PSO) );
+                return PSO;
+            }
+
+            const size_t Hash = HashPipelineContent(Desc);
+            wchar_t Name[32];
+            swprintf(Name, 32, L"PSO %zx", Hash);
+
+            // The library is free-threaded except that loads of the same pipeline must be serialized
+            mutex& NameMutex = m_NameMutex[Hash % kNumNameMutexes];
+            {
+                lock_guard<mutex> Lock(NameMutex);
+                if (SUCCEEDED(LoadPipeline(m_Library.Get(), Name, Desc, PSO)))
+                    return PSO;
+            }
+
+            ASSERT_SUCCEEDED( CreatePipeline(Desc, PSO) );
+
+            {
+                lock_guard<mutex> Lock(NameMutex);
+                if (SUCCEEDED(m_Library->StorePipeline(Name, PSO.Get())))
+                    m_Modified = true;
+            }
+
+            return PSO;
+        }
+
+    private:
+        void Save( void )
+        {
+            vector<byte> Serialized(m_Library->GetSerializedSize());
+            if (Serialized.empty() || FAILED(m_Library->Serialize(Serialized.data(), Serialized.size())))
+                return;
+
+            ofstream File(m_FileName, ios::out | ios::binary | ios::trunc);
+            if (File.write((const char*)Serialized.data(), Serialized.size()))
+                Utility::Printf(L"Saved %zu byte pipeline library to %s\n", Serialized.size(), m_FileName.c_str());
+            else
+                Utility::Printf(L"Couldn't save pipeline library to %s\n", m_FileName.c_str());
+        }
+
+        static const size_t kNumNameMutexes = 16;
+
+        ComPtr<ID3D12PipelineLibrary> m_Library;
+        Utility::ByteArray m_Blob;
+        wstring m_FileName;
+        atomic<bool> m_Modified;
+        mutex m_NameMutex[kNumNameMutexes];
+    };
+
+    PipelineLibraryFile s_PipelineLibrary;
+}
+
+bool PSO::OpenPipelineLibrary( const wstring& FileName )
+{
+    return s_PipelineLibrary.Open(FileName);
+}
 
 void PSO::DestroyAll(void)
 {
-    s_GraphicsPSOHashMap.clear();
-    s_ComputePSOHashMap.clear();
+    s_PipelineLibrary.Close();
+    s_GraphicsPSOCache.Clear();
+    s_ComputePSOCache.Clear();
 }
 
 
@@ -112,39 +314,14 @@ void GraphicsPSO::Finalize()
     m_PSODesc.pRootSignature = m_RootSignature->GetSignature();
     ASSERT(m_PSODesc.pRootSignature != nullptr);
 
+    // Compare the input layout itself rather than our copy's address
     m_PSODesc.InputLayout.pInputElementDescs = nullptr;
-    size_t HashCode = Utility::HashState(&m_PSODesc);
-    HashCode = Utility::HashState(m_InputLayouts.get(), m_PSODesc.InputLayout.NumElements, HashCode);
+    Utility::ObjectKey Key;
+    Key.Append(&m_PSODesc);
+    Key.Append(m_InputLayouts.get(), m_PSODesc.InputLayout.NumElements);
     m_PSODesc.InputLayout.pInputElementDescs = m_InputLayouts.get();
 
-    ID3D12PipelineState** PSORef = nullptr;
-    bool firstCompile = false;
-    {
-        static mutex s_HashMapMutex;
-        lock_guard<mutex> CS(s_HashMapMutex);
-        auto iter = s_GraphicsPSOHashMap.find(HashCode);
-
-        // Reserve space so the next inquiry will find that someone got here first.
-        if (iter == s_GraphicsPSOHashMap.end())
-        {
-            firstCompile = true;
-            PSORef = s_GraphicsPSOHashMap[HashCode].GetAddressOf();
-        }
-        else
-            PSORef = iter->second.GetAddressOf();
-    }
-
-    if (firstCompile)
-    {
-        ASSERT_SUCCEEDED( g_Device->CreateGraphicsPipelineState(&m_PSODesc, MY_IID_PPV_ARGS(&m_PSO)) );
-        s_GraphicsPSOHashMap[HashCode].Attach(m_PSO);
-    }
-    else
-    {
-        while (*PSORef == nullptr)
-            this_thread::yield();
-        m_PSO = *PSORef;
-    }
+    m_PSO = s_GraphicsPSOCache.GetOrCreate(Key, [this] { return s_PipelineLibrary.LoadOrCreate(m_PSODesc); });
 }
 
 void ComputePSO::Finalize()
@@ -153,36 +330,10 @@ void ComputePSO::Finalize()
     m_PSODesc.pRootSignature = m_RootSignature->GetSignature();
     ASSERT(m_PSODesc.pRootSignature != nullptr);
 
-    size_t HashCode = Utility::HashState(&m_PSODesc);
+    Utility::ObjectKey Key;
+    Key.Append(&m_PSODesc);
 
-    ID3D12PipelineState** PSORef = nullptr;
-    bool firstCompile = false;
-    {
-        static mutex s_HashMapMutex;
-        lock_guard<mutex> CS(s_HashMapMutex);
-        auto iter = s_ComputePSOHashMap.find(HashCode);
-
-        // Reserve space so the next inquiry will find that someone got here first.
-        if (iter == s_ComputePSOHashMap.end())
-        {
-            firstCompile = true;
-            PSORef = s_ComputePSOHashMap[HashCode].GetAddressOf();
-        }
-        else
-            PSORef = iter->second.GetAddressOf();
-    }
-
-    if (firstCompile)
-    {
-        ASSERT_SUCCEEDED( g_Device->CreateComputePipelineState(&m_PSODesc, MY_IID_PPV_ARGS(&m_PSO)) );
-        s_ComputePSOHashMap[HashCode].Attach(m_PSO);
-    }
-    else
-    {
-        while (*PSORef == nullptr)
-            this_thread::yield();
-        m_PSO = *PSORef;
-    }
+    m_PSO = s_ComputePSOCache.GetOrCreate(Key, [this] { return s_PipelineLibrary.LoadOrCreate(m_PSODesc); });
 }
 
 ComputePSO::ComputePSO()
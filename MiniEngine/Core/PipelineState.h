@@ -32,6 +32,10 @@ public:
 
     static void DestroyAll( void );
 
+    // Loads PSOs from a pipeline library file, and adds newly created PSOs to it to be saved by DestroyAll().  Call
+    // before finalizing any PSOs.  Returns false if the device or driver doesn't support pipeline libraries.
+    static bool OpenPipelineLibrary( const std::wstring& FileName );
+
     void SetRootSignature( const RootSignature& BindMappings )
     {
         m_RootSignature = &BindMappings;
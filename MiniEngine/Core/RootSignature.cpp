@@ -15,19 +15,17 @@
 #include "RootSignature.h"
 #include "GraphicsCore.h"
 #include "Hash.h"
-#include <map>
-#include <thread>
-#include <mutex>
+#include "ObjectCache.h"
 
 using namespace Graphics;
 using namespace std;
 using Microsoft::WRL::ComPtr;
 
-static std::map< size_t, ComPtr<ID3D12RootSignature> > s_RootSignatureHashMap;
+static Utility::ObjectCache<ID3D12RootSignature> s_RootSignatureCache;
 
 void RootSignature::DestroyAll(void)
 {
-    s_RootSignatureHashMap.clear();
+    s_RootSignatureCache.Clear();
 }
 
 void RootSignature::InitStaticSampler(
@@ -103,20 +101,27 @@ void RootSignature::Finalize(const std::wstring& name, D3D12_ROOT_SIGNATURE_FLAG
     m_DescriptorTableBitMap = 0;
     m_SamplerTableBitMap = 0;
 
-    size_t HashCode = Utility::HashState(&RootDesc.Flags);
-    HashCode = Utility::HashState( RootDesc.pStaticSamplers, m_NumSamplers, HashCode );
+    Utility::ObjectKey Key;
+    Key.Append(&RootDesc.Flags);
+    Key.Append(RootDesc.pStaticSamplers, m_NumSamplers);
 
     for (UINT Param = 0; Param < m_NumParameters; ++Param)
     {
         const D3D12_ROOT_PARAMETER& RootParam = RootDesc.pParameters[Param];
         m_DescriptorTableSize[Param] = 0;
 
+        // Only the members of the parameter's type are initialized, and tables are compared by their ranges
+        D3D12_ROOT_PARAMETER ParamKey = {};
+        ParamKey.ParameterType = RootParam.ParameterType;
+        ParamKey.ShaderVisibility = RootParam.ShaderVisibility;
+
         if (RootParam.ParameterType == D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE)
         {
             ASSERT(RootParam.DescriptorTable.pDescriptorRanges != nullptr);
 
-            HashCode = Utility::HashState( RootParam.DescriptorTable.pDescriptorRanges,
-                RootParam.DescriptorTable.NumDescriptorRanges, HashCode );
+            ParamKey.DescriptorTable.NumDescriptorRanges = RootParam.DescriptorTable.NumDescriptorRanges;
+            Key.Append(&ParamKey);
+            Key.Append(RootParam.DescriptorTable.pDescriptorRanges, RootParam.DescriptorTable.NumDescriptorRanges);
 
             // We keep track of sampler descriptor tables separately from CBV_SRV_UAV descriptor tables
             if (RootParam.DescriptorTable.pDescriptorRanges->RangeType == D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER)
@@ -128,47 +133,30 @@ void RootSignature::Finalize(const std::wstring& name, D3D12_ROOT_SIGNATURE_FLAG
                 m_DescriptorTableSize[Param] += RootParam.DescriptorTable.pDescriptorRanges[TableRange].NumDescriptors;
         }
         else
-            HashCode = Utility::HashState( &RootParam, 1, HashCode );
-    }
-
-    ID3D12RootSignature** RSRef = nullptr;
-    bool firstCompile = false;
-    {
-        static mutex s_HashMapMutex;
-        lock_guard<mutex> CS(s_HashMapMutex);
-        auto iter = s_RootSignatureHashMap.find(HashCode);
-
-        // Reserve space so the next inquiry will find that someone got here first.
-        if (iter == s_RootSignatureHashMap.end())
         {
-            RSRef = s_RootSignatureHashMap[HashCode].GetAddressOf();
-            firstCompile = true;
+            if (RootParam.ParameterType == D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS)
+                ParamKey.Constants = RootParam.Constants;
+            else
+                ParamKey.Descriptor = RootParam.Descriptor;
+
+            Key.Append(&ParamKey);
         }
-        else
-            RSRef = iter->second.GetAddressOf();
     }
 
-    if (firstCompile)
+    m_Signature = s_RootSignatureCache.GetOrCreate(Key, [&]
     {
         ComPtr<ID3DBlob> pOutBlob, pErrorBlob;
 
         ASSERT_SUCCEEDED( D3D12SerializeRootSignature(&RootDesc, D3D_ROOT_SIGNATURE_VERSION_1,
             pOutBlob.GetAddressOf(), pErrorBlob.GetAddressOf()));
 
+        ComPtr<ID3D12RootSignature> Signature;
         ASSERT_SUCCEEDED( g_Device->CreateRootSignature(1, pOutBlob->GetBufferPointer(), pOutBlob->GetBufferSize(),
-            MY_IID_PPV_ARGS(&m_Signature)) );
-
-        m_Signature->SetName(name.c_str());
+            MY_IID_PPV_ARGS(Signature.GetAddressOf())) );
 
-        s_RootSignatureHashMap[HashCode].Attach(m_Signature);
-        ASSERT(*RSRef == m_Signature);
-    }
-    else
-    {
-        while (*RSRef == nullptr)
-            this_thread::yield();
-        m_Signature = *RSRef;
-    }
+        Signature->SetName(name.c_str());
+        return Signature;
+    });
 
     m_Finalized = TRUE;
 }
@@ -18,6 +18,7 @@
 #include "DDSTextureLoader.h"
 #include "GraphicsCore.h"
 #include "CommandContext.h"
+#include <atomic>
 #include <map>
 #include <thread>
 
@@ -152,7 +153,15 @@ void Texture::CreatePIXImageFromMemory( const void* memBuffer, size_t fileSize )
 namespace TextureManager
 {
     wstring s_RootPath = L"";
-    map< wstring, unique_ptr<ManagedTexture> > s_TextureCache;
+
+    // The cache is split into shards with their own locks so that loading threads rarely contend
+    struct CacheShard
+    {
+        mutex Mutex;
+        map< wstring, unique_ptr<ManagedTexture> > Textures;
+    };
+    const size_t kNumCacheShards = 16;
+    CacheShard s_TextureCache[kNumCacheShards];
 
     void Initialize( const std::wstring& TextureLibRoot )
     {
@@ -161,22 +170,26 @@ namespace TextureManager
 
     void Shutdown( void )
     {
-        s_TextureCache.clear();
+        for (CacheShard& Shard : s_TextureCache)
+        {
+            lock_guard<mutex> Guard(Shard.Mutex);
+            Shard.Textures.clear();
+        }
     }
 
     pair<ManagedTexture*, bool> FindOrLoadTexture( const wstring& fileName )
     {
-        static mutex s_Mutex;
-        lock_guard<mutex> Guard(s_Mutex);
+        CacheShard& Shard = s_TextureCache[hash<wstring>()(fileName) % kNumCacheShards];
+        lock_guard<mutex> Guard(Shard.Mutex);
 
-        auto iter = s_TextureCache.find(fileName);
+        auto iter = Shard.Textures.find(fileName);
 
         // If it's found, it has already been loaded or the load process has begun
-        if (iter != s_TextureCache.end())
+        if (iter != Shard.Textures.end())
             return make_pair(iter->second.get(), false);
 
         ManagedTexture* NewTexture = new ManagedTexture(fileName);
-        s_TextureCache[fileName].reset( NewTexture );
+        Shard.Textures[fileName].reset( NewTexture );
 
         // This was the first time it was requested, so indicate that the caller must read the file
         return make_pair(NewTexture, true);
@@ -236,20 +249,168 @@ namespace TextureManager
         return *ManTex;
     }
 
+    struct PendingLoad
+    {
+        ManagedTexture* Tex;
+        wstring FileName;
+        bool sRGB;
+        bool IsTGA;        // Tex is the ".tga" entry because the ".dds" file is already known to be unusable
+    };
+
+    struct LoadBatch
+    {
+        vector<PendingLoad> Loads;
+        vector<const ManagedTexture*> Textures;
+        atomic<size_t> NextLoad;
+        atomic<size_t> JobsRemaining;
+        function<void(void)> OnComplete;
+    };
+
+    // A job submits the uploads it has recorded once they reach either limit, then publishes their textures
+    const size_t kMaxUploadBatchSize = 64 * 1024 * 1024;
+    const size_t kMaxUploadBatchTextures = 32;
+
+    void RunLoadJob( shared_ptr<LoadBatch> Batch )
+    {
+        // Loaded textures can't be published until the batch holding their uploads has been submitted
+        vector< pair<ManagedTexture*, Texture> > Loaded;
+
+        auto SubmitUploads = [&Loaded]( void )
+        {
+            CommandContext::EndUploadBatch();
+            for (auto& L : Loaded)
+                *L.first = L.second;
+            Loaded.clear();
+        };
+
+        CommandContext::BeginUploadBatch();
+
+        auto GetLoadPath = []( const PendingLoad& Load )
+        {
+            return Load.FileName + (Load.IsTGA ? L".tga" : L".dds");
+        };
+
+        size_t LoadIdx = Batch->NextLoad++;
+        concurrency::task<Utility::ByteArray> NextRead;
+        if (LoadIdx < Batch->Loads.size())
+            NextRead = Utility::ReadFileAsync( s_RootPath + GetLoadPath(Batch->Loads[LoadIdx]) );
+
+        while (LoadIdx < Batch->Loads.size())
+        {
+            const PendingLoad& Load = Batch->Loads[LoadIdx];
+            Utility::ByteArray ba = NextRead.get();
+
+            // Read the next file while this one is parsed and uploaded
+            LoadIdx = Batch->NextLoad++;
+            if (LoadIdx < Batch->Loads.size())
+                NextRead = Utility::ReadFileAsync( s_RootPath + GetLoadPath(Batch->Loads[LoadIdx]) );
+
+            Texture NewTex;
+            bool Success = false;
+            if (Load.IsTGA)
+            {
+                if (ba->size() > 0)
+                {
+                    NewTex.CreateTGAFromMemory( ba->data(), ba->size(), Load.sRGB );
+                    NewTex.GetResource()->SetName(GetLoadPath(Load).c_str());
+                    Success = true;
+                }
+            }
+            else if (ba->size() > 0 && NewTex.CreateDDSFromMemory( ba->data(), ba->size(), Load.sRGB ))
+            {
+                NewTex.GetResource()->SetName(GetLoadPath(Load).c_str());
+                Success = true;
+            }
+            else
+            {
+                // As LoadFromFile() does, fall back to the ".tga" file and cache it under its own name.  The ".dds"
+                // entry shares that texture, since it is the one that was handed out.
+                const wstring TGAName = Load.FileName + L".tga";
+                auto TGATex = FindOrLoadTexture(TGAName);
+                if (TGATex.second)
+                {
+                    ba = Utility::ReadFileSync( s_RootPath + TGAName );
+                    if (ba->size() > 0)
+                    {
+                        NewTex.CreateTGAFromMemory( ba->data(), ba->size(), Load.sRGB );
+                        NewTex.GetResource()->SetName(TGAName.c_str());
+                        Loaded.emplace_back(TGATex.first, NewTex);
+                        Success = true;
+                    }
+                    else
+                        TGATex.first->SetToInvalidTexture();
+                }
+                else
+                {
+                    // Another thread is loading it, so don't hold back our own uploads while waiting
+                    SubmitUploads();
+                    CommandContext::BeginUploadBatch();
+
+                    TGATex.first->WaitForLoad();
+                    if (TGATex.first->IsValid())
+                    {
+                        NewTex = *TGATex.first;
+                        Success = true;
+                    }
+                }
+            }
+
+            if (Success)
+                Loaded.emplace_back(Load.Tex, NewTex);
+            else
+                Load.Tex->SetToInvalidTexture();
+
+            if (Loaded.size() >= kMaxUploadBatchTextures || CommandContext::GetUploadBatchSize() >= kMaxUploadBatchSize)
+            {
+                SubmitUploads();
+                CommandContext::BeginUploadBatch();
+            }
+        }
+
+        SubmitUploads();
+
+        // The last job to finish waits out any textures another thread was already loading
+        if (--Batch->JobsRemaining == 0 && Batch->OnComplete)
+        {
+            for (const ManagedTexture* Tex : Batch->Textures)
+                Tex->WaitForLoad();
+
+            Batch->OnComplete();
+        }
+    }
+
 } // namespace TextureManager
 
+void ManagedTexture::operator= ( const Texture& Texture )
+{
+    GpuResource::operator=(Texture);
+
+    // Publish the view last so that any thread seeing it also sees the resource
+    volatile D3D12_CPU_DESCRIPTOR_HANDLE& VolHandle = (volatile D3D12_CPU_DESCRIPTOR_HANDLE&)m_hCpuDescriptorHandle;
+    VolHandle.ptr = Texture.GetSRV().ptr;
+    (volatile bool&)m_IsLoading = false;
+}
+
 void ManagedTexture::WaitForLoad( void ) const
 {
     volatile D3D12_CPU_DESCRIPTOR_HANDLE& VolHandle = (volatile D3D12_CPU_DESCRIPTOR_HANDLE&)m_hCpuDescriptorHandle;
     volatile bool& VolValid = (volatile bool&)m_IsValid;
-    while (VolHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN && VolValid)
+    volatile bool& VolLoading = (volatile bool&)m_IsLoading;
+    while ((VolHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN || VolLoading) && VolValid)
         this_thread::yield();
 }
 
+void ManagedTexture::SetToPlaceholder( const Texture& Placeholder )
+{
+    m_IsLoading = true;
+    m_hCpuDescriptorHandle = Placeholder.GetSRV();
+}
+
 void ManagedTexture::SetToInvalidTexture( void )
 {
     m_hCpuDescriptorHandle = TextureManager::GetMagentaTex2D().GetSRV();
     m_IsValid = false;
+    m_IsLoading = false;
 }
 
 const ManagedTexture* TextureManager::LoadFromFile( const std::wstring& fileName, bool sRGB )
@@ -310,6 +471,63 @@ const ManagedTexture* TextureManager::LoadTGAFromFile( const std::wstring& fileN
     return ManTex;
 }
 
+vector<const ManagedTexture*> TextureManager::LoadFromFilesAsync( const vector<TextureRequest>& requests,
+    function<void(void)> OnComplete )
+{
+    // Create the stand-in textures up front so that no job uploads them outside of its batch
+    const Texture& Placeholder = GetBlackTex2D();
+    GetMagentaTex2D();
+
+    auto Batch = make_shared<LoadBatch>();
+    Batch->Textures.resize(requests.size());
+    Batch->OnComplete = OnComplete;
+
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        // Use the same cache entries as LoadFromFile()
+        auto ManagedTex = FindOrLoadTexture(requests[i].FileName + L".dds");
+        bool IsTGA = false;
+
+        // Only a finished load is marked invalid, so the ".dds" file has already failed and the ".tga" entry is used
+        if (!ManagedTex.second && !ManagedTex.first->IsValid())
+        {
+            ManagedTex = FindOrLoadTexture(requests[i].FileName + L".tga");
+            IsTGA = true;
+        }
+
+        ManagedTexture* ManTex = ManagedTex.first;
+        const bool RequestsLoad = ManagedTex.second;
+
+        if (RequestsLoad)
+        {
+            ManTex->SetToPlaceholder(Placeholder);
+            Batch->Loads.push_back({ ManTex, requests[i].FileName, requests[i].sRGB, IsTGA });
+        }
+
+        Batch->Textures[i] = ManTex;
+    }
+
+    size_t NumJobs = min(Batch->Loads.size(), (size_t)max(thread::hardware_concurrency(), 1u));
+    Batch->NextLoad = 0;
+    Batch->JobsRemaining = NumJobs;
+
+    if (NumJobs == 0 && OnComplete)
+    {
+        // Everything was already loaded or loading on another thread
+        concurrency::create_task( [Batch]
+        {
+            for (const ManagedTexture* Tex : Batch->Textures)
+                Tex->WaitForLoad();
+
+            Batch->OnComplete();
+        } );
+    }
+
+    for (size_t i = 0; i < NumJobs; ++i)
+        concurrency::create_task( [Batch] { RunLoadJob(Batch); } );
+
+    return Batch->Textures;
+}
 
 const ManagedTexture* TextureManager::LoadPIXImageFromFile( const std::wstring& fileName )
 {
@@ -17,6 +17,7 @@
 #include "pch.h"
 #include "GpuResource.h"
 #include "Utility.h"
+#include <functional>
 
 class Texture : public GpuResource
 {
@@ -57,19 +58,23 @@ protected:
 class ManagedTexture : public Texture
 {
 public:
-    ManagedTexture( const std::wstring& FileName ) : m_MapKey(FileName), m_IsValid(true) {}
+    ManagedTexture( const std::wstring& FileName ) : m_MapKey(FileName), m_IsValid(true), m_IsLoading(false) {}
 
+    // Publishes a loaded texture, replacing any placeholder
     void operator= ( const Texture& Texture );
 
     void WaitForLoad(void) const;
     void Unload(void);
 
+    // Shows the placeholder's view until a loaded texture is assigned
+    void SetToPlaceholder( const Texture& Placeholder );
     void SetToInvalidTexture(void);
     bool IsValid(void) const { return m_IsValid; }
 
 private:
     std::wstring m_MapKey;        // For deleting from the map later
     bool m_IsValid;
+    bool m_IsLoading;
 };
 
 namespace TextureManager
@@ -82,6 +87,19 @@ namespace TextureManager
     const ManagedTexture* LoadTGAFromFile( const std::wstring& fileName, bool sRGB = false );
     const ManagedTexture* LoadPIXImageFromFile( const std::wstring& fileName );
 
+    struct TextureRequest
+    {
+        std::wstring FileName;    // Without extension.  As with LoadFromFile(), ".dds" is tried before ".tga" and
+                                  // the textures are cached under the same names.
+        bool sRGB;
+    };
+
+    // Loads the textures on worker threads and returns without waiting.  Files are read in parallel, parsed on the
+    // workers, and their uploads are submitted in batches.  Each texture shows the black texture until its own load
+    // completes; OnComplete, if given, is called on a worker thread once all of the returned textures have loaded.
+    std::vector<const ManagedTexture*> LoadFromFilesAsync( const std::vector<TextureRequest>& requests,
+        std::function<void(void)> OnComplete = nullptr );
+
     inline const ManagedTexture* LoadFromFile( const std::string& fileName, bool sRGB = false )
     {
         return LoadFromFile(MakeWStr(fileName), sRGB);
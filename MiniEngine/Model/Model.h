@@ -97,6 +97,24 @@ public:
         attrib_formats
     };
 
+    enum
+    {
+        index_format_uint16 = 0,
+        index_format_uint32,
+
+        index_formats
+    };
+
+    // Version 1 added the FileHeader and Mesh::indexFormat. Version 0 files begin directly with the Header, and all
+    // of their meshes use 16-bit indices.
+    enum { h3dVersion = 1 };
+
+    struct FileHeader
+    {
+        char id[4];
+        uint32_t version;
+    };
+
     struct BoundingBox
     {
         Vector3 min;
@@ -141,7 +159,12 @@ public:
 
         unsigned int vertexDataByteOffsetDepth;
         unsigned int vertexCountDepth;
+
+        // shared by the color and depth-only index data. 32-bit indices start on a 4 byte boundary.
+        unsigned int indexFormat;
     };
+    // Meshes are saved as is. indexFormat fills what was tail padding in version 0, so both versions are this size.
+    static_assert(sizeof(Mesh) == 336, "Mesh size doesn't match the H3D file format");
     Mesh *m_pMesh;
 
     struct Material
@@ -192,6 +215,11 @@ public:
         return m_Header.boundingBox;
     }
 
+    static uint32_t GetIndexSize(const Mesh& mesh)
+    {
+        return mesh.indexFormat == index_format_uint32 ? sizeof(uint32_t) : sizeof(uint16_t);
+    }
+
     D3D12_CPU_DESCRIPTOR_HANDLE* GetSRVs( uint32_t materialIdx ) const
     {
         return m_SRVs + materialIdx * 6;
@@ -18,6 +18,9 @@
 #include "DescriptorHeap.h"
 #include "CommandContext.h"
 #include <stdio.h>
+#include <string.h>
+
+static const char s_H3DFileId[4] = { 'H', '3', 'D', 0x1a };
 
 bool Model::LoadH3D(const char *filename)
 {
@@ -26,6 +29,20 @@ bool Model::LoadH3D(const char *filename)
         return false;
 
     bool ok = false;
+    FileHeader fileHeader;
+    uint32_t version = 0;
+
+    // version 0 files have no file header, so rewind if the id doesn't match
+    if (1 != fread(&fileHeader, sizeof(FileHeader), 1, file)) goto h3d_load_fail;
+    if (0 == memcmp(fileHeader.id, s_H3DFileId, sizeof(s_H3DFileId)))
+        version = fileHeader.version;
+    else if (0 != fseek(file, 0, SEEK_SET)) goto h3d_load_fail;
+
+    if (version > h3dVersion)
+    {
+        Utility::Printf("%s is H3D version %u, newer than the supported version %u\n", filename, version, (uint32_t)h3dVersion);
+        goto h3d_load_fail;
+    }
 
     if (1 != fread(&m_Header, sizeof(Header), 1, file)) goto h3d_load_fail;
 
@@ -34,6 +51,13 @@ bool Model::LoadH3D(const char *filename)
 
     if (m_Header.meshCount > 0)
         if (1 != fread(m_pMesh, sizeof(Mesh) * m_Header.meshCount, 1, file)) goto h3d_load_fail;
+
+    // version 0 meshes are the same size, but indexFormat was tail padding
+    if (version == 0)
+    {
+        for (uint32_t meshIndex = 0; meshIndex < m_Header.meshCount; ++meshIndex)
+            m_pMesh[meshIndex].indexFormat = index_format_uint16;
+    }
     if (m_Header.materialCount > 0)
         if (1 != fread(m_pMaterial, sizeof(Material) * m_Header.materialCount, 1, file)) goto h3d_load_fail;
 
@@ -61,6 +85,9 @@ bool Model::LoadH3D(const char *filename)
         ASSERT( mesh.attribsEnabledDepth ==
             (attrib_mask_position) );
         ASSERT(mesh.attrib[0].components == 3 && mesh.attrib[0].format == Model::attrib_format_float); // position
+
+        ASSERT(mesh.indexFormat < index_formats);
+        ASSERT(mesh.indexDataByteOffset % GetIndexSize(mesh) == 0);
     }
 #endif
 
@@ -79,7 +106,13 @@ bool Model::LoadH3D(const char *filename)
     if (m_Header.indexDataByteSize > 0)
         if (1 != fread(m_pIndexDataDepth, m_Header.indexDataByteSize, 1, file)) goto h3d_load_fail;
 
+#if _DEBUG
+    // the whole file should have been read, otherwise the records don't match the layout it was saved with
+    ASSERT(EOF == fgetc(file), "%s has unexpected data after the index data", filename);
+#endif
+
     m_VertexBuffer.Create(L"VertexBuffer", m_Header.vertexDataByteSize / m_VertexStride, m_VertexStride, m_pVertexData);
+    // meshes may mix index formats, so index buffer views pick the format per mesh rather than from the element size
     m_IndexBuffer.Create(L"IndexBuffer", m_Header.indexDataByteSize / sizeof(uint16_t), sizeof(uint16_t), m_pIndexData);
     delete [] m_pVertexData;
     m_pVertexData = nullptr;
@@ -112,7 +145,12 @@ bool Model::SaveH3D(const char *filename) const
         return false;
 
     bool ok = false;
+    FileHeader fileHeader;
 
+    memcpy(fileHeader.id, s_H3DFileId, sizeof(s_H3DFileId));
+    fileHeader.version = h3dVersion;
+
+    if (1 != fwrite(&fileHeader, sizeof(FileHeader), 1, file)) goto h3d_save_fail;
     if (1 != fwrite(&m_Header, sizeof(Header), 1, file)) goto h3d_save_fail;
 
     if (m_Header.meshCount > 0)
@@ -165,43 +203,84 @@ void Model::LoadTextures(void)
 
     m_SRVs = new D3D12_CPU_DESCRIPTOR_HANDLE[m_Header.materialCount * 6];
 
-    const ManagedTexture* MatTextures[6] = {};
+    // Textures load in parallel batches: first each material's own textures along with the defaults, then the
+    // textures named after the diffuse map for any that turned out to be missing.
+    auto LoadAll = [](const std::vector<TextureManager::TextureRequest>& Requests)
+    {
+        std::vector<const ManagedTexture*> Textures = TextureManager::LoadFromFilesAsync(Requests);
+        for (const ManagedTexture* Tex : Textures)
+            Tex->WaitForLoad();
+        return Textures;
+    };
+
+    enum { kDiffuse, kSpecular, kNormal, kNumMaterialTextures };
+
+    std::vector<TextureManager::TextureRequest> Requests;
+    Requests.reserve(m_Header.materialCount * kNumMaterialTextures + kNumMaterialTextures);
 
     for (uint32_t materialIdx = 0; materialIdx < m_Header.materialCount; ++materialIdx)
     {
         const Material& pMaterial = m_pMaterial[materialIdx];
 
-        // Load diffuse
-        MatTextures[0] = TextureManager::LoadFromFile(pMaterial.texDiffusePath, true);
-        if (!MatTextures[0]->IsValid())
-            MatTextures[0] = TextureManager::LoadFromFile("default", true);
+        Requests.push_back({ MakeWStr(pMaterial.texDiffusePath), true });
+        Requests.push_back({ MakeWStr(pMaterial.texSpecularPath), true });
+        Requests.push_back({ MakeWStr(pMaterial.texNormalPath), false });
+    }
 
-        // Load specular
-        MatTextures[1] = TextureManager::LoadFromFile(pMaterial.texSpecularPath, true);
-        if (!MatTextures[1]->IsValid())
+    const size_t DefaultsIdx = Requests.size();
+    Requests.push_back({ L"default", true });
+    Requests.push_back({ L"default_specular", true });
+    Requests.push_back({ L"default_normal", false });
+
+    std::vector<const ManagedTexture*> Textures = LoadAll(Requests);
+
+    // Missing specular and normal maps fall back to ones named after the diffuse map
+    std::vector<TextureManager::TextureRequest> FallbackRequests;
+    std::vector<size_t> FallbackIdx;
+
+    for (uint32_t materialIdx = 0; materialIdx < m_Header.materialCount; ++materialIdx)
+    {
+        const std::wstring DiffusePath = MakeWStr(m_pMaterial[materialIdx].texDiffusePath);
+        const size_t MaterialIdx = materialIdx * kNumMaterialTextures;
+
+        if (!Textures[MaterialIdx + kSpecular]->IsValid())
         {
-            MatTextures[1] = TextureManager::LoadFromFile(std::string(pMaterial.texDiffusePath) + "_specular", true);
-            if (!MatTextures[1]->IsValid())
-                MatTextures[1] = TextureManager::LoadFromFile("default_specular", true);
+            FallbackRequests.push_back({ DiffusePath + L"_specular", true });
+            FallbackIdx.push_back(MaterialIdx + kSpecular);
         }
 
-        // Load emissive
-        //MatTextures[2] = TextureManager::LoadFromFile(pMaterial.texEmissivePath, true);
+        if (!Textures[MaterialIdx + kNormal]->IsValid())
+        {
+            FallbackRequests.push_back({ DiffusePath + L"_normal", false });
+            FallbackIdx.push_back(MaterialIdx + kNormal);
+        }
+    }
+
+    std::vector<const ManagedTexture*> Fallbacks = LoadAll(FallbackRequests);
+    for (size_t i = 0; i < Fallbacks.size(); ++i)
+    {
+        if (Fallbacks[i]->IsValid())
+            Textures[FallbackIdx[i]] = Fallbacks[i];
+    }
+
+    const ManagedTexture* MatTextures[6] = {};
+
+    for (uint32_t materialIdx = 0; materialIdx < m_Header.materialCount; ++materialIdx)
+    {
+        const ManagedTexture* const* Loaded = Textures.data() + materialIdx * kNumMaterialTextures;
 
-        // Load normal
-        MatTextures[3] = TextureManager::LoadFromFile(pMaterial.texNormalPath, false);
-        if (!MatTextures[3]->IsValid())
+        // Anything still missing uses the defaults
+        for (int n = 0; n < kNumMaterialTextures; ++n)
         {
-            MatTextures[3] = TextureManager::LoadFromFile(std::string(pMaterial.texDiffusePath) + "_normal", false);
-            if (!MatTextures[3]->IsValid())
-                MatTextures[3] = TextureManager::LoadFromFile("default_normal", false);
+            if (!Loaded[n]->IsValid())
+                Textures[materialIdx * kNumMaterialTextures + n] = Textures[DefaultsIdx + n];
         }
 
-        // Load lightmap
-        //MatTextures[4] = TextureManager::LoadFromFile(pMaterial.texLightmapPath, true);
+        MatTextures[0] = Loaded[kDiffuse];
+        MatTextures[1] = Loaded[kSpecular];
+        MatTextures[3] = Loaded[kNormal];
 
-        // Load reflection
-        //MatTextures[5] = TextureManager::LoadFromFile(pMaterial.texReflectionPath, true);
+        // Emissive, lightmap and reflection maps aren't loaded
 
         m_SRVs[materialIdx * 6 + 0] = MatTextures[0]->GetSRV();
         m_SRVs[materialIdx * 6 + 1] = MatTextures[1]->GetSRV();
@@ -17,6 +17,23 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+template <typename IndexType>
+static void CopyFaces(const aiMesh *srcMesh, IndexType *dstIndex, IndexType *dstIndexDepth)
+{
+    for (unsigned int f = 0; f < srcMesh->mNumFaces; f++)
+    {
+        assert(srcMesh->mFaces[f].mNumIndices == 3);
+
+        *dstIndex++ = (IndexType)srcMesh->mFaces[f].mIndices[0];
+        *dstIndex++ = (IndexType)srcMesh->mFaces[f].mIndices[1];
+        *dstIndex++ = (IndexType)srcMesh->mFaces[f].mIndices[2];
+
+        *dstIndexDepth++ = (IndexType)srcMesh->mFaces[f].mIndices[0];
+        *dstIndexDepth++ = (IndexType)srcMesh->mFaces[f].mIndices[1];
+        *dstIndexDepth++ = (IndexType)srcMesh->mFaces[f].mIndices[2];
+    }
+}
+
 const char* AssimpModel::s_FormatString[] =
 {
     "none",
@@ -95,10 +112,6 @@ bool AssimpModel::LoadAssimp(const char *filename)
     importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, 
         aiComponent_COLORS | aiComponent_LIGHTS | aiComponent_CAMERAS);
 
-    // max triangles and vertices per mesh, splits above this threshold
-    importer.SetPropertyInteger(AI_CONFIG_PP_SLM_TRIANGLE_LIMIT, INT_MAX);
-    importer.SetPropertyInteger(AI_CONFIG_PP_SLM_VERTEX_LIMIT, 0xfffe); // avoid the primitive restart index
-
     // remove points and lines
     importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
 
@@ -108,7 +121,6 @@ bool AssimpModel::LoadAssimp(const char *filename)
         aiProcess_Triangulate |
         aiProcess_RemoveComponent |
         aiProcess_GenSmoothNormals |
-        aiProcess_SplitLargeMeshes |
         aiProcess_ValidateDataStructure |
         //aiProcess_ImproveCacheLocality | // handled by optimizePostTransform()
         aiProcess_RemoveRedundantMaterials |
@@ -276,11 +288,17 @@ bool AssimpModel::LoadAssimp(const char *filename)
         dstMesh->vertexDataByteOffset = m_Header.vertexDataByteSize;
         dstMesh->vertexCount = srcMesh->mNumVertices;
 
+        // large meshes use 32-bit indices rather than being split by assimp; 0xffff stays free as the strip cut value.
+        // this is the unwelded count, OptimizeIndexFormat narrows meshes again once welding has run
+        dstMesh->indexFormat = dstMesh->vertexCount <= 0xffff ? index_format_uint16 : index_format_uint32;
+        if (dstMesh->indexFormat == index_format_uint32)
+            m_Header.indexDataByteSize = (m_Header.indexDataByteSize + 3) & ~3u;
+
         dstMesh->indexDataByteOffset = m_Header.indexDataByteSize;
         dstMesh->indexCount = srcMesh->mNumFaces * 3;
 
         m_Header.vertexDataByteSize += dstMesh->vertexStride * dstMesh->vertexCount;
-        m_Header.indexDataByteSize += sizeof(uint16_t) * dstMesh->indexCount;
+        m_Header.indexDataByteSize += GetIndexSize(*dstMesh) * dstMesh->indexCount;
 
         // depth-only rendering
         dstMesh->vertexDataByteOffsetDepth = m_Header.vertexDataByteSizeDepth;
@@ -384,19 +402,15 @@ bool AssimpModel::LoadAssimp(const char *filename)
             dstBitangent = (float*)((unsigned char*)dstBitangent + dstMesh->vertexStride);
         }
 
-        uint16_t *dstIndex = (uint16_t*)(m_pIndexData + dstMesh->indexDataByteOffset);
-        uint16_t *dstIndexDepth = (uint16_t*)(m_pIndexDataDepth + dstMesh->indexDataByteOffset);
-        for (unsigned int f = 0; f < srcMesh->mNumFaces; f++)
+        if (dstMesh->indexFormat == index_format_uint32)
         {
-            assert(srcMesh->mFaces[f].mNumIndices == 3);
-
-            *dstIndex++ = srcMesh->mFaces[f].mIndices[0];
-            *dstIndex++ = srcMesh->mFaces[f].mIndices[1];
-            *dstIndex++ = srcMesh->mFaces[f].mIndices[2];
-
-            *dstIndexDepth++ = srcMesh->mFaces[f].mIndices[0];
-            *dstIndexDepth++ = srcMesh->mFaces[f].mIndices[1];
-            *dstIndexDepth++ = srcMesh->mFaces[f].mIndices[2];
+            CopyFaces(srcMesh, (uint32_t*)(m_pIndexData + dstMesh->indexDataByteOffset),
+                (uint32_t*)(m_pIndexDataDepth + dstMesh->indexDataByteOffset));
+        }
+        else
+        {
+            CopyFaces(srcMesh, (uint16_t*)(m_pIndexData + dstMesh->indexDataByteOffset),
+                (uint16_t*)(m_pIndexDataDepth + dstMesh->indexDataByteOffset));
         }
     }
 
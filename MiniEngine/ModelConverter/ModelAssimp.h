@@ -27,6 +27,15 @@ public:
     static const char *s_FormatString[];
     static int FormatFromFilename(const char *filename);
 
+    AssimpModel() : m_WeldEpsilon(0.0f), m_SplitLargeMeshes(false) {}
+
+    // Vertices whose float attributes all round to the same multiple of epsilon are welded together. Zero (the
+    // default) welds only exact duplicates.
+    void SetWeldEpsilon(float epsilon) { m_WeldEpsilon = epsilon; }
+
+    // Meshes too large for 16-bit indices are split along meshlet boundaries rather than using 32-bit indices.
+    void SetSplitLargeMeshes(bool split) { m_SplitLargeMeshes = split; }
+
     virtual bool Load(const char* filename) override;
     bool Save(const char* filename) const;
 
@@ -35,8 +44,13 @@ private:
     bool LoadAssimp(const char *filename);
 
     void Optimize();
+    void SplitLargeMeshes();
     void OptimizeRemoveDuplicateVertices(bool depth);
+    void OptimizeIndexFormat();
     void OptimizePostTransform(bool depth);
     void OptimizePreTransform(bool depth);
+
+    float m_WeldEpsilon;
+    bool m_SplitLargeMeshes;
 };
 
@@ -14,13 +14,17 @@
 #include "ModelAssimp.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 void PrintHelp()
 {
     printf("model_convert\n");
 
     printf("usage:\n");
-    printf("model_convert input_file output_file\n");
+    printf("model_convert [-weld epsilon] [-split] input_file output_file\n");
+    printf("  -weld epsilon  weld vertices whose attributes differ by less than epsilon (default: exact duplicates only)\n");
+    printf("  -split         split meshes too large for 16-bit indices along meshlet boundaries (default: 32-bit indices)\n");
 }
 
 void PrintModelStats(const Model *model)
@@ -71,6 +75,7 @@ void PrintModelStats(const Model *model)
         printf("mesh %u\n", meshIndex);
         printf("vertices: %u\n", mesh->vertexCount);
         printf("indices: %u\n", mesh->indexCount);
+        printf("index format: %s\n", mesh->indexFormat == Model::index_format_uint32 ? "uint32" : "uint16");
         printf("vertex stride: %u\n", mesh->vertexStride);
         for (int n = 0; n < Model::maxAttribs; n++)
         {
@@ -112,19 +117,47 @@ void PrintModelStats(const Model *model)
 
 int main(int argc, char **argv)
 {
-    if (argc != 3)
+    float weld_epsilon = 0.0f;
+    bool split_large_meshes = false;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if (0 == strcmp(argv[arg], "-weld") && arg + 1 < argc)
+        {
+            weld_epsilon = (float)atof(argv[++arg]);
+            if (!(weld_epsilon > 0.0f))
+            {
+                printf("invalid weld epsilon: %s\n", argv[arg]);
+                return -1;
+            }
+        }
+        else if (0 == strcmp(argv[arg], "-split"))
+        {
+            split_large_meshes = true;
+        }
+        else
+        {
+            PrintHelp();
+            return -1;
+        }
+    }
+
+    if (argc - arg != 2)
     {
         PrintHelp();
         return -1;
     }
 
-    const char *input_file = argv[1];
-    const char *output_file = argv[2];
+    const char *input_file = argv[arg];
+    const char *output_file = argv[arg + 1];
 
     printf("input file %s\n", input_file);
     printf("output file %s\n", output_file);
 
     AssimpModel model;
+    model.SetWeldEpsilon(weld_epsilon);
+    model.SetSplitLargeMeshes(split_large_meshes);
 
     printf("loading...\n");
     if (!model.Load(input_file))
@@ -14,74 +14,319 @@
 #include "ModelAssimp.h"
 #include "IndexOptimizePostTransform.h"
 
+#include <chrono>
+#include <math.h>
+#include <ppl.h>
 #include <string.h>
+#include <vector>
 
-void AssimpModel::OptimizeRemoveDuplicateVertices(bool depth)
+namespace
 {
-    unsigned char *deduplicatedVertexData = new unsigned char [depth ? m_Header.vertexDataByteSizeDepth : m_Header.vertexDataByteSize];
-    uint32_t deduplicatedVertexDataSize = 0;
+    const uint32_t kEmptySlot = (uint32_t)-1;
 
-    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    uint64_t HashVertex(const unsigned char *data, unsigned int stride)
     {
-        Mesh *mesh = m_pMesh + meshIndex;
-        unsigned int vertexStride = depth ? mesh->vertexStrideDepth : mesh->vertexStride;
-        unsigned char *meshVertexData = depth ? (m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth) : (m_pVertexData + mesh->vertexDataByteOffset);
+        // FNV-1a, a word at a time
+        uint64_t hash = 0xcbf29ce484222325ull;
 
-        unsigned char *meshDeduplicatedVertexData = deduplicatedVertexData + deduplicatedVertexDataSize;
-        unsigned int deduplicatedCount = 0;
+        unsigned int n = 0;
+        for (; n + sizeof(uint32_t) <= stride; n += sizeof(uint32_t))
+        {
+            uint32_t word;
+            memcpy(&word, data + n, sizeof(word));
+            hash = (hash ^ word) * 0x100000001b3ull;
+        }
+        for (; n < stride; n++)
+        {
+            hash = (hash ^ data[n]) * 0x100000001b3ull;
+        }
 
-        unsigned int vertexCount = depth ? mesh->vertexCountDepth : mesh->vertexCount;
-        uint32_t *vertexRemap = new uint32_t [vertexCount];
-        memset(vertexRemap, (uint32_t)-1, sizeof(uint32_t) * vertexCount);
-        assert(vertexCount <= (uint32_t)-1);
+        return hash ^ (hash >> 32);
+    }
+
+    // Snaps every float component to a grid of epsilon sized cells, so vertices falling in the same cell compare
+    // equal. Welded vertices never differ by more than epsilon, but vertices closer than that may still straddle a
+    // cell boundary and stay separate. Non-float components are compared exactly.
+    void BuildWeldKeys(const unsigned char *vertexData, unsigned int vertexCount, unsigned int vertexStride,
+        const Model::Attrib *attribs, float epsilon, unsigned char *keyData)
+    {
+        memcpy(keyData, vertexData, (size_t)vertexCount * vertexStride);
 
-        for (unsigned int v1 = 0; v1 < vertexCount; v1++)
+        for (int a = 0; a < Model::maxAttribs; a++)
         {
-            if (vertexRemap[v1] != (uint32_t)-1)
-                continue; // this was already found to be a duplicate
+            if (attribs[a].format != Model::attrib_format_float)
+                continue;
+
+            for (unsigned int v = 0; v < vertexCount; v++)
+            {
+                unsigned char *key = keyData + (size_t)v * vertexStride + attribs[a].offset;
+
+                for (unsigned int c = 0; c < attribs[a].components; c++)
+                {
+                    float value;
+                    memcpy(&value, key + c * sizeof(float), sizeof(float));
+
+                    // Leave values beyond the grid's range (and NaNs) as they are
+                    float cell = floorf(value / epsilon + 0.5f);
+                    if (!(fabsf(cell) < 2147483648.0f))
+                        continue;
+
+                    int32_t snapped = (int32_t)cell;
+                    memcpy(key + c * sizeof(float), &snapped, sizeof(int32_t));
+                }
+            }
+        }
+    }
 
-            const unsigned char *v1Data = meshVertexData + v1 * vertexStride;
+    // Welds vertices with equal keys, keeping the first of each in its original order. Each vertex is hashed into an
+    // open addressing table once, so welding is linear in the vertex count.
+    unsigned int WeldVertices(const unsigned char *vertexData, const unsigned char *keyData, unsigned int vertexCount,
+        unsigned int vertexStride, unsigned char *weldedVertexData, uint32_t *vertexRemap)
+    {
+        size_t tableSize = 16;
+        while (tableSize < (size_t)vertexCount * 2)
+            tableSize *= 2;
+
+        // Each slot holds the first vertex with a given key; its remap is the index of the welded vertex
+        std::vector<uint32_t> table(tableSize, kEmptySlot);
+        unsigned int weldedCount = 0;
 
-            // this is a new unique vertex
-            uint32_t remappedSlot = deduplicatedCount++;
-            vertexRemap[v1] = remappedSlot;
-            memcpy(meshDeduplicatedVertexData + remappedSlot * vertexStride, v1Data, vertexStride);
+        for (unsigned int v = 0; v < vertexCount; v++)
+        {
+            const unsigned char *key = keyData + (size_t)v * vertexStride;
 
-            // scan for duplicates
-            for (unsigned int v2 = v1 + 1; v2 < vertexCount; v2++)
+            for (size_t slot = HashVertex(key, vertexStride) & (tableSize - 1); ; slot = (slot + 1) & (tableSize - 1))
             {
-                if (vertexRemap[v2] != (uint32_t)-1)
-                    continue; // this was already found to be a duplicate of another vertex
+                uint32_t first = table[slot];
 
-                const unsigned char *v2Data = meshVertexData + v2 * vertexStride;
+                if (first == kEmptySlot)
+                {
+                    // this is a new unique vertex
+                    table[slot] = v;
+                    memcpy(weldedVertexData + (size_t)weldedCount * vertexStride, vertexData + (size_t)v * vertexStride, vertexStride);
+                    vertexRemap[v] = weldedCount++;
+                    break;
+                }
 
-                if (0 == memcmp(v1Data, v2Data, vertexStride))
+                if (0 == memcmp(keyData + (size_t)first * vertexStride, key, vertexStride))
                 {
-                    vertexRemap[v2] = remappedSlot;
+                    vertexRemap[v] = vertexRemap[first];
+                    break;
                 }
             }
         }
 
-        unsigned int indexCount = mesh->indexCount;
-        uint16_t *indexArray = (uint16_t*)((depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset);
+        return weldedCount;
+    }
+
+    template <typename IndexType>
+    void RemapIndices(IndexType *indexArray, unsigned int indexCount, const uint32_t *vertexRemap)
+    {
         for (unsigned int n = 0; n < indexCount; n++)
         {
-            indexArray[n] = vertexRemap[indexArray[n]];
+            indexArray[n] = (IndexType)vertexRemap[indexArray[n]];
         }
+    }
 
-        delete [] vertexRemap;
+    void NarrowIndices(uint16_t *dst, const uint32_t *src, unsigned int indexCount)
+    {
+        for (unsigned int n = 0; n < indexCount; n++)
+        {
+            dst[n] = (uint16_t)src[n];
+        }
+    }
 
-        if (depth)
+    template <typename IndexType>
+    void OptimizeMeshFaces(IndexType *indexArray, unsigned int indexCount, uint16_t lruCacheSize)
+    {
+        std::vector<IndexType> srcIndices(indexArray, indexArray + indexCount);
+        OptimizeFaces<IndexType>(srcIndices.data(), indexCount, indexArray, lruCacheSize);
+    }
+
+    // Moves vertices into the order the indices first reference them, remapping the indices to match.
+    template <typename IndexType>
+    void ReorderVertices(IndexType *indexArray, unsigned int indexCount, const unsigned char *vertexData,
+        unsigned int vertexCount, unsigned int vertexStride, unsigned char *reorderedVertexData)
+    {
+        std::vector<uint32_t> vertexRemap(vertexCount, (uint32_t)-1);
+        unsigned int reorderedCount = 0;
+
+        for (unsigned int n = 0; n < indexCount; n++)
         {
-            mesh->vertexCountDepth = deduplicatedCount;
-            mesh->vertexDataByteOffsetDepth = deduplicatedVertexDataSize;
+            IndexType index = indexArray[n];
+            if (vertexRemap[index] == (uint32_t)-1)
+            {
+                // not relocated yet
+                const unsigned char *vSrc = vertexData + (size_t)index * vertexStride;
+                unsigned char *vDst = reorderedVertexData + (size_t)reorderedCount * vertexStride;
+                memcpy(vDst, vSrc, vertexStride);
+
+                vertexRemap[index] = reorderedCount;
+                reorderedCount++;
+            }
+            indexArray[n] = (IndexType)vertexRemap[index];
         }
-        else
+    }
+
+    // A range of a split mesh, gathered from the source mesh's vertices.
+    struct MeshPart
+    {
+        std::vector<uint32_t> vertices;
+        std::vector<uint16_t> indices;
+    };
+
+    // Groups the triangles into meshlets of at most 64 vertices & 126 triangles in post-transform cache order, then
+    // packs whole meshlets into parts that fit 16-bit indices. Each part is a spatially coherent run of meshlets.
+    void SplitMesh(const uint32_t *indexArray, unsigned int indexCount, unsigned int vertexCount, std::vector<MeshPart> &parts)
+    {
+        enum { maxMeshletVertices = 64, maxMeshletTriangles = 126, maxPartVertices = 0xffff };
+
+        std::vector<uint32_t> orderedIndices(indexCount);
+        OptimizeFaces<uint32_t>(indexArray, indexCount, orderedIndices.data(), 64);
+
+        // first triangle & vertex count of each meshlet
+        std::vector<unsigned int> meshletStarts;
+        std::vector<unsigned int> meshletVertexCounts;
+        std::vector<uint32_t> meshletStamp(vertexCount, (uint32_t)-1);
+
+        unsigned int triangleCount = indexCount / 3;
+        if (triangleCount == 0)
+            return;
+
+        uint32_t meshletId = 0;
+        unsigned int meshletVertexCount = 0;
+        unsigned int meshletTriangleCount = 0;
+        meshletStarts.push_back(0);
+
+        for (unsigned int t = 0; t < triangleCount; t++)
+        {
+            const uint32_t *tri = orderedIndices.data() + t * 3;
+
+            unsigned int newVertices = 0;
+            for (int i = 0; i < 3; i++)
+            {
+                bool repeated = (i > 0 && tri[i] == tri[0]) || (i > 1 && tri[i] == tri[1]);
+                if (!repeated && meshletStamp[tri[i]] != meshletId)
+                    newVertices++;
+            }
+
+            if (meshletVertexCount + newVertices > maxMeshletVertices || meshletTriangleCount == maxMeshletTriangles)
+            {
+                meshletVertexCounts.push_back(meshletVertexCount);
+                meshletStarts.push_back(t);
+                meshletId++;
+                meshletVertexCount = 0;
+                meshletTriangleCount = 0;
+            }
+
+            for (int i = 0; i < 3; i++)
+            {
+                if (meshletStamp[tri[i]] != meshletId)
+                {
+                    meshletStamp[tri[i]] = meshletId;
+                    meshletVertexCount++;
+                }
+            }
+            meshletTriangleCount++;
+        }
+        meshletVertexCounts.push_back(meshletVertexCount);
+
+        // local index of each vertex in the part it was last added to
+        std::vector<uint32_t> partStamp(vertexCount, (uint32_t)-1);
+        std::vector<uint16_t> partIndex(vertexCount);
+
+        for (size_t m = 0; m < meshletStarts.size(); m++)
         {
+            if (parts.empty() || parts.back().vertices.size() + meshletVertexCounts[m] > maxPartVertices)
+                parts.emplace_back();
+
+            MeshPart &part = parts.back();
+            uint32_t partId = (uint32_t)parts.size() - 1;
+
+            unsigned int end = m + 1 < meshletStarts.size() ? meshletStarts[m + 1] : triangleCount;
+            for (unsigned int n = meshletStarts[m] * 3; n < end * 3; n++)
+            {
+                uint32_t v = orderedIndices[n];
+                if (partStamp[v] != partId)
+                {
+                    partStamp[v] = partId;
+                    partIndex[v] = (uint16_t)part.vertices.size();
+                    part.vertices.push_back(v);
+                }
+                part.indices.push_back(partIndex[v]);
+            }
+        }
+    }
+}
+
+void AssimpModel::OptimizeRemoveDuplicateVertices(bool depth)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::vector<unsigned char>> meshWeldedVertexData(m_Header.meshCount);
+    std::vector<unsigned int> meshVertexCounts(m_Header.meshCount);
+
+    // meshes share no vertices or indices, so they're welded in parallel
+    concurrency::parallel_for(0u, m_Header.meshCount, [&](unsigned int meshIndex)
+    {
+        Mesh *mesh = m_pMesh + meshIndex;
+        unsigned int vertexStride = depth ? mesh->vertexStrideDepth : mesh->vertexStride;
+        unsigned char *meshVertexData = depth ? (m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth) : (m_pVertexData + mesh->vertexDataByteOffset);
+        const Attrib *attribs = depth ? mesh->attribDepth : mesh->attrib;
+
+        unsigned int vertexCount = depth ? mesh->vertexCountDepth : mesh->vertexCount;
+        meshVertexCounts[meshIndex] = vertexCount;
+
+        std::vector<unsigned char> keyData;
+        const unsigned char *meshKeyData = meshVertexData;
+        if (m_WeldEpsilon > 0.0f)
+        {
+            keyData.resize((size_t)vertexCount * vertexStride);
+            BuildWeldKeys(meshVertexData, vertexCount, vertexStride, attribs, m_WeldEpsilon, keyData.data());
+            meshKeyData = keyData.data();
+        }
+
+        std::vector<unsigned char> &weldedVertexData = meshWeldedVertexData[meshIndex];
+        weldedVertexData.resize((size_t)vertexCount * vertexStride);
+
+        std::vector<uint32_t> vertexRemap(vertexCount);
+        unsigned int deduplicatedCount = WeldVertices(meshVertexData, meshKeyData, vertexCount, vertexStride, weldedVertexData.data(), vertexRemap.data());
+        weldedVertexData.resize((size_t)deduplicatedCount * vertexStride);
+
+        unsigned char *indexData = (depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset;
+        if (mesh->indexFormat == index_format_uint32)
+            RemapIndices((uint32_t*)indexData, mesh->indexCount, vertexRemap.data());
+        else
+            RemapIndices((uint16_t*)indexData, mesh->indexCount, vertexRemap.data());
+
+        if (depth)
+            mesh->vertexCountDepth = deduplicatedCount;
+        else
             mesh->vertexCount = deduplicatedCount;
+    });
+
+    // pack the welded meshes back together in order
+    unsigned char *deduplicatedVertexData = new unsigned char [depth ? m_Header.vertexDataByteSizeDepth : m_Header.vertexDataByteSize];
+    uint32_t deduplicatedVertexDataSize = 0;
+    unsigned int vertexCountBefore = 0;
+    unsigned int vertexCountAfter = 0;
+
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        Mesh *mesh = m_pMesh + meshIndex;
+        const std::vector<unsigned char> &weldedVertexData = meshWeldedVertexData[meshIndex];
+
+        if (!weldedVertexData.empty())
+            memcpy(deduplicatedVertexData + deduplicatedVertexDataSize, weldedVertexData.data(), weldedVertexData.size());
+
+        if (depth)
+            mesh->vertexDataByteOffsetDepth = deduplicatedVertexDataSize;
+        else
             mesh->vertexDataByteOffset = deduplicatedVertexDataSize;
-        }
-        deduplicatedVertexDataSize += deduplicatedCount * vertexStride;
+
+        deduplicatedVertexDataSize += (uint32_t)weldedVertexData.size();
+        vertexCountBefore += meshVertexCounts[meshIndex];
+        vertexCountAfter += depth ? mesh->vertexCountDepth : mesh->vertexCount;
     }
 
     if (depth)
@@ -96,6 +341,9 @@ void AssimpModel::OptimizeRemoveDuplicateVertices(bool depth)
         m_pVertexData = deduplicatedVertexData;
         m_Header.vertexDataByteSize = deduplicatedVertexDataSize;
     }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+    printf("welded %svertices: %u -> %u in %.2f ms\n", depth ? "depth-only " : "", vertexCountBefore, vertexCountAfter, elapsed.count());
 }
 
 void AssimpModel::OptimizePostTransform(bool depth)
@@ -106,13 +354,11 @@ void AssimpModel::OptimizePostTransform(bool depth)
     {
         Mesh *mesh = m_pMesh + meshIndex;
 
-        uint16_t *srcIndices = new uint16_t [mesh->indexCount];
-        uint16_t *dstIndices = (uint16_t*)((depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset);
-        memcpy(srcIndices, dstIndices, sizeof(uint16_t) * mesh->indexCount);
-
-        OptimizeFaces<uint16_t>(srcIndices, mesh->indexCount, dstIndices, lruCacheSize);
-
-        delete [] srcIndices;
+        unsigned char *indexData = (depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset;
+        if (mesh->indexFormat == index_format_uint32)
+            OptimizeMeshFaces((uint32_t*)indexData, mesh->indexCount, lruCacheSize);
+        else
+            OptimizeMeshFaces((uint16_t*)indexData, mesh->indexCount, lruCacheSize);
     }
 }
 
@@ -123,36 +369,16 @@ void AssimpModel::OptimizePreTransform(bool depth)
     for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
     {
         Mesh *mesh = m_pMesh + meshIndex;
-        unsigned int indexCount = mesh->indexCount;
         unsigned int vertexStride = depth ? mesh->vertexStrideDepth : mesh->vertexStride;
         unsigned char *meshVertexData = depth ? (m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth) : (m_pVertexData + mesh->vertexDataByteOffset);
-
         unsigned char *meshReorderedVertexData = reorderedVertexData + (depth ? mesh->vertexDataByteOffsetDepth : mesh->vertexDataByteOffset);
-        unsigned int reorderedCount = 0;
-
         unsigned int vertexCount = depth ? mesh->vertexCountDepth : mesh->vertexCount;
-        uint32_t *vertexRemap = new uint32_t [vertexCount];
-        memset(vertexRemap, (uint32_t)-1, sizeof(uint32_t) * vertexCount);
-        assert(vertexCount <= (uint32_t)-1);
 
-        uint16_t *indexArray = (uint16_t*)((depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset);
-        for (unsigned int n = 0; n < indexCount; n++)
-        {
-            uint16_t index = indexArray[n];
-            if (vertexRemap[index] == (uint32_t)-1)
-            {
-                // not relocated yet
-                const unsigned char *vSrc = meshVertexData + index * vertexStride;
-                unsigned char *vDst = meshReorderedVertexData + reorderedCount * vertexStride;
-                memcpy(vDst, vSrc, vertexStride);
-
-                vertexRemap[index] = reorderedCount;
-                reorderedCount++;
-            }
-            indexArray[n] = vertexRemap[index];
-        }
-
-        delete [] vertexRemap;
+        unsigned char *indexData = (depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset;
+        if (mesh->indexFormat == index_format_uint32)
+            ReorderVertices((uint32_t*)indexData, mesh->indexCount, meshVertexData, vertexCount, vertexStride, meshReorderedVertexData);
+        else
+            ReorderVertices((uint16_t*)indexData, mesh->indexCount, meshVertexData, vertexCount, vertexStride, meshReorderedVertexData);
     }
 
     if (depth)
@@ -167,12 +393,203 @@ void AssimpModel::OptimizePreTransform(bool depth)
     }
 }
 
+void AssimpModel::SplitLargeMeshes()
+{
+    // The color and depth-only streams still match one to one before welding, so both are split the same way.
+    std::vector<std::vector<MeshPart>> meshParts(m_Header.meshCount);
+
+    concurrency::parallel_for(0u, m_Header.meshCount, [&](unsigned int meshIndex)
+    {
+        const Mesh *mesh = m_pMesh + meshIndex;
+        if (mesh->indexFormat != index_format_uint32)
+            return;
+
+        assert(mesh->vertexCount == mesh->vertexCountDepth);
+        SplitMesh((const uint32_t*)(m_pIndexData + mesh->indexDataByteOffset), mesh->indexCount, mesh->vertexCount, meshParts[meshIndex]);
+    });
+
+    unsigned int splitCount = 0;
+    unsigned int newMeshCount = 0;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        splitCount += meshParts[meshIndex].empty() ? 0 : 1;
+        newMeshCount += meshParts[meshIndex].empty() ? 1 : (unsigned int)meshParts[meshIndex].size();
+    }
+
+    if (splitCount == 0)
+        return;
+
+    Mesh *newMesh = new Mesh [newMeshCount];
+    uint32_t vertexDataByteSize = 0;
+    uint32_t vertexDataByteSizeDepth = 0;
+    uint32_t indexDataByteSize = 0;
+
+    // first pass, lay out the parts. Vertices on the seams are repeated in each part that uses them.
+    unsigned int partIndex = 0;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        const Mesh *mesh = m_pMesh + meshIndex;
+        const std::vector<MeshPart> &parts = meshParts[meshIndex];
+
+        for (size_t p = 0; p < (parts.empty() ? 1 : parts.size()); p++)
+        {
+            Mesh *dstMesh = newMesh + partIndex++;
+            *dstMesh = *mesh;
+
+            if (!parts.empty())
+            {
+                dstMesh->vertexCount = (unsigned int)parts[p].vertices.size();
+                dstMesh->vertexCountDepth = dstMesh->vertexCount;
+                dstMesh->indexCount = (unsigned int)parts[p].indices.size();
+                dstMesh->indexFormat = index_format_uint16;
+            }
+
+            if (dstMesh->indexFormat == index_format_uint32)
+                indexDataByteSize = (indexDataByteSize + 3) & ~3u;
+
+            dstMesh->vertexDataByteOffset = vertexDataByteSize;
+            dstMesh->vertexDataByteOffsetDepth = vertexDataByteSizeDepth;
+            dstMesh->indexDataByteOffset = indexDataByteSize;
+
+            vertexDataByteSize += dstMesh->vertexStride * dstMesh->vertexCount;
+            vertexDataByteSizeDepth += dstMesh->vertexStrideDepth * dstMesh->vertexCountDepth;
+            indexDataByteSize += GetIndexSize(*dstMesh) * dstMesh->indexCount;
+        }
+    }
+
+    unsigned char *newVertexData = new unsigned char [vertexDataByteSize];
+    unsigned char *newVertexDataDepth = new unsigned char [vertexDataByteSizeDepth];
+    unsigned char *newIndexData = new unsigned char [indexDataByteSize];
+    unsigned char *newIndexDataDepth = new unsigned char [indexDataByteSize];
+
+    // second pass, gather the vertices and indices
+    partIndex = 0;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        const Mesh *mesh = m_pMesh + meshIndex;
+        const std::vector<MeshPart> &parts = meshParts[meshIndex];
+
+        if (parts.empty())
+        {
+            const Mesh *dstMesh = newMesh + partIndex++;
+            memcpy(newVertexData + dstMesh->vertexDataByteOffset, m_pVertexData + mesh->vertexDataByteOffset, mesh->vertexStride * mesh->vertexCount);
+            memcpy(newVertexDataDepth + dstMesh->vertexDataByteOffsetDepth, m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth, mesh->vertexStrideDepth * mesh->vertexCountDepth);
+            memcpy(newIndexData + dstMesh->indexDataByteOffset, m_pIndexData + mesh->indexDataByteOffset, GetIndexSize(*mesh) * mesh->indexCount);
+            memcpy(newIndexDataDepth + dstMesh->indexDataByteOffset, m_pIndexDataDepth + mesh->indexDataByteOffset, GetIndexSize(*mesh) * mesh->indexCount);
+            continue;
+        }
+
+        for (const MeshPart &part : parts)
+        {
+            const Mesh *dstMesh = newMesh + partIndex++;
+
+            for (size_t v = 0; v < part.vertices.size(); v++)
+            {
+                memcpy(newVertexData + dstMesh->vertexDataByteOffset + v * mesh->vertexStride,
+                    m_pVertexData + mesh->vertexDataByteOffset + (size_t)part.vertices[v] * mesh->vertexStride, mesh->vertexStride);
+                memcpy(newVertexDataDepth + dstMesh->vertexDataByteOffsetDepth + v * mesh->vertexStrideDepth,
+                    m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth + (size_t)part.vertices[v] * mesh->vertexStrideDepth, mesh->vertexStrideDepth);
+            }
+
+            memcpy(newIndexData + dstMesh->indexDataByteOffset, part.indices.data(), sizeof(uint16_t) * part.indices.size());
+            memcpy(newIndexDataDepth + dstMesh->indexDataByteOffset, part.indices.data(), sizeof(uint16_t) * part.indices.size());
+        }
+    }
+
+    printf("split %u meshes for 16-bit indices: %u -> %u meshes\n", splitCount, m_Header.meshCount, newMeshCount);
+
+    delete [] m_pMesh;
+    delete [] m_pVertexData;
+    delete [] m_pVertexDataDepth;
+    delete [] m_pIndexData;
+    delete [] m_pIndexDataDepth;
+
+    m_pMesh = newMesh;
+    m_pVertexData = newVertexData;
+    m_pVertexDataDepth = newVertexDataDepth;
+    m_pIndexData = newIndexData;
+    m_pIndexDataDepth = newIndexDataDepth;
+
+    m_Header.meshCount = newMeshCount;
+    m_Header.vertexDataByteSize = vertexDataByteSize;
+    m_Header.vertexDataByteSizeDepth = vertexDataByteSizeDepth;
+    m_Header.indexDataByteSize = indexDataByteSize;
+
+    ComputeAllBoundingBoxes();
+}
+
+void AssimpModel::OptimizeIndexFormat()
+{
+    // loading picks the index format from the unwelded vertex count; meshes that welded down to 0xffff
+    // vertices or fewer in both streams switch to 16-bit indices, keeping 0xffff free as the strip cut value
+    unsigned int narrowCount = 0;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        const Mesh *mesh = m_pMesh + meshIndex;
+        if (mesh->indexFormat == index_format_uint32 && mesh->vertexCount <= 0xffff && mesh->vertexCountDepth <= 0xffff)
+            narrowCount++;
+    }
+
+    if (narrowCount == 0)
+        return;
+
+    // offsets only shrink, so the repacked data fits in the current size
+    unsigned char *newIndexData = new unsigned char [m_Header.indexDataByteSize];
+    unsigned char *newIndexDataDepth = new unsigned char [m_Header.indexDataByteSize];
+
+    uint32_t indexDataByteSize = 0;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        Mesh *mesh = m_pMesh + meshIndex;
+        const uint32_t srcOffset = mesh->indexDataByteOffset;
+
+        const bool narrow = mesh->indexFormat == index_format_uint32 && mesh->vertexCount <= 0xffff && mesh->vertexCountDepth <= 0xffff;
+        if (narrow)
+            mesh->indexFormat = index_format_uint16;
+        else if (mesh->indexFormat == index_format_uint32)
+            indexDataByteSize = (indexDataByteSize + 3) & ~3u;
+
+        mesh->indexDataByteOffset = indexDataByteSize;
+
+        if (narrow)
+        {
+            NarrowIndices((uint16_t *)(newIndexData + indexDataByteSize), (const uint32_t *)(m_pIndexData + srcOffset), mesh->indexCount);
+            NarrowIndices((uint16_t *)(newIndexDataDepth + indexDataByteSize), (const uint32_t *)(m_pIndexDataDepth + srcOffset), mesh->indexCount);
+        }
+        else
+        {
+            memcpy(newIndexData + indexDataByteSize, m_pIndexData + srcOffset, GetIndexSize(*mesh) * mesh->indexCount);
+            memcpy(newIndexDataDepth + indexDataByteSize, m_pIndexDataDepth + srcOffset, GetIndexSize(*mesh) * mesh->indexCount);
+        }
+
+        indexDataByteSize += GetIndexSize(*mesh) * mesh->indexCount;
+    }
+
+    printf("narrowed %u welded meshes to 16-bit indices: %u -> %u index bytes\n", narrowCount, m_Header.indexDataByteSize, indexDataByteSize);
+
+    delete [] m_pIndexData;
+    delete [] m_pIndexDataDepth;
+
+    m_pIndexData = newIndexData;
+    m_pIndexDataDepth = newIndexDataDepth;
+
+    m_Header.indexDataByteSize = indexDataByteSize;
+}
+
 void AssimpModel::Optimize()
 {
     // TODO: quantize/compress vertex data
 
-    OptimizeRemoveDuplicateVertices(false);
-    OptimizeRemoveDuplicateVertices(true);
+    if (m_SplitLargeMeshes)
+        SplitLargeMeshes();
+
+    // the main and depth-only streams are independent
+    concurrency::parallel_invoke(
+        [this] { OptimizeRemoveDuplicateVertices(false); },
+        [this] { OptimizeRemoveDuplicateVertices(true); });
+
+    // welding can bring 32-bit meshes back under the 16-bit limit
+    OptimizeIndexFormat();
 
     // re-order indices for post transform cache
     OptimizePostTransform(false);
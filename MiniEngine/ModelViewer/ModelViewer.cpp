@@ -317,6 +317,7 @@ void ModelViewer::RenderObjects( GraphicsContext& gfxContext, const Matrix4& Vie
     gfxContext.SetDynamicConstantBufferView(0, sizeof(vsConstants), &vsConstants);
 
     uint32_t materialIdx = 0xFFFFFFFFul;
+    uint32_t indexFormat = 0xFFFFFFFFul;
 
     uint32_t VertexStride = m_Model.m_VertexStride;
 
@@ -325,7 +326,7 @@ void ModelViewer::RenderObjects( GraphicsContext& gfxContext, const Matrix4& Vie
         const Model::Mesh& mesh = m_Model.m_pMesh[meshIndex];
 
         uint32_t indexCount = mesh.indexCount;
-        uint32_t startIndex = mesh.indexDataByteOffset / sizeof(uint16_t);
+        uint32_t startIndex = mesh.indexDataByteOffset / Model::GetIndexSize(mesh);
         uint32_t baseVertex = mesh.vertexDataByteOffset / VertexStride;
 
         if (mesh.materialIndex != materialIdx)
@@ -338,6 +339,13 @@ void ModelViewer::RenderObjects( GraphicsContext& gfxContext, const Matrix4& Vie
             gfxContext.SetDynamicDescriptors(2, 0, 6, m_Model.GetSRVs(materialIdx) );
         }
 
+        if (mesh.indexFormat != indexFormat)
+        {
+            indexFormat = mesh.indexFormat;
+            gfxContext.SetIndexBuffer(m_Model.m_IndexBuffer.IndexBufferView(0, (uint32_t)m_Model.m_IndexBuffer.GetBufferSize(),
+                indexFormat == Model::index_format_uint32));
+        }
+
         gfxContext.SetConstants(4, baseVertex, materialIdx);
 
         gfxContext.DrawIndexed(indexCount, startIndex, baseVertex);
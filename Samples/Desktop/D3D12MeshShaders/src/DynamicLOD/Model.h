@@ -12,6 +12,7 @@
 
 #include "Span.h"
 
+#include <D3D12MeshletLoader.h>
 #include <DirectXCollision.h>
 
 struct Attribute
@@ -67,6 +68,16 @@ struct CullData
     float             ApexOffset;     // apex = center - axis * offset
 };
 
+struct ClusterLod
+{
+    DirectX::XMFLOAT4 LodBounds;        // xyz = center, w = radius of the group this meshlet was generated from
+    DirectX::XMFLOAT4 ParentLodBounds;  // Bounds of the group this meshlet is simplified into
+    float             Error;            // Object-space error bound relative to the source mesh
+    float             ParentError;      // Error of the meshlets replacing this one; FLT_MAX at the roots
+    uint32_t          Level;
+    uint32_t          Group;
+};
+
 struct Mesh
 {
     D3D12_INPUT_ELEMENT_DESC   LayoutElems[Attribute::Count];
@@ -88,6 +99,11 @@ struct Mesh
     Span<PackedTriangle>       PrimitiveIndices;
     Span<CullData>             CullingData;
 
+    uint32_t                   LodLevel; // Position in a level of detail chain, and its error relative to level 0
+    float                      LodError;
+
+    Span<ClusterLod>           Clusters; // One per meshlet when the mesh carries a cluster hierarchy
+
     // D3D resource references
     std::vector<D3D12_VERTEX_BUFFER_VIEW>  VBViews;
     D3D12_INDEX_BUFFER_VIEW                IBView;
@@ -120,6 +136,11 @@ struct Mesh
         i2 = prim.i2;
     }
 
+    // Gathers the meshlets forming the cluster hierarchy cut for a viewer at viewPosition (in mesh space). Errors are
+    // projected by errorScale / distance - e.g. viewport height / (2 * tan(fovY / 2)) for pixels - and each meshlet
+    // is selected when its own projected error is within the threshold but its parent's is not.
+    void SelectClusters(DirectX::FXMVECTOR viewPosition, float errorScale, float threshold, std::vector<uint32_t>& meshlets) const;
+
     uint32_t GetVertexIndex(uint32_t index) const
     {
         const uint8_t* addr = UniqueVertexIndices.data() + index * IndexSize;
@@ -153,5 +174,5 @@ private:
     std::vector<Mesh>                      m_meshes;
     DirectX::BoundingSphere                m_boundingSphere;
 
-    std::vector<uint8_t>                   m_buffer;
+    MeshFile                               m_file;
 };
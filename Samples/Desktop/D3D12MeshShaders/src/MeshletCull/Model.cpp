@@ -13,7 +13,6 @@
 
 #include "DXSampleHelper.h"
 
-#include <fstream>
 #include <unordered_set>
 
 using namespace DirectX;
@@ -39,53 +38,6 @@ namespace
         12, // Bitangent
     };
 
-    const uint32_t c_prolog = 'MSHL';
-
-    enum FileVersion
-    {
-        FILE_VERSION_INITIAL = 0,
-        CURRENT_FILE_VERSION = FILE_VERSION_INITIAL
-    };
-
-    struct FileHeader
-    {
-        uint32_t Prolog;
-        uint32_t Version;
-
-        uint32_t MeshCount;
-        uint32_t AccessorCount;
-        uint32_t BufferViewCount;
-        uint32_t BufferSize;
-    };
-
-    struct MeshHeader
-    {
-        uint32_t Indices;
-        uint32_t IndexSubsets;
-        uint32_t Attributes[Attribute::Count];
-
-        uint32_t Meshlets;
-        uint32_t MeshletSubsets;
-        uint32_t UniqueVertexIndices;
-        uint32_t PrimitiveIndices;
-        uint32_t CullData;
-    };
-
-    struct BufferView
-    {
-        uint32_t Offset;
-        uint32_t Size;
-    };
-
-    struct Accessor
-    {
-        uint32_t BufferView;
-        uint32_t Offset;
-        uint32_t Size;
-        uint32_t Stride;
-        uint32_t Count;
-    };
-
     uint32_t GetFormatSize(DXGI_FORMAT format)
     { 
         switch(format)
@@ -115,78 +67,38 @@ namespace
 
 HRESULT Model::LoadFromFile(const wchar_t* filename)
 {
-    std::ifstream stream(filename, std::ios::binary);
-    if (!stream.is_open())
-    {
-        return E_INVALIDARG;
-    }
-
-    std::vector<MeshHeader> meshes;
-    std::vector<BufferView> bufferViews;
-    std::vector<Accessor> accessors;
-
-    FileHeader header;
-    stream.read(reinterpret_cast<char*>(&header), sizeof(header));
-
-    if (header.Prolog != c_prolog)
+    // The file is mapped rather than read - mesh data is paged in as it's first touched.
+    HRESULT hr = m_file.Open(filename);
+    if (FAILED(hr))
     {
-        return E_FAIL; // Incorrect file format.
+        return hr;
     }
 
-    if (header.Version != CURRENT_FILE_VERSION)
+    // Populate mesh data from the mapped file.
+    m_meshes.resize(m_file.GetMeshCount());
+    for (uint32_t i = 0; i < static_cast<uint32_t>(m_meshes.size()); ++i)
     {
-        return E_FAIL; // Version mismatch between export and import serialization code.
-    }
+        MeshFileMesh meshView;
 
-    // Read mesh metdata
-    meshes.resize(header.MeshCount);
-    stream.read(reinterpret_cast<char*>(meshes.data()), meshes.size() * sizeof(meshes[0]));
-    
-    accessors.resize(header.AccessorCount);
-    stream.read(reinterpret_cast<char*>(accessors.data()), accessors.size() * sizeof(accessors[0]));
-
-    bufferViews.resize(header.BufferViewCount);
-    stream.read(reinterpret_cast<char*>(bufferViews.data()), bufferViews.size() * sizeof(bufferViews[0]));
-
-    m_buffer.resize(header.BufferSize);
-    stream.read(reinterpret_cast<char*>(m_buffer.data()), header.BufferSize);
-
-    char eofbyte;
-    stream.read(&eofbyte, 1); // Read last byte to hit the eof bit
-
-    assert(stream.eof()); // There's a problem if we didn't completely consume the file contents.
-
-    stream.close();
+        hr = m_file.GetMesh(i, meshView);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
 
-    // Populate mesh data from binary data and metadata.
-    m_meshes.resize(meshes.size());
-    for (uint32_t i = 0; i < static_cast<uint32_t>(meshes.size()); ++i)
-    {
-        auto& meshView = meshes[i];
         auto& mesh = m_meshes[i];
 
         // Index data
-        {
-            Accessor& accessor = accessors[meshView.Indices];
-            BufferView& bufferView = bufferViews[accessor.BufferView];
-
-            mesh.IndexSize = accessor.Size;
-            mesh.IndexCount = accessor.Count;
-
-            mesh.Indices = MakeSpan(m_buffer.data() + bufferView.Offset, bufferView.Size);
-        }
+        mesh.IndexSize = meshView.Indices.ElementSize;
+        mesh.IndexCount = meshView.Indices.Count;
+        mesh.Indices = MakeSpan(meshView.Indices.Data, meshView.Indices.Size);
 
         // Index Subset data
-        {
-            Accessor& accessor = accessors[meshView.IndexSubsets];
-            BufferView& bufferView = bufferViews[accessor.BufferView];
-
-            mesh.IndexSubsets = MakeSpan(reinterpret_cast<Subset*>(m_buffer.data() + bufferView.Offset), accessor.Count);
-        }
+        mesh.IndexSubsets = MakeSpan(reinterpret_cast<Subset*>(meshView.IndexSubsets.Data), meshView.IndexSubsets.Count);
 
         // Vertex data & layout metadata
 
-        // Determine the number of unique Buffer Views associated with the vertex attributes & copy vertex buffers.
+        // Determine the number of unique Buffer Views associated with the vertex attributes & reference vertex buffers.
         std::vector<uint32_t> vbMap;
 
         mesh.LayoutDesc.pInputElementDescs = mesh.LayoutElems;
@@ -194,38 +106,35 @@ HRESULT Model::LoadFromFile(const wchar_t* filename)
 
         for (uint32_t j = 0; j < Attribute::Count; ++j)
         {
-            if (meshView.Attributes[j] == -1)
+            auto& attribute = meshView.Attributes[j];
+            if (attribute.Data == nullptr)
                 continue;
 
-            Accessor& accessor = accessors[meshView.Attributes[j]];
-            
-            auto it = std::find(vbMap.begin(), vbMap.end(), accessor.BufferView);
+            auto it = std::find(vbMap.begin(), vbMap.end(), attribute.BufferView);
             if (it != vbMap.end())
             {
                 continue; // Already added - continue.
             }
 
-            // New buffer view encountered; add to list and copy vertex data
-            vbMap.push_back(accessor.BufferView);
-            BufferView& bufferView = bufferViews[accessor.BufferView];
+            // New buffer view encountered; add to list and reference its vertex data
+            vbMap.push_back(attribute.BufferView);
 
-            Span<uint8_t> verts = MakeSpan(m_buffer.data() + bufferView.Offset, bufferView.Size);
+            Span<uint8_t> verts = MakeSpan(attribute.Data, attribute.Size);
 
-            mesh.VertexStrides.push_back(accessor.Stride);
+            mesh.VertexStrides.push_back(attribute.Stride);
             mesh.Vertices.push_back(verts);
-            mesh.VertexCount = static_cast<uint32_t>(verts.size()) / accessor.Stride;
+            mesh.VertexCount = static_cast<uint32_t>(verts.size()) / attribute.Stride;
         }
 
-         // Populate the vertex buffer metadata from accessors.
+        // Populate the vertex buffer metadata from accessors.
         for (uint32_t j = 0; j < Attribute::Count; ++j)
         {
-            if (meshView.Attributes[j] == -1)
+            auto& attribute = meshView.Attributes[j];
+            if (attribute.Data == nullptr)
                 continue;
 
-            Accessor& accessor = accessors[meshView.Attributes[j]];
-
             // Determine which vertex buffer index holds this attribute's data
-            auto it = std::find(vbMap.begin(), vbMap.end(), accessor.BufferView);
+            auto it = std::find(vbMap.begin(), vbMap.end(), attribute.BufferView);
 
             D3D12_INPUT_ELEMENT_DESC desc = c_elementDescs[j];
             desc.InputSlot = static_cast<uint32_t>(std::distance(vbMap.begin(), it));
@@ -233,46 +142,20 @@ HRESULT Model::LoadFromFile(const wchar_t* filename)
             mesh.LayoutElems[mesh.LayoutDesc.NumElements++] = desc;
         }
 
-        // Meshlet data
-        {
-            Accessor& accessor = accessors[meshView.Meshlets];
-            BufferView& bufferView = bufferViews[accessor.BufferView];
-
-            mesh.Meshlets = MakeSpan(reinterpret_cast<Meshlet*>(m_buffer.data() + bufferView.Offset), accessor.Count);
-        }
+        // Meshlet data - any cluster hierarchy meshlets follow those referenced by the subsets and aren't drawn here.
+        mesh.MeshletSubsets = MakeSpan(reinterpret_cast<Subset*>(meshView.MeshletSubsets.Data), meshView.MeshletSubsets.Count);
 
-        // Meshlet Subset data
+        uint32_t meshletCount = 0;
+        for (auto& subset : mesh.MeshletSubsets)
         {
-            Accessor& accessor = accessors[meshView.MeshletSubsets];
-            BufferView& bufferView = bufferViews[accessor.BufferView];
-
-            mesh.MeshletSubsets = MakeSpan(reinterpret_cast<Subset*>(m_buffer.data() + bufferView.Offset), accessor.Count);
+            meshletCount += subset.Count;
         }
 
-        // Unique Vertex Index data
-        {
-            Accessor& accessor = accessors[meshView.UniqueVertexIndices];
-            BufferView& bufferView = bufferViews[accessor.BufferView];
-
-            mesh.UniqueVertexIndices = MakeSpan(m_buffer.data() + bufferView.Offset, bufferView.Size);
-        }
-
-        // Primitive Index data
-        {
-            Accessor& accessor = accessors[meshView.PrimitiveIndices];
-            BufferView& bufferView = bufferViews[accessor.BufferView];
-
-            mesh.PrimitiveIndices = MakeSpan(reinterpret_cast<PackedTriangle*>(m_buffer.data() + bufferView.Offset), accessor.Count);
-        }
-
-        // Cull data
-        {
-            Accessor& accessor = accessors[meshView.CullData];
-            BufferView& bufferView = bufferViews[accessor.BufferView];
-
-            mesh.CullingData = MakeSpan(reinterpret_cast<CullData*>(m_buffer.data() + bufferView.Offset), accessor.Count);
-        }
-     }
+        mesh.Meshlets = MakeSpan(reinterpret_cast<Meshlet*>(meshView.Meshlets.Data), meshletCount);
+        mesh.UniqueVertexIndices = MakeSpan(meshView.UniqueVertexIndices.Data, meshView.UniqueVertexIndices.Size);
+        mesh.PrimitiveIndices = MakeSpan(reinterpret_cast<PackedTriangle*>(meshView.PrimitiveIndices.Data), meshView.PrimitiveIndices.Count);
+        mesh.CullingData = MakeSpan(reinterpret_cast<CullData*>(meshView.CullData.Data), meshletCount);
+    }
 
     // Build bounding spheres for each mesh
     for (uint32_t i = 0; i < static_cast<uint32_t>(m_meshes.size()); ++i)
@@ -333,6 +216,17 @@ HRESULT Model::UploadGpuResources(ID3D12Device* device, ID3D12CommandQueue* cmdQ
     {
         auto& m = m_meshes[i];
 
+        // Page the mesh's streams in ahead of the copies below instead of faulting them in a page at a time.
+        for (auto& vertices : m.Vertices)
+        {
+            m_file.Prefetch(vertices.data(), vertices.size());
+        }
+        m_file.Prefetch(m.Indices.data(), m.Indices.size());
+        m_file.Prefetch(m.Meshlets.data(), m.Meshlets.size() * sizeof(m.Meshlets[0]));
+        m_file.Prefetch(m.CullingData.data(), m.CullingData.size() * sizeof(m.CullingData[0]));
+        m_file.Prefetch(m.UniqueVertexIndices.data(), m.UniqueVertexIndices.size());
+        m_file.Prefetch(m.PrimitiveIndices.data(), m.PrimitiveIndices.size() * sizeof(m.PrimitiveIndices[0]));
+
         // Create committed D3D resources of proper sizes
         auto indexDesc       = CD3DX12_RESOURCE_DESC::Buffer(m.Indices.size());
         auto meshletDesc     = CD3DX12_RESOURCE_DESC::Buffer(m.Meshlets.size() * sizeof(m.Meshlets[0]));
@@ -446,6 +340,13 @@ HRESULT Model::UploadGpuResources(ID3D12Device* device, ID3D12CommandQueue* cmdQ
             meshInfoUpload->Unmap(0, nullptr);
         }
 
+        // The CPU has no further use for the vertex & index data once it's in the upload heaps.
+        for (auto& vertices : m.Vertices)
+        {
+            m_file.Evict(vertices.data(), vertices.size());
+        }
+        m_file.Evict(m.Indices.data(), m.Indices.size());
+
         // Populate our command list
         cmdList->Reset(cmdAlloc, nullptr);
 
@@ -12,6 +12,7 @@
 
 #include "Span.h"
 
+#include <D3D12MeshletLoader.h>
 #include <DirectXCollision.h>
 
 struct Attribute
@@ -153,5 +154,5 @@ private:
     std::vector<Mesh>                      m_meshes;
     DirectX::BoundingSphere                m_boundingSphere;
 
-    std::vector<uint8_t>                   m_buffer;
+    MeshFile                               m_file;
 };
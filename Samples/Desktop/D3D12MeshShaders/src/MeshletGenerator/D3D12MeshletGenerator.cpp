@@ -13,6 +13,9 @@
 #include "Generation.h"
 #include "Utilities.h"
 
+#include <cstring>
+#include <ppl.h>
+
 using namespace DirectX;
 
 namespace
@@ -26,6 +29,495 @@ namespace
     {
         return (XMVectorClamp(value, g_XMZero, g_XMOne)) * 255.0f;
     }
+
+    // Writes the quantized normal cone. Returns false if the cone is degenerate, in which case there is no apex.
+    bool QuantizeNormalCone(FXMVECTOR axis, FXMVECTOR minDot, CullData& c)
+    {
+        if (XMVector4Less(minDot, XMVectorReplicate(0.1f)))
+        {
+            // Degenerate cone
+            c.NormalCone[0] = 127;
+            c.NormalCone[1] = 127;
+            c.NormalCone[2] = 127;
+            c.NormalCone[3] = 255;
+            return false;
+        }
+
+        // cos(a) for normal cone is minDot; we need to add 90 degrees on both sides and invert the cone
+        // which gives us -cos(a+90) = -(-sin(a)) = sin(a) = sqrt(1 - cos^2(a))
+        XMVECTOR coneCutoff = XMVectorSqrt(g_XMOne - minDot * minDot);
+
+        // 3. Quantize to uint8
+        XMVECTOR quantized = QuantizeSNorm(axis);
+        c.NormalCone[0] = (uint8_t)XMVectorGetX(quantized);
+        c.NormalCone[1] = (uint8_t)XMVectorGetY(quantized);
+        c.NormalCone[2] = (uint8_t)XMVectorGetZ(quantized);
+
+        XMVECTOR error = ((quantized / 255.0f) * 2.0f - g_XMOne) - axis;
+        error = XMVectorSum(XMVectorAbs(error));
+
+        quantized = QuantizeUNorm(coneCutoff + error);
+        quantized = XMVectorMin(quantized + g_XMOne, XMVectorReplicate(255.0f));
+        c.NormalCone[3] = (uint8_t)XMVectorGetX(quantized);
+        return true;
+    }
+
+    //
+    // Strongly influenced by https://github.com/zeux/meshoptimizer - Thanks amigo!
+    //
+
+    template <typename T>
+    void ComputeMeshletCullData(
+        const XMFLOAT3* positions, uint32_t vertexCount,
+        const Meshlet& m,
+        const T* uniqueVertexIndices,
+        const PackedTriangle* primitiveIndices,
+        DWORD flags,
+        CullData& c
+    )
+    {
+        UNREFERENCED_PARAMETER(vertexCount);
+
+        XMFLOAT3 vertices[256];
+        XMFLOAT3 normals[256];
+        float axisDots[256];
+
+        // Cache vertices
+        for (uint32_t i = 0; i < m.VertCount; ++i)
+        {
+            uint32_t vIndex = uniqueVertexIndices[m.VertOffset + i];
+
+            assert(vIndex < vertexCount);
+            vertices[i] = positions[vIndex];
+        }
+
+        // Generate primitive normals & cache
+        for (uint32_t i = 0; i < m.PrimCount; ++i)
+        {
+            auto primitive = primitiveIndices[m.PrimOffset + i];
+
+            XMVECTOR triangle[3]
+            {
+                XMLoadFloat3(&vertices[primitive.indices.i0]),
+                XMLoadFloat3(&vertices[primitive.indices.i1]),
+                XMLoadFloat3(&vertices[primitive.indices.i2]),
+            };
+
+            XMVECTOR p10 = triangle[1] - triangle[0];
+            XMVECTOR p20 = triangle[2] - triangle[0];
+            XMVECTOR n = XMVector3Normalize(XMVector3Cross(p10, p20));
+
+            XMStoreFloat3(&normals[i], (flags & CNORM_WIND_CW) != 0 ? -n : n);
+        }
+
+        // Calculate spatial bounds
+        XMVECTOR positionBounds = MinimumBoundingSphere(vertices, m.VertCount);
+        XMStoreFloat4(&c.BoundingSphere, positionBounds);
+
+        // Calculate the normal cone
+        // 1. Normalized center point of minimum bounding sphere of unit normals == conic axis
+        XMVECTOR normalBounds = MinimumBoundingSphere(normals, m.PrimCount);
+
+        // 2. Calculate dot product of all normals to conic axis, selecting minimum
+        XMVECTOR axis = XMVectorSetW(XMVector3Normalize(normalBounds), 0);
+
+        XMVECTOR minDot = g_XMOne;
+        for (uint32_t i = 0; i < m.PrimCount; ++i)
+        {
+            XMVECTOR dot = XMVector3Dot(axis, XMLoadFloat3(&normals[i]));
+            minDot = XMVectorMin(minDot, dot);
+
+            // Reused as the denominator of the apex search below
+            axisDots[i] = XMVectorGetX(dot);
+        }
+
+        if (!QuantizeNormalCone(axis, minDot, c))
+        {
+            return;
+        }
+
+        // Find the point on center-t*axis ray that lies in negative half-space of all triangles
+        float maxt = 0;
+
+        for (uint32_t i = 0; i < m.PrimCount; ++i)
+        {
+            auto primitive = primitiveIndices[m.PrimOffset + i];
+
+            XMVECTOR c = positionBounds - XMLoadFloat3(&vertices[primitive.indices.i0]);
+
+            XMVECTOR n = XMLoadFloat3(&normals[i]);
+            float dc = XMVectorGetX(XMVector3Dot(c, n));
+            float dn = axisDots[i];
+
+            // dn should be larger than mindp cutoff above
+            assert(dn > 0.0f);
+            float t = dc / dn;
+
+            maxt = (t > maxt) ? t : maxt;
+        }
+
+        // cone apex should be in the negative half-space of all cluster triangles by construction
+        c.ApexOffset = maxt;
+    }
+
+#if defined(_XM_SSE_INTRINSICS_)
+#if !defined(XM_FNMADD_PS)
+#define XM_FNMADD_PS(a, b, c) _mm_sub_ps((c), _mm_mul_ps((a), (b)))
+#endif
+
+    // The lane path computes the cull data of 4 meshlets at once, one per SSE lane, with points & normals
+    // stored as structures of arrays. Every lane performs the same operations in the same order as the scalar
+    // path - the helpers below mirror the DirectXMath SSE implementations of its calls - so the results are
+    // bit-identical.
+    const uint32_t LaneCount = 4;
+
+    struct VectorLanes
+    {
+        XMVECTOR x;
+        XMVECTOR y;
+        XMVECTOR z;
+    };
+
+    inline VectorLanes LoadLanes(const XMFLOAT3* const (&points)[LaneCount])
+    {
+        XMVECTOR r0 = XMLoadFloat3(points[0]);
+        XMVECTOR r1 = XMLoadFloat3(points[1]);
+        XMVECTOR r2 = XMLoadFloat3(points[2]);
+        XMVECTOR r3 = XMLoadFloat3(points[3]);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+        return { r0, r1, r2 };
+    }
+
+    inline VectorLanes LoadLanes(const XMVECTOR (&vectors)[LaneCount])
+    {
+        XMVECTOR r0 = vectors[0];
+        XMVECTOR r1 = vectors[1];
+        XMVECTOR r2 = vectors[2];
+        XMVECTOR r3 = vectors[3];
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+        return { r0, r1, r2 };
+    }
+
+    // Returns lane l as it would have been loaded by XMLoadFloat3.
+    inline XMVECTOR GetLane(const VectorLanes& v, uint32_t l)
+    {
+        return XMVectorSet(XMVectorGetByIndex(v.x, l), XMVectorGetByIndex(v.y, l), XMVectorGetByIndex(v.z, l), 0);
+    }
+
+    inline XMVECTOR LaneMask(const uint32_t (&counts)[LaneCount], uint32_t i)
+    {
+        __m128i c = _mm_setr_epi32(int(counts[0]), int(counts[1]), int(counts[2]), int(counts[3]));
+        return _mm_castsi128_ps(_mm_cmpgt_epi32(c, _mm_set1_epi32(int(i))));
+    }
+
+    inline VectorLanes SelectLanes(const VectorLanes& a, const VectorLanes& b, FXMVECTOR mask)
+    {
+        return { XMVectorSelect(a.x, b.x, mask), XMVectorSelect(a.y, b.y, mask), XMVectorSelect(a.z, b.z, mask) };
+    }
+
+    inline VectorLanes SubtractLanes(const VectorLanes& a, const VectorLanes& b)
+    {
+        return { _mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z) };
+    }
+
+    // XMVector3Dot: (x + y) + z, or (x + y) + (z + w) with w masked to zero by _mm_dp_ps.
+    inline XMVECTOR DotLanes(const VectorLanes& a, const VectorLanes& b)
+    {
+        XMVECTOR xy = _mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y));
+#if defined(_XM_SSE4_INTRINSICS_)
+        return _mm_add_ps(xy, _mm_add_ps(_mm_mul_ps(a.z, b.z), _mm_setzero_ps()));
+#else
+        return _mm_add_ps(xy, _mm_mul_ps(a.z, b.z));
+#endif
+    }
+
+    // XMVector3Cross
+    inline VectorLanes CrossLanes(const VectorLanes& a, const VectorLanes& b)
+    {
+        return
+        {
+            XM_FNMADD_PS(a.z, b.y, _mm_mul_ps(a.y, b.z)),
+            XM_FNMADD_PS(a.x, b.z, _mm_mul_ps(a.z, b.x)),
+            XM_FNMADD_PS(a.y, b.x, _mm_mul_ps(a.x, b.y)),
+        };
+    }
+
+    // XMVector3Normalize: zero length vectors become zero and infinite length vectors become NaN.
+    inline VectorLanes NormalizeLanes(const VectorLanes& v)
+    {
+        XMVECTOR lengthSq = DotLanes(v, v);
+        XMVECTOR length = _mm_sqrt_ps(lengthSq);
+        XMVECTOR zeroMask = _mm_cmpneq_ps(_mm_setzero_ps(), length);
+        XMVECTOR finiteMask = _mm_cmpneq_ps(lengthSq, g_XMInfinity);
+        XMVECTOR nan = _mm_andnot_ps(finiteMask, g_XMQNaN);
+
+        VectorLanes result;
+        result.x = _mm_or_ps(nan, _mm_and_ps(_mm_and_ps(_mm_div_ps(v.x, length), zeroMask), finiteMask));
+        result.y = _mm_or_ps(nan, _mm_and_ps(_mm_and_ps(_mm_div_ps(v.y, length), zeroMask), finiteMask));
+        result.z = _mm_or_ps(nan, _mm_and_ps(_mm_and_ps(_mm_div_ps(v.z, length), zeroMask), finiteMask));
+        return result;
+    }
+
+    // XMVectorNegate
+    inline VectorLanes NegateLanes(const VectorLanes& v)
+    {
+        return { _mm_sub_ps(_mm_setzero_ps(), v.x), _mm_sub_ps(_mm_setzero_ps(), v.y), _mm_sub_ps(_mm_setzero_ps(), v.z) };
+    }
+
+    // MinimumBoundingSphere of the first counts[l] points in each lane.
+    void MinimumBoundingSphereLanes(const VectorLanes* points, const uint32_t (&counts)[LaneCount], XMVECTOR (&spheres)[LaneCount])
+    {
+        uint32_t count = 0;
+        for (uint32_t l = 0; l < LaneCount; ++l)
+        {
+            assert(counts[l] != 0);
+            count = counts[l] > count ? counts[l] : count;
+        }
+
+        // Find the min & max points indices along each axis.
+        XMVECTOR minAxis[3] = { g_XMZero, g_XMZero, g_XMZero };
+        XMVECTOR maxAxis[3] = { g_XMZero, g_XMZero, g_XMZero };
+        XMVECTOR minValue[3] = { points[0].x, points[0].y, points[0].z };
+        XMVECTOR maxValue[3] = { points[0].x, points[0].y, points[0].z };
+
+        for (uint32_t i = 1; i < count; ++i)
+        {
+            XMVECTOR active = LaneMask(counts, i);
+            XMVECTOR index = _mm_castsi128_ps(_mm_set1_epi32(int(i)));
+            XMVECTOR point[3] = { points[i].x, points[i].y, points[i].z };
+
+            for (uint32_t j = 0; j < 3; ++j)
+            {
+                XMVECTOR less = _mm_and_ps(active, _mm_cmplt_ps(point[j], minValue[j]));
+                XMVECTOR greater = _mm_and_ps(active, _mm_cmpgt_ps(point[j], maxValue[j]));
+
+                minAxis[j] = XMVectorSelect(minAxis[j], index, less);
+                minValue[j] = XMVectorSelect(minValue[j], point[j], less);
+                maxAxis[j] = XMVectorSelect(maxAxis[j], index, greater);
+                maxValue[j] = XMVectorSelect(maxValue[j], point[j], greater);
+            }
+        }
+
+        // Calculate each lane's starting center point & radius exactly as MinimumBoundingSphere does.
+        XMVECTOR centers[LaneCount];
+        float radii[LaneCount];
+
+        for (uint32_t l = 0; l < LaneCount; ++l)
+        {
+            // Find axis with maximum span.
+            XMVECTOR distSqMax = g_XMZero;
+            uint32_t axis = 0;
+
+            for (uint32_t i = 0; i < 3u; ++i)
+            {
+                XMVECTOR min = GetLane(points[XMVectorGetIntByIndex(minAxis[i], l)], l);
+                XMVECTOR max = GetLane(points[XMVectorGetIntByIndex(maxAxis[i], l)], l);
+
+                XMVECTOR distSq = XMVector3LengthSq(max - min);
+                if (XMVector3Greater(distSq, distSqMax))
+                {
+                    distSqMax = distSq;
+                    axis = i;
+                }
+            }
+
+            XMVECTOR p1 = GetLane(points[XMVectorGetIntByIndex(minAxis[axis], l)], l);
+            XMVECTOR p2 = GetLane(points[XMVectorGetIntByIndex(maxAxis[axis], l)], l);
+
+            centers[l] = (p1 + p2) * 0.5f;
+            radii[l] = XMVectorGetX(XMVector3Length(p2 - p1) * 0.5f);
+        }
+
+        // Add all our points to bounding sphere expanding radius & recalculating center point as necessary.
+        VectorLanes center = LoadLanes(centers);
+        XMVECTOR radius = XMVectorSet(radii[0], radii[1], radii[2], radii[3]);
+        XMVECTOR radiusSq = _mm_mul_ps(radius, radius);
+        XMVECTOR half = XMVectorReplicate(0.5f);
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            VectorLanes offset = SubtractLanes(points[i], center);
+            XMVECTOR distSq = DotLanes(offset, offset);
+
+            XMVECTOR grow = _mm_and_ps(LaneMask(counts, i), _mm_cmpgt_ps(distSq, radiusSq));
+            if (_mm_movemask_ps(grow) == 0)
+            {
+                continue;
+            }
+
+            XMVECTOR dist = _mm_sqrt_ps(distSq);
+            XMVECTOR k = _mm_add_ps(_mm_mul_ps(_mm_div_ps(radius, dist), half), half);
+            XMVECTOR kInv = _mm_sub_ps(g_XMOne, k);
+
+            VectorLanes grown =
+            {
+                _mm_add_ps(_mm_mul_ps(center.x, k), _mm_mul_ps(points[i].x, kInv)),
+                _mm_add_ps(_mm_mul_ps(center.y, k), _mm_mul_ps(points[i].y, kInv)),
+                _mm_add_ps(_mm_mul_ps(center.z, k), _mm_mul_ps(points[i].z, kInv)),
+            };
+
+            center = SelectLanes(center, grown, grow);
+            radius = XMVectorSelect(radius, _mm_mul_ps(_mm_add_ps(radius, dist), half), grow);
+        }
+
+        // Transpose back to one center & radius per lane.
+        spheres[0] = center.x;
+        spheres[1] = center.y;
+        spheres[2] = center.z;
+        spheres[3] = radius;
+        _MM_TRANSPOSE4_PS(spheres[0], spheres[1], spheres[2], spheres[3]);
+    }
+
+    // Computes the cull data of up to 4 meshlets. Lanes past count repeat the first meshlet and their results are
+    // discarded. Meshlets with fewer primitives than the largest repeat their last primitive, which leaves the
+    // min & max reductions unchanged.
+    template <typename T>
+    void ComputeMeshletCullDataLanes(
+        const XMFLOAT3* positions, uint32_t vertexCount,
+        const Meshlet* meshlets, uint32_t count,
+        const T* uniqueVertexIndices,
+        const PackedTriangle* primitiveIndices,
+        DWORD flags,
+        CullData* cullData
+    )
+    {
+        UNREFERENCED_PARAMETER(vertexCount);
+
+        XMFLOAT3 vertices[LaneCount][256];
+        VectorLanes vertexLanes[256];
+        VectorLanes normalLanes[256];
+        XMVECTOR axisDots[256];
+
+        const Meshlet* lanes[LaneCount];
+        uint32_t vertCounts[LaneCount];
+        uint32_t primCounts[LaneCount];
+        uint32_t vertCount = 0;
+        uint32_t primCount = 0;
+
+        for (uint32_t l = 0; l < LaneCount; ++l)
+        {
+            lanes[l] = &meshlets[l < count ? l : 0];
+            vertCounts[l] = lanes[l]->VertCount;
+            primCounts[l] = lanes[l]->PrimCount;
+            vertCount = vertCounts[l] > vertCount ? vertCounts[l] : vertCount;
+            primCount = primCounts[l] > primCount ? primCounts[l] : primCount;
+        }
+
+        // Cache vertices
+        for (uint32_t l = 0; l < LaneCount; ++l)
+        {
+            auto& m = *lanes[l];
+
+            for (uint32_t i = 0; i < m.VertCount; ++i)
+            {
+                uint32_t vIndex = uniqueVertexIndices[m.VertOffset + i];
+
+                assert(vIndex < vertexCount);
+                vertices[l][i] = positions[vIndex];
+            }
+        }
+
+        for (uint32_t i = 0; i < vertCount; ++i)
+        {
+            const XMFLOAT3* p[LaneCount];
+
+            for (uint32_t l = 0; l < LaneCount; ++l)
+            {
+                p[l] = &vertices[l][i < vertCounts[l] ? i : vertCounts[l] - 1];
+            }
+
+            vertexLanes[i] = LoadLanes(p);
+        }
+
+        auto primitive = [&](uint32_t l, uint32_t i)
+        {
+            return primitiveIndices[lanes[l]->PrimOffset + (i < primCounts[l] ? i : primCounts[l] - 1)];
+        };
+
+        // Generate primitive normals & cache
+        for (uint32_t i = 0; i < primCount; ++i)
+        {
+            const XMFLOAT3* p0[LaneCount];
+            const XMFLOAT3* p1[LaneCount];
+            const XMFLOAT3* p2[LaneCount];
+
+            for (uint32_t l = 0; l < LaneCount; ++l)
+            {
+                auto prim = primitive(l, i);
+                p0[l] = &vertices[l][prim.indices.i0];
+                p1[l] = &vertices[l][prim.indices.i1];
+                p2[l] = &vertices[l][prim.indices.i2];
+            }
+
+            VectorLanes triangle0 = LoadLanes(p0);
+            VectorLanes p10 = SubtractLanes(LoadLanes(p1), triangle0);
+            VectorLanes p20 = SubtractLanes(LoadLanes(p2), triangle0);
+            VectorLanes n = NormalizeLanes(CrossLanes(p10, p20));
+
+            normalLanes[i] = (flags & CNORM_WIND_CW) != 0 ? NegateLanes(n) : n;
+        }
+
+        // Calculate spatial bounds
+        XMVECTOR positionBounds[LaneCount];
+        MinimumBoundingSphereLanes(vertexLanes, vertCounts, positionBounds);
+
+        // Calculate the normal cone
+        // 1. Normalized center point of minimum bounding sphere of unit normals == conic axis
+        XMVECTOR normalBounds[LaneCount];
+        MinimumBoundingSphereLanes(normalLanes, primCounts, normalBounds);
+
+        XMVECTOR axis[LaneCount];
+        for (uint32_t l = 0; l < LaneCount; ++l)
+        {
+            axis[l] = XMVectorSetW(XMVector3Normalize(normalBounds[l]), 0);
+        }
+
+        // 2. Calculate dot product of all normals to conic axis, selecting minimum
+        VectorLanes axisLanes = LoadLanes(axis);
+
+        XMVECTOR minDot = g_XMOne;
+        for (uint32_t i = 0; i < primCount; ++i)
+        {
+            axisDots[i] = DotLanes(axisLanes, normalLanes[i]);
+            minDot = _mm_min_ps(minDot, axisDots[i]);
+        }
+
+        // Find the point on center-t*axis ray that lies in negative half-space of all triangles. Lanes with a
+        // degenerate cone are computed too, but not written - unless every lane is degenerate.
+        VectorLanes centerLanes = LoadLanes(positionBounds);
+        const bool anyCone = _mm_movemask_ps(_mm_cmplt_ps(minDot, XMVectorReplicate(0.1f))) != 0xf;
+
+        XMVECTOR maxt = _mm_setzero_ps();
+        for (uint32_t i = 0; anyCone && i < primCount; ++i)
+        {
+            const XMFLOAT3* p0[LaneCount];
+
+            for (uint32_t l = 0; l < LaneCount; ++l)
+            {
+                p0[l] = &vertices[l][primitive(l, i).indices.i0];
+            }
+
+            XMVECTOR dc = DotLanes(SubtractLanes(centerLanes, LoadLanes(p0)), normalLanes[i]);
+            XMVECTOR t = _mm_div_ps(dc, axisDots[i]);
+
+            maxt = _mm_max_ps(t, maxt);
+        }
+
+        for (uint32_t l = 0; l < count; ++l)
+        {
+            auto& c = cullData[l];
+
+            XMStoreFloat4(&c.BoundingSphere, positionBounds[l]);
+
+            if (QuantizeNormalCone(axis[l], XMVectorReplicate(XMVectorGetByIndex(minDot, l)), c))
+            {
+                c.ApexOffset = XMVectorGetByIndex(maxt, l);
+            }
+        }
+    }
+#endif
 } 
 
 namespace internal
@@ -142,14 +634,21 @@ HRESULT internal::ComputeMeshlets(
 {
     UNREFERENCED_PARAMETER(indexCount);
 
-    for (uint32_t i = 0; i < subsetCount; ++i)
+    // Subsets are meshletized independently, so they can be built in parallel and appended in order.
+    std::vector<std::vector<InlineMeshlet<T>>> subsetMeshlets(subsetCount);
+
+    concurrency::parallel_for(0u, subsetCount, [&](uint32_t i)
     {
         Subset s = indexSubsets[i];
 
         assert(s.Offset + s.Count <= indexCount);
 
-        std::vector<InlineMeshlet<T>> builtMeshlets;
-        Meshletize(maxVerts, maxPrims, indices + s.Offset, s.Count, positions, vertexCount, builtMeshlets);
+        Meshletize(maxVerts, maxPrims, indices + s.Offset, s.Count, positions, vertexCount, subsetMeshlets[i]);
+    });
+
+    for (uint32_t i = 0; i < subsetCount; ++i)
+    {
+        const auto& builtMeshlets = subsetMeshlets[i];
 
         Subset meshletSubset;
         meshletSubset.Offset = static_cast<uint32_t>(meshlets.size());
@@ -199,10 +698,6 @@ HRESULT internal::ComputeMeshlets(
     return S_OK;
 }
 
-//
-// Strongly influenced by https://github.com/zeux/meshoptimizer - Thanks amigo!
-//
-
 template <typename T>
 HRESULT internal::ComputeCullData(
     const XMFLOAT3* positions, uint32_t vertexCount,
@@ -213,126 +708,44 @@ HRESULT internal::ComputeCullData(
     CullData* cullData
 )
 {
-    UNREFERENCED_PARAMETER(vertexCount);
-
-    XMFLOAT3 vertices[256];
-    XMFLOAT3 normals[256];
+    // Meshlets are independent, so they're processed in parallel batches.
+    const uint32_t batchSize = 64;
+    const uint32_t batchCount = (meshletCount + batchSize - 1) / batchSize;
 
-    for (uint32_t mi = 0; mi < meshletCount; ++mi)
+    concurrency::parallel_for(0u, batchCount, [&](uint32_t batch)
     {
-        auto& m = meshlets[mi];
-        auto& c = cullData[mi];
+        const uint32_t batchBegin = batch * batchSize;
+        const uint32_t batchEnd = batchBegin + batchSize < meshletCount ? batchBegin + batchSize : meshletCount;
 
-        // Cache vertices
-        for (uint32_t i = 0; i < m.VertCount; ++i)
+#if defined(_XM_SSE_INTRINSICS_)
+        for (uint32_t mi = batchBegin; mi < batchEnd; mi += LaneCount)
         {
-            uint32_t vIndex = uniqueVertexIndices[m.VertOffset + i];
+            const uint32_t count = batchEnd - mi < LaneCount ? batchEnd - mi : LaneCount;
 
-            assert(vIndex < vertexCount);
-            vertices[i] = positions[vIndex];
-        }
+#if defined(_DEBUG)
+            // The lanes must match the scalar path bit for bit.
+            CullData expected[LaneCount];
+            std::memcpy(expected, &cullData[mi], count * sizeof(CullData));
 
-        // Generate primitive normals & cache
-        for (uint32_t i = 0; i < m.PrimCount; ++i)
-        {
-            auto primitive = primitiveIndices[m.PrimOffset + i];
-
-            XMVECTOR triangle[3]
+            for (uint32_t l = 0; l < count; ++l)
             {
-                XMLoadFloat3(&vertices[primitive.indices.i0]),
-                XMLoadFloat3(&vertices[primitive.indices.i1]),
-                XMLoadFloat3(&vertices[primitive.indices.i2]),
-            };
-
-            XMVECTOR p10 = triangle[1] - triangle[0];
-            XMVECTOR p20 = triangle[2] - triangle[0];
-            XMVECTOR n = XMVector3Normalize(XMVector3Cross(p10, p20));
-
-            XMStoreFloat3(&normals[i], (flags & CNORM_WIND_CW) != 0 ? -n : n);
-        }
-
-        // Calculate spatial bounds
-        XMVECTOR positionBounds = MinimumBoundingSphere(vertices, m.VertCount);
-        XMStoreFloat4(&c.BoundingSphere, positionBounds);
-
-        // Calculate the normal cone
-        // 1. Normalized center point of minimum bounding sphere of unit normals == conic axis
-        XMVECTOR normalBounds = MinimumBoundingSphere(normals, m.PrimCount);
+                ComputeMeshletCullData(positions, vertexCount, meshlets[mi + l], uniqueVertexIndices, primitiveIndices, flags, expected[l]);
+            }
+#endif
 
-        // 2. Calculate dot product of all normals to conic axis, selecting minimum
-        XMVECTOR axis = XMVectorSetW(XMVector3Normalize(normalBounds), 0);
+            ComputeMeshletCullDataLanes(positions, vertexCount, &meshlets[mi], count, uniqueVertexIndices, primitiveIndices, flags, &cullData[mi]);
 
-        XMVECTOR minDot = g_XMOne;
-        for (uint32_t i = 0; i < m.PrimCount; ++i)
-        {
-            XMVECTOR dot = XMVector3Dot(axis, XMLoadFloat3(&normals[i]));
-            minDot = XMVectorMin(minDot, dot);
+#if defined(_DEBUG)
+            assert(std::memcmp(expected, &cullData[mi], count * sizeof(CullData)) == 0);
+#endif
         }
-
-        if (XMVector4Less(minDot, XMVectorReplicate(0.1f)))
-        {
-            // Degenerate cone
-            c.NormalCone[0] = 127;
-            c.NormalCone[1] = 127;
-            c.NormalCone[2] = 127;
-            c.NormalCone[3] = 255;
-            continue;
-        }
-
-        // Find the point on center-t*axis ray that lies in negative half-space of all triangles
-        float maxt = 0;
-
-        for (uint32_t i = 0; i < m.PrimCount; ++i)
+#else
+        for (uint32_t mi = batchBegin; mi < batchEnd; ++mi)
         {
-            auto primitive = primitiveIndices[m.PrimOffset + i];
-
-            uint32_t indices[3]
-            {
-                primitive.indices.i0,
-                primitive.indices.i1,
-                primitive.indices.i2,
-            };
-
-            XMVECTOR triangle[3]
-            {
-                XMLoadFloat3(&vertices[indices[0]]),
-                XMLoadFloat3(&vertices[indices[1]]),
-                XMLoadFloat3(&vertices[indices[2]]),
-            };
-
-            XMVECTOR c = positionBounds - triangle[0];
-
-            XMVECTOR n = XMLoadFloat3(&normals[i]);
-            float dc = XMVectorGetX(XMVector3Dot(c, n));
-            float dn = XMVectorGetX(XMVector3Dot(axis, n));
-
-            // dn should be larger than mindp cutoff above
-            assert(dn > 0.0f);
-            float t = dc / dn;
-
-            maxt = (t > maxt) ? t : maxt;
+            ComputeMeshletCullData(positions, vertexCount, meshlets[mi], uniqueVertexIndices, primitiveIndices, flags, cullData[mi]);
         }
-
-        // cone apex should be in the negative half-space of all cluster triangles by construction
-        c.ApexOffset = maxt;
-
-        // cos(a) for normal cone is minDot; we need to add 90 degrees on both sides and invert the cone
-        // which gives us -cos(a+90) = -(-sin(a)) = sin(a) = sqrt(1 - cos^2(a))
-        XMVECTOR coneCutoff = XMVectorSqrt(g_XMOne - minDot * minDot);
-
-        // 3. Quantize to uint8
-        XMVECTOR quantized = QuantizeSNorm(axis);
-        c.NormalCone[0] = (uint8_t)XMVectorGetX(quantized);
-        c.NormalCone[1] = (uint8_t)XMVectorGetY(quantized);
-        c.NormalCone[2] = (uint8_t)XMVectorGetZ(quantized);
-
-        XMVECTOR error = ((quantized / 255.0f) * 2.0f - g_XMOne) - axis;
-        error = XMVectorSum(XMVectorAbs(error));
-
-        quantized = QuantizeUNorm(coneCutoff + error);
-        quantized = XMVectorMin(quantized + g_XMOne, XMVectorReplicate(255.0f));
-        c.NormalCone[3] = (uint8_t)XMVectorGetX(quantized);
-    }
+#endif
+    });
 
     return S_OK;
 }
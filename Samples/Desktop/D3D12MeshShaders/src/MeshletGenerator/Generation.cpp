@@ -14,7 +14,6 @@
 #include <DirectXMath.h>
 
 #include <algorithm>
-#include <unordered_set>
 
 using namespace DirectX;
 
@@ -55,11 +54,7 @@ void Meshletize(
 ///
 // Helpers
 
-// Sort in reverse order to use vector as a queue with pop_back.
-bool CompareScores(const std::pair<uint32_t, float>& a, const std::pair<uint32_t, float>& b)
-{
-    return a.second > b.second;
-}
+static const uint32_t Undef = uint32_t(-1);
 
 XMVECTOR ComputeNormal(XMFLOAT3* tri)
 {
@@ -73,20 +68,56 @@ XMVECTOR ComputeNormal(XMFLOAT3* tri)
     return XMVector3Normalize(XMVector3Cross(v01, v02));
 }
 
+// Maps vertex indices to their slot in the meshlet currently being built. Entries are tagged with the
+// meshlet index so the table never needs to be cleared between meshlets.
+template <typename T>
+struct VertexMembership
+{
+    std::vector<uint32_t> Meshlet;
+    std::vector<uint8_t>  LocalIndex;
+    uint32_t              BaseVertex;
+
+    VertexMembership(const T* indices, uint32_t indexCount)
+    {
+        // Subsets of an optimized mesh reference a compact range of the vertex buffer, so only that range is tracked.
+        T minIndex = indexCount > 0 ? indices[0] : 0;
+        T maxIndex = minIndex;
+        for (uint32_t i = 1; i < indexCount; ++i)
+        {
+            minIndex = indices[i] < minIndex ? indices[i] : minIndex;
+            maxIndex = indices[i] > maxIndex ? indices[i] : maxIndex;
+        }
+
+        BaseVertex = minIndex;
+        Meshlet.assign(uint32_t(maxIndex - minIndex) + 1, Undef);
+        LocalIndex.resize(Meshlet.size());
+    }
+
+    uint32_t Find(uint32_t meshletIndex, T vertex) const
+    {
+        uint32_t slot = vertex - BaseVertex;
+        return Meshlet[slot] == meshletIndex ? LocalIndex[slot] : Undef;
+    }
+
+    void Insert(uint32_t meshletIndex, T vertex, uint32_t localIndex)
+    {
+        uint32_t slot = vertex - BaseVertex;
+        Meshlet[slot] = meshletIndex;
+        LocalIndex[slot] = static_cast<uint8_t>(localIndex);
+    }
+};
+
 // Compute number of triangle vertices already exist in the meshlet
 template <typename T>
-uint32_t ComputeReuse(const InlineMeshlet<T>& meshlet, T (&triIndices)[3])
+uint32_t ComputeReuse(const VertexMembership<T>& membership, uint32_t meshletIndex, T (&triIndices)[3])
 {
     uint32_t count = 0;
 
-    for (uint32_t i = 0; i < static_cast<uint32_t>(meshlet.UniqueVertexIndices.size()); ++i)
+    for (uint32_t j = 0; j < 3u; ++j)
     {
-        for (uint32_t j = 0; j < 3u; ++j)
+        if (membership.Find(meshletIndex, triIndices[j]) != Undef)
         {
-            if (meshlet.UniqueVertexIndices[i] == triIndices[j])
-            {
-                ++count;
-            }
+            ++count;
         }
     }
 
@@ -94,15 +125,13 @@ uint32_t ComputeReuse(const InlineMeshlet<T>& meshlet, T (&triIndices)[3])
 }
 
 // Computes a candidacy score based on spatial locality, orientational coherence, and vertex re-use within a meshlet.
-template <typename T>
-float ComputeScore(const InlineMeshlet<T>& meshlet, XMVECTOR sphere, XMVECTOR normal, T (&triIndices)[3], XMFLOAT3* triVerts)
+float ComputeScore(uint32_t reuse, XMVECTOR sphere, XMVECTOR normal, const XMFLOAT3 (&triVerts)[3], const XMFLOAT3& triNormal)
 {
     const float reuseWeight = 0.334f;
     const float locWeight = 0.333f;
     const float oriWeight = 0.333f;
     
     // Vertex reuse
-    uint32_t reuse = ComputeReuse(meshlet, triIndices);
     XMVECTOR reuseScore = g_XMOne - (XMVectorReplicate(float(reuse)) / 3.0f);
 
     // Distance from center point
@@ -117,7 +146,7 @@ float ComputeScore(const InlineMeshlet<T>& meshlet, XMVECTOR sphere, XMVECTOR no
     XMVECTOR locScore = XMVectorLog(maxSq / r2 + g_XMOne);
 
     // Angle between normal and meshlet cone axis
-    XMVECTOR n = ComputeNormal(triVerts);
+    XMVECTOR n = XMLoadFloat3(&triNormal);
     XMVECTOR d = XMVector3Dot(n, normal);
     XMVECTOR oriScore = (-d + g_XMOne) / 2.0f;
 
@@ -128,7 +157,7 @@ float ComputeScore(const InlineMeshlet<T>& meshlet, XMVECTOR sphere, XMVECTOR no
 
 // Determines whether a candidate triangle can be added to a specific meshlet; if it can, does so.
 template <typename T>
-bool AddToMeshlet(uint32_t maxVerts, uint32_t maxPrims, InlineMeshlet<T>& meshlet, T (&tri)[3])
+bool AddToMeshlet(uint32_t maxVerts, uint32_t maxPrims, InlineMeshlet<T>& meshlet, uint32_t meshletIndex, VertexMembership<T>& membership, T (&tri)[3])
 {
     // Are we already full of vertices?
     if (meshlet.UniqueVertexIndices.size() == maxVerts)
@@ -138,19 +167,17 @@ bool AddToMeshlet(uint32_t maxVerts, uint32_t maxPrims, InlineMeshlet<T>& meshle
     if (meshlet.PrimitiveIndices.size() == maxPrims)
         return false;
 
-    static const uint32_t Undef = uint32_t(-1);
     uint32_t indices[3] = { Undef, Undef, Undef };
-    uint32_t newCount = 3;
+    uint32_t newCount = 0;
 
-    for (uint32_t i = 0; i < meshlet.UniqueVertexIndices.size(); ++i)
+    for (uint32_t j = 0; j < 3; ++j)
     {
-        for (uint32_t j = 0; j < 3; ++j)
+        indices[j] = membership.Find(meshletIndex, tri[j]);
+
+        // Degenerate triangles only add a repeated vertex once
+        if (indices[j] == Undef && (j == 0 || tri[j] != tri[0]) && (j < 2 || tri[j] != tri[1]))
         {
-            if (meshlet.UniqueVertexIndices[i] == tri[j])
-            {
-                indices[j] = i;
-                --newCount;
-            }
+            ++newCount;
         }
     }
 
@@ -161,10 +188,16 @@ bool AddToMeshlet(uint32_t maxVerts, uint32_t maxPrims, InlineMeshlet<T>& meshle
     // Add unique vertex indices to unique vertex index list
     for (uint32_t j = 0; j < 3; ++j)
     {
+        if (indices[j] == Undef)
+        {
+            indices[j] = membership.Find(meshletIndex, tri[j]);
+        }
+
         if (indices[j] == Undef)
         {
             indices[j] = static_cast<uint32_t>(meshlet.UniqueVertexIndices.size());
             meshlet.UniqueVertexIndices.push_back(tri[j]);
+            membership.Insert(meshletIndex, tri[j], indices[j]);
         }
     }
 
@@ -189,6 +222,19 @@ bool IsMeshletFull(uint32_t maxVerts, uint32_t maxPrims, const InlineMeshlet<T>&
         || meshlet.PrimitiveIndices.size() == maxPrims;
 }
 
+struct Candidate
+{
+    uint32_t Index;
+    uint32_t Reuse;
+    float    Score;
+};
+
+// Orders the candidate heap so the lowest score sits at the front.
+bool CompareScores(const Candidate& a, const Candidate& b)
+{
+    return a.Score > b.Score;
+}
+
 
 ///
 // Implementation 
@@ -203,37 +249,103 @@ void internal::Meshletize(
 {
     const uint32_t triCount = indexCount / 3;
 
+    // Rest our outputs
+    output.clear();
+    if (triCount == 0)
+        return;
+
     // Build a primitive adjacency list
     std::vector<uint32_t> adjacency;
     adjacency.resize(indexCount);
 
     BuildAdjacencyList(indices, indexCount, positions, vertexCount, adjacency.data());
 
-    // Rest our outputs
-    output.clear();
     output.emplace_back();
     auto* curr = &output.back();
+    uint32_t meshletIndex = 0;
 
     // Bitmask of all triangles in mesh to determine whether a specific one has been added.
     std::vector<bool> checklist;
     checklist.resize(triCount);
 
-    std::vector<XMFLOAT3> m_positions;
-    std::vector<XMFLOAT3> normals;
-    std::vector<std::pair<uint32_t, float>> candidates;
-    std::unordered_set<uint32_t> candidateCheck;
+    // Face normals are needed every time a candidate is scored - compute them once up front.
+    std::vector<XMFLOAT3> triNormals;
+    triNormals.resize(triCount);
+
+    for (uint32_t i = 0; i < triCount; ++i)
+    {
+        XMFLOAT3 points[3] =
+        {
+            positions[indices[i * 3]],
+            positions[indices[i * 3 + 1]],
+            positions[indices[i * 3 + 2]],
+        };
+
+        XMStoreFloat3(&triNormals[i], ComputeNormal(points));
+    }
+
+    VertexMembership<T> membership(indices, indexCount);
+
+    // Meshlet index each triangle was last made a candidate for.
+    std::vector<uint32_t> candidateCheck;
+    candidateCheck.resize(triCount, Undef);
 
-    XMVECTOR psphere, normal;
+    // Min-heap of candidates keyed on score.
+    std::vector<Candidate> candidates;
+
+    XMVECTOR psphere = g_XMZero;
+    XMVECTOR nsphere = g_XMZero;
+    XMVECTOR normal = g_XMZero;
+
+    auto scoreCandidate = [&](Candidate& candidate)
+    {
+        uint32_t index = candidate.Index;
+
+        T triIndices[3] =
+        {
+            indices[index * 3],
+            indices[index * 3 + 1],
+            indices[index * 3 + 2],
+        };
+
+        assert(triIndices[0] < vertexCount);
+        assert(triIndices[1] < vertexCount);
+        assert(triIndices[2] < vertexCount);
+
+        XMFLOAT3 triVerts[3] =
+        {
+            positions[triIndices[0]],
+            positions[triIndices[1]],
+            positions[triIndices[2]],
+        };
+
+        candidate.Reuse = ComputeReuse(membership, meshletIndex, triIndices);
+        candidate.Score = ComputeScore(candidate.Reuse, psphere, normal, triVerts, triNormals[index]);
+    };
+
+    auto addSeed = [&](uint32_t index)
+    {
+        candidates.clear();
+        candidates.push_back({ index, 0, 0.0f });
+        candidateCheck[index] = meshletIndex;
+    };
+
+    auto startMeshlet = [&]()
+    {
+        output.emplace_back();
+        curr = &output.back();
+        ++meshletIndex;
+    };
 
     // Arbitrarily start at triangle zero.
     uint32_t triIndex = 0;
-    candidates.push_back(std::make_pair(triIndex, 0.0f));
-    candidateCheck.insert(triIndex);
-    
+    addSeed(triIndex);
+
     // Continue adding triangles until 
     while (!candidates.empty())
     {
-        uint32_t index = candidates.back().first;
+        std::pop_heap(candidates.begin(), candidates.end(), &CompareScores);
+        uint32_t index = candidates.back().Index;
         candidates.pop_back();
 
         T tri[3] =
@@ -248,33 +360,61 @@ void internal::Meshletize(
         assert(tri[2] < vertexCount);
 
         // Try to add triangle to meshlet
-        if (AddToMeshlet(maxVerts, maxPrims, *curr, tri))
+        if (AddToMeshlet(maxVerts, maxPrims, *curr, meshletIndex, membership, tri))
         {
             // Success! Mark as added.
             checklist[index] = true;
 
-            // Add m_positions & normal to list
-            XMFLOAT3 points[3] =
+            // Grow the bounding sphere & normal axis to include the new triangle. They only change when the
+            // triangle pokes out of the current bounds, in which case every candidate has to be re-scored.
+            bool boundsChanged = false;
+
+            if (curr->PrimitiveIndices.size() == 1)
             {
-                positions[tri[0]],
-                positions[tri[1]],
-                positions[tri[2]],
-            };
+                XMFLOAT3 points[3] =
+                {
+                    positions[tri[0]],
+                    positions[tri[1]],
+                    positions[tri[2]],
+                };
 
-            m_positions.push_back(points[0]);
-            m_positions.push_back(points[1]);
-            m_positions.push_back(points[2]);
+                psphere = MinimumBoundingSphere(points, 3);
+                nsphere = XMVectorSetW(XMLoadFloat3(&triNormals[index]), 0.0f);
+                boundsChanged = true;
+            }
+            else
+            {
+                for (uint32_t i = 0; i < 3u; ++i)
+                {
+                    boundsChanged |= GrowBoundingSphere(psphere, XMLoadFloat3(&positions[tri[i]]));
+                }
 
-            XMFLOAT3 Normal;
-            XMStoreFloat3(&Normal, ComputeNormal(points));
-            normals.push_back(Normal);
+                boundsChanged |= GrowBoundingSphere(nsphere, XMLoadFloat3(&triNormals[index]));
+            }
 
-            // Compute new bounding sphere & normal axis
-            psphere = MinimumBoundingSphere(m_positions.data(), static_cast<uint32_t>(m_positions.size()));
-            
-            XMVECTOR nsphere = MinimumBoundingSphere(normals.data(), static_cast<uint32_t>(normals.size()));
             normal = XMVector3Normalize(nsphere);
 
+            // Re-score remaining candidate triangles - without new bounds only those sharing a new vertex change.
+            bool scoresChanged = false;
+            for (auto& candidate : candidates)
+            {
+                if (!boundsChanged)
+                {
+                    T triIndices[3] =
+                    {
+                        indices[candidate.Index * 3],
+                        indices[candidate.Index * 3 + 1],
+                        indices[candidate.Index * 3 + 2],
+                    };
+
+                    if (ComputeReuse(membership, meshletIndex, triIndices) == candidate.Reuse)
+                        continue;
+                }
+
+                scoreCandidate(candidate);
+                scoresChanged = true;
+            }
+
             // Find and add all applicable adjacent triangles to candidate list
             const uint32_t adjIndex = index * 3;
 
@@ -288,7 +428,7 @@ void internal::Meshletize(
             for (uint32_t i = 0; i < 3u; ++i)
             {
                 // Invalid triangle in adjacency slot
-                if (adj[i] == -1)
+                if (adj[i] == Undef)
                     continue;
                 
                 // Already processed triangle
@@ -296,72 +436,43 @@ void internal::Meshletize(
                     continue;
 
                 // Triangle already in the candidate list
-                if (candidateCheck.count(adj[i]))
+                if (candidateCheck[adj[i]] == meshletIndex)
                     continue;
 
-                candidates.push_back(std::make_pair(adj[i], FLT_MAX));
-                candidateCheck.insert(adj[i]);
-            }
-
-            // Re-score remaining candidate triangles
-            for (uint32_t i = 0; i < static_cast<uint32_t>(candidates.size()); ++i)
-            {
-                uint32_t candidate = candidates[i].first;
-
-                T triIndices[3] =
-                {
-                    indices[candidate * 3],
-                    indices[candidate * 3 + 1],
-                    indices[candidate * 3 + 2],
-                };
+                Candidate candidate = { adj[i] };
+                scoreCandidate(candidate);
 
-                assert(triIndices[0] < vertexCount);
-                assert(triIndices[1] < vertexCount);
-                assert(triIndices[2] < vertexCount);
+                candidates.push_back(candidate);
+                candidateCheck[adj[i]] = meshletIndex;
 
-                XMFLOAT3 triVerts[3] =
+                if (!scoresChanged)
                 {
-                    positions[triIndices[0]],
-                    positions[triIndices[1]],
-                    positions[triIndices[2]],
-                };
+                    std::push_heap(candidates.begin(), candidates.end(), &CompareScores);
+                }
+            }
 
-                candidates[i].second = ComputeScore(*curr, psphere, normal, triIndices, triVerts);
+            if (scoresChanged)
+            {
+                std::make_heap(candidates.begin(), candidates.end(), &CompareScores);
             }
 
             // Determine whether we need to move to the next meshlet.
             if (IsMeshletFull(maxVerts, maxPrims, *curr))
             {
-                m_positions.clear();
-                normals.clear();
-                candidateCheck.clear();
+                startMeshlet();
 
-                // Use one of our existing candidates as the next meshlet seed.
+                // Use the best of our existing candidates as the next meshlet seed.
                 if (!candidates.empty())
                 {
-                    candidates[0] = candidates.back();
-                    candidates.resize(1);
-                    candidateCheck.insert(candidates[0].first);
+                    addSeed(candidates.front().Index);
                 }
-
-                output.emplace_back();
-                curr = &output.back();
-            }
-            else
-            {
-                std::sort(candidates.begin(), candidates.end(), &CompareScores);
             }
         }
         else
         {
             if (candidates.empty())
             {
-                m_positions.clear();
-                normals.clear();
-                candidateCheck.clear();
-
-                output.emplace_back();
-                curr = &output.back();
+                startMeshlet();
             }
         }
 
@@ -374,8 +485,7 @@ void internal::Meshletize(
             if (triIndex == triCount)
                 break;
 
-            candidates.push_back(std::make_pair(triIndex, 0.0f));
-            candidateCheck.insert(triIndex);
+            addSeed(triIndex);
         }
     }
 
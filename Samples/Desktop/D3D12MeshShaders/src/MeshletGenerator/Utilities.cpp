@@ -10,51 +10,43 @@
 //*********************************************************
 #include "Utilities.h"
 
-#include <unordered_map>
-#include <memory>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <numeric>
+#include <ppl.h>
 
 using namespace DirectX;
 
 namespace
 {
+    static const uint32_t Undef = uint32_t(-1);
+
+    // A directed triangle edge keyed by its welded start & end vertices. Entry is face * 3 + edge.
     struct EdgeEntry
     {
-        uint32_t   i0;
-        uint32_t   i1;
-        uint32_t   i2;
-                   
-        uint32_t   Face;
-        EdgeEntry* Next;
+        uint64_t Key;
+        uint32_t Entry;
     };
 
-    size_t CRCHash(const uint32_t* dwords, uint32_t dwordCount)
+    inline uint64_t MakeEdgeKey(uint32_t i0, uint32_t i1)
     {
-        size_t h = 0;
-
-        for (uint32_t i = 0; i < dwordCount; ++i)
-        {
-            uint32_t highOrd = h & 0xf8000000;
-            h = h << 5;
-            h = h ^ (highOrd >> 27);
-            h = h ^ size_t(dwords[i]);
-        }
-
-        return h;
+        return (uint64_t(i0) << 32) | i1;
     }
 
-    template <typename T>
-    inline size_t Hash(const T& val)
+    // Edges sharing a key are ordered most recently added first, matching the order the previous
+    // hash chains were walked in - ties between equally good candidates resolve the same way.
+    bool CompareEdges(const EdgeEntry& a, const EdgeEntry& b)
     {
-        return std::hash<T>()(val);
+        return a.Key < b.Key || (a.Key == b.Key && a.Entry > b.Entry);
     }
-}
 
-namespace std
-{
-    template <> struct hash<XMFLOAT3> { size_t operator()(const XMFLOAT3& v) const { return CRCHash(reinterpret_cast<const uint32_t*>(&v), sizeof(v) / 4); } };
+    bool CompareEdgeKeys(const EdgeEntry& a, uint64_t key)
+    {
+        return a.Key < key;
+    }
 }
 
-
 ///
 // External Interface
 
@@ -65,6 +57,13 @@ namespace internal
         const T* indices, uint32_t indexCount,
         const XMFLOAT3* positions, uint32_t vertexCount,
         uint32_t* adjacency);
+
+    template <typename T>
+    void BuildVertexIncidence(
+        const T* indices, uint32_t indexCount,
+        uint32_t vertexCount,
+        uint32_t* offsets,
+        uint32_t* triangles);
 }
 
 void BuildAdjacencyList(
@@ -85,6 +84,26 @@ void BuildAdjacencyList(
     internal::BuildAdjacencyList(indices, indexCount, positions, vertexCount, adjacency);
 }
 
+void BuildVertexIncidence(
+    const uint16_t* indices, uint32_t indexCount,
+    uint32_t vertexCount,
+    uint32_t* offsets,
+    uint32_t* triangles
+)
+{
+    internal::BuildVertexIncidence(indices, indexCount, vertexCount, offsets, triangles);
+}
+
+void BuildVertexIncidence(
+    const uint32_t* indices, uint32_t indexCount,
+    uint32_t vertexCount,
+    uint32_t* offsets,
+    uint32_t* triangles
+)
+{
+    internal::BuildVertexIncidence(indices, indexCount, vertexCount, offsets, triangles);
+}
+
 
 ///
 // Implementation
@@ -97,71 +116,97 @@ void internal::BuildAdjacencyList(
 )
 {
     const uint32_t triCount = indexCount / 3;
+    const uint32_t edgeCount = triCount * 3;
+
     // Find point reps (unique positions) in the position stream
-    // Create a mapping of non-unique vertex indices to point reps
+    // Create a mapping of non-unique vertex indices to point reps. Positions are compared by their exact bit
+    // pattern, so each vertex maps to the lowest index holding an identical position.
+    std::vector<uint32_t> sortedVerts(vertexCount);
+    std::iota(sortedVerts.begin(), sortedVerts.end(), 0u);
+
+    concurrency::parallel_sort(sortedVerts.begin(), sortedVerts.end(), [&](uint32_t a, uint32_t b)
+    {
+        int c = std::memcmp(&positions[a], &positions[b], sizeof(XMFLOAT3));
+        return c < 0 || (c == 0 && a < b);
+    });
+
     std::vector<T> pointRep;
     pointRep.resize(vertexCount);
 
-    std::unordered_map<size_t, T> uniquePositionMap;
-    uniquePositionMap.reserve(vertexCount);
-
+    // Each run of identical positions starts with its lowest index.
+    uint32_t first = 0;
     for (uint32_t i = 0; i < vertexCount; ++i)
     {
-        XMFLOAT3 position = *(positions + i);
-        size_t hash = Hash(position);
-
-        auto it = uniquePositionMap.find(hash);
-        if (it != uniquePositionMap.end())
-        {
-            // Position already encountered - reference previous index
-            pointRep[i] = it->second;
-        }
-        else
+        if (i > 0 && std::memcmp(&positions[sortedVerts[i - 1]], &positions[sortedVerts[i]], sizeof(XMFLOAT3)) != 0)
         {
-            // New position found - add to hash table and LUT
-            uniquePositionMap.insert(std::make_pair(hash, static_cast<T>(i)));
-            pointRep[i] = static_cast<T>(i);
+            first = i;
         }
-    }
 
-    // Create a linked list of edges for each vertex to determine adjacency
-    const uint32_t hashSize = vertexCount / 3;
-
-    std::unique_ptr<EdgeEntry*[]> hashTable(new EdgeEntry*[hashSize]);
-    std::unique_ptr<EdgeEntry[]> entries(new EdgeEntry[triCount * 3]);
+        pointRep[sortedVerts[i]] = static_cast<T>(sortedVerts[first]);
+    }
 
-    std::memset(hashTable.get(), 0, sizeof(EdgeEntry*) * hashSize);
-    uint32_t entryIndex = 0;
+    // Create an entry for each directed edge, and cache the normal of its face as seen from that edge.
+    std::vector<EdgeEntry> edges(edgeCount);
+    std::vector<XMFLOAT3> normals(edgeCount);
 
-    for (uint32_t iFace = 0; iFace < triCount; ++iFace)
+    concurrency::parallel_for(0u, triCount, [&](uint32_t iFace)
     {
         uint32_t index = iFace * 3;
 
-        // Create a hash entry in the hash table for each each.
         for (uint32_t iEdge = 0; iEdge < 3; ++iEdge)
         {
             T i0 = pointRep[indices[index + (iEdge % 3)]];
             T i1 = pointRep[indices[index + ((iEdge + 1) % 3)]];
             T i2 = pointRep[indices[index + ((iEdge + 2) % 3)]];
 
-            auto& entry = entries[entryIndex++];
-            entry.i0 = i0;
-            entry.i1 = i1;
-            entry.i2 = i2;
+            edges[index + iEdge] = { MakeEdgeKey(i0, i1), index + iEdge };
 
-            uint32_t key = entry.i0 % hashSize;
+            XMVECTOR p0 = XMLoadFloat3(&positions[i0]);
+            XMVECTOR p1 = XMLoadFloat3(&positions[i1]);
+            XMVECTOR p2 = XMLoadFloat3(&positions[i2]);
 
-            entry.Next = hashTable[key];
-            entry.Face = iFace;
+            XMVECTOR e0 = p0 - p1;
+            XMVECTOR e1 = p1 - p2;
 
-            hashTable[key] = &entry;
+            XMStoreFloat3(&normals[index + iEdge], XMVector3Normalize(XMVector3Cross(e0, e1)));
         }
+    });
+
+    // Group the edges by key, then locate the group of oppositely directed edges for each one.
+    concurrency::parallel_sort(edges.begin(), edges.end(), CompareEdges);
+
+    std::vector<uint32_t> groupStart(edgeCount);
+    std::vector<uint32_t> opposite(edgeCount);
+
+    // Record where each edge's group starts in the sorted table.
+    uint32_t start = 0;
+    for (uint32_t i = 0; i < edgeCount; ++i)
+    {
+        if (i > 0 && edges[i - 1].Key != edges[i].Key)
+        {
+            start = i;
+        }
+
+        groupStart[edges[i].Entry] = start;
     }
 
+    concurrency::parallel_for(0u, edgeCount, [&](uint32_t i)
+    {
+        const EdgeEntry& edge = edges[i];
+
+        uint64_t key = MakeEdgeKey(uint32_t(edge.Key), uint32_t(edge.Key >> 32));
+        auto it = std::lower_bound(edges.begin(), edges.end(), key, CompareEdgeKeys);
+
+        opposite[edge.Entry] = (it != edges.end() && it->Key == key) ? uint32_t(it - edges.begin()) : Undef;
+    });
 
     // Initialize the adjacency list
     std::memset(adjacency, uint32_t(-1), indexCount * sizeof(uint32_t));
 
+    // Pair the edges up in face order. Each pairing consumes both edges, so later faces see the outcome of earlier
+    // ones; this pass stays serial, but every lookup is now a direct index into a small group.
+    std::vector<uint8_t> removed(edgeCount, 0);
+
     for (uint32_t iFace = 0; iFace < triCount; ++iFace)
     {
         uint32_t index = iFace * 3;
@@ -174,95 +219,56 @@ void internal::BuildAdjacencyList(
             // Look for edges directed in the opposite direction.
             T i0 = pointRep[indices[index + ((point + 1) % 3)]];
             T i1 = pointRep[indices[index + (point % 3)]];
-            T i2 = pointRep[indices[index + ((point + 2) % 3)]];
 
-            // Find a face sharing this edge
-            uint32_t key = i0 % hashSize;
+            const uint32_t entry = index + point;
+            const uint64_t key = MakeEdgeKey(i0, i1);
 
-            EdgeEntry* found = nullptr;
-            EdgeEntry* foundPrev = nullptr;
+            XMVECTOR n0 = XMLoadFloat3(&normals[entry]);
+
+            // Use face normal dot product to determine best edge-sharing candidate.
+            uint32_t found = Undef;
+            float bestDot = -2.0f;
 
-            for (EdgeEntry* current = hashTable[key], *prev = nullptr; current != nullptr; prev = current, current = current->Next)
+            for (uint32_t i = opposite[entry]; i < edgeCount && edges[i].Key == key; ++i)
             {
-                if (current->i1 == i1 && current->i0 == i0)
+                uint32_t current = edges[i].Entry;
+                if (removed[current])
+                    continue;
+
+                if (found == Undef)
                 {
                     found = current;
-                    foundPrev = prev;
-                    break;
                 }
-            }
-
-            // Cache this face's normal
-            XMVECTOR n0;
-            {
-                XMVECTOR p0 = XMLoadFloat3(&positions[i1]);
-                XMVECTOR p1 = XMLoadFloat3(&positions[i0]);
-                XMVECTOR p2 = XMLoadFloat3(&positions[i2]);
 
-                XMVECTOR e0 = p0 - p1;
-                XMVECTOR e1 = p1 - p2;
+                XMVECTOR n1 = XMLoadFloat3(&normals[current]);
+                float dot = XMVectorGetX(XMVector3Dot(n0, n1));
 
-                n0 = XMVector3Normalize(XMVector3Cross(e0, e1));
-            }
-
-            // Use face normal dot product to determine best edge-sharing candidate.
-            float bestDot = -2.0f;
-            for (EdgeEntry* current = found, *prev = foundPrev; current != nullptr; prev = current, current = current->Next)
-            {
-                if (bestDot == -2.0f || (current->i1 == i1 && current->i0 == i0))
+                if (dot > bestDot)
                 {
-                    XMVECTOR p0 = XMLoadFloat3(&positions[current->i0]);
-                    XMVECTOR p1 = XMLoadFloat3(&positions[current->i1]);
-                    XMVECTOR p2 = XMLoadFloat3(&positions[current->i2]);
-
-                    XMVECTOR e0 = p0 - p1;
-                    XMVECTOR e1 = p1 - p2;
-
-                    XMVECTOR n1 = XMVector3Normalize(XMVector3Cross(e0, e1));
-
-                    float dot = XMVectorGetX(XMVector3Dot(n0, n1));
-
-                    if (dot > bestDot)
-                    {
-                        found = current;
-                        foundPrev = prev;
-                        bestDot = dot;
-                    }
+                    found = current;
+                    bestDot = dot;
                 }
             }
 
-            // Update hash table and adjacency list
-            if (found && found->Face != uint32_t(-1))
+            // Update edge table and adjacency list
+            if (found != Undef)
             {
-                // Erase the found from the hash table linked list.
-                if (foundPrev != nullptr)
-                {
-                    foundPrev->Next = found->Next;
-                }
-                else
-                {
-                    hashTable[key] = found->Next;
-                }
+                const uint32_t foundFace = found / 3;
 
-                // Update adjacency information
-                adjacency[iFace * 3 + point] = found->Face;
+                // Erase the found edge from the table.
+                removed[found] = 1;
 
-                // Search & remove this face from the table linked list
-                uint32_t key2 = i1 % hashSize;
+                // Update adjacency information
+                adjacency[iFace * 3 + point] = foundFace;
 
-                for (EdgeEntry* current = hashTable[key2], *prev = nullptr; current != nullptr; prev = current, current = current->Next)
+                // Search & remove this face's edge from the table
+                const uint32_t group = groupStart[entry];
+                for (uint32_t i = group; i < edgeCount && edges[i].Key == edges[group].Key; ++i)
                 {
-                    if (current->Face == iFace && current->i1 == i0 && current->i0 == i1)
+                    uint32_t current = edges[i].Entry;
+                    if (!removed[current] && current / 3 == iFace)
                     {
-                        if (prev != nullptr)
-                        {
-                            prev->Next = current->Next;
-                        }
-                        else
-                        {
-                            hashTable[key2] = current->Next;
-                        }
-
+                        removed[current] = 1;
                         break;
                     }
                 }
@@ -270,7 +276,7 @@ void internal::BuildAdjacencyList(
                 bool linked = false;
                 for (uint32_t point2 = 0; point2 < point; ++point2)
                 {
-                    if (found->Face == adjacency[iFace * 3 + point2])
+                    if (foundFace == adjacency[iFace * 3 + point2])
                     {
                         linked = true;
                         adjacency[iFace * 3 + point] = uint32_t(-1);
@@ -283,7 +289,7 @@ void internal::BuildAdjacencyList(
                     uint32_t edge2 = 0;
                     for (; edge2 < 3; ++edge2)
                     {
-                        T k = indices[found->Face * 3 + edge2];
+                        T k = indices[foundFace * 3 + edge2];
                         if (k == uint32_t(-1))
                             continue;
 
@@ -293,7 +299,7 @@ void internal::BuildAdjacencyList(
 
                     if (edge2 < 3)
                     {
-                        adjacency[found->Face * 3 + edge2] = iFace;
+                        adjacency[foundFace * 3 + edge2] = iFace;
                     }
                 }
             }
@@ -301,6 +307,54 @@ void internal::BuildAdjacencyList(
     }
 }
 
+template <typename T>
+void internal::BuildVertexIncidence(
+    const T* indices, uint32_t indexCount,
+    uint32_t vertexCount,
+    uint32_t* offsets,
+    uint32_t* triangles
+)
+{
+    const uint32_t triCount = indexCount / 3;
+
+    // Count the triangles referencing each vertex, skipping repeated corners of degenerate triangles.
+    std::memset(offsets, 0, (vertexCount + 1) * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < triCount; ++i)
+    {
+        const T* tri = indices + i * 3;
+
+        for (uint32_t j = 0; j < 3; ++j)
+        {
+            if ((j < 1 || tri[j] != tri[0]) && (j < 2 || tri[j] != tri[1]))
+            {
+                ++offsets[tri[j] + 1];
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < vertexCount; ++i)
+    {
+        offsets[i + 1] += offsets[i];
+    }
+
+    // Scatter the triangle indices - each vertex's list ends up sorted by triangle index.
+    std::vector<uint32_t> cursor(offsets, offsets + vertexCount);
+
+    for (uint32_t i = 0; i < triCount; ++i)
+    {
+        const T* tri = indices + i * 3;
+
+        for (uint32_t j = 0; j < 3; ++j)
+        {
+            if ((j < 1 || tri[j] != tri[0]) && (j < 2 || tri[j] != tri[1]))
+            {
+                triangles[cursor[tri[j]]++] = i;
+            }
+        }
+    }
+}
+
 XMVECTOR MinimumBoundingSphere(XMFLOAT3* points, uint32_t count)
 {
     assert(points != nullptr && count != 0);
@@ -369,3 +423,26 @@ XMVECTOR MinimumBoundingSphere(XMFLOAT3* points, uint32_t count)
     return XMVectorSelect(center, radius, select0001);
 }
 
+// Expands a sphere (xyz = center, w = radius) to contain a point, using the same step MinimumBoundingSphere
+// takes for every point outside of its estimate. Returns false if the point was already contained.
+bool GrowBoundingSphere(XMVECTOR& sphere, FXMVECTOR point)
+{
+    XMVECTOR center = sphere;
+    XMVECTOR radius = XMVectorSplatW(sphere);
+    XMVECTOR distSq = XMVector3LengthSq(point - center);
+
+    if (!XMVector3Greater(distSq, radius * radius))
+    {
+        return false;
+    }
+
+    XMVECTOR dist = XMVectorSqrt(distSq);
+    XMVECTOR k = (radius / dist) * 0.5f + XMVectorReplicate(0.5f);
+
+    center = center * k + point * (g_XMOne - k);
+    radius = (radius + dist) * 0.5f;
+
+    XMVECTOR select0001 = XMVectorSelectControl(0, 0, 0, 1);
+    sphere = XMVectorSelect(center, radius, select0001);
+    return true;
+}
@@ -26,4 +26,23 @@ void BuildAdjacencyList(
     uint32_t* adjacency
 );
 
+// Builds a CSR table of the triangles referencing each vertex: the triangles touching vertex v are
+// triangles[offsets[v]] .. triangles[offsets[v + 1] - 1], in ascending order. offsets must hold
+// vertexCount + 1 elements and triangles indexCount elements.
+void BuildVertexIncidence(
+    const uint16_t* indices, uint32_t indexCount,
+    uint32_t vertexCount,
+    uint32_t* offsets,
+    uint32_t* triangles
+);
+
+void BuildVertexIncidence(
+    const uint32_t* indices, uint32_t indexCount,
+    uint32_t vertexCount,
+    uint32_t* offsets,
+    uint32_t* triangles
+);
+
 DirectX::XMVECTOR MinimumBoundingSphere(DirectX::XMFLOAT3* points, uint32_t count);
+
+bool GrowBoundingSphere(DirectX::XMVECTOR& sphere, DirectX::FXMVECTOR point);
@@ -0,0 +1,484 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "D3D12MeshletCodec.h"
+
+#include <intrin.h>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+    const float c_snormScale = 32767.0f;
+
+    // Sphere radii are only accurate to within float rounding, so a vertex may sit fractionally outside its sphere.
+    // Widening the quantization range slightly keeps such vertices from clamping.
+    const float c_positionMargin = 1.0f + 1.0f / 1024.0f;
+
+    inline float QuantizationScale(float radius)
+    {
+        return radius * c_positionMargin / c_snormScale;
+    }
+
+    inline int16_t QuantizeSnorm(float value)
+    {
+        value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+        return static_cast<int16_t>(std::round(value * c_snormScale));
+    }
+
+    // Unowned vertices use the sphere following the meshlets'.
+    inline uint32_t SphereIndex(uint32_t owner, uint32_t nMeshlets)
+    {
+        return owner == c_noOwner ? nMeshlets : owner;
+    }
+
+    inline size_t GetEncodedPositionSize(uint32_t nVerts, uint32_t nMeshlets)
+    {
+        return (size_t(nMeshlets) + 1) * sizeof(XMFLOAT4) + size_t(nVerts) * 6 + 2; // Final vertex is loaded as 8 bytes
+    }
+
+    inline uint32_t LoadIndex(const uint8_t* indices, uint32_t indexSize, uint32_t index)
+    {
+        if (indexSize == 4)
+        {
+            uint32_t value;
+            std::memcpy(&value, indices + size_t(index) * 4, 4);
+            return value;
+        }
+        else
+        {
+            uint16_t value;
+            std::memcpy(&value, indices + size_t(index) * 2, 2);
+            return value;
+        }
+    }
+
+    // Reference octahedral decode; the SIMD path in DecodeDirections must match it.
+    inline XMFLOAT3 DecodeOctahedral(int16_t qx, int16_t qy)
+    {
+        float x = qx * (1.0f / c_snormScale);
+        float y = qy * (1.0f / c_snormScale);
+        float z = 1.0f - std::fabs(x) - std::fabs(y);
+
+        float t = z < 0.0f ? -z : 0.0f;
+        x += x >= 0.0f ? -t : t;
+        y += y >= 0.0f ? -t : t;
+
+        float invLength = 1.0f / std::sqrt(x * x + y * y + z * z);
+        return XMFLOAT3(x * invLength, y * invLength, z * invLength);
+    }
+
+    bool HasSsse3()
+    {
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 9)) != 0;
+    }
+
+    const bool s_hasSsse3 = HasSsse3();
+}
+
+size_t GetEncodedSize(StreamEncoding encoding, uint32_t count, uint32_t elementSize)
+{
+    switch (encoding)
+    {
+    case STREAM_ENCODING_PACKED:             return size_t(count) * elementSize;
+    case STREAM_ENCODING_QUANTIZED_POSITION: return GetEncodedPositionSize(count, 0);
+    case STREAM_ENCODING_OCTAHEDRAL:         return size_t(count) * 4;
+    case STREAM_ENCODING_DELTA_VARINT:       return size_t(count);          // At least one byte per index
+    case STREAM_ENCODING_BYTE_TRIANGLES:     return size_t(count) * 3 + 4;  // Final 4 triangles are loaded as 16 bytes
+    default:                                 return 0;
+    }
+}
+
+HRESULT ComputeVertexOwners(
+    const CodecMeshlet* meshlets, uint32_t nMeshlets,
+    const uint8_t* uniqueVertexIndices, uint32_t indexSize, uint32_t nIndices,
+    uint32_t nVerts,
+    std::vector<uint32_t>& owners)
+{
+    owners.assign(nVerts, c_noOwner);
+
+    for (uint32_t i = 0; i < nMeshlets; ++i)
+    {
+        auto& m = meshlets[i];
+        if (uint64_t(m.VertOffset) + m.VertCount > nIndices)
+            return E_FAIL;
+
+        for (uint32_t j = 0; j < m.VertCount; ++j)
+        {
+            uint32_t index = LoadIndex(uniqueVertexIndices, indexSize, m.VertOffset + j);
+            if (index >= nVerts)
+                return E_FAIL;
+
+            if (owners[index] == c_noOwner)
+            {
+                owners[index] = i;
+            }
+        }
+    }
+
+    return S_OK;
+}
+
+void EncodePositions(
+    const uint8_t* positions, uint32_t stride, uint32_t nVerts,
+    const uint32_t* owners, uint32_t nMeshlets,
+    std::vector<uint8_t>& encoded)
+{
+    encoded.assign(GetEncodedPositionSize(nVerts, nMeshlets), 0);
+
+    auto loadPosition = [&](uint32_t i)
+    {
+        XMFLOAT3 p;
+        std::memcpy(&p, positions + size_t(i) * stride, sizeof(p));
+        return XMLoadFloat3(&p);
+    };
+
+    // Center each sphere on the bounding box of the vertices it owns & extend it to the furthest of them.
+    std::vector<XMVECTOR> mins(nMeshlets + 1, g_XMFltMax);
+    std::vector<XMVECTOR> maxs(nMeshlets + 1, -g_XMFltMax);
+
+    for (uint32_t i = 0; i < nVerts; ++i)
+    {
+        uint32_t s = SphereIndex(owners[i], nMeshlets);
+        mins[s] = XMVectorMin(mins[s], loadPosition(i));
+        maxs[s] = XMVectorMax(maxs[s], loadPosition(i));
+    }
+
+    std::vector<XMFLOAT4> spheres(nMeshlets + 1, XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
+
+    for (uint32_t s = 0; s <= nMeshlets; ++s)
+    {
+        if (XMVector3Greater(mins[s], maxs[s]))
+            continue; // Owns no vertices
+
+        XMStoreFloat4(&spheres[s], (mins[s] + maxs[s]) * 0.5f);
+    }
+
+    for (uint32_t i = 0; i < nVerts; ++i)
+    {
+        auto& sphere = spheres[SphereIndex(owners[i], nMeshlets)];
+
+        XMVECTOR center = XMVectorSetW(XMLoadFloat4(&sphere), 0.0f);
+        sphere.w = std::fmax(sphere.w, XMVectorGetX(XMVector3Length(loadPosition(i) - center)));
+    }
+
+    std::memcpy(encoded.data(), spheres.data(), spheres.size() * sizeof(XMFLOAT4));
+
+    int16_t* dest = reinterpret_cast<int16_t*>(encoded.data() + spheres.size() * sizeof(XMFLOAT4));
+
+    for (uint32_t i = 0; i < nVerts; ++i, dest += 3)
+    {
+        XMFLOAT3 p;
+        XMStoreFloat3(&p, loadPosition(i));
+
+        auto& sphere = spheres[SphereIndex(owners[i], nMeshlets)];
+
+        float scale = QuantizationScale(sphere.w);
+        float invScale = scale > 0.0f ? 1.0f / (scale * c_snormScale) : 0.0f;
+
+        dest[0] = QuantizeSnorm((p.x - sphere.x) * invScale);
+        dest[1] = QuantizeSnorm((p.y - sphere.y) * invScale);
+        dest[2] = QuantizeSnorm((p.z - sphere.z) * invScale);
+    }
+}
+
+HRESULT DecodePositions(
+    const uint8_t* encoded, size_t encodedSize, uint32_t nVerts,
+    const uint32_t* owners, uint32_t nMeshlets,
+    uint8_t* positions, uint32_t stride)
+{
+    if (encodedSize < GetEncodedPositionSize(nVerts, nMeshlets))
+        return E_FAIL;
+
+    const uint8_t* spheres = encoded;
+    encoded += (size_t(nMeshlets) + 1) * sizeof(XMFLOAT4);
+
+    __m128 center = _mm_setzero_ps();
+    __m128 scale = _mm_setzero_ps();
+    uint32_t currOwner = 0;
+
+    for (uint32_t i = 0; i < nVerts; ++i, encoded += 6, positions += stride)
+    {
+        // Owners change only between runs of vertices, so the sphere is reloaded rarely.
+        if (i == 0 || owners[i] != currOwner)
+        {
+            currOwner = owners[i];
+
+            XMFLOAT4 sphere;
+            std::memcpy(&sphere, spheres + SphereIndex(currOwner, nMeshlets) * sizeof(XMFLOAT4), sizeof(sphere));
+
+            center = _mm_setr_ps(sphere.x, sphere.y, sphere.z, 0.0f);
+            scale = _mm_set1_ps(QuantizationScale(sphere.w));
+        }
+
+        // Sign extend xyz to 32 bits, convert & rescale into the sphere.
+        __m128i q = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(encoded));
+        q = _mm_srai_epi32(_mm_unpacklo_epi16(q, q), 16);
+
+        __m128 p = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(q), scale), center);
+
+        _mm_storel_pi(reinterpret_cast<__m64*>(positions), p);
+        _mm_store_ss(reinterpret_cast<float*>(positions + 8), _mm_movehl_ps(p, p));
+    }
+
+    return S_OK;
+}
+
+void EncodePacked(const uint8_t* elements, uint32_t stride, uint32_t elementSize, uint32_t count, std::vector<uint8_t>& encoded)
+{
+    encoded.resize(GetEncodedSize(STREAM_ENCODING_PACKED, count, elementSize));
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        std::memcpy(encoded.data() + size_t(i) * elementSize, elements + size_t(i) * stride, elementSize);
+    }
+}
+
+void DecodePacked(const uint8_t* encoded, uint32_t elementSize, uint32_t count, uint8_t* elements, uint32_t stride)
+{
+    if (stride == elementSize)
+    {
+        std::memcpy(elements, encoded, size_t(count) * elementSize);
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        std::memcpy(elements + size_t(i) * stride, encoded + size_t(i) * elementSize, elementSize);
+    }
+}
+
+void EncodeDirections(const uint8_t* directions, uint32_t stride, uint32_t count, std::vector<uint8_t>& encoded)
+{
+    encoded.resize(GetEncodedSize(STREAM_ENCODING_OCTAHEDRAL, count, 0));
+
+    int16_t* dest = reinterpret_cast<int16_t*>(encoded.data());
+
+    for (uint32_t i = 0; i < count; ++i, dest += 2)
+    {
+        XMFLOAT3 n;
+        std::memcpy(&n, directions + size_t(i) * stride, sizeof(n));
+
+        // Project onto the octahedron and fold the lower hemisphere over the upper.
+        float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+        float x = l1 > 0.0f ? n.x / l1 : 0.0f;
+        float y = l1 > 0.0f ? n.y / l1 : 0.0f;
+
+        if (n.z < 0.0f)
+        {
+            float fx = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float fy = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = fx;
+            y = fy;
+        }
+
+        // Rounding each coordinate to nearest isn't always nearest on the sphere - pick the best of the four
+        // neighbouring grid points.
+        float bx = std::floor(std::fmax(-1.0f, std::fmin(1.0f, x)) * c_snormScale);
+        float by = std::floor(std::fmax(-1.0f, std::fmin(1.0f, y)) * c_snormScale);
+
+        float bestDot = -2.0f;
+        for (uint32_t j = 0; j < 4; ++j)
+        {
+            float cx = std::fmin(bx + (j & 1), c_snormScale);
+            float cy = std::fmin(by + (j >> 1), c_snormScale);
+
+            int16_t qx = static_cast<int16_t>(cx);
+            int16_t qy = static_cast<int16_t>(cy);
+
+            XMFLOAT3 d = DecodeOctahedral(qx, qy);
+            float dot = d.x * n.x + d.y * n.y + d.z * n.z;
+
+            if (dot > bestDot)
+            {
+                bestDot = dot;
+                dest[0] = qx;
+                dest[1] = qy;
+            }
+        }
+    }
+}
+
+void DecodeDirections(const uint8_t* encoded, uint32_t count, uint8_t* directions, uint32_t stride)
+{
+    const __m128 invScale = _mm_set1_ps(1.0f / c_snormScale);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+
+    uint32_t i = 0;
+
+    // Four directions at a time in structure-of-arrays form.
+    for (; i + 4 <= count; i += 4, encoded += 16)
+    {
+        __m128i q = _mm_loadu_si128(reinterpret_cast<const __m128i*>(encoded));
+
+        __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(q, 16), 16)), invScale);
+        __m128 y = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(q, 16)), invScale);
+        __m128 z = _mm_sub_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, x)), _mm_andnot_ps(signMask, y));
+
+        // Unfold the lower hemisphere: xy -= sign(xy) * max(-z, 0)
+        __m128 t = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), z), _mm_setzero_ps());
+        x = _mm_sub_ps(x, _mm_or_ps(t, _mm_and_ps(x, signMask)));
+        y = _mm_sub_ps(y, _mm_or_ps(t, _mm_and_ps(y, signMask)));
+
+        __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+
+        x = _mm_mul_ps(x, invLength);
+        y = _mm_mul_ps(y, invLength);
+        z = _mm_mul_ps(z, invLength);
+
+        __m128 w = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+
+        const __m128 rows[] = { x, y, z, w };
+        for (uint32_t j = 0; j < 4; ++j)
+        {
+            uint8_t* dest = directions + size_t(i + j) * stride;
+
+            _mm_storel_pi(reinterpret_cast<__m64*>(dest), rows[j]);
+            _mm_store_ss(reinterpret_cast<float*>(dest + 8), _mm_movehl_ps(rows[j], rows[j]));
+        }
+    }
+
+    for (; i < count; ++i, encoded += 4)
+    {
+        int16_t q[2];
+        std::memcpy(q, encoded, sizeof(q));
+
+        XMFLOAT3 d = DecodeOctahedral(q[0], q[1]);
+        std::memcpy(directions + size_t(i) * stride, &d, sizeof(d));
+    }
+}
+
+void EncodeVertexIndices(const uint8_t* indices, uint32_t indexSize, uint32_t count, std::vector<uint8_t>& encoded)
+{
+    encoded.clear();
+    encoded.reserve(count + count / 4);
+
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t index = LoadIndex(indices, indexSize, i);
+
+        // Meshlets reference runs of nearby vertices, so most deltas fit in a single byte.
+        int32_t delta = static_cast<int32_t>(index - prev);
+        uint32_t zigzag = (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31);
+
+        while (zigzag >= 0x80)
+        {
+            encoded.push_back(static_cast<uint8_t>(zigzag | 0x80));
+            zigzag >>= 7;
+        }
+        encoded.push_back(static_cast<uint8_t>(zigzag));
+
+        prev = index;
+    }
+}
+
+HRESULT DecodeVertexIndices(const uint8_t* encoded, size_t encodedSize, uint32_t indexSize, uint32_t count, uint8_t* indices)
+{
+    const uint8_t* end = encoded + encodedSize;
+    const uint32_t maxIndex = indexSize == 4 ? uint32_t(-1) : 0xFFFFu;
+
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (encoded == end)
+            return E_FAIL;
+
+        uint32_t zigzag = *encoded++;
+
+        if (zigzag >= 0x80)
+        {
+            zigzag &= 0x7F;
+
+            for (uint32_t shift = 7; ; shift += 7)
+            {
+                if (encoded == end || shift > 28)
+                    return E_FAIL;
+
+                uint32_t byte = *encoded++;
+                zigzag |= (byte & 0x7F) << shift;
+
+                if (byte < 0x80)
+                    break;
+            }
+        }
+
+        int32_t delta = static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+        uint32_t index = prev + static_cast<uint32_t>(delta);
+
+        if (index > maxIndex)
+            return E_FAIL;
+
+        if (indexSize == 4)
+        {
+            std::memcpy(indices + size_t(i) * 4, &index, 4);
+        }
+        else
+        {
+            uint16_t index16 = static_cast<uint16_t>(index);
+            std::memcpy(indices + size_t(i) * 2, &index16, 2);
+        }
+
+        prev = index;
+    }
+
+    return S_OK;
+}
+
+void EncodeTriangles(const uint32_t* triangles, uint32_t count, std::vector<uint8_t>& encoded)
+{
+    encoded.assign(GetEncodedSize(STREAM_ENCODING_BYTE_TRIANGLES, count, 0), 0);
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t packed = triangles[i];
+
+        encoded[i * 3 + 0] = static_cast<uint8_t>(packed & 0x3FF);
+        encoded[i * 3 + 1] = static_cast<uint8_t>((packed >> 10) & 0x3FF);
+        encoded[i * 3 + 2] = static_cast<uint8_t>((packed >> 20) & 0x3FF);
+    }
+}
+
+void DecodeTriangles(const uint8_t* encoded, uint32_t count, uint32_t* triangles)
+{
+    uint32_t i = 0;
+
+    if (s_hasSsse3)
+    {
+        // Spread four 3-byte triangles across 32-bit lanes, then shift each byte into its 10-bit field.
+        const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i byteMask = _mm_set1_epi32(0xFF);
+
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(encoded + i * 3)), spread);
+
+            __m128i i0 = _mm_and_si128(v, byteMask);
+            __m128i i1 = _mm_and_si128(_mm_srli_epi32(v, 8), byteMask);
+            __m128i i2 = _mm_srli_epi32(v, 16);
+
+            __m128i packed = _mm_or_si128(i0, _mm_or_si128(_mm_slli_epi32(i1, 10), _mm_slli_epi32(i2, 20)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(triangles + i), packed);
+        }
+    }
+
+    for (; i < count; ++i)
+    {
+        const uint8_t* t = encoded + i * 3;
+        triangles[i] = uint32_t(t[0]) | (uint32_t(t[1]) << 10) | (uint32_t(t[2]) << 20);
+    }
+}
@@ -0,0 +1,84 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+#include <d3d12.h>
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+// Compressed stream encodings of the meshlet (MSHL) file format.
+// The WavefrontConverter encodes with these functions and the MeshFile loader decodes back to the uncompressed
+// layouts the samples upload, so both sides share a single definition of each encoding.
+enum StreamEncoding : uint32_t
+{
+    STREAM_ENCODING_NONE = 0,           // Stored uncompressed in the accessor's buffer view
+    STREAM_ENCODING_PACKED,             // Elements tightly packed - no interleaving
+    STREAM_ENCODING_QUANTIZED_POSITION, // 16-bit snorm xyz relative to a bounding sphere of the vertex's first meshlet
+    STREAM_ENCODING_OCTAHEDRAL,         // 16-bit snorm octahedral mapping of a unit vector
+    STREAM_ENCODING_DELTA_VARINT,       // Zigzag deltas between successive indices as LEB128 varints
+    STREAM_ENCODING_BYTE_TRIANGLES,     // One byte per meshlet-local triangle corner
+    STREAM_ENCODING_COUNT
+};
+
+// The meshlet fields the codec reads; layout compatible with the generator's & samples' Meshlet.
+struct CodecMeshlet
+{
+    uint32_t VertCount;
+    uint32_t VertOffset;
+    uint32_t PrimCount;
+    uint32_t PrimOffset;
+};
+
+const uint32_t c_noOwner = uint32_t(-1);
+
+// Encoded byte sizes of a stream of 'count' elements. Variable length encodings, and positions - whose size depends on
+// the meshlet count - report their lower bound.
+// Sizes include the padding the SIMD decoders rely on to load whole registers at the end of a stream.
+size_t GetEncodedSize(StreamEncoding encoding, uint32_t count, uint32_t elementSize);
+
+// Assigns each vertex to the first meshlet that references it; unreferenced vertices are assigned c_noOwner.
+// Fails if a meshlet references vertex indices out of range of the stream or the vertex count.
+HRESULT ComputeVertexOwners(
+    const CodecMeshlet* meshlets, uint32_t nMeshlets,
+    const uint8_t* uniqueVertexIndices, uint32_t indexSize, uint32_t nIndices,
+    uint32_t nVerts,
+    std::vector<uint32_t>& owners);
+
+// Positions - each meshlet's sphere bounds the vertices it owns rather than all it references, so it's usually
+// tighter than the meshlet's culling sphere. The spheres are stored ahead of the quantized positions, followed by one
+// for any vertices without an owner. Decoding fails if the encoded data is too small for the vertex & meshlet counts.
+void EncodePositions(
+    const uint8_t* positions, uint32_t stride, uint32_t nVerts,
+    const uint32_t* owners, uint32_t nMeshlets,
+    std::vector<uint8_t>& encoded);
+
+HRESULT DecodePositions(
+    const uint8_t* encoded, size_t encodedSize, uint32_t nVerts,
+    const uint32_t* owners, uint32_t nMeshlets,
+    uint8_t* positions, uint32_t stride);
+
+// Elements of a possibly interleaved stream, copied without conversion.
+void EncodePacked(const uint8_t* elements, uint32_t stride, uint32_t elementSize, uint32_t count, std::vector<uint8_t>& encoded);
+void DecodePacked(const uint8_t* encoded, uint32_t elementSize, uint32_t count, uint8_t* elements, uint32_t stride);
+
+// Unit vectors - normals, tangents & bitangents.
+void EncodeDirections(const uint8_t* directions, uint32_t stride, uint32_t count, std::vector<uint8_t>& encoded);
+void DecodeDirections(const uint8_t* encoded, uint32_t count, uint8_t* directions, uint32_t stride);
+
+// Unique vertex indices of 2 or 4 bytes. Decoding fails if the encoded data is truncated or a value overflows the
+// index size.
+void EncodeVertexIndices(const uint8_t* indices, uint32_t indexSize, uint32_t count, std::vector<uint8_t>& encoded);
+HRESULT DecodeVertexIndices(const uint8_t* encoded, size_t encodedSize, uint32_t indexSize, uint32_t count, uint8_t* indices);
+
+// Primitive indices in the 10:10:10 PackedTriangle layout. Meshlets must have no more than 256 vertices.
+void EncodeTriangles(const uint32_t* triangles, uint32_t count, std::vector<uint8_t>& encoded);
+void DecodeTriangles(const uint8_t* encoded, uint32_t count, uint32_t* triangles);
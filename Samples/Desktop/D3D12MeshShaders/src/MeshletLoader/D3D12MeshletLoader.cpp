@@ -0,0 +1,618 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "D3D12MeshletLoader.h"
+#include "D3D12MeshletCodec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+    const uint32_t c_prolog = 'MSHL';
+
+    enum FileVersion
+    {
+        FILE_VERSION_INITIAL = 0,
+        FILE_VERSION_LOD_CHAIN = 1,
+        FILE_VERSION_CLUSTER_HIERARCHY = 2,
+        FILE_VERSION_COMPRESSED = 3,
+        CURRENT_FILE_VERSION = FILE_VERSION_COMPRESSED
+    };
+
+    struct FileHeader
+    {
+        uint32_t Prolog;
+        uint32_t Version;
+
+        uint32_t MeshCount;
+        uint32_t AccessorCount;
+        uint32_t BufferViewCount;
+        uint32_t BufferSize;
+    };
+
+    struct MeshHeader
+    {
+        uint32_t Indices;
+        uint32_t IndexSubsets;
+        uint32_t Attributes[MeshFileMesh::AttributeCount];
+
+        uint32_t Meshlets;
+        uint32_t MeshletSubsets;
+        uint32_t UniqueVertexIndices;
+        uint32_t PrimitiveIndices;
+        uint32_t CullData;
+    };
+
+    struct MeshLod
+    {
+        uint32_t Level;
+        float    Error;
+    };
+
+    struct MeshHierarchy
+    {
+        uint32_t Clusters;
+    };
+
+    struct EncodedStream
+    {
+        uint32_t BufferView; // Holds the encoded data; the accessor's own buffer view has no data in the file
+        uint32_t Encoding;   // STREAM_ENCODING_NONE if the stream is stored uncompressed
+    };
+
+    struct MeshEncoding
+    {
+        EncodedStream Attributes[MeshFileMesh::AttributeCount];
+        EncodedStream UniqueVertexIndices;
+        EncodedStream PrimitiveIndices;
+    };
+
+    struct BufferView
+    {
+        uint32_t Offset;
+        uint32_t Size;
+    };
+
+    struct Accessor
+    {
+        uint32_t BufferView;
+        uint32_t Offset;
+        uint32_t Size;
+        uint32_t Stride;
+        uint32_t Count;
+    };
+
+    const uint32_t c_absent = uint32_t(-1);
+
+    // Encoding table of meshes stored uncompressed.
+    const MeshEncoding c_uncompressed = {};
+    const EncodedStream c_raw = { c_absent, STREAM_ENCODING_NONE };
+
+    // Specialized encoding of each vertex attribute; any stream may also be stored packed.
+    const StreamEncoding c_attributeEncodings[MeshFileMesh::AttributeCount] =
+    {
+        STREAM_ENCODING_QUANTIZED_POSITION, // Position
+        STREAM_ENCODING_OCTAHEDRAL,         // Normal
+        STREAM_ENCODING_PACKED,             // TexCoord
+        STREAM_ENCODING_OCTAHEDRAL,         // Tangent
+        STREAM_ENCODING_OCTAHEDRAL,         // Bitangent
+    };
+
+    // Checks that an accessor and its buffer view lie within the file's data. The buffer views of encoded streams
+    // have no data in the file - they're only materialized by decoding.
+    bool ValidateAccessor(uint32_t index, const Accessor* accessors, uint32_t accessorCount, const BufferView* bufferViews, uint32_t bufferViewCount, uint32_t bufferSize, bool optional, bool encoded = false)
+    {
+        if (index == c_absent)
+            return optional;
+
+        if (index >= accessorCount)
+            return false;
+
+        auto& accessor = accessors[index];
+        if (accessor.BufferView >= bufferViewCount)
+            return false;
+
+        auto& view = bufferViews[accessor.BufferView];
+        if (encoded ? view.Offset != c_absent : uint64_t(view.Offset) + view.Size > bufferSize)
+            return false;
+
+        if (accessor.Count > 0 && uint64_t(accessor.Offset) + uint64_t(accessor.Count - 1) * accessor.Stride + accessor.Size > view.Size)
+            return false;
+
+        return true;
+    }
+
+    // Checks that an encoded stream's data lies within the file and holds enough elements for its accessor.
+    bool ValidateEncoding(const EncodedStream& stream, uint32_t accessor, const Accessor* accessors, const BufferView* bufferViews, uint32_t bufferViewCount, uint32_t bufferSize, StreamEncoding specialized)
+    {
+        if (stream.Encoding == STREAM_ENCODING_NONE)
+            return true;
+
+        if ((stream.Encoding != STREAM_ENCODING_PACKED && stream.Encoding != specialized) || stream.BufferView >= bufferViewCount)
+            return false;
+
+        auto& view = bufferViews[stream.BufferView];
+        if (view.Offset == c_absent || uint64_t(view.Offset) + view.Size > bufferSize)
+            return false;
+
+        auto& a = accessors[accessor];
+        switch (stream.Encoding)
+        {
+        case STREAM_ENCODING_QUANTIZED_POSITION:
+        case STREAM_ENCODING_OCTAHEDRAL:
+            if (a.Size != 12)
+                return false;
+            break;
+
+        case STREAM_ENCODING_DELTA_VARINT:
+            if ((a.Size != 2 && a.Size != 4) || a.Stride != a.Size)
+                return false;
+            break;
+
+        case STREAM_ENCODING_BYTE_TRIANGLES:
+            if (a.Size != 4 || a.Stride != 4)
+                return false;
+            break;
+        }
+
+        return view.Size >= GetEncodedSize(static_cast<StreamEncoding>(stream.Encoding), a.Count, a.Size);
+    }
+
+    // Expands a mesh's encoded streams into the decoded buffer views their accessors reference.
+    HRESULT DecodeStreams(const MeshHeader& header, const MeshEncoding& encoding, const Accessor* accessors, const BufferView* bufferViews, uint8_t* buffer, std::vector<std::vector<uint8_t>>& decoded)
+    {
+        // Address of an accessor's first element, in the file or in its decoded buffer view.
+        auto data = [&](uint32_t index)
+        {
+            auto& accessor = accessors[index];
+            auto& view = bufferViews[accessor.BufferView];
+
+            return (view.Offset == c_absent ? decoded[accessor.BufferView].data() : buffer + view.Offset) + accessor.Offset;
+        };
+
+        auto decode = [&](uint32_t index, const EncodedStream& stream) -> HRESULT
+        {
+            auto& accessor = accessors[index];
+            auto& source = bufferViews[stream.BufferView];
+
+            // Interleaved attributes share a decoded buffer view - allocate it for the first one decoded.
+            auto& target = decoded[accessor.BufferView];
+            if (target.empty())
+            {
+                target.resize(bufferViews[accessor.BufferView].Size);
+            }
+
+            const uint8_t* src = buffer + source.Offset;
+            uint8_t* dest = data(index);
+
+            switch (stream.Encoding)
+            {
+            case STREAM_ENCODING_PACKED:
+                DecodePacked(src, accessor.Size, accessor.Count, dest, accessor.Stride);
+                return S_OK;
+
+            case STREAM_ENCODING_OCTAHEDRAL:
+                DecodeDirections(src, accessor.Count, dest, accessor.Stride);
+                return S_OK;
+
+            case STREAM_ENCODING_DELTA_VARINT:
+                return DecodeVertexIndices(src, source.Size, accessor.Size, accessor.Count, dest);
+
+            case STREAM_ENCODING_BYTE_TRIANGLES:
+                DecodeTriangles(src, accessor.Count, reinterpret_cast<uint32_t*>(dest));
+                return S_OK;
+
+            case STREAM_ENCODING_QUANTIZED_POSITION:
+            {
+                // Positions are quantized against per-meshlet spheres, so ownership is recovered from the meshlet data.
+                auto& meshlets = accessors[header.Meshlets];
+                auto& vertexIndices = accessors[header.UniqueVertexIndices];
+
+                if (meshlets.Size != sizeof(CodecMeshlet) || meshlets.Stride != meshlets.Size || vertexIndices.Stride != vertexIndices.Size)
+                {
+                    return E_FAIL;
+                }
+
+                std::vector<uint32_t> owners;
+                HRESULT hr = ComputeVertexOwners(
+                    reinterpret_cast<const CodecMeshlet*>(data(header.Meshlets)), meshlets.Count,
+                    data(header.UniqueVertexIndices), vertexIndices.Size, vertexIndices.Count,
+                    accessor.Count,
+                    owners);
+
+                if (FAILED(hr))
+                    return hr;
+
+                return DecodePositions(src, source.Size, accessor.Count, owners.data(), meshlets.Count, dest, accessor.Stride);
+            }
+
+            default:
+                return E_FAIL;
+            }
+        };
+
+        // Vertex indices are decoded first - position decoding depends on them.
+        HRESULT hr = S_OK;
+
+        if (encoding.UniqueVertexIndices.Encoding != STREAM_ENCODING_NONE)
+        {
+            hr = decode(header.UniqueVertexIndices, encoding.UniqueVertexIndices);
+        }
+
+        if (SUCCEEDED(hr) && encoding.PrimitiveIndices.Encoding != STREAM_ENCODING_NONE)
+        {
+            hr = decode(header.PrimitiveIndices, encoding.PrimitiveIndices);
+        }
+
+        for (uint32_t i = 0; SUCCEEDED(hr) && i < MeshFileMesh::AttributeCount; ++i)
+        {
+            if (encoding.Attributes[i].Encoding != STREAM_ENCODING_NONE)
+            {
+                hr = decode(header.Attributes[i], encoding.Attributes[i]);
+            }
+        }
+
+        return hr;
+    }
+
+    MeshFileStream ResolveAccessor(uint32_t index, const Accessor* accessors, const BufferView* bufferViews, uint8_t* buffer, const std::vector<std::vector<uint8_t>>& decoded)
+    {
+        MeshFileStream stream = {};
+
+        if (index == c_absent)
+            return stream;
+
+        auto& accessor = accessors[index];
+        auto& view = bufferViews[accessor.BufferView];
+
+        stream.Data = view.Offset == c_absent ? const_cast<uint8_t*>(decoded[accessor.BufferView].data()) : buffer + view.Offset;
+        stream.Size = view.Size;
+        stream.BufferView = accessor.BufferView;
+        stream.Offset = accessor.Offset;
+        stream.ElementSize = accessor.Size;
+        stream.Stride = accessor.Stride;
+        stream.Count = accessor.Count;
+
+        return stream;
+    }
+
+    // The samples size their meshlet and cull data spans by the meshlets the subsets reference, so every subset has to
+    // lie within both streams.
+    bool ValidateMeshletSubsets(const MeshFileStream& subsets, const Accessor& meshlets, const Accessor& cullData)
+    {
+        if (subsets.ElementSize < 2 * sizeof(uint32_t))
+            return false;
+
+        uint64_t meshletCount = 0;
+        for (uint32_t i = 0; i < subsets.Count; ++i)
+        {
+            uint32_t subset[2]; // Offset, Count
+            std::memcpy(subset, subsets.Data + subsets.Offset + uint64_t(i) * subsets.Stride, sizeof(subset));
+
+            if (uint64_t(subset[0]) + subset[1] > meshlets.Count)
+                return false;
+
+            meshletCount += subset[1];
+        }
+
+        return meshletCount <= meshlets.Count && meshletCount <= cullData.Count;
+    }
+}
+
+MeshFile::MeshFile()
+    : m_file(INVALID_HANDLE_VALUE)
+    , m_mapping(nullptr)
+    , m_view(nullptr)
+    , m_fileSize(0)
+    , m_version(0)
+    , m_meshCount(0)
+    , m_accessorCount(0)
+    , m_bufferViewCount(0)
+    , m_meshes(nullptr)
+    , m_accessors(nullptr)
+    , m_bufferViews(nullptr)
+    , m_lods(nullptr)
+    , m_hierarchies(nullptr)
+    , m_encodings(nullptr)
+    , m_buffer(nullptr)
+    , m_bufferSize(0)
+{ }
+
+MeshFile::~MeshFile()
+{
+    Close();
+}
+
+MeshFile::MeshFile(MeshFile&& other) noexcept
+    : MeshFile()
+{
+    Swap(other);
+}
+
+MeshFile& MeshFile::operator=(MeshFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        Close();
+        Swap(other);
+    }
+
+    return *this;
+}
+
+HRESULT MeshFile::Open(const wchar_t* filename)
+{
+    Close();
+
+    m_file = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        return E_INVALIDARG;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(FileHeader)))
+    {
+        Close();
+        return E_FAIL;
+    }
+    m_fileSize = static_cast<uint64_t>(size.QuadPart);
+
+    // Copy-on-write keeps the file untouched while still handing out writable spans.
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (m_mapping == nullptr)
+    {
+        Close();
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    m_view = static_cast<uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_COPY, 0, 0, 0));
+    if (m_view == nullptr)
+    {
+        Close();
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    auto& header = *reinterpret_cast<const FileHeader*>(m_view);
+
+    if (header.Prolog != c_prolog)
+    {
+        Close();
+        return E_FAIL; // Incorrect file format.
+    }
+
+    if (header.Version > CURRENT_FILE_VERSION)
+    {
+        Close();
+        return E_FAIL; // Version mismatch between export and import serialization code.
+    }
+
+    // Lay out the metadata tables, which sit back to back between the header and the buffer data.
+    uint64_t offset = sizeof(FileHeader);
+
+    m_meshes = m_view + offset;
+    offset += uint64_t(header.MeshCount) * sizeof(MeshHeader);
+
+    m_accessors = m_view + offset;
+    offset += uint64_t(header.AccessorCount) * sizeof(Accessor);
+
+    m_bufferViews = m_view + offset;
+    offset += uint64_t(header.BufferViewCount) * sizeof(BufferView);
+
+    if (header.Version >= FILE_VERSION_LOD_CHAIN)
+    {
+        m_lods = m_view + offset;
+        offset += uint64_t(header.MeshCount) * sizeof(MeshLod);
+    }
+
+    if (header.Version >= FILE_VERSION_CLUSTER_HIERARCHY)
+    {
+        m_hierarchies = m_view + offset;
+        offset += uint64_t(header.MeshCount) * sizeof(MeshHierarchy);
+    }
+
+    if (header.Version >= FILE_VERSION_COMPRESSED)
+    {
+        m_encodings = m_view + offset;
+        offset += uint64_t(header.MeshCount) * sizeof(MeshEncoding);
+    }
+
+    if (offset + header.BufferSize > m_fileSize)
+    {
+        Close();
+        return E_FAIL; // Truncated file.
+    }
+
+    m_buffer = m_view + offset;
+    m_bufferSize = header.BufferSize;
+
+    m_version = header.Version;
+    m_meshCount = header.MeshCount;
+    m_accessorCount = header.AccessorCount;
+    m_bufferViewCount = header.BufferViewCount;
+
+    m_validated.assign(m_meshCount, false);
+    m_decoded.resize(m_bufferViewCount);
+
+    return S_OK;
+}
+
+void MeshFile::Close()
+{
+    if (m_view != nullptr)
+    {
+        UnmapViewOfFile(m_view);
+        m_view = nullptr;
+    }
+
+    if (m_mapping != nullptr)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+
+    m_fileSize = 0;
+    m_version = 0;
+    m_meshCount = 0;
+    m_accessorCount = 0;
+    m_bufferViewCount = 0;
+    m_meshes = nullptr;
+    m_accessors = nullptr;
+    m_bufferViews = nullptr;
+    m_lods = nullptr;
+    m_hierarchies = nullptr;
+    m_encodings = nullptr;
+    m_buffer = nullptr;
+    m_bufferSize = 0;
+    m_validated.clear();
+    m_decoded.clear();
+}
+
+HRESULT MeshFile::GetMesh(uint32_t index, MeshFileMesh& mesh)
+{
+    if (index >= m_meshCount)
+    {
+        return E_INVALIDARG;
+    }
+
+    auto& header = static_cast<const MeshHeader*>(m_meshes)[index];
+    auto accessors = static_cast<const Accessor*>(m_accessors);
+    auto bufferViews = static_cast<const BufferView*>(m_bufferViews);
+
+    const uint32_t clusters = m_hierarchies != nullptr ? static_cast<const MeshHierarchy*>(m_hierarchies)[index].Clusters : c_absent;
+    auto& encoding = m_encodings != nullptr ? static_cast<const MeshEncoding*>(m_encodings)[index] : c_uncompressed;
+
+    // Validate the mesh and expand any compressed streams the first time it's requested.
+    if (!m_validated[index])
+    {
+        auto validate = [&](uint32_t accessor, bool optional, const EncodedStream& stream, StreamEncoding specialized)
+        {
+            if (!ValidateAccessor(accessor, accessors, m_accessorCount, bufferViews, m_bufferViewCount, m_bufferSize, optional, stream.Encoding != STREAM_ENCODING_NONE))
+                return false;
+
+            if (accessor == c_absent)
+                return stream.Encoding == STREAM_ENCODING_NONE;
+
+            return ValidateEncoding(stream, accessor, accessors, bufferViews, m_bufferViewCount, m_bufferSize, specialized);
+        };
+
+        bool valid = validate(header.Indices, false, c_raw, STREAM_ENCODING_NONE) && validate(header.IndexSubsets, false, c_raw, STREAM_ENCODING_NONE)
+            && validate(header.Meshlets, false, c_raw, STREAM_ENCODING_NONE) && validate(header.MeshletSubsets, false, c_raw, STREAM_ENCODING_NONE)
+            && validate(header.UniqueVertexIndices, false, encoding.UniqueVertexIndices, STREAM_ENCODING_DELTA_VARINT)
+            && validate(header.PrimitiveIndices, false, encoding.PrimitiveIndices, STREAM_ENCODING_BYTE_TRIANGLES)
+            && validate(header.CullData, false, c_raw, STREAM_ENCODING_NONE) && validate(clusters, true, c_raw, STREAM_ENCODING_NONE);
+
+        for (uint32_t i = 0; i < MeshFileMesh::AttributeCount; ++i)
+        {
+            valid = valid && validate(header.Attributes[i], true, encoding.Attributes[i], c_attributeEncodings[i]);
+        }
+
+        valid = valid && ValidateMeshletSubsets(ResolveAccessor(header.MeshletSubsets, accessors, bufferViews, m_buffer, m_decoded),
+            accessors[header.Meshlets], accessors[header.CullData]);
+
+        if (!valid)
+        {
+            return E_FAIL; // Corrupt mesh metadata.
+        }
+
+        HRESULT hr = DecodeStreams(header, encoding, accessors, bufferViews, m_buffer, m_decoded);
+        if (FAILED(hr))
+        {
+            return hr; // Corrupt encoded data.
+        }
+
+        m_validated[index] = true;
+    }
+
+    mesh.Indices = ResolveAccessor(header.Indices, accessors, bufferViews, m_buffer, m_decoded);
+    mesh.IndexSubsets = ResolveAccessor(header.IndexSubsets, accessors, bufferViews, m_buffer, m_decoded);
+
+    for (uint32_t i = 0; i < MeshFileMesh::AttributeCount; ++i)
+    {
+        mesh.Attributes[i] = ResolveAccessor(header.Attributes[i], accessors, bufferViews, m_buffer, m_decoded);
+    }
+
+    mesh.Meshlets = ResolveAccessor(header.Meshlets, accessors, bufferViews, m_buffer, m_decoded);
+    mesh.MeshletSubsets = ResolveAccessor(header.MeshletSubsets, accessors, bufferViews, m_buffer, m_decoded);
+    mesh.UniqueVertexIndices = ResolveAccessor(header.UniqueVertexIndices, accessors, bufferViews, m_buffer, m_decoded);
+    mesh.PrimitiveIndices = ResolveAccessor(header.PrimitiveIndices, accessors, bufferViews, m_buffer, m_decoded);
+    mesh.CullData = ResolveAccessor(header.CullData, accessors, bufferViews, m_buffer, m_decoded);
+    mesh.Clusters = ResolveAccessor(clusters, accessors, bufferViews, m_buffer, m_decoded);
+
+    if (m_lods != nullptr)
+    {
+        auto& lod = static_cast<const MeshLod*>(m_lods)[index];
+        mesh.LodLevel = lod.Level;
+        mesh.LodError = lod.Error;
+    }
+    else
+    {
+        mesh.LodLevel = 0;
+        mesh.LodError = 0.0f;
+    }
+
+    return S_OK;
+}
+
+void MeshFile::Prefetch(const void* data, size_t size) const
+{
+    if (!IsMapped(data, size))
+        return;
+
+    WIN32_MEMORY_RANGE_ENTRY range = { const_cast<void*>(data), size };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+void MeshFile::Evict(const void* data, size_t size) const
+{
+    if (!IsMapped(data, size))
+        return;
+
+    // Unlocking pages that were never locked removes them from the working set.
+    VirtualUnlock(const_cast<void*>(data), size);
+}
+
+bool MeshFile::IsMapped(const void* data, size_t size) const
+{
+    // Decoded streams live on the heap; there's nothing to page in from the file and evicting them would only push
+    // them out to the page file.
+    auto bytes = static_cast<const uint8_t*>(data);
+    return size > 0 && m_view != nullptr && bytes >= m_view && bytes + size <= m_view + m_fileSize;
+}
+
+void MeshFile::Swap(MeshFile& other)
+{
+    std::swap(m_file, other.m_file);
+    std::swap(m_mapping, other.m_mapping);
+    std::swap(m_view, other.m_view);
+    std::swap(m_fileSize, other.m_fileSize);
+    std::swap(m_version, other.m_version);
+    std::swap(m_meshCount, other.m_meshCount);
+    std::swap(m_accessorCount, other.m_accessorCount);
+    std::swap(m_bufferViewCount, other.m_bufferViewCount);
+    std::swap(m_meshes, other.m_meshes);
+    std::swap(m_accessors, other.m_accessors);
+    std::swap(m_bufferViews, other.m_bufferViews);
+    std::swap(m_lods, other.m_lods);
+    std::swap(m_hierarchies, other.m_hierarchies);
+    std::swap(m_encodings, other.m_encodings);
+    std::swap(m_buffer, other.m_buffer);
+    std::swap(m_bufferSize, other.m_bufferSize);
+    m_validated.swap(other.m_validated);
+    m_decoded.swap(other.m_decoded);
+}
@@ -0,0 +1,110 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+#include <d3d12.h>
+#include <cstdint>
+#include <vector>
+
+// One stream of mesh data, pointing directly into the file mapping.
+struct MeshFileStream
+{
+    uint8_t* Data;        // Start of the stream's buffer view; nullptr if the mesh doesn't contain the stream
+    uint32_t Size;        // Byte size of the buffer view
+    uint32_t BufferView;  // Streams sharing a buffer view are interleaved within it
+    uint32_t Offset;      // Byte offset of the element within each stride
+    uint32_t ElementSize;
+    uint32_t Stride;
+    uint32_t Count;
+};
+
+struct MeshFileMesh
+{
+    enum { AttributeCount = 5 }; // Position, Normal, TexCoord, Tangent, Bitangent
+
+    MeshFileStream Indices;
+    MeshFileStream IndexSubsets;
+    MeshFileStream Attributes[AttributeCount];
+
+    MeshFileStream Meshlets;
+    MeshFileStream MeshletSubsets;
+    MeshFileStream UniqueVertexIndices;
+    MeshFileStream PrimitiveIndices;
+    MeshFileStream CullData;
+    MeshFileStream Clusters; // Cluster hierarchy level of detail records, one per meshlet
+
+    uint32_t       LodLevel; // Position in a level of detail chain, and its error relative to level 0
+    float          LodError;
+};
+
+// Read-only view of a meshlet (MSHL) file exported by the WavefrontConverter.
+// The file is memory mapped rather than read, so opening it only touches the metadata at its head; mesh data is paged
+// in by the OS as it's accessed. The mapping is copy-on-write - writing through a stream is safe and never reaches
+// the file. Compressed streams are decoded into memory owned by the MeshFile when their mesh is first requested.
+// Streams remain valid until the file is closed.
+class MeshFile
+{
+public:
+    MeshFile();
+    ~MeshFile();
+
+    MeshFile(MeshFile&& other) noexcept;
+    MeshFile& operator=(MeshFile&& other) noexcept;
+
+    MeshFile(const MeshFile&) = delete;
+    MeshFile& operator=(const MeshFile&) = delete;
+
+    // Maps the file and validates its header and metadata tables.
+    HRESULT Open(const wchar_t* filename);
+    void Close();
+
+    uint32_t GetVersion() const { return m_version; }
+    uint32_t GetMeshCount() const { return m_meshCount; }
+
+    // Resolves a mesh's streams, validating its accessors and buffer views against the file and decoding any
+    // compressed streams on first request.
+    HRESULT GetMesh(uint32_t index, MeshFileMesh& mesh);
+
+    // Starts paging in a range of the mapping ahead of its first use, e.g. before copying it into an upload heap.
+    void Prefetch(const void* data, size_t size) const;
+
+    // Drops a consumed range's pages from the working set; they're paged back in from the file if touched again.
+    // Ranges of decoded streams are ignored by both.
+    void Evict(const void* data, size_t size) const;
+
+private:
+    bool IsMapped(const void* data, size_t size) const;
+    void Swap(MeshFile& other);
+
+private:
+    HANDLE            m_file;
+    HANDLE            m_mapping;
+    uint8_t*          m_view;
+    uint64_t          m_fileSize;
+
+    uint32_t          m_version;
+    uint32_t          m_meshCount;
+    uint32_t          m_accessorCount;
+    uint32_t          m_bufferViewCount;
+
+    const void*       m_meshes;
+    const void*       m_accessors;
+    const void*       m_bufferViews;
+    const void*       m_lods;
+    const void*       m_hierarchies;
+    const void*       m_encodings;
+    uint8_t*          m_buffer;
+    uint32_t          m_bufferSize;
+
+    std::vector<bool> m_validated;
+
+    std::vector<std::vector<uint8_t>> m_decoded; // Storage of each buffer view expanded from compressed streams
+};
@@ -0,0 +1,324 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "stdafx.h"
+#include "Batch.h"
+
+#include "Import.h"
+#include "Export.h"
+#include "Verify.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+
+namespace
+{
+    // Bump whenever the converter's output changes for the same input & options, so previous outputs are rebuilt.
+    const uint32_t c_outputRevision = 1;
+
+    const size_t c_hashBlockSize = 1 << 20;
+
+    struct FileResult
+    {
+        bool         Success;
+        bool         Skipped;
+        double       TotalTime;
+        StageTimings Timings;
+    };
+
+    // Multiply & xorshift hash consuming 8 bytes per step. It only needs to detect changed inputs, so it isn't
+    // cryptographic.
+    class ContentHash
+    {
+    public:
+        ContentHash() : m_hash(0xCBF29CE484222325ull) { }
+
+        void Add(const void* data, size_t size)
+        {
+            auto bytes = static_cast<const uint8_t*>(data);
+
+            for (; size >= sizeof(uint64_t); bytes += sizeof(uint64_t), size -= sizeof(uint64_t))
+            {
+                uint64_t word;
+                std::memcpy(&word, bytes, sizeof(word));
+                Mix(word);
+            }
+
+            // Tag the trailing bytes with their count so short inputs differing only by trailing zeros don't collide.
+            if (size > 0)
+            {
+                uint64_t word = 0;
+                std::memcpy(&word, bytes, size);
+                Mix(word ^ (uint64_t(size) << 56));
+            }
+        }
+
+        template <typename T>
+        void Add(const T& value)
+        {
+            static_assert(std::is_arithmetic<T>::value, "Only arithmetic values may be hashed by value.");
+            Add(&value, sizeof(value));
+        }
+
+        uint64_t Get() const { return m_hash; }
+
+    private:
+        void Mix(uint64_t word)
+        {
+            m_hash = (m_hash ^ word) * 0x9E3779B97F4A7C15ull;
+            m_hash ^= m_hash >> 29;
+        }
+
+    private:
+        uint64_t m_hash;
+    };
+
+    // Hashes a file's content together with every option that affects the exported file.
+    bool HashInput(const std::string& filename, const ProcessOptions& options, uint64_t& hash)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file)
+            return false;
+
+        ContentHash h;
+        h.Add(c_outputRevision);
+        h.Add(options.MeshletMaxVerts);
+        h.Add(options.MeshletMaxPrims);
+        h.Add(options.LodCount);
+        h.Add(options.LodRatio);
+        h.Add(options.ClusterHierarchy);
+        h.Add(options.Compress);
+        h.Add(options.UnitScale);
+        h.Add(options.Force32BitIndices);
+        h.Add(options.Flip);
+
+        h.Add(static_cast<uint32_t>(options.ExportAttributes.size()));
+        for (auto& stream : options.ExportAttributes)
+        {
+            h.Add(static_cast<uint32_t>(stream.size()));
+            for (auto attr : stream)
+            {
+                h.Add(static_cast<uint32_t>(attr));
+            }
+        }
+
+        std::vector<char> block(c_hashBlockSize);
+        while (file)
+        {
+            file.read(block.data(), block.size());
+            h.Add(block.data(), static_cast<size_t>(file.gcount()));
+        }
+
+        hash = h.Get();
+        return true;
+    }
+
+    // An output is up to date if it exists alongside a record of the hash it was converted from.
+    bool IsUpToDate(const std::string& path, const std::string& hashPath, uint64_t hash)
+    {
+        std::ifstream output(path, std::ios::binary);
+        std::ifstream record(hashPath);
+
+        uint64_t recorded = 0;
+        return output && record && (record >> std::hex >> recorded) && recorded == hash;
+    }
+
+    void RecordHash(const std::string& hashPath, uint64_t hash)
+    {
+        std::ofstream record(hashPath, std::ios::trunc);
+        record << std::hex << std::setw(16) << std::setfill('0') << hash << std::endl;
+    }
+
+    FileResult ConvertFile(const std::string& filename, const ProcessOptions& options)
+    {
+        FileResult result = {};
+
+        // Generate output filename
+        auto extLoc = filename.find_last_of(".");
+        auto path = filename.substr(0, extLoc) + ".bin";
+        auto hashPath = path + ".hash";
+
+        uint64_t hash = 0;
+        if (options.Incremental)
+        {
+            if (!HashInput(filename, options, hash))
+            {
+                std::cout << "Failed to read file: " << filename << std::endl;
+                return result;
+            }
+
+            if (IsUpToDate(path, hashPath, hash))
+            {
+                if (options.LogLevel >= ProcessOptions::Basic)
+                {
+                    std::cout << "Skipping up to date file: " << filename << std::endl;
+                }
+
+                result.Success = true;
+                result.Skipped = true;
+                return result;
+            }
+        }
+
+        // Drop any record of a previous conversion until this one succeeds; the output is about to be overwritten.
+        std::remove(hashPath.c_str());
+
+        // Try import
+        std::vector<ExportMesh> meshes;
+        if (!ImportFile(filename.c_str(), options, meshes, result.Timings))
+            return result;
+
+        // Try export
+        auto stageStart = std::chrono::high_resolution_clock::now();
+
+        if (!ExportMeshes(path.c_str(), meshes, options))
+            return result;
+
+        stageStart = result.Timings.Add(StageTimings::Export, stageStart);
+
+        // Check the exported file round trips through the loader
+        if (options.Verify)
+        {
+            bool verified = VerifyExport(path.c_str(), meshes);
+            result.Timings.Add(StageTimings::Verify, stageStart);
+
+            if (!verified)
+                return result;
+        }
+
+        if (options.Incremental)
+        {
+            RecordHash(hashPath, hash);
+        }
+
+        result.Success = true;
+        return result;
+    }
+
+    void WriteTimingReport(const std::string& path, const std::vector<std::string>& files, const std::vector<FileResult>& results)
+    {
+        std::ofstream report(path, std::ios::trunc);
+        if (!report)
+        {
+            std::cout << "Failed to write timing report: " << path << std::endl;
+            return;
+        }
+
+        report << "File,Status";
+        for (auto name : StageTimings::Names)
+        {
+            report << "," << name;
+        }
+        report << ",Total" << std::endl;
+
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            auto& r = results[i];
+
+            report << "\"" << files[i] << "\"," << (r.Skipped ? "Skipped" : r.Success ? "Converted" : "Failed");
+            for (double ms : r.Timings.Milliseconds)
+            {
+                report << "," << ms;
+            }
+            report << "," << r.TotalTime << std::endl;
+        }
+    }
+}
+
+bool ConvertFiles(const std::vector<std::string>& files, const ProcessOptions& options)
+{
+    auto batchStart = std::chrono::high_resolution_clock::now();
+
+    std::vector<FileResult> results(files.size());
+    std::atomic<size_t> nextFile(0);
+
+    // Each worker converts one file at a time, so the files in flight - and the memory they hold - are bounded by
+    // the worker count. Work within each file is spread across the thread pool behind concurrency::parallel_for.
+    auto worker = [&]()
+    {
+        for (size_t i = nextFile++; i < files.size(); i = nextFile++)
+        {
+            auto fileStart = std::chrono::high_resolution_clock::now();
+
+            try
+            {
+                results[i] = ConvertFile(files[i], options);
+            }
+            catch (const std::exception& e)
+            {
+                std::cout << "Failed to convert file: " << files[i] << " - " << e.what() << std::endl;
+                results[i] = {};
+            }
+
+            results[i].TotalTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - fileStart).count();
+        }
+    };
+
+    size_t jobs = options.Jobs > 0 ? options.Jobs : std::max(std::thread::hardware_concurrency(), 1u);
+    jobs = std::min(jobs, files.size());
+
+    if (jobs <= 1)
+    {
+        worker();
+    }
+    else
+    {
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < jobs; ++i)
+        {
+            workers.emplace_back(worker);
+        }
+
+        for (auto& w : workers)
+        {
+            w.join();
+        }
+    }
+
+    std::chrono::duration<double, std::milli> batchTime = std::chrono::high_resolution_clock::now() - batchStart;
+
+    StageTimings totals;
+    uint32_t convertedCount = 0;
+    uint32_t skippedCount = 0;
+    uint32_t failedCount = 0;
+
+    for (auto& r : results)
+    {
+        totals += r.Timings;
+
+        convertedCount += r.Success && !r.Skipped ? 1 : 0;
+        skippedCount += r.Skipped ? 1 : 0;
+        failedCount += r.Success ? 0 : 1;
+    }
+
+    if (options.LogLevel >= ProcessOptions::Basic && files.size() > 1)
+    {
+        std::cout << std::endl;
+        std::cout << "Converted " << convertedCount << " files, skipped " << skippedCount << ", failed " << failedCount
+            << " in " << batchTime.count() << " ms" << std::endl;
+
+        std::cout << "Time per stage, summed over files:" << std::endl;
+        for (uint32_t i = 0; i < StageTimings::Count; ++i)
+        {
+            std::cout << "\t" << std::left << std::setw(18) << StageTimings::Names[i] << std::right << totals.Milliseconds[i] << " ms" << std::endl;
+        }
+    }
+
+    if (!options.TimingReport.empty())
+    {
+        WriteTimingReport(options.TimingReport, files, results);
+    }
+
+    return failedCount == 0;
+}
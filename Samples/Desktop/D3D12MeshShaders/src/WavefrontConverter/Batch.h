@@ -0,0 +1,19 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+#include "MeshProcessor.h"
+
+// Imports, processes & exports each file, keeping up to options.Jobs files in flight on a pool of worker threads.
+// With options.Incremental set, files whose output was written from the same input content & conversion options are
+// skipped. Prints the time spent in each stage, and writes it per file to options.TimingReport if specified.
+// Returns false if any file failed to convert.
+bool ConvertFiles(const std::vector<std::string>& files, const ProcessOptions& options);
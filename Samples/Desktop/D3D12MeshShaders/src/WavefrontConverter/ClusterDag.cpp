@@ -0,0 +1,432 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "stdafx.h"
+#include "ClusterDag.h"
+#include "Simplify.h"
+
+#include <DirectXMesh.h>
+
+#include <cfloat>
+#include <cstring>
+#include <numeric>
+#include <ppl.h>
+
+using namespace DirectX;
+
+namespace
+{
+    const uint32_t Undef = uint32_t(-1);
+
+    // Number of neighbouring meshlets merged and simplified together. Larger groups leave fewer locked borders
+    // behind at each level, at the cost of a coarser cut.
+    const uint32_t s_groupSize = 4;
+
+    // A group keeping more than this fraction of its triangles has hit its locked borders; its meshlets become roots.
+    const float s_maxSimplifiedRatio = 0.85f;
+
+    // Outcome of simplifying one group, gathered in parallel and appended to the hierarchy afterwards.
+    struct GroupResult
+    {
+        float                       Error;
+        std::vector<Meshlet>        Meshlets;
+        std::vector<uint32_t>       UniqueVertexIndices; // Indices into the mesh's vertex buffer
+        std::vector<PackedTriangle> PrimitiveIndices;
+    };
+
+    // Returns the smallest sphere enclosing both spheres.
+    XMFLOAT4 MergeSpheres(const XMFLOAT4& a, const XMFLOAT4& b)
+    {
+        const float dx = b.x - a.x;
+        const float dy = b.y - a.y;
+        const float dz = b.z - a.z;
+        const float d = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+        if (d + b.w <= a.w)
+            return a;
+        if (d + a.w <= b.w)
+            return b;
+
+        const float r = (d + a.w + b.w) * 0.5f;
+        const float t = (r - a.w) / d;
+
+        return XMFLOAT4(a.x + dx * t, a.y + dy * t, a.z + dz * t, r);
+    }
+
+    // Maps each vertex to the lowest index sharing its exact position, so that meshlets split along attribute
+    // seams still register as neighbours.
+    std::vector<uint32_t> WeldPositions(const XMFLOAT3* positions, uint32_t vertexCount)
+    {
+        std::vector<uint32_t> order(vertexCount);
+        std::iota(order.begin(), order.end(), 0u);
+
+        std::sort(order.begin(), order.end(), [=](uint32_t a, uint32_t b)
+        {
+            int c = std::memcmp(&positions[a], &positions[b], sizeof(XMFLOAT3));
+            return c < 0 || (c == 0 && a < b);
+        });
+
+        std::vector<uint32_t> reps(vertexCount);
+        for (uint32_t i = 0; i < vertexCount; )
+        {
+            uint32_t j = i + 1;
+            while (j < vertexCount && std::memcmp(&positions[order[i]], &positions[order[j]], sizeof(XMFLOAT3)) == 0)
+                ++j;
+
+            for (uint32_t k = i; k < j; ++k)
+            {
+                reps[order[k]] = order[i];
+            }
+            i = j;
+        }
+
+        return reps;
+    }
+
+    // Partitions meshlets into groups of up to s_groupSize, growing each group from the first ungrouped meshlet by
+    // repeatedly adding the ungrouped neighbour sharing the most welded vertices with it.
+    template <typename T>
+    std::vector<std::vector<uint32_t>> GroupMeshlets(
+        const std::vector<uint32_t>& ids,
+        const Meshlet* meshlets,
+        const T* uniqueVertexIndices,
+        const std::vector<uint32_t>& reps)
+    {
+        const uint32_t count = static_cast<uint32_t>(ids.size());
+
+        // Pair every welded position with the meshlets touching it
+        std::vector<std::pair<uint32_t, uint32_t>> incidence;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            auto& m = meshlets[ids[i]];
+
+            for (uint32_t j = 0; j < m.VertCount; ++j)
+            {
+                incidence.push_back(std::make_pair(reps[uniqueVertexIndices[m.VertOffset + j]], i));
+            }
+        }
+
+        std::sort(incidence.begin(), incidence.end());
+        incidence.erase(std::unique(incidence.begin(), incidence.end()), incidence.end());
+
+        // Every pair of meshlets sharing a position is linked once per shared position
+        std::vector<std::pair<uint32_t, uint32_t>> links;
+        for (size_t i = 0; i < incidence.size(); )
+        {
+            size_t j = i + 1;
+            while (j < incidence.size() && incidence[j].first == incidence[i].first)
+                ++j;
+
+            for (size_t a = i; a < j; ++a)
+            {
+                for (size_t b = i; b < j; ++b)
+                {
+                    if (a != b)
+                    {
+                        links.push_back(std::make_pair(incidence[a].second, incidence[b].second));
+                    }
+                }
+            }
+            i = j;
+        }
+
+        std::sort(links.begin(), links.end());
+
+        std::vector<uint32_t> offsets(count + 1, 0);
+        std::vector<uint32_t> neighbours;
+        std::vector<uint32_t> weights;
+        for (size_t i = 0; i < links.size(); )
+        {
+            size_t j = i + 1;
+            while (j < links.size() && links[j] == links[i])
+                ++j;
+
+            neighbours.push_back(links[i].second);
+            weights.push_back(static_cast<uint32_t>(j - i));
+            ++offsets[links[i].first + 1];
+            i = j;
+        }
+
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        // Grow the groups
+        std::vector<std::vector<uint32_t>> groups;
+        std::vector<bool> grouped(count, false);
+        std::vector<uint32_t> scores(count, 0);
+        std::vector<uint32_t> candidates;
+
+        for (uint32_t seed = 0; seed < count; ++seed)
+        {
+            if (grouped[seed])
+                continue;
+
+            std::vector<uint32_t> group;
+            uint32_t next = seed;
+
+            while (next != Undef)
+            {
+                group.push_back(next);
+                grouped[next] = true;
+
+                if (group.size() == s_groupSize)
+                    break;
+
+                for (uint32_t j = offsets[next]; j < offsets[next + 1]; ++j)
+                {
+                    if (scores[neighbours[j]] == 0)
+                    {
+                        candidates.push_back(neighbours[j]);
+                    }
+                    scores[neighbours[j]] += weights[j];
+                }
+
+                next = Undef;
+                uint32_t bestScore = 0;
+                for (uint32_t c : candidates)
+                {
+                    if (!grouped[c] && scores[c] > bestScore)
+                    {
+                        next = c;
+                        bestScore = scores[c];
+                    }
+                }
+            }
+
+            for (uint32_t c : candidates)
+            {
+                scores[c] = 0;
+            }
+            candidates.clear();
+
+            for (auto& g : group)
+            {
+                g = ids[g];
+            }
+            groups.push_back(std::move(group));
+        }
+
+        return groups;
+    }
+
+    // Merges the group's meshlets, simplifies them to half their triangle count and splits the result into new
+    // meshlets. Returns false if the locked border left too little to simplify.
+    template <typename T>
+    bool SimplifyGroup(
+        uint32_t maxVerts, uint32_t maxPrims,
+        const XMFLOAT3* positions,
+        const std::vector<uint32_t>& group,
+        const Meshlet* meshlets,
+        const T* uniqueVertexIndices,
+        const PackedTriangle* primitiveIndices,
+        GroupResult& result)
+    {
+        std::vector<uint32_t> indices;
+        for (uint32_t id : group)
+        {
+            auto& m = meshlets[id];
+
+            for (uint32_t j = 0; j < m.PrimCount; ++j)
+            {
+                auto& tri = primitiveIndices[m.PrimOffset + j].indices;
+
+                indices.push_back(uniqueVertexIndices[m.VertOffset + tri.i0]);
+                indices.push_back(uniqueVertexIndices[m.VertOffset + tri.i1]);
+                indices.push_back(uniqueVertexIndices[m.VertOffset + tri.i2]);
+            }
+        }
+
+        // Compact to the group's own vertices so neither the simplifier nor the meshletizer scales with the mesh
+        std::vector<uint32_t> vertices(indices);
+        std::sort(vertices.begin(), vertices.end());
+        vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+        std::vector<XMFLOAT3> localPositions(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            localPositions[i] = positions[vertices[i]];
+        }
+
+        for (auto& index : indices)
+        {
+            index = static_cast<uint32_t>(std::lower_bound(vertices.begin(), vertices.end(), index) - vertices.begin());
+        }
+
+        const uint32_t indexCount = static_cast<uint32_t>(indices.size());
+        const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+
+        std::vector<uint32_t> simplified;
+        std::vector<uint32_t> attributes;
+        result.Error = SimplifyMesh(indices.data(), indexCount, nullptr, localPositions.data(), vertexCount, indexCount / 6 * 3, simplified, attributes);
+
+        if (simplified.empty() || simplified.size() > indexCount * s_maxSimplifiedRatio)
+        {
+            return false;
+        }
+
+        std::vector<Subset> subsets;
+        std::vector<uint8_t> localVertexIndices;
+        ThrowIfFailed(ComputeMeshlets(
+            maxVerts, maxPrims,
+            simplified.data(), static_cast<uint32_t>(simplified.size()),
+            localPositions.data(), vertexCount,
+            subsets,
+            result.Meshlets,
+            localVertexIndices,
+            result.PrimitiveIndices
+        ));
+
+        const uint32_t* local = reinterpret_cast<const uint32_t*>(localVertexIndices.data());
+        result.UniqueVertexIndices.resize(localVertexIndices.size() / sizeof(uint32_t));
+
+        for (size_t i = 0; i < result.UniqueVertexIndices.size(); ++i)
+        {
+            result.UniqueVertexIndices[i] = vertices[local[i]];
+        }
+
+        return true;
+    }
+}
+
+template <typename T>
+void BuildClusterHierarchy(
+    uint32_t maxVerts, uint32_t maxPrims,
+    const XMFLOAT3* positions, uint32_t vertexCount,
+    const std::vector<Subset>& meshletSubsets,
+    std::vector<Meshlet>& meshlets,
+    std::vector<uint8_t>& uniqueVertexIndices,
+    std::vector<PackedTriangle>& primitiveIndices,
+    std::vector<CullData>& cullData,
+    std::vector<ClusterLod>& clusters)
+{
+    assert(cullData.size() == meshlets.size());
+
+    const uint32_t sourceCount = static_cast<uint32_t>(meshlets.size());
+
+    // The source meshlets are exact and bounded by their own spheres until grouped
+    clusters.resize(sourceCount);
+    for (uint32_t i = 0; i < sourceCount; ++i)
+    {
+        auto& c = clusters[i];
+        c.LodBounds = cullData[i].BoundingSphere;
+        c.ParentLodBounds = c.LodBounds;
+        c.Error = 0.0f;
+        c.ParentError = FLT_MAX;
+        c.Level = 0;
+        c.Group = Undef;
+    }
+
+    const std::vector<uint32_t> reps = WeldPositions(positions, vertexCount);
+    uint32_t groupCount = 0;
+
+    // Meshlet subsets hold different materials and are never merged with one another
+    for (auto& s : meshletSubsets)
+    {
+        std::vector<uint32_t> current(s.Count);
+        std::iota(current.begin(), current.end(), s.Offset);
+
+        for (uint32_t level = 0; current.size() > 1; ++level)
+        {
+            const T* uvi = reinterpret_cast<const T*>(uniqueVertexIndices.data());
+
+            auto groups = GroupMeshlets(current, meshlets.data(), uvi, reps);
+
+            std::vector<GroupResult> results(groups.size());
+            std::vector<uint8_t> simplified(groups.size(), 0);
+
+            concurrency::parallel_for(size_t(0), groups.size(), [&](size_t i)
+            {
+                simplified[i] = SimplifyGroup(maxVerts, maxPrims, positions, groups[i], meshlets.data(), uvi, primitiveIndices.data(), results[i]) ? 1 : 0;
+            });
+
+            // Append the new meshlets and link each group's meshlets to their replacements
+            std::vector<uint32_t> next;
+            for (size_t i = 0; i < groups.size(); ++i)
+            {
+                if (!simplified[i])
+                    continue;
+
+                auto& group = groups[i];
+                auto& result = results[i];
+
+                XMFLOAT4 bounds = clusters[group[0]].LodBounds;
+                float error = clusters[group[0]].Error;
+                for (uint32_t id : group)
+                {
+                    bounds = MergeSpheres(bounds, clusters[id].LodBounds);
+                    error = clusters[id].Error > error ? clusters[id].Error : error;
+                }
+                error += result.Error;
+
+                for (uint32_t id : group)
+                {
+                    clusters[id].ParentLodBounds = bounds;
+                    clusters[id].ParentError = error;
+                }
+
+                const uint32_t vertOffset = static_cast<uint32_t>(uniqueVertexIndices.size() / sizeof(T));
+                const uint32_t primOffset = static_cast<uint32_t>(primitiveIndices.size());
+
+                uniqueVertexIndices.resize(uniqueVertexIndices.size() + result.UniqueVertexIndices.size() * sizeof(T));
+                T* dest = reinterpret_cast<T*>(uniqueVertexIndices.data()) + vertOffset;
+                for (uint32_t index : result.UniqueVertexIndices)
+                {
+                    *dest++ = static_cast<T>(index);
+                }
+
+                primitiveIndices.insert(primitiveIndices.end(), result.PrimitiveIndices.begin(), result.PrimitiveIndices.end());
+
+                for (auto m : result.Meshlets)
+                {
+                    m.VertOffset += vertOffset;
+                    m.PrimOffset += primOffset;
+
+                    next.push_back(static_cast<uint32_t>(meshlets.size()));
+                    meshlets.push_back(m);
+
+                    ClusterLod c;
+                    c.LodBounds = bounds;
+                    c.ParentLodBounds = bounds;
+                    c.Error = error;
+                    c.ParentError = FLT_MAX;
+                    c.Level = level + 1;
+                    c.Group = groupCount;
+                    clusters.push_back(c);
+                }
+
+                ++groupCount;
+            }
+
+            std::swap(current, next);
+        }
+    }
+
+    // Generate culling data for the new meshlets
+    cullData.resize(meshlets.size());
+
+    if (meshlets.size() == sourceCount)
+        return;
+
+    ThrowIfFailed(ComputeCullData(
+        positions, vertexCount,
+        meshlets.data() + sourceCount, static_cast<uint32_t>(meshlets.size()) - sourceCount,
+        reinterpret_cast<const T*>(uniqueVertexIndices.data()),
+        primitiveIndices.data(),
+        CNORM_DEFAULT,
+        cullData.data() + sourceCount
+    ));
+}
+
+template void BuildClusterHierarchy<uint16_t>(
+    uint32_t, uint32_t, const XMFLOAT3*, uint32_t, const std::vector<Subset>&,
+    std::vector<Meshlet>&, std::vector<uint8_t>&, std::vector<PackedTriangle>&, std::vector<CullData>&, std::vector<ClusterLod>&);
+
+template void BuildClusterHierarchy<uint32_t>(
+    uint32_t, uint32_t, const XMFLOAT3*, uint32_t, const std::vector<Subset>&,
+    std::vector<Meshlet>&, std::vector<uint8_t>&, std::vector<PackedTriangle>&, std::vector<CullData>&, std::vector<ClusterLod>&);
@@ -0,0 +1,44 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+#include <D3D12MeshletGenerator.h>
+#include <vector>
+
+// Level of detail record for one meshlet of a cluster hierarchy.
+// A meshlet belongs to the cut drawn at an error threshold when its own projected error is within the threshold and
+// its parent's is not. Errors only grow and bounds only enclose moving up the hierarchy, which guarantees exactly one
+// meshlet covering each piece of the surface passes that test.
+struct ClusterLod
+{
+    DirectX::XMFLOAT4 LodBounds;        // xyz = center, w = radius of the group this meshlet was generated from
+    DirectX::XMFLOAT4 ParentLodBounds;  // Bounds of the group this meshlet is simplified into
+    float             Error;            // Object-space error bound relative to the source mesh
+    float             ParentError;      // Error of the meshlets replacing this one; FLT_MAX at the roots
+    uint32_t          Level;            // 0 for the source meshlets
+    uint32_t          Group;            // Group this meshlet was generated from; -1 for the source meshlets
+};
+
+// Builds a cluster hierarchy over the meshlets already generated for a mesh.
+// Neighbouring meshlets of each meshlet subset are repeatedly grouped, simplified to half their triangle count with
+// the group's outer border locked, and split back into meshlets. The new meshlets and their cull data are appended
+// after the existing ones - meshlet subsets keep referencing only the source meshlets - and one ClusterLod is
+// produced per meshlet.
+template <typename T>
+void BuildClusterHierarchy(
+    uint32_t maxVerts, uint32_t maxPrims,
+    const DirectX::XMFLOAT3* positions, uint32_t vertexCount,
+    const std::vector<Subset>& meshletSubsets,
+    std::vector<Meshlet>& meshlets,
+    std::vector<uint8_t>& uniqueVertexIndices,
+    std::vector<PackedTriangle>& primitiveIndices,
+    std::vector<CullData>& cullData,
+    std::vector<ClusterLod>& clusters);
@@ -11,9 +11,13 @@
 #include "stdafx.h"
 #include "Export.h"
 
+#include <D3D12MeshletCodec.h>
+
 #include <fstream>
 #include <iostream>
 
+using namespace DirectX;
+
 namespace
 {
     const char s_padding[4096] = {};
@@ -32,7 +36,10 @@ namespace
     enum FileVersion
     {
         FILE_VERSION_INITIAL = 0,
-        CURRENT_FILE_VERSION = FILE_VERSION_INITIAL
+        FILE_VERSION_LOD_CHAIN = 1,
+        FILE_VERSION_CLUSTER_HIERARCHY = 2,
+        FILE_VERSION_COMPRESSED = 3,
+        CURRENT_FILE_VERSION = FILE_VERSION_COMPRESSED
     };
 
     struct FileHeader
@@ -59,12 +66,42 @@ namespace
         uint32_t CullData;
     };
 
+    // Stored after the buffer views, one per mesh, in files containing levels of detail.
+    struct MeshLod
+    {
+        uint32_t Level;
+        float    Error; // Object-space error bound relative to level 0
+    };
+
+    // Stored after the level of detail records, one per mesh, in files containing cluster hierarchies.
+    struct MeshHierarchy
+    {
+        uint32_t Clusters; // Accessor of one ClusterLod per meshlet, or -1 if the mesh has no hierarchy
+    };
+
+    struct EncodedStream
+    {
+        uint32_t BufferView; // Holds the encoded data
+        uint32_t Encoding;   // StreamEncoding, or STREAM_ENCODING_NONE if the stream is stored uncompressed
+    };
+
+    // Stored after the cluster hierarchy records, one per mesh, in compressed files. The accessors of encoded
+    // streams reference buffer views with an offset of -1, which have no data in the file and are decoded on load.
+    struct MeshEncoding
+    {
+        EncodedStream Attributes[Attribute::Count];
+        EncodedStream UniqueVertexIndices;
+        EncodedStream PrimitiveIndices;
+    };
+
     struct BufferView
     {
         uint32_t Offset;
         uint32_t Size;
     };
 
+    const uint32_t c_decodedOffset = uint32_t(-1);
+
     struct Accessor
     {
         uint32_t BufferView;
@@ -93,19 +130,117 @@ namespace
         stream.write(s_padding, pad);
         offset += pad;
     }
+
+    // Encoded data of a mesh's compressed streams; vertex attributes are in layout order.
+    struct EncodedMesh
+    {
+        std::vector<std::vector<uint8_t>> Attributes;
+        std::vector<uint8_t>              UniqueVertexIndices;
+        std::vector<uint8_t>              PrimitiveIndices;
+    };
+
+    void EncodeMesh(const ExportMesh& m, EncodedMesh& encoded, MeshEncoding& encoding)
+    {
+        encoding = {};
+
+        // Positions are quantized against the meshlet which first references them.
+        std::vector<uint32_t> owners;
+
+        ThrowIfFailed(ComputeVertexOwners(
+            reinterpret_cast<const CodecMeshlet*>(m.Meshlets.data()), static_cast<uint32_t>(m.Meshlets.size()),
+            m.UniqueVertexIndices.data(), m.IndexSize, static_cast<uint32_t>(m.UniqueVertexIndices.size()) / m.IndexSize,
+            m.VertexCount,
+            owners));
+
+        encoded.Attributes.clear();
+
+        for (uint32_t i = 0; i < m.Layout.size(); ++i)
+        {
+            auto& l = m.Layout[i];
+
+            for (auto& a : l.Attributes)
+            {
+                const uint8_t* src = m.Vertices[i].data() + a.Offset;
+
+                std::vector<uint8_t> data;
+                StreamEncoding type;
+
+                switch (a.Type)
+                {
+                case Attribute::Position:
+                    EncodePositions(src, l.Stride, m.VertexCount, owners.data(), static_cast<uint32_t>(m.Meshlets.size()), data);
+                    type = STREAM_ENCODING_QUANTIZED_POSITION;
+                    break;
+
+                case Attribute::Normal:
+                case Attribute::Tangent:
+                case Attribute::Bitangent:
+                    EncodeDirections(src, l.Stride, m.VertexCount, data);
+                    type = STREAM_ENCODING_OCTAHEDRAL;
+                    break;
+
+                default:
+                    EncodePacked(src, l.Stride, s_sizeMap[a.Type], m.VertexCount, data);
+                    type = STREAM_ENCODING_PACKED;
+                    break;
+                }
+
+                encoding.Attributes[a.Type].Encoding = type;
+                encoded.Attributes.emplace_back(std::move(data));
+            }
+        }
+
+        EncodeVertexIndices(m.UniqueVertexIndices.data(), m.IndexSize, static_cast<uint32_t>(m.UniqueVertexIndices.size()) / m.IndexSize, encoded.UniqueVertexIndices);
+        encoding.UniqueVertexIndices.Encoding = STREAM_ENCODING_DELTA_VARINT;
+
+        EncodeTriangles(reinterpret_cast<const uint32_t*>(m.PrimitiveIndices.data()), static_cast<uint32_t>(m.PrimitiveIndices.size()), encoded.PrimitiveIndices);
+        encoding.PrimitiveIndices.Encoding = STREAM_ENCODING_BYTE_TRIANGLES;
+    }
 }
 
 
-bool ExportMeshes(const char* filename, std::vector<ExportMesh>& exportMeshes)
+bool ExportMeshes(const char* filename, std::vector<ExportMesh>& exportMeshes, const ProcessOptions& options)
 {
+    const bool compress = options.Compress;
+
+    // Encode the compressed streams up front - their sizes determine the data layout.
+    std::vector<EncodedMesh> encodedMeshes(compress ? exportMeshes.size() : 0);
+    std::vector<MeshEncoding> encodings(compress ? exportMeshes.size() : 0);
+
+    for (uint32_t i = 0; i < encodedMeshes.size(); ++i)
+    {
+        EncodeMesh(exportMeshes[i], encodedMeshes[i], encodings[i]);
+    }
+
     // Build data descriptors and compute data length
     std::vector<MeshHeader> meshes;
     std::vector<Accessor> accessors;
     std::vector<BufferView> bufferViews;
+    std::vector<MeshHierarchy> hierarchies;
 
     uint32_t dataOffset = 0;
-    for (auto& m : exportMeshes)
+    uint64_t uncompressedSize = 0;
+    uint64_t compressedSize = 0;
+
+    // Adds the buffer view holding an encoded stream's data.
+    auto addEncodedView = [&](const std::vector<uint8_t>& data, EncodedStream& stream)
+    {
+        BufferView bufferView;
+        bufferView.Offset = dataOffset;
+        bufferView.Size = static_cast<uint32_t>(data.size());
+
+        stream.BufferView = static_cast<uint32_t>(bufferViews.size());
+
+        bufferViews.push_back(bufferView);
+        AddAlignUp(dataOffset, bufferView.Size);
+
+        compressedSize += bufferView.Size;
+    };
+
+    for (uint32_t meshIndex = 0; meshIndex < exportMeshes.size(); ++meshIndex)
     {
+        auto& m = exportMeshes[meshIndex];
+
         MeshHeader meshView;
 
         {
@@ -149,7 +284,7 @@ bool ExportMeshes(const char* filename, std::vector<ExportMesh>& exportMeshes)
         for (auto& l : m.Layout)
         {
             BufferView bufferView;
-            bufferView.Offset = dataOffset;
+            bufferView.Offset = compress ? c_decodedOffset : dataOffset;
             bufferView.Size = m.VertexCount * l.Stride;
 
             for (uint32_t k = 0; k < _countof(meshView.Attributes); ++k)
@@ -172,7 +307,30 @@ bool ExportMeshes(const char* filename, std::vector<ExportMesh>& exportMeshes)
 
 
             bufferViews.push_back(bufferView);
-            AddAlignUp(dataOffset, bufferView.Size);
+
+            if (compress)
+            {
+                uncompressedSize += bufferView.Size;
+            }
+            else
+            {
+                AddAlignUp(dataOffset, bufferView.Size);
+            }
+        }
+
+        // Encoded vertex data follows the decoded vertex buffer views
+        if (compress)
+        {
+            auto& encoded = encodedMeshes[meshIndex].Attributes;
+            uint32_t stream = 0;
+
+            for (auto& l : m.Layout)
+            {
+                for (auto& a : l.Attributes)
+                {
+                    addEncodedView(encoded[stream++], encodings[meshIndex].Attributes[a.Type]);
+                }
+            }
         }
 
         // Meshlet data
@@ -217,7 +375,7 @@ bool ExportMeshes(const char* filename, std::vector<ExportMesh>& exportMeshes)
         // UniqueVertexIndex Data
         {
             BufferView bufferView;
-            bufferView.Offset = dataOffset;
+            bufferView.Offset = compress ? c_decodedOffset : dataOffset;
             bufferView.Size = static_cast<uint32_t>(m.UniqueVertexIndices.size());
 
             Accessor accessor;
@@ -231,13 +389,22 @@ bool ExportMeshes(const char* filename, std::vector<ExportMesh>& exportMeshes)
             accessors.push_back(accessor);
 
             bufferViews.push_back(bufferView);
-            AddAlignUp(dataOffset, bufferView.Size);
+
+            if (compress)
+            {
+                uncompressedSize += bufferView.Size;
+                addEncodedView(encodedMeshes[meshIndex].UniqueVertexIndices, encodings[meshIndex].UniqueVertexIndices);
+            }
+            else
+            {
+                AddAlignUp(dataOffset, bufferView.Size);
+            }
         }
 
         // PrimitiveIndex Data
         {
             BufferView bufferView;
-            bufferView.Offset = dataOffset;
+            bufferView.Offset = compress ? c_decodedOffset : dataOffset;
             bufferView.Size = static_cast<uint32_t>(m.PrimitiveIndices.size()) * sizeof(m.PrimitiveIndices[0]);
 
             Accessor accessor;
@@ -251,7 +418,16 @@ bool ExportMeshes(const char* filename, std::vector<ExportMesh>& exportMeshes)
             accessors.push_back(accessor);
 
             bufferViews.push_back(bufferView);
-            AddAlignUp(dataOffset, bufferView.Size);
+
+            if (compress)
+            {
+                uncompressedSize += bufferView.Size;
+                addEncodedView(encodedMeshes[meshIndex].PrimitiveIndices, encodings[meshIndex].PrimitiveIndices);
+            }
+            else
+            {
+                AddAlignUp(dataOffset, bufferView.Size);
+            }
         }
 
         // Cull Data
@@ -274,13 +450,48 @@ bool ExportMeshes(const char* filename, std::vector<ExportMesh>& exportMeshes)
             AddAlignUp(dataOffset, bufferView.Size);
         }
 
+        // Cluster Hierarchy Data
+        MeshHierarchy hierarchy = { uint32_t(-1) };
+
+        if (!m.Clusters.empty())
+        {
+            BufferView bufferView;
+            bufferView.Offset = dataOffset;
+            bufferView.Size = static_cast<uint32_t>(m.Clusters.size()) * sizeof(m.Clusters[0]);
+
+            Accessor accessor;
+            accessor.BufferView = static_cast<uint32_t>(bufferViews.size());
+            accessor.Count = static_cast<uint32_t>(m.Clusters.size());
+            accessor.Offset = 0;
+            accessor.Size = sizeof(m.Clusters[0]);
+            accessor.Stride = sizeof(m.Clusters[0]);
+
+            hierarchy.Clusters = static_cast<uint32_t>(accessors.size());
+            accessors.push_back(accessor);
+
+            bufferViews.push_back(bufferView);
+            AddAlignUp(dataOffset, bufferView.Size);
+        }
+
         meshes.push_back(meshView);
+        hierarchies.push_back(hierarchy);
     }
 
+    // Only files holding a level of detail chain or cluster hierarchies need the newer formats; single meshes stay
+    // readable by older loaders.
+    std::vector<MeshLod> lods;
+    for (auto& m : exportMeshes)
+    {
+        lods.push_back({ m.LodLevel, m.LodError });
+    }
+
+    const bool hasLods = std::any_of(lods.begin(), lods.end(), [](auto& lod) { return lod.Level > 0; });
+    const bool hasHierarchies = std::any_of(hierarchies.begin(), hierarchies.end(), [](auto& h) { return h.Clusters != uint32_t(-1); });
+
     // Populate the file header
     FileHeader header;
     header.Prolog = s_prolog;
-    header.Version = CURRENT_FILE_VERSION;
+    header.Version = compress ? FILE_VERSION_COMPRESSED : hasHierarchies ? FILE_VERSION_CLUSTER_HIERARCHY : hasLods ? FILE_VERSION_LOD_CHAIN : FILE_VERSION_INITIAL;
     header.MeshCount = static_cast<uint32_t>(meshes.size());
     header.AccessorCount = static_cast<uint32_t>(accessors.size());
     header.BufferViewCount = static_cast<uint32_t>(bufferViews.size());
@@ -301,29 +512,78 @@ bool ExportMeshes(const char* filename, std::vector<ExportMesh>& exportMeshes)
     stream.write(reinterpret_cast<const char*>(accessors.data()), accessors.size() * sizeof(accessors[0]));
     stream.write(reinterpret_cast<const char*>(bufferViews.data()), bufferViews.size() * sizeof(bufferViews[0]));
 
+    if (header.Version >= FILE_VERSION_LOD_CHAIN)
+    {
+        stream.write(reinterpret_cast<const char*>(lods.data()), lods.size() * sizeof(lods[0]));
+    }
+
+    if (header.Version >= FILE_VERSION_CLUSTER_HIERARCHY)
+    {
+        stream.write(reinterpret_cast<const char*>(hierarchies.data()), hierarchies.size() * sizeof(hierarchies[0]));
+    }
+
+    if (header.Version >= FILE_VERSION_COMPRESSED)
+    {
+        stream.write(reinterpret_cast<const char*>(encodings.data()), encodings.size() * sizeof(encodings[0]));
+    }
+
     uint32_t offset = 0;
 
     // Serialize the mesh data
-    for (auto& m : exportMeshes)
+    for (uint32_t meshIndex = 0; meshIndex < exportMeshes.size(); ++meshIndex)
     {
+        auto& m = exportMeshes[meshIndex];
+
         // Index data
         WriteAlignUp(stream, m.Indices.data(), static_cast<uint32_t>(m.Indices.size()), offset);
         WriteAlignUp(stream, m.IndexSubsets.data(), static_cast<uint32_t>(m.IndexSubsets.size()), offset);
 
-        // Vertex data
-        for (auto& vb : m.Vertices)
+        if (compress)
+        {
+            auto& encoded = encodedMeshes[meshIndex];
+
+            // Encoded vertex data
+            for (auto& data : encoded.Attributes)
+            {
+                WriteAlignUp(stream, data.data(), static_cast<uint32_t>(data.size()), offset);
+            }
+
+            // Meshlet data
+            WriteAlignUp(stream, m.Meshlets.data(), static_cast<uint32_t>(m.Meshlets.size()), offset);
+            WriteAlignUp(stream, m.MeshletSubsets.data(), static_cast<uint32_t>(m.MeshletSubsets.size()), offset);
+            WriteAlignUp(stream, encoded.UniqueVertexIndices.data(), static_cast<uint32_t>(encoded.UniqueVertexIndices.size()), offset);
+            WriteAlignUp(stream, encoded.PrimitiveIndices.data(), static_cast<uint32_t>(encoded.PrimitiveIndices.size()), offset);
+        }
+        else
         {
-            WriteAlignUp(stream, vb.data(), static_cast<uint32_t>(vb.size()), offset);
+            // Vertex data
+            for (auto& vb : m.Vertices)
+            {
+                WriteAlignUp(stream, vb.data(), static_cast<uint32_t>(vb.size()), offset);
+            }
+
+            // Meshlet data
+            WriteAlignUp(stream, m.Meshlets.data(), static_cast<uint32_t>(m.Meshlets.size()), offset);
+            WriteAlignUp(stream, m.MeshletSubsets.data(), static_cast<uint32_t>(m.MeshletSubsets.size()), offset);
+            WriteAlignUp(stream, m.UniqueVertexIndices.data(), static_cast<uint32_t>(m.UniqueVertexIndices.size()), offset);
+            WriteAlignUp(stream, m.PrimitiveIndices.data(), static_cast<uint32_t>(m.PrimitiveIndices.size()), offset);
         }
 
-        // Meshlet data
-        WriteAlignUp(stream, m.Meshlets.data(), static_cast<uint32_t>(m.Meshlets.size()), offset);
-        WriteAlignUp(stream, m.MeshletSubsets.data(), static_cast<uint32_t>(m.MeshletSubsets.size()), offset);
-        WriteAlignUp(stream, m.UniqueVertexIndices.data(), static_cast<uint32_t>(m.UniqueVertexIndices.size()), offset);
-        WriteAlignUp(stream, m.PrimitiveIndices.data(), static_cast<uint32_t>(m.PrimitiveIndices.size()), offset);
         WriteAlignUp(stream, m.CullData.data(), static_cast<uint32_t>(m.CullData.size()), offset);
+
+        // Cluster hierarchy data
+        if (!m.Clusters.empty())
+        {
+            WriteAlignUp(stream, m.Clusters.data(), static_cast<uint32_t>(m.Clusters.size()), offset);
+        }
     }
 
     stream.close();
+
+    if (compress && options.LogLevel >= ProcessOptions::Verbose)
+    {
+        std::cout << "Compressed vertex & meshlet index data from " << uncompressedSize / 1024 << " KB to " << compressedSize / 1024 << " KB." << std::endl;
+    }
+
     return true;
 }
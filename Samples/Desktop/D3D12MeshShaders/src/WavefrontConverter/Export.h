@@ -13,4 +13,4 @@
 #include "MeshProcessor.h"
 #include <vector>
 
-bool ExportMeshes(const char* filename, std::vector<ExportMesh>& meshes);
+bool ExportMeshes(const char* filename, std::vector<ExportMesh>& meshes, const ProcessOptions& options);
@@ -11,14 +11,14 @@
 #include "stdafx.h"
 #include "Import.h"
 
-#include "WaveFrontReader.h"
+#include "ObjParser.h"
 
 #include <algorithm>
 #include <iostream>
 
 using namespace DirectX;
 
-bool ImportFile(const char* filename, const ProcessOptions& options, std::vector<ExportMesh>& meshes)
+bool ImportFile(const char* filename, const ProcessOptions& options, std::vector<ExportMesh>& meshes, StageTimings& timings)
 {
     if (!filename)
     {
@@ -66,10 +66,19 @@ bool ImportFile(const char* filename, const ProcessOptions& options, std::vector
     std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
     std::wstring filenameW = converter.from_bytes(filename);
 
+    if (options.Benchmark)
+    {
+        BenchmarkObjParser(filenameW.c_str(), options.Flip);
+    }
+
+    auto parseStart = std::chrono::high_resolution_clock::now();
+
     WaveFrontReader<uint32_t> reader;
-    HRESULT hr = reader.Load(filenameW.c_str(), options.Flip);
+    HRESULT hr = ParseObj(filenameW.c_str(), reader, options.Flip);
+
+    timings.Add(StageTimings::Parse, parseStart);
 
-    // WaveFrontReader::Load() also returns a failing HRESULT if no material file was found - but we only care about mesh data.
+    // ParseObj() also returns a failing HRESULT if no material file was found - but we only care about mesh data.
     if (FAILED(hr) && reader.vertices.size() == 0)
     {
         std::cout << "Failed to load file: " << filename << std::endl;
@@ -84,8 +93,7 @@ bool ImportFile(const char* filename, const ProcessOptions& options, std::vector
         std::cout << "Mesh " << reader.name.c_str() << std::endl;
     }
 
-    meshes.resize(1);
-    processor.Process(options, reader, meshes[0]);
+    processor.Process(options, reader, meshes, timings);
     
     return !meshes.empty();
 }
@@ -12,4 +12,4 @@
 
 #include "MeshProcessor.h"
 
-bool ImportFile(const char* filename, const ProcessOptions& options, std::vector<ExportMesh>& meshes);
\ No newline at end of file
+bool ImportFile(const char* filename, const ProcessOptions& options, std::vector<ExportMesh>& meshes, StageTimings& timings);
\ No newline at end of file
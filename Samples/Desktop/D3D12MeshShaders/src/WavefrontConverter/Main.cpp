@@ -10,8 +10,7 @@
 //*********************************************************
 #include "stdafx.h"
 
-#include "Import.h"
-#include "Export.h"
+#include "Batch.h"
 
 
 namespace
@@ -33,6 +32,15 @@ namespace
         std::cout << "\t-v <int>      -- Specifies the maximum vertex count of a meshlet. Must be less than 256. Default is 64" << std::endl;
         std::cout << "\t-p <int>      -- Specifies the maximum primitive count of a meshlet. Must be less than 256. Default is 126" << std::endl;
         std::cout << "\t-s <float>    -- Specifies a global scaling factor for scene geometry. Default is 1.0" << std::endl;
+        std::cout << "\t-d <int>      -- Specifies the number of levels of detail to generate, each simplified from the last. Default is 1" << std::endl;
+        std::cout << "\t-r <float>    -- Specifies the triangle ratio between successive levels of detail. Default is 0.5" << std::endl;
+        std::cout << "\t-c            -- Builds a hierarchy of simplified meshlet clusters for continuous level of detail. Default is false" << std::endl;
+        std::cout << "\t-z            -- Compresses vertex & meshlet index data - quantized positions, octahedral normals & packed indices. Default is false" << std::endl;
+        std::cout << "\t-t            -- Verifies each exported file by reloading it and comparing against the converted data. Default is false" << std::endl;
+        std::cout << "\t-b            -- Benchmarks the OBJ parser against the stream based reader on each input file. Default is false" << std::endl;
+        std::cout << "\t-j <int>      -- Specifies the number of files converted concurrently - 0 uses one per hardware thread. Default is 1" << std::endl;
+        std::cout << "\t-u            -- Skips files whose output was converted from the same file content & options. Default is false" << std::endl;
+        std::cout << "\t-o <path>     -- Writes a CSV report of the time each file spent in each conversion stage." << std::endl;
         std::cout << "\t-i            -- Forces vertex indices to be 32 bits, even if only 16 bits are required. Default is false" << std::endl;
         std::cout << "\t-f            -- Flip primitive winding order. Default is false" << std::endl;
         std::cout << "\t-l <int>      -- Sets the log verbosity: 0 - Error, 1 - Basic, 2 - Verbose. Default is Basic" << std::endl;
@@ -49,7 +57,7 @@ namespace
         std::cout << std::endl;
 
         std::cout << "Example:" << std::endl;
-        std::cout << "\tConverterApp.exe -a p:nutb -v 128 -p 128 -i Path/To/MyFile1.obj Path/To/MyFile2.obj " << std::endl;
+        std::cout << "\tConverterApp.exe -a p:nutb -v 128 -p 128 -d 4 -i Path/To/MyFile1.obj Path/To/MyFile2.obj " << std::endl;
         std::cout << std::endl;
     }
 
@@ -124,6 +132,34 @@ namespace
 
                 options.UnitScale = scale;
             }
+            else if (std::strcmp(args[i], "-d") == 0)
+            {
+                if (i + 1 == argc)
+                {
+                    std::cout << "Must provide an integral value for level of detail count if supplying -d switch." << std::endl;
+                    return 1;
+                }
+
+                uint32_t lodCount = std::strtoul(args[++i], nullptr, 10);
+                options.LodCount = std::max(lodCount, 1u);
+            }
+            else if (std::strcmp(args[i], "-r") == 0)
+            {
+                if (i + 1 == argc)
+                {
+                    std::cout << "Must provide a float value for level of detail ratio if supplying -r switch." << std::endl;
+                    return 1;
+                }
+
+                float ratio = (float)strtod(args[++i], nullptr);
+                if (ratio <= 0.0f || ratio >= 1.0f)
+                {
+                    std::cout << "Level of detail ratio must be between 0 and 1 - using default of 0.5." << std::endl;
+                    ratio = 0.5f;
+                }
+
+                options.LodRatio = ratio;
+            }
             else if (std::strcmp(args[i], "-a") == 0)
             {
                 if (i + 1 == argc)
@@ -171,6 +207,46 @@ namespace
                 if (!stream.empty())
                     options.ExportAttributes.emplace_back(std::move(stream));
             }
+            else if (std::strcmp(args[i], "-c") == 0)
+            {
+                options.ClusterHierarchy = true;
+            }
+            else if (std::strcmp(args[i], "-z") == 0)
+            {
+                options.Compress = true;
+            }
+            else if (std::strcmp(args[i], "-t") == 0)
+            {
+                options.Verify = true;
+            }
+            else if (std::strcmp(args[i], "-b") == 0)
+            {
+                options.Benchmark = true;
+            }
+            else if (std::strcmp(args[i], "-j") == 0)
+            {
+                if (i + 1 == argc)
+                {
+                    std::cout << "Must provide an integral value for the concurrent file count if supplying -j switch." << std::endl;
+                    return 1;
+                }
+
+                options.Jobs = std::strtoul(args[++i], nullptr, 10);
+            }
+            else if (std::strcmp(args[i], "-u") == 0)
+            {
+                options.Incremental = true;
+            }
+            else if (std::strcmp(args[i], "-o") == 0)
+            {
+                if (i + 1 == argc)
+                {
+                    std::cout << "Must provide a path for the timing report if supplying -o switch." << std::endl;
+                    return 1;
+                }
+
+                options.TimingReport = args[++i];
+            }
             else if (std::strcmp(args[i], "-i") == 0)
             {
                 std::cout << "Forcing vertex indices to 32 bits." << std::endl;
@@ -233,10 +309,35 @@ namespace
         std::cout << "Using global scale factor - " << options.UnitScale << std::endl;
         std::cout << "Using meshlet size - Vertices: " << options.MeshletMaxVerts << "   Primitives: " << options.MeshletMaxPrims << std::endl;
 
+        if (options.LodCount > 1)
+        {
+            std::cout << "Generating " << options.LodCount << " levels of detail with a triangle ratio of " << options.LodRatio << std::endl;
+        }
+
+        if (options.ClusterHierarchy)
+        {
+            std::cout << "Building meshlet cluster hierarchies." << std::endl;
+        }
+
+        if (options.Compress)
+        {
+            std::cout << "Compressing vertex & meshlet index data." << std::endl;
+        }
+
         if (options.Force32BitIndices)
         {
             std::cout << "Forcing indices to 32 bits" << std::endl;
         }
+
+        if (options.Jobs != 1)
+        {
+            std::cout << "Converting up to " << (options.Jobs > 0 ? std::to_string(options.Jobs) : "one per hardware thread") << " files concurrently." << std::endl;
+        }
+
+        if (options.Incremental)
+        {
+            std::cout << "Skipping files with up to date outputs." << std::endl;
+        }
         
         std::cout << "Exporting vertex buffers as: " << std::endl;
         for (uint32_t i = 0; i < options.ExportAttributes.size(); ++i)
@@ -273,29 +374,8 @@ int _cdecl main(int argc, const char* args[])
         return ret;
     }
 
-    // Try loading all files specified on command line
-    bool success = true;
-    for (auto& filename : files)
-    {
-        std::vector<ExportMesh> meshes;
-
-        // Try import
-        if (!ImportFile(filename.c_str(), options, meshes))
-        {
-            success = false;
-            continue;
-        }
-
-        // Generate output filename
-        auto extLoc = filename.find_last_of(".");
-        auto path = filename.substr(0, extLoc) + ".bin";
-
-        // Try export
-        if (!ExportMeshes(path.c_str(), meshes))
-        {
-            success = false;
-        }
-    }
+    // Try converting all files specified on command line
+    bool success = ConvertFiles(files, options);
 
     // Return success if all files were successfully loaded & exported.
     return success ? 0 : 1;
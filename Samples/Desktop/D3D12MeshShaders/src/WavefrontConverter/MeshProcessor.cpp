@@ -10,11 +10,15 @@
 //*********************************************************
 #include "stdafx.h"
 #include "MeshProcessor.h"
+#include "Simplify.h"
 
 #include <Utilities.h>
 
 #include <DirectXMesh.h>
 
+#include <cfloat>
+#include <ppl.h>
+
 using namespace DirectX;
 
 namespace
@@ -54,6 +58,69 @@ namespace
     {
         return std::hash<T>()(val);
     }
+
+    // Fuller meshlets mean fewer mesh shader groups; narrower normal cones mean more meshlets can be culled.
+    void PrintMeshletStats(const ExportMesh& mesh, double buildTime, double cullDataTime)
+    {
+        if (mesh.Meshlets.empty())
+            return;
+
+        // Cluster hierarchy meshlets are appended after those referenced by the meshlet subsets.
+        uint32_t sourceCount = 0;
+        for (auto& s : mesh.MeshletSubsets)
+        {
+            sourceCount += s.Count;
+        }
+
+        uint64_t vertexSum = 0;
+        uint64_t primitiveSum = 0;
+        for (uint32_t i = 0; i < sourceCount; ++i)
+        {
+            vertexSum += mesh.Meshlets[i].VertCount;
+            primitiveSum += mesh.Meshlets[i].PrimCount;
+        }
+
+        // NormalCone.w holds the sine of the cone's half angle; 255 can't be culled.
+        double angleSum = 0.0;
+        uint32_t cullableCount = 0;
+        for (uint32_t i = 0; i < sourceCount; ++i)
+        {
+            auto& c = mesh.CullData[i];
+
+            angleSum += std::asin(c.NormalCone[3] / 255.0);
+            cullableCount += c.NormalCone[3] < 255 ? 1 : 0;
+        }
+
+        const double meshletCount = static_cast<double>(sourceCount);
+
+        std::cout << "\t" << buildTime << " ms to build meshlets" << std::endl;
+        std::cout << "\t" << cullDataTime << " ms to compute cull data" << std::endl;
+        std::cout << "\t" << vertexSum / meshletCount << " vertices per meshlet" << std::endl;
+        std::cout << "\t" << primitiveSum / meshletCount << " primitives per meshlet" << std::endl;
+        std::cout << "\t" << XMConvertToDegrees(static_cast<float>(angleSum / meshletCount)) << " degree average normal cone half angle" << std::endl;
+        std::cout << "\t" << cullableCount << " meshlets with a cullable normal cone" << std::endl;
+    }
+
+    void PrintHierarchyStats(const ExportMesh& mesh, double buildTime)
+    {
+        if (mesh.Clusters.empty())
+            return;
+
+        uint32_t levelCount = 0;
+        uint32_t rootCount = 0;
+        float maxError = 0.0f;
+        for (auto& c : mesh.Clusters)
+        {
+            levelCount = std::max(levelCount, c.Level + 1);
+            rootCount += c.ParentError == FLT_MAX ? 1 : 0;
+            maxError = std::max(maxError, c.Error);
+        }
+
+        std::cout << "\t" << buildTime << " ms to build the cluster hierarchy" << std::endl;
+        std::cout << "\t" << levelCount << " hierarchy levels" << std::endl;
+        std::cout << "\t" << mesh.Clusters.size() << " clusters, " << rootCount << " roots" << std::endl;
+        std::cout << "\t" << maxError << " maximum root error" << std::endl;
+    }
 }
 
 namespace std
@@ -70,10 +137,28 @@ namespace std
 }
 
 
+const char* const StageTimings::Names[StageTimings::Count] =
+{
+    "Parse",
+    "Simplify",
+    "Clean",
+    "OptimizeFaces",
+    "OptimizeVertices",
+    "TangentFrame",
+    "Meshlets",
+    "CullData",
+    "Hierarchy",
+    "Export",
+    "Verify",
+};
+
 MeshProcessor::MeshProcessor() 
     : m_type(0)
     , m_indexSize(4)
     , m_indexCount(0)
+    , m_meshletBuildTime(0.0)
+    , m_cullDataTime(0.0)
+    , m_hierarchyTime(0.0)
 { }
 
 void MeshProcessor::Reset()
@@ -101,103 +186,193 @@ void MeshProcessor::Reset()
     m_indexCount = 0;
 }
 
-bool MeshProcessor::Process(const ProcessOptions& options, const WaveFrontReader<uint32_t>& reader, ExportMesh& output)
+bool MeshProcessor::Process(const ProcessOptions& options, const WaveFrontReader<uint32_t>& reader, std::vector<ExportMesh>& output, StageTimings& timings)
 {
-    if (!Extract(options, reader))
-    {
-        return false;
-    }
+    // Each level of detail is simplified from the level before it, starting from the full resolution mesh.
+    std::vector<uint32_t> lodIndices(reader.indices);
+    std::vector<uint32_t> lodAttributes(reader.attributes);
+    float lodError = 0.0f;
 
-    if (m_indexSize == 4)
+    std::vector<XMFLOAT3> scaledPositions;
+    if (options.LodCount > 1)
     {
-        Finalize<uint32_t>(options);
+        scaledPositions.resize(reader.vertices.size());
+
+        for (uint32_t i = 0; i < reader.vertices.size(); ++i)
+        {
+            XMStoreFloat3(&scaledPositions[i], XMLoadFloat3(&reader.vertices[i].position) * options.UnitScale);
+        }
     }
-    else
+
+    for (uint32_t level = 0; level < options.LodCount; ++level)
     {
-        Finalize<uint16_t>(options);
-    }
+        if (level > 0)
+        {
+            const uint32_t targetIndexCount = static_cast<uint32_t>(static_cast<float>(lodIndices.size() / 3) * options.LodRatio) * 3;
 
-    Export(options, output);
+            std::vector<uint32_t> simplifiedIndices;
+            std::vector<uint32_t> simplifiedAttributes;
 
-    if (options.LogLevel >= ProcessOptions::Verbose)
-    {
-        std::cout << "Stats: " << std::endl;
-        std::cout << "\t" << output.VertexCount << " vertices" << std::endl;
-        std::cout << "\t" << output.IndexCount << " indices" << std::endl;
-        std::cout << "\t" << output.IndexSize << " byte indices" << std::endl;
-        std::cout << "\t" << output.IndexSubsets.size() << " material subsets" << std::endl;
-        std::cout << "\t" << output.Meshlets.size() << " meshlets" << std::endl;
-    }
+            auto simplifyStart = std::chrono::high_resolution_clock::now();
+
+            // Errors are measured against the previous level, so accumulate them to bound the error against level 0.
+            lodError += SimplifyMesh(
+                lodIndices.data(), static_cast<uint32_t>(lodIndices.size()),
+                lodAttributes.data(),
+                scaledPositions.data(), static_cast<uint32_t>(scaledPositions.size()),
+                targetIndexCount,
+                simplifiedIndices,
+                simplifiedAttributes);
+
+            timings.Add(StageTimings::Simplify, simplifyStart);
+
+            if (simplifiedIndices.empty() || simplifiedIndices.size() == lodIndices.size())
+            {
+                if (options.LogLevel >= ProcessOptions::Basic)
+                {
+                    std::cout << "Mesh can't be simplified further - stopping at " << level << " levels of detail." << std::endl;
+                }
+                break;
+            }
+
+            std::swap(lodIndices, simplifiedIndices);
+            std::swap(lodAttributes, simplifiedAttributes);
+        }
+
+        if (!Extract(options, reader, lodIndices, lodAttributes))
+        {
+            return false;
+        }
+
+        if (m_indexSize == 4)
+        {
+            Finalize<uint32_t>(options, timings);
+        }
+        else
+        {
+            Finalize<uint16_t>(options, timings);
+        }
+
+        output.emplace_back();
+        ExportMesh& mesh = output.back();
 
-    Reset();
+        Export(options, mesh);
+
+        mesh.LodLevel = level;
+        mesh.LodError = lodError;
+
+        if (options.LogLevel >= ProcessOptions::Verbose)
+        {
+            std::cout << "Stats: " << std::endl;
+
+            if (options.LodCount > 1)
+            {
+                std::cout << "\tLOD " << level << " - " << mesh.LodError << " maximum error" << std::endl;
+            }
+
+            std::cout << "\t" << mesh.VertexCount << " vertices" << std::endl;
+            std::cout << "\t" << mesh.IndexCount << " indices" << std::endl;
+            std::cout << "\t" << mesh.IndexSize << " byte indices" << std::endl;
+            std::cout << "\t" << mesh.IndexSubsets.size() << " material subsets" << std::endl;
+            std::cout << "\t" << mesh.Meshlets.size() << " meshlets" << std::endl;
+
+            PrintMeshletStats(mesh, m_meshletBuildTime, m_cullDataTime);
+            PrintHierarchyStats(mesh, m_hierarchyTime);
+        }
+
+        Reset();
+    }
 
     return true;
 }
 
-bool MeshProcessor::Extract(const ProcessOptions& options, const WaveFrontReader<uint32_t>& reader)
+bool MeshProcessor::Extract(const ProcessOptions& options, const WaveFrontReader<uint32_t>& reader, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& attributes)
 {
+    // Gather the vertices referenced by this level's triangles, preserving their order in the source mesh.
+    std::vector<uint32_t> vertexMap(reader.vertices.size(), uint32_t(-1));
+    for (uint32_t index : indices)
+    {
+        vertexMap[index] = 0;
+    }
+
+    uint32_t vertexCount = 0;
+    for (auto& v : vertexMap)
+    {
+        if (v != uint32_t(-1))
+        {
+            v = vertexCount++;
+        }
+    }
+
     m_type = AddAttribute(m_type, Attribute::Position);
-    m_positions.resize(reader.vertices.size());
+    m_positions.resize(vertexCount);
 
     if (reader.hasNormals)
     {
         m_type = AddAttribute(m_type, Attribute::Normal);
-        m_normals.resize(reader.vertices.size());
+        m_normals.resize(vertexCount);
     }
 
     if (reader.hasTexcoords)
     {
         m_type = AddAttribute(m_type, Attribute::TexCoord);
-        m_uvs.resize(reader.vertices.size());
+        m_uvs.resize(vertexCount);
     }
 
     for (uint32_t i = 0; i < reader.vertices.size(); ++i)
     {
-        XMStoreFloat3(&m_positions[i], XMLoadFloat3(&reader.vertices[i].position) * options.UnitScale);
+        const uint32_t dest = vertexMap[i];
+        if (dest == uint32_t(-1))
+            continue;
+
+        XMStoreFloat3(&m_positions[dest], XMLoadFloat3(&reader.vertices[i].position) * options.UnitScale);
 
         if (reader.hasNormals)
         {
-            m_normals[i] = reader.vertices[i].normal;
+            m_normals[dest] = reader.vertices[i].normal;
         }
 
         if (reader.hasTexcoords)
         {
-            m_uvs[i] = reader.vertices[i].textureCoordinate;
+            m_uvs[dest] = reader.vertices[i].textureCoordinate;
         }
     }
 
     // Determine our index properties
-    m_indexCount = static_cast<uint32_t>(reader.indices.size());
+    m_indexCount = static_cast<uint32_t>(indices.size());
     m_indexSize = (m_indexCount > 65536 || options.Force32BitIndices) ? 4 : 2;
     m_indices.resize(m_indexSize * m_indexCount);
 
-    // Copy our indices over to their final buffer.
+    // Copy our indices over to their final buffer, remapped to the gathered vertices.
     if (m_indexSize == 4)
     {
-        // Already stored at 32-bits - simple copy over.
-        std::memcpy(m_indices.data(), reader.indices.data(), m_indexCount * m_indexSize);
+        uint32_t* dest = reinterpret_cast<uint32_t*>(m_indices.data());
+
+        for (uint32_t i = 0; i < m_indexCount; ++i)
+        {
+            dest[i] = vertexMap[indices[i]];
+        }
     }
     else
     {
-        // Type conversion - must copy one value at a time.
-        const uint32_t* src = reader.indices.data();
-        uint8_t* dest = m_indices.data();
+        uint16_t* dest = reinterpret_cast<uint16_t*>(m_indices.data());
 
-        for (uint32_t i = 0; i < m_indexCount; ++i, ++src, dest += m_indexSize)
+        for (uint32_t i = 0; i < m_indexCount; ++i)
         {
-            std::memcpy(dest, src, m_indexSize);
+            dest[i] = static_cast<uint16_t>(vertexMap[indices[i]]);
         }
     }
 
-    m_attributes.resize(reader.attributes.size());
-    std::memcpy(m_attributes.data(), reader.attributes.data(), reader.attributes.size() * sizeof(uint32_t));
+    m_attributes = attributes;
 
     return true;
 }
 
 template <typename T>
-void MeshProcessor::Finalize(const ProcessOptions& options)
+void MeshProcessor::Finalize(const ProcessOptions& options, StageTimings& timings)
 {
+    auto stageStart = std::chrono::high_resolution_clock::now();
+
     // Pull out some final counts for readability
     const uint32_t vertexCount = static_cast<uint32_t>(m_positions.size());
     const uint32_t triCount = m_indexCount / 3;
@@ -219,12 +394,37 @@ void MeshProcessor::Finalize(const ProcessOptions& options)
 
     std::swap(m_indices, m_indexReorder);
 
-    // Optimize triangle faces and reorder
-    ThrowIfFailed(DirectX::OptimizeFacesLRU(reinterpret_cast<T*>(m_indices.data()), triCount, m_faceRemap.data()));
+    stageStart = timings.Add(StageTimings::Clean, stageStart);
+
+    // Optimize triangle faces within each material subset - keeping the faces sorted by material - and reorder.
+    // Subsets share no faces, so they're optimized in parallel.
+    auto faceSubsets = DirectX::ComputeSubsets(m_attributes.data(), m_attributes.size());
+
+    concurrency::parallel_for(size_t(0), faceSubsets.size(), [&](size_t i)
+    {
+        const size_t faceOffset = faceSubsets[i].first;
+        const size_t faceCount = faceSubsets[i].second;
+
+        uint32_t* faceRemap = m_faceRemap.data() + faceOffset;
+
+        ThrowIfFailed(DirectX::OptimizeFacesLRU(reinterpret_cast<T*>(m_indices.data()) + faceOffset * 3, faceCount, faceRemap));
+
+        // Rebase the remap onto the whole index buffer; degenerate faces stay marked as unused so ReorderIB skips them.
+        for (size_t j = 0; j < faceCount; ++j)
+        {
+            if (faceRemap[j] != DirectX::UNUSED32)
+            {
+                faceRemap[j] += static_cast<uint32_t>(faceOffset);
+            }
+        }
+    });
+
     ThrowIfFailed(DirectX::ReorderIB(reinterpret_cast<T*>(m_indices.data()), triCount, m_faceRemap.data(), reinterpret_cast<T*>(m_indexReorder.data())));
 
     std::swap(m_indices, m_indexReorder);
 
+    stageStart = timings.Add(StageTimings::OptimizeFaces, stageStart);
+
     // Optimize our vertex data
     ThrowIfFailed(DirectX::OptimizeVertices(reinterpret_cast<T*>(m_indices.data()), triCount, vertexCount, m_vertexRemap.data()));
 
@@ -251,6 +451,8 @@ void MeshProcessor::Finalize(const ProcessOptions& options)
         std::swap(m_uvs, m_uvReorder);
     }
 
+    stageStart = timings.Add(StageTimings::OptimizeVertices, stageStart);
+
     // Populate material subset data
     auto subsets = DirectX::ComputeSubsets(m_attributes.data(), m_attributes.size());
 
@@ -281,7 +483,11 @@ void MeshProcessor::Finalize(const ProcessOptions& options)
         ThrowIfFailed(DirectX::ComputeTangentFrame(reinterpret_cast<T*>(m_indices.data()), triCount, m_positions.data(), m_normals.data(), m_uvs.data(), vertexCount, m_tangents.data(), m_bitangents.data()));
     }
 
+    timings.Add(StageTimings::TangentFrame, stageStart);
+
     // Meshletize our mesh and generate per-meshlet culling data
+    auto meshletStart = std::chrono::high_resolution_clock::now();
+
     ThrowIfFailed(ComputeMeshlets(
         options.MeshletMaxVerts, options.MeshletMaxPrims,
         reinterpret_cast<T*>(m_indices.data()), m_indexCount,
@@ -293,6 +499,12 @@ void MeshProcessor::Finalize(const ProcessOptions& options)
         m_primitiveIndices
     ));
 
+    std::chrono::duration<double, std::milli> meshletTime = std::chrono::high_resolution_clock::now() - meshletStart;
+    m_meshletBuildTime = meshletTime.count();
+    timings.Milliseconds[StageTimings::Meshlets] += m_meshletBuildTime;
+
+    auto cullDataStart = std::chrono::high_resolution_clock::now();
+
     m_cullData.resize(m_meshlets.size());
 
     ThrowIfFailed(ComputeCullData(
@@ -303,6 +515,31 @@ void MeshProcessor::Finalize(const ProcessOptions& options)
         CNORM_DEFAULT,
         m_cullData.data()
     ));
+
+    std::chrono::duration<double, std::milli> cullDataTime = std::chrono::high_resolution_clock::now() - cullDataStart;
+    m_cullDataTime = cullDataTime.count();
+    timings.Milliseconds[StageTimings::CullData] += m_cullDataTime;
+
+    // Build the cluster hierarchy on top of the finished meshlets
+    if (options.ClusterHierarchy)
+    {
+        auto hierarchyStart = std::chrono::high_resolution_clock::now();
+
+        BuildClusterHierarchy<T>(
+            options.MeshletMaxVerts, options.MeshletMaxPrims,
+            m_positions.data(), static_cast<uint32_t>(m_positions.size()),
+            m_meshletSubsets,
+            m_meshlets,
+            m_uniqueVertexIndices,
+            m_primitiveIndices,
+            m_cullData,
+            m_clusters
+        );
+
+        std::chrono::duration<double, std::milli> hierarchyTime = std::chrono::high_resolution_clock::now() - hierarchyStart;
+        m_hierarchyTime = hierarchyTime.count();
+        timings.Milliseconds[StageTimings::Hierarchy] += m_hierarchyTime;
+    }
 }
 
 void MeshProcessor::Export(const ProcessOptions& options, ExportMesh& output)
@@ -421,4 +658,5 @@ void MeshProcessor::Export(const ProcessOptions& options, ExportMesh& output)
     std::swap(output.UniqueVertexIndices, m_uniqueVertexIndices);
     std::swap(output.PrimitiveIndices, m_primitiveIndices);
     std::swap(output.CullData, m_cullData);
+    std::swap(output.Clusters, m_clusters);
 }
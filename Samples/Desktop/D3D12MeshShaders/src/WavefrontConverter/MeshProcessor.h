@@ -12,6 +12,8 @@
 
 #include "WaveFrontReader.h"
 
+#include "ClusterDag.h"
+
 #include <D3D12MeshletGenerator.h>
 
 struct Attribute
@@ -60,9 +62,54 @@ struct ExportMesh
     std::vector<uint8_t>            UniqueVertexIndices;
     std::vector<PackedTriangle>     PrimitiveIndices;
     std::vector<CullData>           CullData;
+    std::vector<ClusterLod>         Clusters;
+
+    uint32_t                        LodLevel;
+    float                           LodError;
 };
 
 
+// Wall time a file spends in each stage of conversion, accumulated over its levels of detail.
+struct StageTimings
+{
+    enum EStage
+    {
+        Parse,
+        Simplify,
+        Clean,              // Clean & sort faces by material
+        OptimizeFaces,
+        OptimizeVertices,   // Optimize & finalize the vertex and index buffers
+        TangentFrame,       // Normals, tangents & bitangents
+        Meshlets,
+        CullData,
+        Hierarchy,
+        Export,
+        Verify,
+        Count
+    };
+
+    static const char* const Names[Count];
+
+    double Milliseconds[Count] = {};
+
+    // Adds the time since start to a stage, returning the current time to start the next stage from.
+    std::chrono::high_resolution_clock::time_point Add(EStage stage, std::chrono::high_resolution_clock::time_point start)
+    {
+        auto now = std::chrono::high_resolution_clock::now();
+        Milliseconds[stage] += std::chrono::duration<double, std::milli>(now - start).count();
+        return now;
+    }
+
+    StageTimings& operator+=(const StageTimings& other)
+    {
+        for (uint32_t i = 0; i < Count; ++i)
+        {
+            Milliseconds[i] += other.Milliseconds[i];
+        }
+        return *this;
+    }
+};
+
 struct ProcessOptions
 {
     enum ELogVerbosity
@@ -74,6 +121,15 @@ struct ProcessOptions
 
     uint32_t        MeshletMaxVerts;
     uint32_t        MeshletMaxPrims;
+    uint32_t        LodCount;
+    float           LodRatio;
+    bool            ClusterHierarchy;
+    bool            Compress;
+    bool            Verify;
+    bool            Benchmark;
+    bool            Incremental;
+    uint32_t        Jobs;
+    std::string     TimingReport;
     AttrLayout      ExportAttributes;
     float           UnitScale;
     bool            Force32BitIndices;
@@ -83,6 +139,15 @@ struct ProcessOptions
     ProcessOptions(void)
         : MeshletMaxVerts(64)
         , MeshletMaxPrims(126)
+        , LodCount(1)
+        , LodRatio(0.5f)
+        , ClusterHierarchy(false)
+        , Compress(false)
+        , Verify(false)
+        , Benchmark(false)
+        , Incremental(false)
+        , Jobs(1)
+        , TimingReport{}
         , UnitScale(1.0f)
         , ExportAttributes{}
         , Force32BitIndices(false)
@@ -96,15 +161,15 @@ class MeshProcessor
 public:
     MeshProcessor();
 
-    bool Process(const ProcessOptions& options, const WaveFrontReader<uint32_t>& reader, ExportMesh& output);
+    bool Process(const ProcessOptions& options, const WaveFrontReader<uint32_t>& reader, std::vector<ExportMesh>& output, StageTimings& timings);
 
 private:
     void Reset();
-    bool Extract(const ProcessOptions& options, const WaveFrontReader<uint32_t>& reader);
+    bool Extract(const ProcessOptions& options, const WaveFrontReader<uint32_t>& reader, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& attributes);
     void Export(const ProcessOptions& options, ExportMesh& output);
 
     template <typename T> 
-    void Finalize(const ProcessOptions& options);
+    void Finalize(const ProcessOptions& options, StageTimings& timings);
 
 private:
     std::vector<uint32_t>                   m_attributes;
@@ -126,6 +191,10 @@ private:
     std::vector<uint8_t>                    m_uniqueVertexIndices;
     std::vector<PackedTriangle>             m_primitiveIndices;
     std::vector<CullData>                   m_cullData;
+    std::vector<ClusterLod>                 m_clusters;
+    double                                  m_meshletBuildTime;
+    double                                  m_cullDataTime;
+    double                                  m_hierarchyTime;
 
     std::unordered_map<size_t, uint32_t>    m_uniqueVertices;
 
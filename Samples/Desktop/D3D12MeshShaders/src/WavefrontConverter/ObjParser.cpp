@@ -0,0 +1,972 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "stdafx.h"
+#include "ObjParser.h"
+
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+#include <ppl.h>
+#include <thread>
+
+using namespace DirectX;
+
+namespace
+{
+    using Vertex = WaveFrontReader<uint32_t>::Vertex;
+
+    const uint32_t c_absent = uint32_t(-1);
+    const uint32_t c_relative = uint32_t(-2); // Negative OBJ index, resolved once the elements ahead of its chunk are counted
+
+    // Chunks are no smaller than this, and there are no more than a few per hardware thread to balance uneven lines.
+    const size_t c_minChunkSize = 1 << 20;
+    const uint32_t c_chunksPerThread = 4;
+
+    const uint32_t c_maxPoly = 64;
+
+    const double c_powersOf10[] =
+    {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    // Read-only mapping of a whole file.
+    class MappedFile
+    {
+    public:
+        MappedFile()
+            : m_file(INVALID_HANDLE_VALUE)
+            , m_mapping(nullptr)
+            , m_data(nullptr)
+            , m_size(0)
+        { }
+
+        ~MappedFile()
+        {
+            if (m_data != nullptr)
+                UnmapViewOfFile(m_data);
+            if (m_mapping != nullptr)
+                CloseHandle(m_mapping);
+            if (m_file != INVALID_HANDLE_VALUE)
+                CloseHandle(m_file);
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        HRESULT Open(const wchar_t* filename)
+        {
+            m_file = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (m_file == INVALID_HANDLE_VALUE)
+                return HRESULT_FROM_WIN32(GetLastError());
+
+            LARGE_INTEGER size = {};
+            if (!GetFileSizeEx(m_file, &size))
+                return HRESULT_FROM_WIN32(GetLastError());
+
+            // Empty files can't be mapped - and have no positions anyway.
+            if (size.QuadPart == 0)
+                return E_FAIL;
+
+            m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (m_mapping == nullptr)
+                return HRESULT_FROM_WIN32(GetLastError());
+
+            m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+            if (m_data == nullptr)
+                return HRESULT_FROM_WIN32(GetLastError());
+
+            m_size = static_cast<size_t>(size.QuadPart);
+            return S_OK;
+        }
+
+        const char* Data() const { return m_data; }
+        size_t Size() const { return m_size; }
+
+    private:
+        HANDLE      m_file;
+        HANDLE      m_mapping;
+        const char* m_data;
+        size_t      m_size;
+    };
+
+    // Open addressing table deduplicating vertices by position index & value, matching WaveFrontReader::AddVertex().
+    class VertexTable
+    {
+    public:
+        explicit VertexTable(size_t capacity)
+        {
+            size_t size = 16;
+            while (size < capacity * 2)
+                size *= 2;
+
+            m_slots.assign(size, c_absent);
+            m_mask = size - 1;
+
+            Vertices.reserve(capacity);
+            Positions.reserve(capacity);
+        }
+
+        // Returns the index of an equal vertex already in the table, or appends the vertex and returns its index.
+        uint32_t Insert(uint32_t position, const Vertex& vertex)
+        {
+            for (size_t slot = Hash(position, vertex) & m_mask; ; slot = (slot + 1) & m_mask)
+            {
+                uint32_t index = m_slots[slot];
+
+                if (index == c_absent)
+                {
+                    index = static_cast<uint32_t>(Vertices.size());
+                    Vertices.push_back(vertex);
+                    Positions.push_back(position);
+
+                    m_slots[slot] = index;
+                    return index;
+                }
+
+                if (Positions[index] == position && std::memcmp(&Vertices[index], &vertex, sizeof(Vertex)) == 0)
+                    return index;
+            }
+        }
+
+        std::vector<Vertex>   Vertices;  // In order of first insertion
+        std::vector<uint32_t> Positions; // Position index each vertex was referenced by
+
+    private:
+        static size_t Hash(uint32_t position, const Vertex& vertex)
+        {
+            // Equal position indices imply equal positions, so only the remaining attributes are hashed by value.
+            uint32_t words[5];
+            std::memcpy(words, &vertex.normal, sizeof(words));
+
+            uint64_t h = (position + 1) * 0x9E3779B97F4A7C15ull;
+            for (uint32_t w : words)
+            {
+                h = (h ^ w) * 0x100000001B3ull;
+            }
+
+            return static_cast<size_t>(h ^ (h >> 29));
+        }
+
+    private:
+        std::vector<uint32_t> m_slots;
+        size_t                m_mask;
+    };
+
+    // An OBJ index to a position, texture coordinate or normal.
+    struct Corner
+    {
+        uint32_t Position;
+        uint32_t TexCoord;
+        uint32_t Normal;
+    };
+
+    // Range of one element type's indices within a chunk, relative to the elements the chunk had parsed when each
+    // was referenced. OBJ indices may only reference elements declared before them, which is checked once the
+    // elements ahead of the chunk are counted.
+    struct IndexRange
+    {
+        int64_t MaxAbsolute = INT64_MIN; // Largest 0-based absolute index less the chunk's element count
+        int64_t MinRelative = INT64_MAX; // Smallest negative index plus the chunk's element count
+
+        bool IsValid(size_t base) const
+        {
+            return MaxAbsolute < int64_t(base) && MinRelative >= -int64_t(base);
+        }
+    };
+
+    struct MaterialChange
+    {
+        uint32_t     Triangle; // First of the chunk's triangles using the material
+        std::wstring Name;
+        uint32_t     Subset;
+    };
+
+    struct Chunk
+    {
+        const char*                 Begin;
+        const char*                 End;
+        HRESULT                     Result;
+
+        std::vector<XMFLOAT3>       Positions;
+        std::vector<XMFLOAT3>       Normals;
+        std::vector<XMFLOAT2>       TexCoords;
+        IndexRange                  PositionRange;
+        IndexRange                  NormalRange;
+        IndexRange                  TexCoordRange;
+
+        std::vector<Corner>         Corners;
+        std::vector<int64_t>        RelativeIndices; // Element offsets from the chunk's start of each c_relative index, in order
+        std::vector<uint8_t>        FaceSizes;
+        uint32_t                    TriangleCount;
+
+        std::vector<MaterialChange> Materials;
+        std::wstring                MaterialLibrary;
+
+        // Filled once the elements ahead of the chunk are counted
+        size_t                      PositionBase;
+        size_t                      NormalBase;
+        size_t                      TexCoordBase;
+        size_t                      TriangleBase;
+        std::vector<uint32_t>       CornerVertices; // Index of each corner's vertex in the chunk's table
+        std::unique_ptr<VertexTable> Vertices;
+        std::vector<uint32_t>       Remap;          // Chunk table index to final vertex index
+    };
+
+    inline bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    inline bool IsDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    inline void SkipSpace(const char*& p, const char* end)
+    {
+        while (p < end && IsSpace(*p))
+            ++p;
+    }
+
+    inline void SkipLine(const char*& p, const char* end)
+    {
+        auto next = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        p = next != nullptr ? next + 1 : end;
+    }
+
+    // Reads a whitespace delimited token on the current line.
+    inline size_t ReadToken(const char*& p, const char* end, const char*& token)
+    {
+        SkipSpace(p, end);
+
+        token = p;
+        while (p < end && *p != '\n' && !IsSpace(*p))
+            ++p;
+
+        return p - token;
+    }
+
+    inline bool IsCommand(const char* token, size_t length, const char* command)
+    {
+        return length == std::strlen(command) && std::memcmp(token, command, length) == 0;
+    }
+
+    // Material names & paths are widened byte by byte, as the default locale of the wide stream reader does.
+    std::wstring Widen(const char* token, size_t length)
+    {
+        length = std::min(length, size_t(MAX_PATH - 1));
+
+        std::wstring result(length, L'\0');
+        for (size_t i = 0; i < length; ++i)
+        {
+            result[i] = static_cast<wchar_t>(static_cast<unsigned char>(token[i]));
+        }
+
+        return result;
+    }
+
+    // Parses a float without the locale & stream machinery of operator>>. The decimal mantissa and power of 10 are
+    // each exact in double precision for mantissas below 2^53 and exponents within +/-22, so their product is
+    // correctly rounded. Narrowing to float is then correct too unless the double lands exactly halfway between two
+    // floats, where the first rounding may have decided the second; those, along with long mantissas, large exponents
+    // and subnormals, fall back to strtof.
+    bool ParseFloat(const char*& p, const char* end, float& value)
+    {
+        SkipSpace(p, end);
+        const char* start = p;
+
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            ++p;
+        }
+
+        uint64_t mantissa = 0;
+        int32_t  exponent = 0;
+        uint32_t digits = 0;
+        bool     anyDigits = false;
+        bool     exact = true;
+
+        for (; p < end && IsDigit(*p); ++p)
+        {
+            anyDigits = true;
+
+            if (mantissa == 0 && *p == '0')
+                continue;
+
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                ++digits;
+            }
+            else
+            {
+                exact = false;
+            }
+        }
+
+        if (p < end && *p == '.')
+        {
+            for (++p; p < end && IsDigit(*p); ++p)
+            {
+                anyDigits = true;
+
+                if (mantissa == 0 && *p == '0')
+                {
+                    --exponent;
+                }
+                else if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    ++digits;
+                    --exponent;
+                }
+                else
+                {
+                    exact = false;
+                }
+            }
+        }
+
+        if (anyDigits && p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char* q = p + 1;
+
+            bool negativeExponent = false;
+            if (q < end && (*q == '-' || *q == '+'))
+            {
+                negativeExponent = *q == '-';
+                ++q;
+            }
+
+            // An 'e' without digits isn't part of the number.
+            if (q < end && IsDigit(*q))
+            {
+                int32_t e = 0;
+                for (; q < end && IsDigit(*q); ++q)
+                {
+                    e = std::min(e * 10 + (*q - '0'), 100000);
+                }
+
+                exponent += negativeExponent ? -e : e;
+                p = q;
+            }
+        }
+
+        if (anyDigits && exact && mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22)
+        {
+            double d = static_cast<double>(mantissa);
+            d = exponent < 0 ? d / c_powersOf10[-exponent] : d * c_powersOf10[exponent];
+
+            uint64_t bits;
+            std::memcpy(&bits, &d, sizeof(bits));
+
+            bool halfway = (bits & 0x1FFFFFFFull) == 0x10000000ull;
+            if (d == 0.0 || (!halfway && d >= FLT_MIN && d <= FLT_MAX))
+            {
+                value = static_cast<float>(negative ? -d : d);
+                return true;
+            }
+        }
+
+        // Hand anything else - including inf & nan - to the CRT.
+        if (!anyDigits)
+        {
+            while (p < end && *p != '\n' && !IsSpace(*p))
+                ++p;
+        }
+
+        char buffer[128];
+        std::string overflow;
+
+        size_t length = p - start;
+        const char* text = buffer;
+
+        if (length < sizeof(buffer))
+        {
+            std::memcpy(buffer, start, length);
+            buffer[length] = '\0';
+        }
+        else
+        {
+            overflow.assign(start, length);
+            text = overflow.c_str();
+        }
+
+        char* parsed = nullptr;
+        value = std::strtof(text, &parsed);
+
+        if (parsed == text)
+            return false;
+
+        p = start + (parsed - text);
+        return true;
+    }
+
+    bool ParseIndex(const char*& p, const char* end, int32_t& value)
+    {
+        SkipSpace(p, end);
+
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            ++p;
+        }
+
+        if (p == end || !IsDigit(*p))
+            return false;
+
+        int64_t result = 0;
+        for (; p < end && IsDigit(*p); ++p)
+        {
+            result = result * 10 + (*p - '0');
+
+            if (result > INT32_MAX)
+                return false;
+        }
+
+        value = static_cast<int32_t>(negative ? -result : result);
+        return true;
+    }
+
+    HRESULT AddIndex(int32_t index, size_t count, IndexRange& range, uint32_t& resolved, std::vector<int64_t>& relativeIndices)
+    {
+        if (index == 0)
+        {
+            // 0 is not allowed for index
+            return E_UNEXPECTED;
+        }
+        else if (index < 0)
+        {
+            // Negative values are relative indices
+            int64_t offset = int64_t(count) + index;
+
+            range.MinRelative = std::min(range.MinRelative, offset);
+            relativeIndices.push_back(offset);
+            resolved = c_relative;
+        }
+        else
+        {
+            // OBJ format uses 1-based arrays
+            range.MaxAbsolute = std::max(range.MaxAbsolute, int64_t(index - 1) - int64_t(count));
+            resolved = static_cast<uint32_t>(index - 1);
+        }
+
+        return S_OK;
+    }
+
+    HRESULT ParseFace(const char*& p, const char* end, Chunk& chunk)
+    {
+        uint32_t count = 0;
+
+        for (;;)
+        {
+            if (count >= c_maxPoly)
+            {
+                // Too many polygon verts for the reader
+                return E_FAIL;
+            }
+
+            Corner corner = { c_absent, c_absent, c_absent };
+            int32_t index;
+
+            if (!ParseIndex(p, end, index))
+                return E_FAIL;
+
+            HRESULT hr = AddIndex(index, chunk.Positions.size(), chunk.PositionRange, corner.Position, chunk.RelativeIndices);
+            if (FAILED(hr))
+                return hr;
+
+            if (p < end && *p == '/')
+            {
+                ++p;
+
+                if (p < end && *p != '/')
+                {
+                    // Optional texture coordinate
+                    if (!ParseIndex(p, end, index))
+                        return E_FAIL;
+
+                    hr = AddIndex(index, chunk.TexCoords.size(), chunk.TexCoordRange, corner.TexCoord, chunk.RelativeIndices);
+                    if (FAILED(hr))
+                        return hr;
+                }
+
+                if (p < end && *p == '/')
+                {
+                    ++p;
+
+                    // Optional vertex normal
+                    if (!ParseIndex(p, end, index))
+                        return E_FAIL;
+
+                    hr = AddIndex(index, chunk.Normals.size(), chunk.NormalRange, corner.Normal, chunk.RelativeIndices);
+                    if (FAILED(hr))
+                        return hr;
+                }
+            }
+
+            chunk.Corners.push_back(corner);
+            ++count;
+
+            // Anything up to the next index or the end of the line separates corners.
+            while (p < end && *p != '\n' && !IsDigit(*p) && *p != '-' && *p != '+')
+                ++p;
+
+            if (p == end || *p == '\n')
+                break;
+        }
+
+        if (count < 3)
+        {
+            // Need at least 3 points to form a triangle
+            return E_FAIL;
+        }
+
+        chunk.FaceSizes.push_back(static_cast<uint8_t>(count));
+        chunk.TriangleCount += count - 2;
+
+        return S_OK;
+    }
+
+    HRESULT ParseChunk(Chunk& chunk)
+    {
+        const char* p = chunk.Begin;
+        const char* end = chunk.End;
+
+        while (p < end)
+        {
+            const char* token;
+            size_t length = ReadToken(p, end, token);
+
+            if (length == 0)
+            {
+                // Blank line
+            }
+            else if (*token == '#')
+            {
+                // Comment
+            }
+            else if (IsCommand(token, length, "v"))
+            {
+                // Vertex Position
+                XMFLOAT3 v;
+                if (!ParseFloat(p, end, v.x) || !ParseFloat(p, end, v.y) || !ParseFloat(p, end, v.z))
+                    return E_FAIL;
+
+                chunk.Positions.push_back(v);
+            }
+            else if (IsCommand(token, length, "vt"))
+            {
+                // Vertex TexCoord
+                XMFLOAT2 vt;
+                if (!ParseFloat(p, end, vt.x) || !ParseFloat(p, end, vt.y))
+                    return E_FAIL;
+
+                chunk.TexCoords.push_back(vt);
+            }
+            else if (IsCommand(token, length, "vn"))
+            {
+                // Vertex Normal
+                XMFLOAT3 vn;
+                if (!ParseFloat(p, end, vn.x) || !ParseFloat(p, end, vn.y) || !ParseFloat(p, end, vn.z))
+                    return E_FAIL;
+
+                chunk.Normals.push_back(vn);
+            }
+            else if (IsCommand(token, length, "f"))
+            {
+                // Face
+                HRESULT hr = ParseFace(p, end, chunk);
+                if (FAILED(hr))
+                    return hr;
+            }
+            else if (IsCommand(token, length, "mtllib"))
+            {
+                // Material library
+                length = ReadToken(p, end, token);
+                chunk.MaterialLibrary = Widen(token, length);
+            }
+            else if (IsCommand(token, length, "usemtl"))
+            {
+                // Material
+                length = ReadToken(p, end, token);
+                chunk.Materials.push_back(MaterialChange{ chunk.TriangleCount, Widen(token, length), 0 });
+            }
+            else
+            {
+                // Object & group names, smoothing groups and unrecognized commands are ignored
+            }
+
+            SkipLine(p, end);
+        }
+
+        return S_OK;
+    }
+
+    // Resolves each corner's indices into the merged element arrays and deduplicates the chunk's vertices.
+    void BuildChunkVertices(Chunk& chunk, const std::vector<XMFLOAT3>& positions, const std::vector<XMFLOAT3>& normals, const std::vector<XMFLOAT2>& texCoords)
+    {
+        auto relative = chunk.RelativeIndices.cbegin();
+
+        auto resolve = [&](uint32_t index, size_t base)
+        {
+            return index == c_relative ? static_cast<uint32_t>(base + *relative++) : index;
+        };
+
+        chunk.Vertices = std::make_unique<VertexTable>(chunk.Corners.size());
+        chunk.CornerVertices.resize(chunk.Corners.size());
+
+        for (size_t i = 0; i < chunk.Corners.size(); ++i)
+        {
+            auto& corner = chunk.Corners[i];
+
+            Vertex vertex = {};
+
+            uint32_t position = resolve(corner.Position, chunk.PositionBase);
+            vertex.position = positions[position];
+
+            if (corner.TexCoord != c_absent)
+            {
+                vertex.textureCoordinate = texCoords[resolve(corner.TexCoord, chunk.TexCoordBase)];
+            }
+
+            if (corner.Normal != c_absent)
+            {
+                vertex.normal = normals[resolve(corner.Normal, chunk.NormalBase)];
+            }
+
+            chunk.CornerVertices[i] = chunk.Vertices->Insert(position, vertex);
+        }
+
+        std::vector<Corner>().swap(chunk.Corners);
+        std::vector<int64_t>().swap(chunk.RelativeIndices);
+    }
+
+    // Writes the chunk's triangles and their subsets into its range of the reader's arrays.
+    void WriteChunkTriangles(const Chunk& chunk, uint32_t subset, bool ccw, uint32_t* indices, uint32_t* attributes)
+    {
+        auto material = chunk.Materials.cbegin();
+        uint32_t triangle = 0;
+        size_t corner = 0;
+
+        for (uint8_t faceSize : chunk.FaceSizes)
+        {
+            // Convert polygons to triangles
+            uint32_t i0 = chunk.Remap[chunk.CornerVertices[corner]];
+            uint32_t i1 = chunk.Remap[chunk.CornerVertices[corner + 1]];
+
+            for (uint32_t j = 2; j < faceSize; ++j, ++triangle)
+            {
+                uint32_t index = chunk.Remap[chunk.CornerVertices[corner + j]];
+
+                *indices++ = i0;
+                *indices++ = ccw ? i1 : index;
+                *indices++ = ccw ? index : i1;
+
+                while (material != chunk.Materials.cend() && material->Triangle <= triangle)
+                {
+                    subset = material->Subset;
+                    ++material;
+                }
+
+                *attributes++ = subset;
+
+                i1 = index;
+            }
+
+            corner += faceSize;
+        }
+    }
+
+    // Splits the file into chunks at line boundaries.
+    std::vector<Chunk> SplitChunks(const char* data, size_t size)
+    {
+        size_t maxChunks = std::max(std::thread::hardware_concurrency(), 1u) * size_t(c_chunksPerThread);
+        size_t chunkCount = std::max(std::min(size / c_minChunkSize, maxChunks), size_t(1));
+
+        std::vector<Chunk> chunks;
+        chunks.reserve(chunkCount);
+
+        const char* end = data + size;
+        const char* begin = data;
+
+        for (size_t i = 1; i <= chunkCount && begin < end; ++i)
+        {
+            const char* split = end;
+
+            if (i < chunkCount)
+            {
+                split = std::max(data + size * i / chunkCount, begin);
+                SkipLine(split, end);
+            }
+
+            chunks.emplace_back();
+            chunks.back().Begin = begin;
+            chunks.back().End = split;
+
+            begin = split;
+        }
+
+        return chunks;
+    }
+}
+
+HRESULT ParseObj(const wchar_t* filename, WaveFrontReader<uint32_t>& reader, bool ccw)
+{
+    reader.Clear();
+
+    MappedFile file;
+    HRESULT hr = file.Open(filename);
+    if (FAILED(hr))
+        return hr;
+
+    wchar_t fname[_MAX_FNAME] = {};
+    _wsplitpath_s(filename, nullptr, 0, nullptr, 0, fname, _MAX_FNAME, nullptr, 0);
+
+    reader.name = fname;
+
+    // Parse each chunk into its own element arrays & faces.
+    std::vector<Chunk> chunks = SplitChunks(file.Data(), file.Size());
+
+    concurrency::parallel_for(size_t(0), chunks.size(), [&](size_t i)
+    {
+        chunks[i].TriangleCount = 0;
+        chunks[i].Result = ParseChunk(chunks[i]);
+    });
+
+    // Count the elements ahead of each chunk, reporting the first failure in file order.
+    size_t positionCount = 0;
+    size_t normalCount = 0;
+    size_t texCoordCount = 0;
+    size_t triangleCount = 0;
+
+    for (auto& chunk : chunks)
+    {
+        if (FAILED(chunk.Result))
+            return chunk.Result;
+
+        if (!chunk.PositionRange.IsValid(positionCount)
+            || !chunk.NormalRange.IsValid(normalCount)
+            || !chunk.TexCoordRange.IsValid(texCoordCount))
+        {
+            return E_FAIL;
+        }
+
+        chunk.PositionBase = positionCount;
+        chunk.NormalBase = normalCount;
+        chunk.TexCoordBase = texCoordCount;
+        chunk.TriangleBase = triangleCount;
+
+        positionCount += chunk.Positions.size();
+        normalCount += chunk.Normals.size();
+        texCoordCount += chunk.TexCoords.size();
+        triangleCount += chunk.TriangleCount;
+    }
+
+    if (positionCount == 0)
+        return E_FAIL;
+
+    if (triangleCount * 3 > UINT32_MAX)
+        return E_FAIL;
+
+    std::vector<XMFLOAT3> positions(positionCount);
+    std::vector<XMFLOAT3> normals(normalCount);
+    std::vector<XMFLOAT2> texCoords(texCoordCount);
+
+    concurrency::parallel_for(size_t(0), chunks.size(), [&](size_t i)
+    {
+        auto& chunk = chunks[i];
+
+        std::copy(chunk.Positions.cbegin(), chunk.Positions.cend(), positions.begin() + chunk.PositionBase);
+        std::copy(chunk.Normals.cbegin(), chunk.Normals.cend(), normals.begin() + chunk.NormalBase);
+        std::copy(chunk.TexCoords.cbegin(), chunk.TexCoords.cend(), texCoords.begin() + chunk.TexCoordBase);
+
+        std::vector<XMFLOAT3>().swap(chunk.Positions);
+        std::vector<XMFLOAT3>().swap(chunk.Normals);
+        std::vector<XMFLOAT2>().swap(chunk.TexCoords);
+    });
+
+    // Deduplicate each chunk's vertices in parallel.
+    concurrency::parallel_for(size_t(0), chunks.size(), [&](size_t i)
+    {
+        BuildChunkVertices(chunks[i], positions, normals, texCoords);
+    });
+
+    // Merge the chunk tables in file order, so vertices keep the order of their first reference.
+    size_t chunkVertexCount = 0;
+    for (auto& chunk : chunks)
+    {
+        chunkVertexCount += chunk.Vertices->Vertices.size();
+    }
+
+    VertexTable vertices(chunkVertexCount);
+
+    for (auto& chunk : chunks)
+    {
+        auto& table = *chunk.Vertices;
+
+        chunk.Remap.resize(table.Vertices.size());
+        for (size_t i = 0; i < table.Vertices.size(); ++i)
+        {
+            chunk.Remap[i] = vertices.Insert(table.Positions[i], table.Vertices[i]);
+        }
+
+        chunk.Vertices.reset();
+    }
+
+    reader.vertices = std::move(vertices.Vertices);
+
+    // Assign subsets in order of each material's first use, carrying the active one across chunk boundaries.
+    WaveFrontReader<uint32_t>::Material defmat;
+    wcscpy_s(defmat.strName, L"default");
+    reader.materials.emplace_back(defmat);
+
+    std::vector<uint32_t> initialSubsets(chunks.size());
+    uint32_t curSubset = 0;
+    std::wstring materialLibrary;
+
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        initialSubsets[i] = curSubset;
+
+        for (auto& change : chunks[i].Materials)
+        {
+            auto it = std::find_if(reader.materials.cbegin(), reader.materials.cend(), [&](auto& m) { return change.Name == m.strName; });
+
+            if (it == reader.materials.cend())
+            {
+                WaveFrontReader<uint32_t>::Material mat;
+                wcscpy_s(mat.strName, change.Name.c_str());
+
+                it = reader.materials.emplace(reader.materials.cend(), mat);
+            }
+
+            change.Subset = static_cast<uint32_t>(it - reader.materials.cbegin());
+            curSubset = change.Subset;
+        }
+
+        if (!chunks[i].MaterialLibrary.empty())
+        {
+            materialLibrary = chunks[i].MaterialLibrary;
+        }
+    }
+
+    reader.indices.resize(triangleCount * 3);
+    reader.attributes.resize(triangleCount);
+
+    concurrency::parallel_for(size_t(0), chunks.size(), [&](size_t i)
+    {
+        auto& chunk = chunks[i];
+        WriteChunkTriangles(chunk, initialSubsets[i], ccw, reader.indices.data() + chunk.TriangleBase * 3, reader.attributes.data() + chunk.TriangleBase);
+    });
+
+    reader.hasNormals = normalCount > 0;
+    reader.hasTexcoords = texCoordCount > 0;
+
+    BoundingBox::CreateFromPoints(reader.bounds, positions.size(), positions.data(), sizeof(XMFLOAT3));
+
+    // If an associated material file was found, read that in as well.
+    if (!materialLibrary.empty())
+    {
+        wchar_t ext[_MAX_EXT] = {};
+        _wsplitpath_s(materialLibrary.c_str(), nullptr, 0, nullptr, 0, fname, _MAX_FNAME, ext, _MAX_EXT);
+
+        wchar_t drive[_MAX_DRIVE] = {};
+        wchar_t dir[_MAX_DIR] = {};
+        _wsplitpath_s(filename, drive, _MAX_DRIVE, dir, _MAX_DIR, nullptr, 0, nullptr, 0);
+
+        wchar_t szPath[MAX_PATH] = {};
+        _wmakepath_s(szPath, MAX_PATH, drive, dir, fname, ext);
+
+        hr = reader.LoadMTL(szPath);
+        if (FAILED(hr))
+            return hr;
+    }
+
+    return S_OK;
+}
+
+bool BenchmarkObjParser(const wchar_t* filename, bool ccw)
+{
+    // Touch every page up front so neither reader pays for the first read from disk.
+    MappedFile file;
+    if (FAILED(file.Open(filename)))
+    {
+        std::cout << "Failed to open file for benchmarking." << std::endl;
+        return false;
+    }
+
+    volatile char sum = 0;
+    for (size_t i = 0; i < file.Size(); i += 4096)
+    {
+        sum += file.Data()[i];
+    }
+
+    double megabytes = double(file.Size()) / (1024.0 * 1024.0);
+
+    auto measure = [](auto&& load, HRESULT& hr)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        hr = load();
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    WaveFrontReader<uint32_t> streamed;
+    WaveFrontReader<uint32_t> parsed;
+    HRESULT streamedResult;
+    HRESULT parsedResult;
+
+    double streamedTime = measure([&]() { return streamed.Load(filename, ccw); }, streamedResult);
+    double parsedTime = measure([&]() { return ParseObj(filename, parsed, ccw); }, parsedResult);
+
+    std::cout << "OBJ parser benchmark (" << megabytes << " MB):" << std::endl;
+    std::cout << "\tWaveFrontReader::Load - " << streamedTime << " ms, " << megabytes * 1000.0 / streamedTime << " MB/s" << std::endl;
+    std::cout << "\tParseObj              - " << parsedTime << " ms, " << megabytes * 1000.0 / parsedTime << " MB/s ("
+        << streamedTime / parsedTime << "x)" << std::endl;
+
+    if (streamedResult != parsedResult)
+    {
+        std::cout << "\tResults differ: " << std::hex << streamedResult << " vs " << parsedResult << std::dec << std::endl;
+        return false;
+    }
+
+    // A failed parse leaves no mesh data behind, while the stream reader keeps whatever it read before the error.
+    if (FAILED(parsedResult) && parsed.vertices.empty())
+    {
+        std::cout << "\tBoth readers failed with " << std::hex << parsedResult << std::dec << "." << std::endl;
+        return false;
+    }
+
+    auto equal = [](auto& a, auto& b)
+    {
+        return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(a[0])) == 0);
+    };
+
+    bool match = equal(streamed.vertices, parsed.vertices)
+        && equal(streamed.indices, parsed.indices)
+        && equal(streamed.attributes, parsed.attributes)
+        && streamed.materials.size() == parsed.materials.size()
+        && streamed.hasNormals == parsed.hasNormals
+        && streamed.hasTexcoords == parsed.hasTexcoords
+        && std::memcmp(&streamed.bounds, &parsed.bounds, sizeof(BoundingBox)) == 0;
+
+    for (size_t i = 0; match && i < streamed.materials.size(); ++i)
+    {
+        match = std::wcscmp(streamed.materials[i].strName, parsed.materials[i].strName) == 0;
+    }
+
+    std::cout << (match ? "\tOutputs match." : "\tOutputs differ.") << std::endl;
+    return match;
+}
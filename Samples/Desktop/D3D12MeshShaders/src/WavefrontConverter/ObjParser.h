@@ -0,0 +1,24 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+#include "WaveFrontReader.h"
+
+// Loads an OBJ file into the reader, producing the same vertices, indices, attributes & materials as
+// WaveFrontReader::Load(). The file is memory mapped and split into line-aligned chunks which are parsed & have their
+// vertices deduplicated in parallel; the per-chunk vertex tables are then merged in file order.
+// Malformed vertex statements fail the load rather than ending it early. The material library is read by
+// WaveFrontReader::LoadMTL().
+HRESULT ParseObj(const wchar_t* filename, WaveFrontReader<uint32_t>& reader, bool ccw = true);
+
+// Loads a file with both WaveFrontReader::Load() & ParseObj(), printing the throughput of each and whether their
+// outputs match. Returns false if either fails or they disagree.
+bool BenchmarkObjParser(const wchar_t* filename, bool ccw = true);
@@ -0,0 +1,412 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "stdafx.h"
+#include "Simplify.h"
+
+#include <Utilities.h>
+
+using namespace DirectX;
+
+namespace
+{
+    const uint32_t Undef = uint32_t(-1);
+
+    // Symmetric 4x4 matrix summing the squared distances to a set of planes, along with the total area of those
+    // planes so that its error can be normalized back into a squared distance.
+    struct Quadric
+    {
+        double a00, a01, a02, a03;
+        double a11, a12, a13;
+        double a22, a23;
+        double a33;
+        double Weight;
+    };
+
+    void AddPlane(Quadric& q, double x, double y, double z, double d, double weight)
+    {
+        q.a00 += weight * x * x; q.a01 += weight * x * y; q.a02 += weight * x * z; q.a03 += weight * x * d;
+        q.a11 += weight * y * y; q.a12 += weight * y * z; q.a13 += weight * y * d;
+        q.a22 += weight * z * z; q.a23 += weight * z * d;
+        q.a33 += weight * d * d;
+        q.Weight += weight;
+    }
+
+    void AddQuadric(Quadric& q, const Quadric& r)
+    {
+        q.a00 += r.a00; q.a01 += r.a01; q.a02 += r.a02; q.a03 += r.a03;
+        q.a11 += r.a11; q.a12 += r.a12; q.a13 += r.a13;
+        q.a22 += r.a22; q.a23 += r.a23;
+        q.a33 += r.a33;
+        q.Weight += r.Weight;
+    }
+
+    // Returns the area-weighted mean squared distance from the point to the quadric's planes.
+    double QuadricError(const Quadric& q, const Quadric& r, const XMFLOAT3& p)
+    {
+        const double x = p.x, y = p.y, z = p.z;
+
+        double error =
+            (q.a00 + r.a00) * x * x + 2.0 * (q.a01 + r.a01) * x * y + 2.0 * (q.a02 + r.a02) * x * z + 2.0 * (q.a03 + r.a03) * x +
+            (q.a11 + r.a11) * y * y + 2.0 * (q.a12 + r.a12) * y * z + 2.0 * (q.a13 + r.a13) * y +
+            (q.a22 + r.a22) * z * z + 2.0 * (q.a23 + r.a23) * z +
+            (q.a33 + r.a33);
+
+        double weight = q.Weight + r.Weight;
+        return weight > 0.0 ? std::max(error, 0.0) / weight : 0.0;
+    }
+
+    struct Collapse
+    {
+        uint32_t From;
+        uint32_t To;
+        double   Error;
+    };
+
+    bool CompareCollapses(const Collapse& a, const Collapse& b)
+    {
+        if (a.Error != b.Error)
+            return a.Error < b.Error;
+
+        return a.From < b.From || (a.From == b.From && a.To < b.To);
+    }
+
+    inline uint64_t MakeEdgeKey(uint32_t a, uint32_t b)
+    {
+        return (uint64_t(a) << 32) | b;
+    }
+
+    inline XMVECTOR TriangleNormal(const XMFLOAT3& p0, const XMFLOAT3& p1, const XMFLOAT3& p2)
+    {
+        XMVECTOR v0 = XMLoadFloat3(&p0);
+        return XMVector3Cross(XMLoadFloat3(&p1) - v0, XMLoadFloat3(&p2) - v0);
+    }
+
+    // Appends the corners of a triangle other than 'center' to a ring, skipping those already present.
+    inline void AddToRing(std::vector<uint32_t>& ring, const uint32_t* tri, uint32_t center)
+    {
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            if (tri[i] != center && std::find(ring.begin(), ring.end(), tri[i]) == ring.end())
+            {
+                ring.push_back(tri[i]);
+            }
+        }
+    }
+}
+
+float SimplifyMesh(
+    const uint32_t* indices, uint32_t indexCount,
+    const uint32_t* faceAttributes,
+    const XMFLOAT3* positions, uint32_t vertexCount,
+    uint32_t targetIndexCount,
+    std::vector<uint32_t>& simplifiedIndices,
+    std::vector<uint32_t>& simplifiedAttributes)
+{
+    // Weld vertices by exact position - each position is collapsed as a whole, through its representative vertex.
+    std::vector<uint32_t> sortedVerts(vertexCount);
+    for (uint32_t i = 0; i < vertexCount; ++i)
+    {
+        sortedVerts[i] = i;
+    }
+
+    std::sort(sortedVerts.begin(), sortedVerts.end(), [&](uint32_t a, uint32_t b)
+    {
+        int c = std::memcmp(&positions[a], &positions[b], sizeof(XMFLOAT3));
+        return c < 0 || (c == 0 && a < b);
+    });
+
+    std::vector<uint32_t> pointRep(vertexCount);
+    for (uint32_t i = 0, first = 0; i < vertexCount; ++i)
+    {
+        if (std::memcmp(&positions[sortedVerts[first]], &positions[sortedVerts[i]], sizeof(XMFLOAT3)) != 0)
+        {
+            first = i;
+        }
+
+        pointRep[sortedVerts[i]] = sortedVerts[first];
+    }
+
+    // Start from the input triangles, dropping any which are already degenerate once positions are welded.
+    simplifiedIndices.clear();
+    simplifiedAttributes.clear();
+
+    for (uint32_t i = 0; i < indexCount / 3; ++i)
+    {
+        const uint32_t* tri = indices + i * 3;
+        if (pointRep[tri[0]] == pointRep[tri[1]] || pointRep[tri[1]] == pointRep[tri[2]] || pointRep[tri[2]] == pointRep[tri[0]])
+            continue;
+
+        simplifiedIndices.insert(simplifiedIndices.end(), tri, tri + 3);
+        simplifiedAttributes.push_back(faceAttributes != nullptr ? faceAttributes[i] : 0);
+    }
+
+    const uint32_t triCount = static_cast<uint32_t>(simplifiedAttributes.size());
+
+    // Classify positions, locking those whose neighborhood a collapse couldn't preserve.
+    std::vector<uint32_t> wedgeVertex(vertexCount, Undef);
+    std::vector<uint32_t> firstAttribute(vertexCount, Undef);
+    std::vector<uint8_t> locked(vertexCount, 0);
+    std::vector<uint64_t> edges;
+    edges.reserve(triCount * 3);
+
+    for (uint32_t i = 0; i < triCount; ++i)
+    {
+        const uint32_t* tri = &simplifiedIndices[i * 3];
+
+        for (uint32_t j = 0; j < 3; ++j)
+        {
+            uint32_t v = tri[j];
+            uint32_t rep = pointRep[v];
+
+            // Attribute seam - more than one vertex references this position.
+            if (wedgeVertex[rep] != Undef && wedgeVertex[rep] != v)
+            {
+                locked[rep] = 1;
+            }
+            wedgeVertex[rep] = v;
+
+            // Material boundary
+            if (firstAttribute[rep] != Undef && firstAttribute[rep] != simplifiedAttributes[i])
+            {
+                locked[rep] = 1;
+            }
+            firstAttribute[rep] = simplifiedAttributes[i];
+
+            edges.push_back(MakeEdgeKey(rep, pointRep[tri[(j + 1) % 3]]));
+        }
+    }
+
+    // Open borders & non-manifold edges - every directed edge must be matched by exactly one edge running the other way.
+    std::sort(edges.begin(), edges.end());
+
+    for (size_t i = 0; i < edges.size(); )
+    {
+        size_t end = i + 1;
+        while (end < edges.size() && edges[end] == edges[i])
+        {
+            ++end;
+        }
+
+        uint32_t a = uint32_t(edges[i] >> 32);
+        uint32_t b = uint32_t(edges[i]);
+
+        auto range = std::equal_range(edges.begin(), edges.end(), MakeEdgeKey(b, a));
+        if (end - i != 1 || range.second - range.first != 1)
+        {
+            locked[a] = 1;
+            locked[b] = 1;
+        }
+
+        i = end;
+    }
+
+    // Accumulate the area-weighted planes of each position's triangles.
+    std::vector<Quadric> quadrics(vertexCount, Quadric{});
+
+    for (uint32_t i = 0; i < triCount; ++i)
+    {
+        const uint32_t* tri = &simplifiedIndices[i * 3];
+
+        XMVECTOR n = TriangleNormal(positions[tri[0]], positions[tri[1]], positions[tri[2]]);
+        float length = XMVectorGetX(XMVector3Length(n));
+
+        if (length <= 0.0f)
+            continue;
+
+        XMFLOAT3 plane;
+        XMStoreFloat3(&plane, n / length);
+
+        double d = -(double(plane.x) * positions[tri[0]].x + double(plane.y) * positions[tri[0]].y + double(plane.z) * positions[tri[0]].z);
+
+        for (uint32_t j = 0; j < 3; ++j)
+        {
+            AddPlane(quadrics[pointRep[tri[j]]], plane.x, plane.y, plane.z, d, length * 0.5);
+        }
+    }
+
+    double maxError = 0.0;
+
+    std::vector<uint32_t> repIndices;
+    std::vector<uint32_t> offsets(vertexCount + 1);
+    std::vector<uint32_t> incidence;
+    std::vector<Collapse> collapses;
+    std::vector<uint8_t> passLocked(vertexCount);
+    std::vector<uint32_t> vertexRemap(vertexCount);
+    std::vector<uint32_t> fromRing, toRing;
+
+    // Collapse edges in passes, cheapest first. A collapse locks both endpoints' neighborhoods for the rest of its pass,
+    // so every decision within a pass is made against unmodified topology.
+    while (simplifiedIndices.size() > targetIndexCount)
+    {
+        const uint32_t passTriCount = static_cast<uint32_t>(simplifiedIndices.size()) / 3;
+
+        repIndices.resize(simplifiedIndices.size());
+        for (size_t i = 0; i < simplifiedIndices.size(); ++i)
+        {
+            repIndices[i] = pointRep[simplifiedIndices[i]];
+        }
+
+        incidence.resize(repIndices.size());
+        BuildVertexIncidence(repIndices.data(), static_cast<uint32_t>(repIndices.size()), vertexCount, offsets.data(), incidence.data());
+
+        // Each interior edge is seen once in each direction, so every candidate is gathered exactly once.
+        collapses.clear();
+        for (uint32_t i = 0; i < passTriCount * 3; ++i)
+        {
+            uint32_t from = repIndices[i];
+            uint32_t to = repIndices[i - i % 3 + (i + 1) % 3];
+
+            if (locked[from])
+                continue;
+
+            collapses.push_back({ from, to, QuadricError(quadrics[from], quadrics[to], positions[to]) });
+        }
+
+        std::sort(collapses.begin(), collapses.end(), CompareCollapses);
+
+        // Stay close to a global cheapest-first order - only dip into the more expensive half of the candidates when
+        // nothing cheaper was possible this pass.
+        const uint32_t collapseGoal = (passTriCount - targetIndexCount / 3 + 1) / 2;
+        const size_t scanLimit = std::max(collapses.size() / 2, size_t(collapseGoal) * 3);
+
+        std::fill(passLocked.begin(), passLocked.end(), uint8_t(0));
+        for (uint32_t i = 0; i < vertexCount; ++i)
+        {
+            vertexRemap[i] = i;
+        }
+
+        uint32_t collapseCount = 0;
+
+        for (size_t c = 0; c < collapses.size() && collapseCount < collapseGoal; ++c)
+        {
+            if (c >= scanLimit && collapseCount > 0)
+                break;
+
+            const uint32_t from = collapses[c].From;
+            const uint32_t to = collapses[c].To;
+
+            if (passLocked[from] || passLocked[to])
+                continue;
+
+            // Gather both one-rings, and find which of the target's vertices the edge triangles reference.
+            fromRing.clear();
+            toRing.clear();
+
+            uint32_t toVertex = Undef;
+            uint32_t edgeTriCount = 0;
+            bool valid = true;
+
+            for (uint32_t j = offsets[from]; j < offsets[from + 1]; ++j)
+            {
+                const uint32_t tri = incidence[j];
+                AddToRing(fromRing, &repIndices[tri * 3], from);
+
+                for (uint32_t k = 0; k < 3; ++k)
+                {
+                    if (repIndices[tri * 3 + k] != to)
+                        continue;
+
+                    uint32_t v = simplifiedIndices[tri * 3 + k];
+                    valid &= (toVertex == Undef || toVertex == v);
+
+                    toVertex = v;
+                    ++edgeTriCount;
+                }
+            }
+
+            for (uint32_t j = offsets[to]; j < offsets[to + 1]; ++j)
+            {
+                AddToRing(toRing, &repIndices[incidence[j] * 3], to);
+            }
+
+            // Link condition - the rings may only share the two vertices opposite the collapsing edge.
+            uint32_t shared = 0;
+            for (uint32_t r : fromRing)
+            {
+                shared += std::find(toRing.begin(), toRing.end(), r) != toRing.end() ? 1 : 0;
+            }
+
+            if (!valid || edgeTriCount != 2 || shared != 2)
+                continue;
+
+            // Reject collapses that flip any of the remaining triangles.
+            for (uint32_t j = offsets[from]; j < offsets[from + 1] && valid; ++j)
+            {
+                const uint32_t* tri = &repIndices[incidence[j] * 3];
+                if (tri[0] == to || tri[1] == to || tri[2] == to)
+                    continue;
+
+                XMFLOAT3 p[3] = { positions[tri[0]], positions[tri[1]], positions[tri[2]] };
+                XMVECTOR before = TriangleNormal(p[0], p[1], p[2]);
+
+                for (uint32_t k = 0; k < 3; ++k)
+                {
+                    if (tri[k] == from)
+                    {
+                        p[k] = positions[to];
+                    }
+                }
+
+                // Also reject large rotations and triangles collapsing to (nearly) zero area, whose normals are unreliable.
+                XMVECTOR after = TriangleNormal(p[0], p[1], p[2]);
+                float beforeLength = XMVectorGetX(XMVector3Length(before));
+                float afterLength = XMVectorGetX(XMVector3Length(after));
+
+                valid = XMVectorGetX(XMVector3Dot(before, after)) > 0.25f * beforeLength * afterLength && afterLength > 1e-3f * beforeLength;
+            }
+
+            if (!valid)
+                continue;
+
+            // Commit the collapse
+            vertexRemap[wedgeVertex[from]] = toVertex;
+            AddQuadric(quadrics[to], quadrics[from]);
+            maxError = std::max(maxError, collapses[c].Error);
+
+            passLocked[from] = 1;
+            passLocked[to] = 1;
+
+            for (uint32_t r : fromRing)
+                passLocked[r] = 1;
+
+            for (uint32_t r : toRing)
+                passLocked[r] = 1;
+
+            ++collapseCount;
+        }
+
+        if (collapseCount == 0)
+            break;
+
+        // Apply the remap and drop the triangles which collapsed to a line.
+        uint32_t writeTri = 0;
+        for (uint32_t i = 0; i < passTriCount; ++i)
+        {
+            uint32_t v[3];
+            for (uint32_t j = 0; j < 3; ++j)
+            {
+                v[j] = vertexRemap[simplifiedIndices[i * 3 + j]];
+            }
+
+            if (pointRep[v[0]] == pointRep[v[1]] || pointRep[v[1]] == pointRep[v[2]] || pointRep[v[2]] == pointRep[v[0]])
+                continue;
+
+            std::memcpy(&simplifiedIndices[writeTri * 3], v, sizeof(v));
+            simplifiedAttributes[writeTri] = simplifiedAttributes[i];
+            ++writeTri;
+        }
+
+        simplifiedIndices.resize(writeTri * 3);
+        simplifiedAttributes.resize(writeTri);
+    }
+
+    return static_cast<float>(std::sqrt(maxError));
+}
@@ -0,0 +1,26 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+// Reduces a triangle list towards targetIndexCount using quadric error metric half-edge collapses.
+// Vertices are never moved or created, so every surviving vertex keeps its original attributes. Vertices on open
+// borders, attribute seams (several vertices sharing one position) and material boundaries are never collapsed.
+// Returns the largest object-space error introduced by any of the collapses.
+float SimplifyMesh(
+    const uint32_t* indices, uint32_t indexCount,
+    const uint32_t* faceAttributes,
+    const DirectX::XMFLOAT3* positions, uint32_t vertexCount,
+    uint32_t targetIndexCount,
+    std::vector<uint32_t>& simplifiedIndices,
+    std::vector<uint32_t>& simplifiedAttributes);
@@ -0,0 +1,213 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "stdafx.h"
+#include "Verify.h"
+
+#include <D3D12MeshletLoader.h>
+
+#include <iostream>
+
+using namespace DirectX;
+
+namespace
+{
+    const uint32_t s_attributeSizes[] =
+    {
+        12, // Position
+        12, // Normal
+        8,  // TexCoord
+        12, // Tangent
+        12, // Bitangent
+    };
+
+    const float c_directionTolerance = 1e-3f;
+
+    bool CompareBytes(const char* name, const MeshFileStream& stream, const void* expected, size_t size)
+    {
+        bool match = stream.Data == nullptr
+            ? size == 0
+            : stream.Count * stream.ElementSize == size && std::memcmp(stream.Data + stream.Offset, expected, size) == 0;
+
+        if (!match)
+        {
+            std::cout << "\t" << name << " data mismatch." << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    template <typename T>
+    bool Compare(const char* name, const MeshFileStream& stream, const std::vector<T>& expected)
+    {
+        return CompareBytes(name, stream, expected.data(), expected.size() * sizeof(T));
+    }
+}
+
+bool VerifyExport(const char* filename, const std::vector<ExportMesh>& meshes)
+{
+    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+    std::wstring filenameW = converter.from_bytes(filename);
+
+    MeshFile file;
+    if (FAILED(file.Open(filenameW.c_str())))
+    {
+        std::cout << "Verification failed to open file '" << filename << "'." << std::endl;
+        return false;
+    }
+
+    if (file.GetMeshCount() != meshes.size())
+    {
+        std::cout << "Verification of '" << filename << "' failed - expected " << meshes.size() << " meshes, found " << file.GetMeshCount() << "." << std::endl;
+        return false;
+    }
+
+    bool success = true;
+    for (uint32_t i = 0; i < meshes.size(); ++i)
+    {
+        auto& m = meshes[i];
+
+        MeshFileMesh mesh;
+        if (FAILED(file.GetMesh(i, mesh)))
+        {
+            std::cout << "Verification of '" << filename << "' failed - mesh " << i << " could not be loaded." << std::endl;
+            success = false;
+            continue;
+        }
+
+        bool valid = Compare("Index", mesh.Indices, m.Indices)
+            && Compare("Index subset", mesh.IndexSubsets, m.IndexSubsets)
+            && Compare("Meshlet", mesh.Meshlets, m.Meshlets)
+            && Compare("Meshlet subset", mesh.MeshletSubsets, m.MeshletSubsets)
+            && Compare("Unique vertex index", mesh.UniqueVertexIndices, m.UniqueVertexIndices)
+            && Compare("Cull data", mesh.CullData, m.CullData)
+            && Compare("Cluster", mesh.Clusters, m.Clusters);
+
+        // The 2 spare bits of a packed triangle aren't preserved by compression.
+        if (valid && mesh.PrimitiveIndices.Count == m.PrimitiveIndices.size())
+        {
+            auto triangles = reinterpret_cast<const uint32_t*>(mesh.PrimitiveIndices.Data);
+
+            for (uint32_t j = 0; j < m.PrimitiveIndices.size(); ++j)
+            {
+                if ((triangles[j] ^ m.PrimitiveIndices[j].packed) & 0x3FFFFFFF)
+                {
+                    std::cout << "\tPrimitive index data mismatch." << std::endl;
+                    valid = false;
+                    break;
+                }
+            }
+        }
+        else if (valid)
+        {
+            std::cout << "\tPrimitive index count mismatch." << std::endl;
+            valid = false;
+        }
+
+        // Positions may be off by one quantization step of the sphere around their owning meshlet's vertices, which
+        // can't exceed a sphere around the mesh's bounding box.
+        XMVECTOR vMin = g_XMFltMax;
+        XMVECTOR vMax = -g_XMFltMax;
+
+        for (uint32_t j = 0; j < m.Layout.size(); ++j)
+        {
+            for (auto& a : m.Layout[j].Attributes)
+            {
+                if (a.Type != Attribute::Position)
+                    continue;
+
+                for (uint32_t k = 0; k < m.VertexCount; ++k)
+                {
+                    XMVECTOR p = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(m.Vertices[j].data() + a.Offset + k * m.Layout[j].Stride));
+                    vMin = XMVectorMin(vMin, p);
+                    vMax = XMVectorMax(vMax, p);
+                }
+            }
+        }
+
+        const float radius = XMVectorGetX(XMVector3Length(vMax - vMin)) * 0.5f;
+        const float positionTolerance = radius / 32767.0f * 1.01f;
+
+        float positionError = 0.0f;
+        float directionError = 0.0f;
+
+        for (uint32_t j = 0; valid && j < m.Layout.size(); ++j)
+        {
+            auto& l = m.Layout[j];
+
+            for (auto& a : l.Attributes)
+            {
+                auto& stream = mesh.Attributes[a.Type];
+                if (stream.Data == nullptr || stream.Count != m.VertexCount || stream.ElementSize != s_attributeSizes[a.Type])
+                {
+                    std::cout << "\tVertex attribute " << a.Type << " layout mismatch." << std::endl;
+                    valid = false;
+                    break;
+                }
+
+                for (uint32_t k = 0; k < m.VertexCount; ++k)
+                {
+                    const uint8_t* expected = m.Vertices[j].data() + a.Offset + k * l.Stride;
+                    const uint8_t* actual = stream.Data + stream.Offset + k * stream.Stride;
+
+                    switch (a.Type)
+                    {
+                    case Attribute::Position:
+                    {
+                        XMVECTOR error = XMVectorAbs(XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(actual)) - XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(expected)));
+                        positionError = std::max(positionError, std::max(XMVectorGetX(error), std::max(XMVectorGetY(error), XMVectorGetZ(error))));
+                        break;
+                    }
+
+                    case Attribute::Normal:
+                    case Attribute::Tangent:
+                    case Attribute::Bitangent:
+                    {
+                        // Directions are only preserved up to length - compare against the normalized source.
+                        XMVECTOR source = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(expected));
+                        if (XMVectorGetX(XMVector3LengthSq(source)) == 0.0f)
+                            break;
+
+                        XMVECTOR error = XMVectorAbs(XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(actual)) - XMVector3Normalize(source));
+                        directionError = std::max(directionError, std::max(XMVectorGetX(error), std::max(XMVectorGetY(error), XMVectorGetZ(error))));
+                        break;
+                    }
+
+                    default:
+                        if (std::memcmp(actual, expected, stream.ElementSize) != 0)
+                        {
+                            std::cout << "\tVertex attribute " << a.Type << " data mismatch." << std::endl;
+                            valid = false;
+                        }
+                        break;
+                    }
+
+                    if (!valid)
+                        break;
+                }
+            }
+        }
+
+        if (valid && (positionError > positionTolerance || directionError > c_directionTolerance))
+        {
+            std::cout << "\tVertex data exceeds the quantization error bounds." << std::endl;
+            valid = false;
+        }
+
+        std::cout << "Verified mesh " << i << " of '" << filename << "': " << (valid ? "passed" : "FAILED")
+            << " - max position error " << positionError << " (tolerance " << positionTolerance << ")"
+            << ", max direction error " << directionError << std::endl;
+
+        success = success && valid;
+    }
+
+    return success;
+}
@@ -0,0 +1,19 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+#pragma once
+
+#include "MeshProcessor.h"
+
+// Reloads an exported file through the meshlet loader and compares it against the meshes it was exported from.
+// Compressed streams must decode to within their quantization error and all other data must match exactly.
+bool VerifyExport(const char* filename, const std::vector<ExportMesh>& meshes);
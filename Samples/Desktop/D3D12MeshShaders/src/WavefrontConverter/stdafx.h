@@ -22,6 +22,8 @@
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cmath>
 #include <codecvt>
 #include <iostream>
 #include <locale>
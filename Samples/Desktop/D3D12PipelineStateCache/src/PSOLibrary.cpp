@@ -25,6 +25,7 @@ PSOLibrary::PSOLibrary(UINT frameCount, UINT cbvRootSignatureIndex) :
     m_drawIndex(0),
     m_compiledPSOFlags{},
     m_inflightPSOFlags{},
+    m_pipelineCacheKeys{},
     m_workerThreads{}
 {
     WCHAR path[512];
@@ -44,7 +45,7 @@ PSOLibrary::~PSOLibrary()
     }
 
     // The Pipeline Library is saved to disk on exit.
-    m_pipelineLibrary.Destroy(false);
+    m_pipelineCache.Destroy(false);
 }
 
 void PSOLibrary::WaitForThreads()
@@ -63,7 +64,7 @@ void PSOLibrary::WaitForThreads()
 void PSOLibrary::Build(ID3D12Device* pDevice, ID3D12RootSignature* pRootSignature)
 {
     // Initialize all cache file mappings (file may be empty).
-    m_pipelineLibrariesSupported = m_pipelineLibrary.Init(pDevice, m_cachePath + g_cPipelineLibraryFileName);
+    m_pipelineLibrariesSupported = m_pipelineCache.Init(pDevice, m_cachePath + g_cPipelineLibraryFileName, g_cPipelineCacheSettings);
     for (UINT i = 0; i < EffectPipelineTypeCount; i++)
     {
         m_diskCaches[i].Init(m_cachePath + g_cCacheFileNames[i]);
@@ -76,6 +77,12 @@ void PSOLibrary::Build(ID3D12Device* pDevice, ID3D12RootSignature* pRootSignatur
         m_psoCachingMechanism = PSOCachingMechanism::CachedBlobs;
     }
 
+    // Register every PSO the sample may use with the Pipeline Library cache.
+    for (UINT i = 0; i < EffectPipelineTypeCount; i++)
+    {
+        m_pipelineCacheKeys[i] = m_pipelineCache.Register(GetPipelineDesc(pRootSignature, EffectPipelineType(i)));
+    }
+
     // Always compile the 3D shader and the Ubershader.
     for (UINT i = 0; i < BaseEffectCount; i++)
     {
@@ -86,6 +93,12 @@ void PSOLibrary::Build(ID3D12Device* pDevice, ID3D12RootSignature* pRootSignatur
         CompilePSO(&m_workerThreads[i]);
     }
 
+    // Load the effects used most in previous runs in the background, so they're likely ready by first use.
+    if (m_useDiskLibraries && m_psoCachingMechanism == PSOCachingMechanism::PipelineLibraries)
+    {
+        m_pipelineCache.Precompile(PrecompileEffectCount);
+    }
+
     m_dynamicCB.Init(pDevice);
 }
 
@@ -176,22 +189,8 @@ void PSOLibrary::SetPipelineState(
     m_drawIndex++;
 }
 
-void PSOLibrary::CompilePSO(CompilePSOThreadData* pDataPackage)
+D3D12_GRAPHICS_PIPELINE_STATE_DESC PSOLibrary::GetPipelineDesc(ID3D12RootSignature* pRootSignature, EffectPipelineType type)
 {
-    PSOLibrary* pLibrary = pDataPackage->pLibrary;
-    ID3D12Device* pDevice = pDataPackage->pDevice;
-    ID3D12RootSignature* pRootSignature = pDataPackage->pRootSignature;
-    EffectPipelineType type = pDataPackage->type;
-    bool useCache = false;
-    bool sleepToEmulateComplexCreatePSO = false;
-
-    {
-        auto lock = Mutex::Lock(pLibrary->m_flagsMutex);
-
-        // When using the disk cache compilation should be extremely quick so don't sleep.
-        useCache = pLibrary->m_useDiskLibraries;
-    }
-
     D3D12_GRAPHICS_PIPELINE_STATE_DESC baseDesc = {};
     baseDesc.pRootSignature = pRootSignature;
     baseDesc.SampleMask = UINT_MAX;
@@ -211,38 +210,35 @@ void PSOLibrary::CompilePSO(CompilePSOThreadData* pDataPackage)
     baseDesc.HS = g_cEffectShaderData[type].HS;
     baseDesc.GS = g_cEffectShaderData[type].GS;
 
-    if (useCache && 
-        (pLibrary->m_psoCachingMechanism == PSOCachingMechanism::PipelineLibraries))
+    return baseDesc;
+}
+
+void PSOLibrary::CompilePSO(CompilePSOThreadData* pDataPackage)
+{
+    PSOLibrary* pLibrary = pDataPackage->pLibrary;
+    ID3D12Device* pDevice = pDataPackage->pDevice;
+    ID3D12RootSignature* pRootSignature = pDataPackage->pRootSignature;
+    EffectPipelineType type = pDataPackage->type;
+    bool useCache = false;
+    bool sleepToEmulateComplexCreatePSO = false;
+
     {
-        assert(pLibrary->m_pipelineLibrary.IsMapped());
-        ID3D12PipelineLibrary* pPipelineLibrary = pLibrary->m_pipelineLibrary.GetPipelineLibrary();
+        auto lock = Mutex::Lock(pLibrary->m_flagsMutex);
 
-        // Note: Load*Pipeline() will auto-name PSOs for you based on the provided name. However, this sample overrides those names.
-        HRESULT hr = pPipelineLibrary->LoadGraphicsPipeline(g_cEffectNames[type], &baseDesc, IID_PPV_ARGS(&pLibrary->m_pipelineStates[type]));
-        if (E_INVALIDARG == hr)
-        {
-            // A PSO with the specified name doesnt exist, or the input desc doesnt match the data in the library.
-            // Create the PSO and then store it in the library for next time.
-            ThrowIfFailed(pDevice->CreateGraphicsPipelineState(&baseDesc, IID_PPV_ARGS(&pLibrary->m_pipelineStates[type])));
+        // When using the disk cache compilation should be extremely quick so don't sleep.
+        useCache = pLibrary->m_useDiskLibraries;
+    }
 
-            // Note: You don't need to pass StorePipeline() a name if the object is already named. If the name parameter is null, it will use the object's name.
-            hr = pPipelineLibrary->StorePipeline(g_cEffectNames[type], pLibrary->m_pipelineStates[type].Get());
-            if (E_INVALIDARG == hr)
-            {
-                // A PSO with the specified name already exists in the library.
-                // This shouldn't happen in this sample, but depending on how you name the PSOs collisions are possible.
-            }
-            else
-            {
-                ThrowIfFailed(hr);
-            }
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC baseDesc = GetPipelineDesc(pRootSignature, type);
 
-            sleepToEmulateComplexCreatePSO = true;
-        }
-        else
-        {
-            ThrowIfFailed(hr);
-        }
+    if (useCache && 
+        (pLibrary->m_psoCachingMechanism == PSOCachingMechanism::PipelineLibraries))
+    {
+        // The PSO may already have been precompiled, or be loading on another thread.
+        PipelineCacheManager::Source source;
+        pLibrary->m_pipelineStates[type] = pLibrary->m_pipelineCache.GetPipeline(pLibrary->m_pipelineCacheKeys[type], &source);
+
+        sleepToEmulateComplexCreatePSO = (source == PipelineCacheManager::Source::Created);
     }
     else if (useCache && 
         (pLibrary->m_psoCachingMechanism == PSOCachingMechanism::CachedBlobs))
@@ -336,7 +332,7 @@ void PSOLibrary::ClearPSOCache()
         m_diskCaches[i].Destroy(true);
     }
 
-    m_pipelineLibrary.Destroy(true);
+    m_pipelineCache.Destroy(true);
 }
 
 void PSOLibrary::ToggleUberShader()
@@ -386,4 +382,7 @@ void PSOLibrary::DestroyShader(EffectPipelineType type)
         m_compiledPSOFlags[type] = false;
         m_inflightPSOFlags[type] = false;
     }
+
+    // Load it from the library again next time, rather than reusing the cache's reference.
+    m_pipelineCache.ReleasePipeline(m_pipelineCacheKeys[type]);
 }
@@ -13,7 +13,7 @@
 #include "DXSample.h"
 #include "DynamicConstantBuffer.h"
 #include "MemoryMappedPSOCache.h"
-#include "MemoryMappedPipelineLibrary.h"
+#include "PipelineCacheManager.h"
 #include "SimpleVertexShader.hlsl.h"
 #include "SimplePixelShader.hlsl.h"
 #include "QuadVertexShader.hlsl.h"
@@ -48,7 +48,7 @@ enum EffectPipelineType : UINT
     BaseNormal3DRender,
     BaseUberShader,
 
-    // These are compiled a la carte.
+    // These are compiled a la carte, unless they were used enough in previous runs to be precompiled.
     PostBlit,
     PostInvert,
     PostGrayScale,
@@ -180,6 +180,13 @@ static const GraphicsShaderSet g_cEffectShaderData[EffectPipelineTypeCount] =
 
 static const LPWCH g_cPipelineLibraryFileName = L"pipelineLibrary.cache";
 
+static const PipelineCacheManager::Settings g_cPipelineCacheSettings =
+{
+    1,                  // contentVersion
+    64 * 1024 * 1024,   // diskBudget
+    8,                  // maxIdleSessions
+};
+
 static const LPWCH g_cCacheFileNames[EffectPipelineTypeCount] =
 {
     L"normal3dPSO.cache",
@@ -239,6 +246,9 @@ public:
 private:
     static const UINT BaseEffectCount = 2;
 
+    // The most used effects from previous runs to precompile at startup, when using Pipeline Libraries.
+    static const UINT PrecompileEffectCount = 4;
+
     struct CompilePSOThreadData
     {
         PSOLibrary* pLibrary;
@@ -255,6 +265,7 @@ private:
         UINT32 effectIndex;
     };
 
+    static D3D12_GRAPHICS_PIPELINE_STATE_DESC GetPipelineDesc(ID3D12RootSignature* pRootSignature, EffectPipelineType type);
     static void CompilePSO(CompilePSOThreadData* pDataPackage);
     void WaitForThreads();
 
@@ -262,7 +273,8 @@ private:
     bool m_compiledPSOFlags[EffectPipelineTypeCount];
     bool m_inflightPSOFlags[EffectPipelineTypeCount];
     MemoryMappedPSOCache m_diskCaches[EffectPipelineTypeCount];    // Cached blobs.
-    MemoryMappedPipelineLibrary m_pipelineLibrary; // Pipeline Library.
+    PipelineCacheManager m_pipelineCache;    // Pipeline Library.
+    UINT64 m_pipelineCacheKeys[EffectPipelineTypeCount];
     HANDLE m_flagsMutex;
     CompilePSOThreadData m_workerThreads[EffectPipelineTypeCount];
 
@@ -0,0 +1,635 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "stdafx.h"
+#include "PipelineCacheManager.h"
+#include "DXSampleHelper.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    // FNV-1a. Only needs to tell PSOs apart, so it isn't cryptographic.
+    UINT64 HashBytes(const void* pData, size_t size, UINT64 hash = 0xCBF29CE484222325ull)
+    {
+        auto bytes = static_cast<const BYTE*>(pData);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    template <typename T>
+    UINT64 HashValue(const T& value, UINT64 hash)
+    {
+        return HashBytes(&value, sizeof(value), hash);
+    }
+
+    // Copies the state which determines a PSO into a zeroed desc, member by member. Copying whole structs doesn't
+    // necessarily copy their padding, which would make the hash differ from one run to the next. Pointers are left
+    // null, as their content is hashed separately.
+    void GetPipelineContent(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, D3D12_GRAPHICS_PIPELINE_STATE_DESC& content)
+    {
+        memset(&content, 0, sizeof(content));
+
+        content.VS.BytecodeLength = desc.VS.BytecodeLength;
+        content.PS.BytecodeLength = desc.PS.BytecodeLength;
+        content.DS.BytecodeLength = desc.DS.BytecodeLength;
+        content.HS.BytecodeLength = desc.HS.BytecodeLength;
+        content.GS.BytecodeLength = desc.GS.BytecodeLength;
+
+        content.StreamOutput.NumEntries = desc.StreamOutput.NumEntries;
+        content.StreamOutput.NumStrides = desc.StreamOutput.NumStrides;
+        content.StreamOutput.RasterizedStream = desc.StreamOutput.RasterizedStream;
+
+        content.BlendState.AlphaToCoverageEnable = desc.BlendState.AlphaToCoverageEnable;
+        content.BlendState.IndependentBlendEnable = desc.BlendState.IndependentBlendEnable;
+        for (UINT i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; i++)
+        {
+            const D3D12_RENDER_TARGET_BLEND_DESC& src = desc.BlendState.RenderTarget[i];
+            D3D12_RENDER_TARGET_BLEND_DESC& dst = content.BlendState.RenderTarget[i];
+            dst.BlendEnable = src.BlendEnable;
+            dst.LogicOpEnable = src.LogicOpEnable;
+            dst.SrcBlend = src.SrcBlend;
+            dst.DestBlend = src.DestBlend;
+            dst.BlendOp = src.BlendOp;
+            dst.SrcBlendAlpha = src.SrcBlendAlpha;
+            dst.DestBlendAlpha = src.DestBlendAlpha;
+            dst.BlendOpAlpha = src.BlendOpAlpha;
+            dst.LogicOp = src.LogicOp;
+            dst.RenderTargetWriteMask = src.RenderTargetWriteMask;
+        }
+
+        content.SampleMask = desc.SampleMask;
+        content.RasterizerState = desc.RasterizerState;
+
+        content.DepthStencilState.DepthEnable = desc.DepthStencilState.DepthEnable;
+        content.DepthStencilState.DepthWriteMask = desc.DepthStencilState.DepthWriteMask;
+        content.DepthStencilState.DepthFunc = desc.DepthStencilState.DepthFunc;
+        content.DepthStencilState.StencilEnable = desc.DepthStencilState.StencilEnable;
+        content.DepthStencilState.StencilReadMask = desc.DepthStencilState.StencilReadMask;
+        content.DepthStencilState.StencilWriteMask = desc.DepthStencilState.StencilWriteMask;
+        content.DepthStencilState.FrontFace = desc.DepthStencilState.FrontFace;
+        content.DepthStencilState.BackFace = desc.DepthStencilState.BackFace;
+
+        content.InputLayout.NumElements = desc.InputLayout.NumElements;
+        content.IBStripCutValue = desc.IBStripCutValue;
+        content.PrimitiveTopologyType = desc.PrimitiveTopologyType;
+        content.NumRenderTargets = desc.NumRenderTargets;
+        for (UINT i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; i++)
+        {
+            content.RTVFormats[i] = desc.RTVFormats[i];
+        }
+        content.DSVFormat = desc.DSVFormat;
+        content.SampleDesc = desc.SampleDesc;
+        content.NodeMask = desc.NodeMask;
+        content.Flags = desc.Flags;
+    }
+}
+
+PipelineCacheManager::PipelineCacheManager() :
+    m_settings{},
+    m_session(0),
+    m_modified(false)
+{
+}
+
+PipelineCacheManager::~PipelineCacheManager()
+{
+    WaitForPrecompile();
+}
+
+bool PipelineCacheManager::Init(ID3D12Device* pDevice, const std::wstring& filename, const Settings& settings)
+{
+    m_device = pDevice;
+    m_filename = filename;
+    m_settings = settings;
+    m_session = 1;
+    m_modified = false;
+    m_entries.clear();
+
+    // Pipeline Libraries require the ID3D12Device1 interface and a WDDM 2.1 driver. Without them PSOs are only
+    // cached in memory.
+    ComPtr<ID3D12Device1> device1;
+    if (SUCCEEDED(pDevice->QueryInterface(IID_PPV_ARGS(&device1))))
+    {
+        LoadFile();
+
+        // The library isn't copied, so m_libraryData must outlive it.
+        HRESULT hr = device1->CreatePipelineLibrary(m_libraryData.data(), m_libraryData.size(), IID_PPV_ARGS(&m_pipelineLibrary));
+        switch (hr)
+        {
+        case DXGI_ERROR_UNSUPPORTED: // The driver doesn't support Pipeline Libraries.
+            m_entries.clear();
+            break;
+
+        case E_INVALIDARG: // The library is corrupted or unrecognized.
+        case D3D12_ERROR_ADAPTER_NOT_FOUND: // The library was created on different hardware.
+        case D3D12_ERROR_DRIVER_VERSION_MISMATCH: // The library was created by an old driver or runtime.
+            m_libraryData.clear();
+            m_entries.clear();
+            m_modified = true;
+            ThrowIfFailed(device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&m_pipelineLibrary)));
+            break;
+
+        default:
+            ThrowIfFailed(hr);
+        }
+
+        if (m_pipelineLibrary)
+        {
+            NAME_D3D12_OBJECT(m_pipelineLibrary);
+        }
+    }
+
+    return m_pipelineLibrary != nullptr;
+}
+
+void PipelineCacheManager::Destroy(bool deleteFile)
+{
+    WaitForPrecompile();
+
+    if (deleteFile)
+    {
+        DeleteFile(m_filename.c_str());
+    }
+    else if (m_pipelineLibrary)
+    {
+        Save();
+    }
+
+    m_entries.clear();
+    m_pipelineLibrary = nullptr;
+    m_libraryData.clear();
+    m_device = nullptr;
+}
+
+// Reads the index and the library data, keeping only the index if it was written by this build of the app.
+void PipelineCacheManager::LoadFile()
+{
+    m_libraryData.clear();
+
+    std::ifstream file(m_filename, std::ios::binary);
+    if (!file)
+    {
+        return;
+    }
+
+    FileHeader header = {};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.magic != FileMagic ||
+        header.formatVersion != FileFormatVersion ||
+        header.contentVersion != m_settings.contentVersion)
+    {
+        // Written by an older build; start over.
+        m_modified = true;
+        return;
+    }
+
+    std::vector<EntryRecord> records(header.entryCount);
+    m_libraryData.resize(static_cast<size_t>(header.librarySize));
+
+    if (!file.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(EntryRecord)) ||
+        !file.read(reinterpret_cast<char*>(m_libraryData.data()), m_libraryData.size()))
+    {
+        m_libraryData.clear();
+        m_modified = true;
+        return;
+    }
+
+    m_session = header.session + 1;
+
+    for (auto& record : records)
+    {
+        Entry& entry = m_entries[record.key];
+        entry.record = record;
+        entry.registered = false;
+        entry.inLibrary = true;
+        entry.stale = false;
+        entry.desc = {};
+    }
+}
+
+UINT64 PipelineCacheManager::Register(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+    UINT64 shaderHash;
+    UINT64 key = HashDesc(desc, shaderHash);
+
+    std::lock_guard<std::mutex> lock(m_entriesMutex);
+
+    auto result = m_entries.emplace(key, Entry());
+    Entry& entry = result.first->second;
+    if (result.second)
+    {
+        entry.record = {};
+        entry.record.key = key;
+        entry.inLibrary = false;
+        entry.stale = false;
+    }
+
+    entry.record.shaderHash = shaderHash;
+    entry.registered = true;
+    entry.desc = desc;
+
+    return key;
+}
+
+ComPtr<ID3D12PipelineState> PipelineCacheManager::GetPipeline(UINT64 key, Source* pSource)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_entriesMutex);
+
+        auto iter = m_entries.find(key);
+        assert(iter != m_entries.end() && iter->second.registered);
+        Entry& entry = iter->second;
+
+        // Usage is counted once per session, and only for the app's requests, so precompiled PSOs which the app
+        // never asks for still age out.
+        if (entry.record.lastSession != m_session)
+        {
+            entry.record.lastSession = m_session;
+            entry.record.sessionsUsed++;
+            m_modified = true;
+        }
+    }
+
+    Source source;
+    ComPtr<ID3D12PipelineState> pipelineState = AcquirePipeline(key, source);
+
+    if (pSource)
+    {
+        *pSource = source;
+    }
+
+    return pipelineState;
+}
+
+// Returns the PSO for a registered key without touching its usage record.
+ComPtr<ID3D12PipelineState> PipelineCacheManager::AcquirePipeline(UINT64 key, Source& source)
+{
+    std::promise<ComPtr<ID3D12PipelineState>> promise;
+    std::shared_future<ComPtr<ID3D12PipelineState>> pipeline;
+    Entry* pEntry = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_entriesMutex);
+
+        auto iter = m_entries.find(key);
+        assert(iter != m_entries.end() && iter->second.registered);
+        Entry& entry = iter->second;
+
+        // Reserve the entry so other requests wait for this one.
+        if (!entry.pipeline.valid())
+        {
+            entry.pipeline = promise.get_future().share();
+            pEntry = &entry;
+        }
+
+        pipeline = entry.pipeline;
+    }
+
+    source = Source::Memory;
+    if (pEntry)
+    {
+        try
+        {
+            promise.set_value(LoadOrCreate(*pEntry, source));
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+        }
+    }
+
+    return pipeline.get();
+}
+
+// Only the thread which reserved the entry gets here, so the library never loads the same PSO concurrently.
+ComPtr<ID3D12PipelineState> PipelineCacheManager::LoadOrCreate(Entry& entry, Source& source)
+{
+    ComPtr<ID3D12PipelineState> pipelineState;
+
+    WCHAR name[32];
+    GetName(entry.record.key, name);
+
+    if (m_pipelineLibrary)
+    {
+        HRESULT hr = m_pipelineLibrary->LoadGraphicsPipeline(name, &entry.desc, IID_PPV_ARGS(&pipelineState));
+        if (SUCCEEDED(hr))
+        {
+            source = Source::Library;
+            return pipelineState;
+        }
+        else if (E_INVALIDARG != hr)
+        {
+            ThrowIfFailed(hr);
+        }
+    }
+
+    ThrowIfFailed(m_device->CreateGraphicsPipelineState(&entry.desc, IID_PPV_ARGS(&pipelineState)));
+    source = Source::Created;
+
+    // Record how much space the PSO takes, to keep the library within its budget.
+    ComPtr<ID3DBlob> blob;
+    if (SUCCEEDED(pipelineState->GetCachedBlob(&blob)))
+    {
+        entry.record.size = static_cast<UINT32>(blob->GetBufferSize());
+    }
+
+    if (m_pipelineLibrary)
+    {
+        HRESULT hr = m_pipelineLibrary->StorePipeline(name, pipelineState.Get());
+        if (E_INVALIDARG == hr)
+        {
+            // The library has a PSO of this name that doesn't match its desc any more, e.g. the root signature
+            // changed. It can't be replaced, so the library is rebuilt when it's saved.
+            std::lock_guard<std::mutex> lock(m_entriesMutex);
+            entry.stale = true;
+            m_modified = true;
+        }
+        else
+        {
+            ThrowIfFailed(hr);
+
+            std::lock_guard<std::mutex> lock(m_entriesMutex);
+            entry.inLibrary = true;
+            m_modified = true;
+        }
+    }
+
+    return pipelineState;
+}
+
+void PipelineCacheManager::ReleasePipeline(UINT64 key)
+{
+    std::lock_guard<std::mutex> lock(m_entriesMutex);
+
+    auto iter = m_entries.find(key);
+    if (iter != m_entries.end())
+    {
+        iter->second.pipeline = {};
+    }
+}
+
+// Entries used in many sessions score highly, decaying with the number of sessions since they were last used.
+double PipelineCacheManager::Score(const Entry& entry) const
+{
+    return entry.record.sessionsUsed / (1.0 + static_cast<double>(m_session - entry.record.lastSession));
+}
+
+void PipelineCacheManager::Precompile(UINT count)
+{
+    WaitForPrecompile();
+
+    auto keys = std::make_shared<std::vector<UINT64>>();
+    {
+        std::lock_guard<std::mutex> lock(m_entriesMutex);
+
+        std::vector<const Entry*> candidates;
+        for (auto& pair : m_entries)
+        {
+            if (pair.second.registered && !pair.second.pipeline.valid() && pair.second.record.sessionsUsed > 0)
+            {
+                candidates.push_back(&pair.second);
+            }
+        }
+
+        count = std::min(count, static_cast<UINT>(candidates.size()));
+        std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+            [this](const Entry* a, const Entry* b) { return Score(*a) > Score(*b); });
+
+        for (UINT i = 0; i < count; i++)
+        {
+            keys->push_back(candidates[i]->record.key);
+        }
+    }
+
+    // Leave a core for the render thread.
+    UINT threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    threadCount = std::min(threadCount, static_cast<UINT>(keys->size()));
+
+    auto nextKey = std::make_shared<std::atomic<size_t>>(0);
+    for (UINT i = 0; i < threadCount; i++)
+    {
+        m_precompileThreads.emplace_back([this, keys, nextKey]()
+        {
+            for (size_t k = (*nextKey)++; k < keys->size(); k = (*nextKey)++)
+            {
+                try
+                {
+                    Source source;
+                    AcquirePipeline((*keys)[k], source);
+                }
+                catch (...)
+                {
+                    // The failure is rethrown to whoever requests this PSO.
+                }
+            }
+        });
+    }
+}
+
+void PipelineCacheManager::WaitForPrecompile()
+{
+    for (auto& thread : m_precompileThreads)
+    {
+        thread.join();
+    }
+    m_precompileThreads.clear();
+}
+
+void PipelineCacheManager::Save()
+{
+    bool compact = false;
+    UINT64 librarySize = 0;
+
+    for (auto& pair : m_entries)
+    {
+        const Entry& entry = pair.second;
+        if (entry.stale || (entry.inLibrary && m_session - entry.record.lastSession > m_settings.maxIdleSessions))
+        {
+            compact = true;
+        }
+
+        librarySize += entry.inLibrary ? entry.record.size : 0;
+    }
+
+    if (!m_modified && !compact && librarySize <= m_settings.diskBudget)
+    {
+        return;
+    }
+
+    if (compact || librarySize > m_settings.diskBudget)
+    {
+        Compact();
+    }
+
+    // Serialize the library to memory first, because m_libraryData backs the current library.
+    std::vector<BYTE> libraryData(m_pipelineLibrary->GetSerializedSize());
+    ThrowIfFailed(m_pipelineLibrary->Serialize(libraryData.data(), libraryData.size()));
+
+    std::vector<EntryRecord> records;
+    for (auto& pair : m_entries)
+    {
+        if (pair.second.inLibrary && !pair.second.stale)
+        {
+            records.push_back(pair.second.record);
+        }
+    }
+
+    FileHeader header = {};
+    header.magic = FileMagic;
+    header.formatVersion = FileFormatVersion;
+    header.contentVersion = m_settings.contentVersion;
+    header.entryCount = static_cast<UINT32>(records.size());
+    header.session = m_session;
+    header.librarySize = libraryData.size();
+
+    // Write a new file and swap it in, so an interrupted save doesn't leave a truncated cache behind.
+    std::wstring tempFilename = m_filename + L".tmp";
+    {
+        std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(EntryRecord));
+        file.write(reinterpret_cast<const char*>(libraryData.data()), libraryData.size());
+
+        if (!file)
+        {
+            OutputDebugString((L"Failed to write the pipeline cache " + tempFilename + L"\n").c_str());
+            return;
+        }
+    }
+
+    if (!MoveFileEx(tempFilename.c_str(), m_filename.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFile(tempFilename.c_str());
+    }
+}
+
+// Pipeline Libraries can't remove PSOs, so the entries kept are copied into a new library. An entry can only be
+// carried over if it's registered or was loaded this session, since loading it needs its desc.
+void PipelineCacheManager::Compact()
+{
+    ComPtr<ID3D12Device1> device1;
+    ThrowIfFailed(m_device.As(&device1));
+
+    std::vector<Entry*> candidates;
+    for (auto& pair : m_entries)
+    {
+        Entry& entry = pair.second;
+        bool loadable = entry.pipeline.valid() || (entry.registered && entry.inLibrary && !entry.stale);
+        bool idle = m_session - entry.record.lastSession > m_settings.maxIdleSessions;
+
+        if (loadable && !idle)
+        {
+            candidates.push_back(&entry);
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(),
+        [this](const Entry* a, const Entry* b) { return Score(*a) > Score(*b); });
+
+    ComPtr<ID3D12PipelineLibrary> pipelineLibrary;
+    ThrowIfFailed(device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&pipelineLibrary)));
+
+    std::vector<UINT64> keep;
+    UINT64 librarySize = 0;
+
+    for (Entry* pEntry : candidates)
+    {
+        if (librarySize + pEntry->record.size > m_settings.diskBudget)
+        {
+            continue;
+        }
+
+        WCHAR name[32];
+        GetName(pEntry->record.key, name);
+
+        ComPtr<ID3D12PipelineState> pipelineState;
+        if (pEntry->pipeline.valid())
+        {
+            try
+            {
+                pipelineState = pEntry->pipeline.get();
+            }
+            catch (...)
+            {
+                continue;
+            }
+        }
+        else if (FAILED(m_pipelineLibrary->LoadGraphicsPipeline(name, &pEntry->desc, IID_PPV_ARGS(&pipelineState))))
+        {
+            continue;
+        }
+
+        if (SUCCEEDED(pipelineLibrary->StorePipeline(name, pipelineState.Get())))
+        {
+            keep.push_back(pEntry->record.key);
+            librarySize += pEntry->record.size;
+        }
+    }
+
+    size_t evicted = 0;
+    for (auto& pair : m_entries)
+    {
+        Entry& entry = pair.second;
+        bool kept = std::find(keep.begin(), keep.end(), entry.record.key) != keep.end();
+
+        evicted += entry.inLibrary && !kept ? 1 : 0;
+        entry.inLibrary = kept;
+        entry.stale = false;
+    }
+
+    WCHAR message[128];
+    if (swprintf_s(message, L"Compacted the pipeline cache to %zu PSOs (%llu bytes), evicting %zu\n",
+        keep.size(), librarySize, evicted) > 0)
+    {
+        OutputDebugString(message);
+    }
+
+    // The old library may be released now that its PSOs have been copied.
+    m_pipelineLibrary = pipelineLibrary;
+}
+
+UINT64 PipelineCacheManager::HashDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, UINT64& shaderHash)
+{
+    // Hash the shaders' and input layout's content in place of their addresses. The root signature is validated by
+    // the library when a PSO is loaded.
+    shaderHash = 0xCBF29CE484222325ull;
+    for (auto pShader : { &desc.VS, &desc.PS, &desc.DS, &desc.HS, &desc.GS })
+    {
+        shaderHash = HashValue(pShader->BytecodeLength, shaderHash);
+        shaderHash = HashBytes(pShader->pShaderBytecode, pShader->BytecodeLength, shaderHash);
+    }
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC content;
+    GetPipelineContent(desc, content);
+
+    UINT64 hash = HashValue(content, shaderHash);
+    for (UINT i = 0; i < desc.InputLayout.NumElements; i++)
+    {
+        D3D12_INPUT_ELEMENT_DESC element = desc.InputLayout.pInputElementDescs[i];
+        hash = HashBytes(element.SemanticName, strlen(element.SemanticName), hash);
+        element.SemanticName = nullptr;
+        hash = HashValue(element, hash);
+    }
+
+    return hash;
+}
+
+void PipelineCacheManager::GetName(UINT64 key, WCHAR (&name)[32])
+{
+    swprintf_s(name, L"PSO %016llX", key);
+}
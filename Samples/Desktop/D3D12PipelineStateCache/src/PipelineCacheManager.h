@@ -0,0 +1,121 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Manages a Pipeline Library on disk, together with an index recording how often each of its PSOs is used.
+//
+// PSOs are keyed by a hash of their full description, including the content of their shaders and input layout, so
+// keys are stable from one run to the next. The app registers every PSO it may use up front; the most used ones can
+// then be precompiled on background threads. When the cache is saved, entries which are stale, haven't been used for
+// a number of sessions, or don't fit in the disk budget are dropped by rebuilding the library from the entries kept.
+class PipelineCacheManager
+{
+public:
+    enum class Source
+    {
+        Memory,     // Already loaded or created this session.
+        Library,    // Loaded from the Pipeline Library.
+        Created,    // Compiled by the driver.
+    };
+
+    struct Settings
+    {
+        UINT contentVersion;    // Bump to discard caches written by older builds of the app.
+        UINT64 diskBudget;      // The most bytes of PSOs to keep in the library.
+        UINT maxIdleSessions;   // Entries unused for more sessions than this are evicted.
+    };
+
+    PipelineCacheManager();
+    ~PipelineCacheManager();
+
+    // Returns false if Pipeline Libraries aren't supported, in which case PSOs are still created and kept in memory.
+    bool Init(ID3D12Device* pDevice, const std::wstring& filename, const Settings& settings);
+
+    // Saves the cache unless deleteFile is set, in which case the file is deleted.
+    void Destroy(bool deleteFile);
+
+    // The shader bytecode, input layout and root signature referenced by the desc must outlive the manager.
+    UINT64 Register(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+
+    // Thread safe. Requests for a PSO which is already being loaded or created wait for it.
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> GetPipeline(UINT64 key, _Out_opt_ Source* pSource = nullptr);
+
+    // Drops the manager's reference to a PSO, so the next request loads it again. It stays in the library.
+    void ReleasePipeline(UINT64 key);
+
+    // Loads or creates the registered PSOs used most in previous sessions on background threads.
+    void Precompile(UINT count);
+    void WaitForPrecompile();
+
+    bool IsLibrarySupported() const { return m_pipelineLibrary != nullptr; }
+
+private:
+    struct FileHeader
+    {
+        UINT32 magic;
+        UINT32 formatVersion;
+        UINT32 contentVersion;
+        UINT32 entryCount;
+        UINT64 session;
+        UINT64 librarySize;
+    };
+
+    struct EntryRecord
+    {
+        UINT64 key;
+        UINT64 shaderHash;
+        UINT64 lastSession;
+        UINT32 sessionsUsed;
+        UINT32 size;
+    };
+
+    struct Entry
+    {
+        EntryRecord record;
+        bool registered;
+        bool inLibrary;     // Stored in the library, under its key's name.
+        bool stale;         // In the library, but no longer matches its desc.
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC desc;
+        std::shared_future<Microsoft::WRL::ComPtr<ID3D12PipelineState>> pipeline;
+    };
+
+    static const UINT32 FileMagic = 'CPSO';
+    static const UINT32 FileFormatVersion = 1;
+
+    void LoadFile();
+    void Save();
+    void Compact();
+    double Score(const Entry& entry) const;
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> AcquirePipeline(UINT64 key, Source& source);
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> LoadOrCreate(Entry& entry, Source& source);
+
+    static UINT64 HashDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, UINT64& shaderHash);
+    static void GetName(UINT64 key, WCHAR (&name)[32]);
+
+    Microsoft::WRL::ComPtr<ID3D12Device> m_device;
+    Microsoft::WRL::ComPtr<ID3D12PipelineLibrary> m_pipelineLibrary;
+    std::vector<BYTE> m_libraryData;   // Must outlive m_pipelineLibrary; it isn't copied.
+    std::wstring m_filename;
+    Settings m_settings;
+    UINT64 m_session;
+    bool m_modified;
+
+    std::mutex m_entriesMutex;
+    std::unordered_map<UINT64, Entry> m_entries;
+    std::vector<std::thread> m_precompileThreads;
+};
@@ -408,6 +408,7 @@ void InitializeSceneInfo(
         meshInfoData[i].m_attributeStrideBytes = model.m_pMesh[i].vertexStride;
         meshInfoData[i].m_materialInstanceId = model.m_pMesh[i].materialIndex;
         ASSERT(meshInfoData[i].m_materialInstanceId < 27);
+        ASSERT(model.m_pMesh[i].indexFormat == Model::index_format_uint16); // the hit shaders load 16-bit indices
     }
 
     g_hitShaderMeshInfoBuffer.Create(L"RayTraceMeshInfo",